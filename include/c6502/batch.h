@@ -0,0 +1,67 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include "c6502/cpu.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The batch runner runs a large number of independent machines, such as fuzzing seeds or a parameter sweep over a
+// single program, across a pool of threads. Each worker thread owns a single CPU and a work-stealing deque of
+// instances. An instance is run for a slice of cycles at a time, then put back on the deque of whichever worker ran it,
+// where it is swapped out through cpu_save_state() only if another instance is run or it is stolen in the meantime.
+// Workers which run out of instances steal from the others, so long-running instances don't hold up the rest.
+
+// A single machine to be run. Each instance only consists of a flat 64 KiB address space, which is mapped read-write in
+// full, so no system interface callbacks are involved.
+typedef struct {
+    uint8_t *memory; // the instance's address space, which is written as it runs and must not be shared
+    // the registers to start from once the reset sequence has run, or NULL to start where the reset vector points
+    const CpuRegisters *regs;
+    uint64_t budget; // the number of cycles to run for, not counting the reset sequence
+    unsigned int stop_mask; // the CpuStopCondition flags to stop on, as for cpu_run_cycles() (breakpoints aside)
+    uint16_t stop_pc; // used with CPU_STOP_PC
+    Mnemonic stop_mnemonic; // used with CPU_STOP_MNEMONIC
+} BatchInstance;
+
+typedef struct {
+    CpuRegisters regs; // the registers at the end of the run
+    uint64_t cycles; // the number of cycles run, not counting the reset sequence
+    CpuStopCondition stop_reason; // the condition which ended the run, or CPU_STOP_NONE if it used its whole budget
+    bool jammed;
+} BatchResult;
+
+// the number of cycles an instance is run for before the next one gets a turn, when no slice length is given
+#define BATCH_DEFAULT_SLICE 100000
+
+// Runs count instances to completion on up to threads worker threads (one per online processor if 0), one of which is
+// the calling thread, writing the outcome of each to the result with the same index. Instances are run for
+// slice_cycles cycles at a time (BATCH_DEFAULT_SLICE if 0). The results do not depend on the number of threads or the
+// slice length. Returns false if memory could not be allocated, in which case nothing is run. Should some of the
+// threads fail to start, the instances are run on the others.
+bool batch_run(const BatchInstance *instances, BatchResult *results, size_t count, unsigned int threads,
+        uint64_t slice_cycles);
@@ -0,0 +1,80 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "c6502/cpu.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Runs a CPU together with any number of other clock domains, such as a video chip running at three times the CPU
+// clock. Each domain runs at a fixed rational number of ticks per CPU cycle, and after the CPU has completed cycle n a
+// domain has been ticked exactly floor(n * ticks / cycles) times since it was added.
+//
+// In lockstep mode the domains are ticked after every CPU cycle. In batched mode they are only ticked when something
+// could observe them: when the CPU accesses them over the bus, which the host reports with clock_sync_catch_up() from
+// its system interface callbacks, when they are due to produce output of their own, such as pulling an interrupt line,
+// and at the end of the run. As long as the host reports every such access and every domain reports when its next
+// output is due, both modes produce exactly the same results.
+
+typedef struct ClockSync ClockSync;
+
+#define CLOCK_NO_OUTPUT UINT64_MAX
+
+// Advances a domain by the given number of its own ticks. Returns the number of ticks from the new position until the
+// domain next produces output the CPU could notice without accessing it, or CLOCK_NO_OUTPUT if there is none.
+typedef uint64_t (*ClockTickFn)(void *userdata, uint64_t ticks);
+
+// Creates a clock sync for the given CPU, returning NULL if allocation failed.
+ClockSync *clock_sync_create(Cpu6502 *cpu);
+
+void clock_sync_destroy(ClockSync *sync);
+
+// Adds a domain which ticks ticks times for every cycles CPU cycles, counting from the CPU's current cycle. Domains are
+// numbered from 0 in the order they are added. The tick function is called with 0 ticks straight away to find out when
+// the domain's first output is due. Returns false if either rate is 0 or allocation failed.
+bool clock_sync_add_domain(ClockSync *sync, uint32_t ticks, uint32_t cycles, ClockTickFn tick, void *userdata);
+
+// Ticks a domain up to the CPU's current cycle. Call this from the system interface before any access which could
+// observe the domain or change its state, so that the access sees the domain exactly as it would in lockstep mode.
+// Accesses are made during the cycle counted by the next increment of the cycle counter, so they see the domain as of
+// the end of the previous cycle.
+void clock_sync_catch_up(ClockSync *sync, size_t domain);
+
+// Tells the sync when a domain will next produce output, in ticks from its current position, for when an access has
+// changed it. CLOCK_NO_OUTPUT means never.
+void clock_sync_set_next_output(ClockSync *sync, size_t domain, uint64_t ticks);
+
+// Returns the number of ticks a domain has been advanced by since it was added.
+uint64_t clock_sync_get_ticks(const ClockSync *sync, size_t domain);
+
+// Runs the CPU and the domains in lockstep for the given number of CPU cycles.
+void clock_sync_run(ClockSync *sync, uint64_t cycles);
+
+// Runs the CPU for the given number of cycles with cpu_run_cycles(), only ticking the domains in batches as described
+// above, and leaves all domains caught up at the end.
+void clock_sync_run_batched(ClockSync *sync, uint64_t cycles);
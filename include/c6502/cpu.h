@@ -28,6 +28,7 @@
 #include "c6502/instrs.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef _MSC_VER
@@ -74,25 +75,281 @@ typedef struct {
 } InterruptType;
 
 typedef struct {
-    uint8_t (*mem_read)(uint16_t);
-    void (*mem_write)(uint16_t, uint8_t);
-    uint8_t (*bus_read)(void);
-    void (*bus_write)(uint8_t);
-    unsigned int (*poll_nmi_line)(void);
-    unsigned int (*poll_irq_line)(void);
-    unsigned int (*poll_rst_line)(void);
+    uint8_t (*mem_read)(void*, uint16_t);
+    void (*mem_write)(void*, uint16_t, uint8_t);
+    uint8_t (*bus_read)(void*);
+    void (*bus_write)(void*, uint8_t);
+    // These return 0 while the respective line is pulled low. Any of them may be NULL, in which case the line only
+    // follows the levels set through cpu_set_nmi_line() and friends.
+    unsigned int (*poll_nmi_line)(void*);
+    unsigned int (*poll_irq_line)(void*);
+    unsigned int (*poll_rst_line)(void*);
+    void *userdata; // passed as the first argument to each of the above callbacks
 } CpuSystemInterface;
 
-void initialize_cpu(CpuSystemInterface system_iface);
+typedef enum {
+    CPU_STOP_NONE = 0,
+    CPU_STOP_PC = 1 << 0, // the opcode at the address set with cpu_set_stop_pc() was fetched
+    CPU_STOP_MNEMONIC = 1 << 1, // an opcode with the mnemonic set with cpu_set_stop_mnemonic() was fetched
+    CPU_STOP_KIL = 1 << 2, // the CPU was jammed by a KIL instruction
+    CPU_STOP_INTERRUPT = 1 << 3, // an NMI, IRQ or reset sequence was started
+    CPU_STOP_BREAKPOINT = 1 << 4, // an opcode at an address marked with cpu_set_breakpoint() was fetched
+    CPU_STOP_REQUESTED = 1 << 5 // cpu_request_stop() was called during the run, regardless of the stop mask
+} CpuStopCondition;
 
-CpuRegisters *cpu_get_registers(void);
+typedef enum {
+    CPU_PAGE_READ_WRITE = 0,
+    CPU_PAGE_READ_ONLY = 1 << 0, // reads are served from the mapped memory, writes still go to mem_write
+    CPU_PAGE_WRITE_IGNORE = 1 << 1, // reads are served from the mapped memory, writes are dropped
+    // For pages left to the system interface: reads have no side effects and return the same value until the next
+    // known change of the interrupt lines, so idle loops polling them may be skipped. Ignored for mapped pages, whose
+    // reads never have side effects.
+    CPU_PAGE_IDEMPOTENT = 1 << 2,
+    // Reads are served from the mapped memory, which is never written. The first write to the page gives the CPU a
+    // private copy of it, shared with the pages mirroring the same memory, and the page is read-write from then on.
+    // Writes go to mem_write if the copy cannot be allocated.
+    CPU_PAGE_COPY_ON_WRITE = 1 << 3
+} CpuPageFlags;
 
-uint8_t cpu_get_instruction_step(void);
+// A fixed-size binary record of a single completed instruction, as appended to the buffer set with
+// cpu_set_trace_buffer(). The registers are those from before the instruction executed.
+typedef struct {
+    uint64_t cycle; // the value of the cycle counter when the instruction started
+    uint16_t pc;
+    uint16_t operand; // the raw operand bytes (low byte first), of which only get_instr_len() - 1 are meaningful
+    uint16_t eff_addr; // the effective address, where the addressing mode has one
+    uint8_t opcode;
+    uint8_t bus_val; // the value on the data bus once the instruction completed
+    uint8_t acc;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t status;
+} CpuTraceRecord;
+
+typedef enum {
+    CPU_LINE_NMI = 1 << 0,
+    CPU_LINE_IRQ = 1 << 1,
+    CPU_LINE_RST = 1 << 2
+} CpuLine;
+
+// A change of the interrupt lines, as recorded with cpu_record_lines().
+typedef struct {
+    uint64_t cycle; // the value of the cycle counter when the change was first seen
+    uint8_t lines; // the CpuLine flags of the lines pulled low from this cycle on
+} CpuLineEvent;
+
+// opaque handle to the complete state of a single emulated CPU
+typedef struct Cpu6502 Cpu6502;
+
+// a queue feeding trace records to a background thread, see trace_queue.h
+typedef struct TraceQueue TraceQueue;
+
+// A basic block of a fixed program image compiled ahead of time, as emitted by the c6502_recomp tool. run executes all
+// instr_count instructions of the block and returns the number of cycles they took.
+typedef struct {
+    uint16_t pc;
+    uint16_t instr_count;
+    uint8_t last_opcode;
+    uint16_t last_operand;
+    unsigned int (*run)(Cpu6502 *cpu);
+} CpuStaticBlock;
+
+// returns the compiled block starting at the given address, or NULL if there is none
+typedef const CpuStaticBlock *(*CpuStaticLookup)(uint16_t pc);
+
+Cpu6502 *cpu_create(CpuSystemInterface system_iface);
+
+void cpu_destroy(Cpu6502 *cpu);
+
+void initialize_cpu(Cpu6502 *cpu, CpuSystemInterface system_iface);
+
+// Maps len bytes of host memory at the given CPU address so that accesses to it bypass mem_read/mem_write (subject to
+// flags, a combination of CpuPageFlags). Both addr and len must be multiples of the 256-byte page size. Passing NULL for
+// mem routes the range back to the system interface, where CPU_PAGE_IDEMPOTENT is the only flag which applies.
+bool cpu_map_memory(Cpu6502 *cpu, uint16_t addr, size_t len, uint8_t *mem, unsigned int flags);
+
+bool cpu_unmap_memory(Cpu6502 *cpu, uint16_t addr, size_t len);
+
+// Creates a copy of the CPU which carries on from exactly the same state against the given system interface, e.g. to
+// explore several futures from a common point. Mapped memory is shared copy-on-write rather than copied: a clone only
+// allocates the pages it writes, and cloning only copies the read-write host memory written since the CPU was last
+// cloned, as the clone sees that memory as it was at the time of cloning in memory of its own. The host reaches a
+// clone's copy with cpu_read_memory() and cpu_write_memory(), and if it modifies its own mapped memory directly it must
+// call cpu_invalidate_code() for the range so that the next clone picks up the change.
+//
+// Configuration such as breakpoints, stop conditions, pending line changes and line replay is carried over. Logging,
+// tracing and line recording are not, and the block cache and native code start out empty if enabled. A clone may run
+// on a different thread from the CPU it was cloned from. Returns NULL if allocation failed.
+Cpu6502 *cpu_clone(Cpu6502 *cpu, CpuSystemInterface system_iface);
+
+// Enables or disables caching of pre-decoded basic blocks for cpu_step_instruction(). Only code in memory mapped with
+// cpu_map_memory() is cached. Writes made by the CPU invalidate affected blocks automatically, but if the host modifies
+// mapped memory directly it must call cpu_invalidate_code() for the range. Returns false if the cache could not be
+// allocated.
+bool cpu_set_block_cache(Cpu6502 *cpu, bool enabled);
+
+// Discards any cached code overlapping the given address range. The pages are also counted as written for
+// cpu_dirty_pages_since().
+void cpu_invalidate_code(Cpu6502 *cpu, uint16_t addr, size_t len);
+
+// Returns a mark from which cpu_dirty_pages_since() reports the pages written. Marks only ever increase, so any number
+// of them can be in use at once.
+uint64_t cpu_mark_dirty_pages(Cpu6502 *cpu);
+
+// Stores the numbers of the 256-byte pages written since the given mark was taken into pages, which must have room for
+// 256 entries, in ascending order and returns how many there are. A page counts as written when the CPU writes to it,
+// along with the pages mirroring the same memory if it is mapped, and when it is remapped with cpu_map_memory() or
+// passed to cpu_invalidate_code(). Writes which go to mem_write count as well, whatever the system does with them;
+// writes dropped by CPU_PAGE_WRITE_IGNORE do not. A mark of 0 reports every page.
+size_t cpu_dirty_pages_since(const Cpu6502 *cpu, uint64_t mark, uint8_t *pages);
+
+CpuRegisters *cpu_get_registers(Cpu6502 *cpu);
+
+uint8_t cpu_get_instruction_step(const Cpu6502 *cpu);
+
+const Instruction *cpu_get_current_instruction(const Cpu6502 *cpu);
+
+// Sets a callback which is passed each instruction as text, along with the registers from before it ran, once the next
+// instruction starts. As with the system interface, its first argument is the interface's userdata.
+void cpu_set_log_callback(Cpu6502 *cpu, void (*callback)(void*, char*, CpuRegisters));
+
+// Starts appending a CpuTraceRecord for each instruction to the given ring buffer, which holds capacity records and is
+// overwritten from the start once full. As with the log callback, an instruction's record is written when the next
+// one starts, and neither translated nor compiled code is run while tracing. Passing NULL stops tracing.
+void cpu_set_trace_buffer(Cpu6502 *cpu, CpuTraceRecord *buffer, size_t capacity);
+
+// Returns the number of records written since the trace buffer was set. The most recent one is at index
+// (count - 1) % capacity.
+uint64_t cpu_get_trace_count(const Cpu6502 *cpu);
+
+// Starts pushing a CpuTraceRecord for each instruction onto the given queue, in addition to the trace buffer if one is
+// set. The same restrictions as for the trace buffer apply. Passing NULL detaches the queue again.
+void cpu_set_trace_queue(Cpu6502 *cpu, TraceQueue *queue);
+
+// Sets the level of an interrupt line, where 0 pulls it low, as an alternative to polling it through the system
+// interface. The CPU samples the line at the end of each cycle, exactly as it would poll it, so the usual one-cycle delay
+// before it reacts applies. If the line also has a poll callback, it is pulled low whenever either pulls it low, as on a
+// shared open-collector line. The levels are not part of saved states and survive initialize_cpu().
+void cpu_set_nmi_line(Cpu6502 *cpu, unsigned int level);
+
+void cpu_set_irq_line(Cpu6502 *cpu, unsigned int level);
+
+void cpu_set_rst_line(Cpu6502 *cpu, unsigned int level);
+
+// Sets the level of the given CpuLine once the cycle counter reaches at_cycle, which lets the host push all changes it
+// knows of ahead of time instead of stopping the CPU at each of them. Changes scheduled for the same cycle take effect
+// in the order they were made. Changes still pending are dropped by initialize_cpu(), and ones which have already taken
+// effect are not undone when the CPU is sent back with cpu_load_state(). Returns false if the change could not be
+// stored.
+bool cpu_schedule_line_change(Cpu6502 *cpu, CpuLine line, unsigned int level, uint64_t at_cycle);
+
+// Starts recording the interrupt lines into the given buffer, which has room for capacity events. An event is only
+// appended when the set of lines pulled low changes, plus once for the state found when recording starts, so a long run
+// usually takes very few events. Passing NULL stops recording.
+void cpu_record_lines(Cpu6502 *cpu, CpuLineEvent *events, size_t capacity);
+
+// Returns the number of events seen since recording started. If this exceeds the capacity, the events past it were
+// lost.
+size_t cpu_get_line_event_count(const Cpu6502 *cpu);
+
+// Takes the interrupt lines from the given recording instead of polling the system interface, which is then no longer
+// consulted for them at all. Before the first event, no line is pulled low. The replay follows the cycle counter, so it
+// stays correct after the CPU is sent back with cpu_load_state(), and it reproduces the recorded run exactly when the
+// same way of running the CPU is used, as the lines are sampled at different points by cycle_cpu() and
+// cpu_step_instruction(). Passing NULL goes back to polling.
+void cpu_replay_lines(Cpu6502 *cpu, const CpuLineEvent *events, size_t count);
+
+#define CPU_TRACE_LINE_MAX 96
+
+// Formats a trace record as a nestest-style line, which needs at most CPU_TRACE_LINE_MAX bytes including the
+// terminator.
+char *cpu_format_trace_record(const CpuTraceRecord *record, char *target);
+
+// Returns the number of cycles run since the CPU was last initialized, including those of the reset sequence.
+uint64_t cpu_get_cycle_count(const Cpu6502 *cpu);
+
+#define CPU_STATE_SIZE 52
+
+// Writes the complete execution state of the CPU, including the data bus latch and any instruction or interrupt
+// sequence in progress, to buf, which must have room for CPU_STATE_SIZE bytes. The format is fixed-layout and
+// versioned, so states can be kept across runs. Configuration such as memory mappings, breakpoints and tracing is not
+// included, and neither is the contents of memory.
+void cpu_save_state(Cpu6502 *cpu, uint8_t *buf);
+
+// Restores a state written by cpu_save_state(), returning false if it is not a valid state. As the state does not
+// include memory, the host has to restore that itself, calling cpu_invalidate_code() for any mapped memory it changes.
+bool cpu_load_state(Cpu6502 *cpu, const uint8_t *buf, size_t len);
+
+bool cpu_is_jammed(const Cpu6502 *cpu);
+
+void cpu_set_stop_pc(Cpu6502 *cpu, uint16_t pc);
+
+void cpu_set_stop_mnemonic(Cpu6502 *cpu, Mnemonic mnemonic);
+
+bool cpu_set_breakpoint(Cpu6502 *cpu, uint16_t addr, bool enabled);
+
+void cpu_clear_breakpoints(Cpu6502 *cpu);
+
+// Ends the cpu_run_cycles() call in progress once the current cycle completes, which lets system interface callbacks
+// hand control back to the host early. Has no effect outside of a run.
+void cpu_request_stop(Cpu6502 *cpu);
+
+// Enables skipping ahead over idle loops in cpu_run_cycles() and cpu_run_until_cycle(). An idle loop is a short run of
+// instructions closed by a branch or jump back to its start, which neither writes memory nor reads anything but mapped
+// pages and pages marked CPU_PAGE_IDEMPOTENT. Once an iteration of such a loop has left the CPU exactly as it found it,
+// the cycle counter is advanced by as many whole iterations as fit before the end of the run or the next change of the
+// interrupt lines, whichever comes first. Such changes are only known in advance when the lines are pushed and
+// scheduled with cpu_set_nmi_line() and cpu_schedule_line_change() or replayed, so nothing is skipped while any poll
+// callback is set. Nothing is skipped while tracing either. The host must not change memory read by a loop during a run
+// other than through the CPU.
+void cpu_set_idle_skip(Cpu6502 *cpu, bool enabled);
+
+// Returns the total number of cycles skipped in idle loops.
+uint64_t cpu_get_idle_skipped_cycles(const Cpu6502 *cpu);
+
+// Returns the condition which ended the last call to cpu_run_cycles(), or CPU_STOP_NONE if it used its whole budget.
+CpuStopCondition cpu_get_stop_reason(const Cpu6502 *cpu);
+
+void cycle_cpu(Cpu6502 *cpu);
+
+// Cycles the CPU until either the budget is used up or one of the conditions in stop_mask (a combination of
+// CpuStopCondition flags) is met, and returns the number of cycles actually run. Opcode-based conditions are checked
+// right after the opcode has been fetched, so the CPU is left one cycle into the matching instruction.
+uint64_t cpu_run_cycles(Cpu6502 *cpu, uint64_t budget, unsigned int stop_mask);
+
+// Executes the next instruction (or interrupt sequence) without stepping through its individual cycles and returns
+// the number of cycles it took. If the CPU is in the middle of an instruction, only the remainder of it is executed.
+// Memory accesses happen in the same order as with cycle_cpu(), but interrupt lines are only sampled once per
+// instruction.
+unsigned int cpu_step_instruction(Cpu6502 *cpu);
+
+// Executes count instructions as with cpu_step_instruction() and returns the total number of cycles taken.
+uint64_t cpu_run_instructions(Cpu6502 *cpu, uint64_t count);
+
+// Executes instructions as with cpu_run_instructions() until the cycle counter reaches the given cycle, and returns the
+// number of cycles taken. The last instruction, or block of translated or compiled code, may overshoot the cycle. A
+// jammed CPU is advanced to the cycle straight away.
+uint64_t cpu_run_until_cycle(Cpu6502 *cpu, uint64_t cycle);
+
+// Enables translation of hot code into native code for cpu_run_instructions(). A cached block is translated once it has
+// been entered hot_threshold times, and passing 0 disables translation again. Translated blocks sample the interrupt
+// lines once per block rather than once per instruction and do not drive the data bus latch. Instructions they cannot
+// handle natively, and those whose memory accesses would go through the system interface, are executed by the
+// interpreter. Enabling this also enables the block cache. Returns false if native translation is not supported on
+// this host.
+bool cpu_set_jit(Cpu6502 *cpu, unsigned int hot_threshold);
 
-Instruction *cpu_get_current_instruction(void);
+// Installs ahead-of-time compiled code for cpu_run_instructions(), which then runs the block returned by lookup for the
+// current PC whenever there is one and falls back to the interpreter otherwise. As with cpu_set_jit(), interrupt lines
+// are only sampled once per block and the data bus latch is not driven. The compiled image must not change while the
+// code is installed. Passing NULL removes the code again.
+void cpu_set_static_code(Cpu6502 *cpu, CpuStaticLookup lookup);
 
-void cpu_set_log_callback(void (*callback)(char*, CpuRegisters));
+// Reads or writes memory exactly as an access made by the CPU would, through mapped pages or the system interface.
+// These are mainly intended for code generated by c6502_recomp.
+uint8_t cpu_read_memory(Cpu6502 *cpu, uint16_t addr);
 
-void cycle_cpu(void);
+void cpu_write_memory(Cpu6502 *cpu, uint16_t addr, uint8_t val);
 
-char *cpu_print_current_instruction(char *target);
+char *cpu_print_current_instruction(Cpu6502 *cpu, char *target);
@@ -59,6 +59,22 @@ typedef struct {
 
 typedef enum { INS_OTHER, INS_BRANCH, INS_JUMP, INS_R, INS_W, INS_RW, INS_STACK, INS_REG, INS_RET } InstructionType;
 
+// identifies the routine in the CPU core which executes an opcode
+typedef enum {
+    HND_IMP, HND_IMM, HND_ZRP, HND_ZPI, HND_ABS, HND_ABI, HND_IZX, HND_IZY,
+    HND_JMP, HND_JSR, HND_RTI, HND_RTS, HND_BRANCH, HND_PUSH, HND_PULL, HND_BRK
+} InstructionHandler;
+
+typedef struct {
+    uint8_t mnemonic; // Mnemonic
+    uint8_t addr_mode; // AddressingMode
+    uint8_t type; // InstructionType
+    uint8_t len; // length in bytes including the opcode
+    uint8_t cycles; // base cycle count, not including penalties
+    uint8_t page_penalty; // whether crossing a page costs an extra cycle
+    uint8_t handler; // InstructionHandler
+} OpcodeInfo;
+
 const char *mnemonic_to_str(const Mnemonic mnemonic);
 
 const char *addr_mode_to_str(const AddressingMode addr_mode);
@@ -69,6 +85,8 @@ uint8_t get_instr_len(const Instruction *instr);
 
 Instruction *decode_instr(unsigned char opcode);
 
+const OpcodeInfo *get_opcode_info(uint8_t opcode);
+
 bool does_cross_page_boundary(uint8_t a, int16_t offset);
 
 bool can_incur_page_boundary_penalty(const uint8_t opcode);
@@ -0,0 +1,70 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "c6502/cpu.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A rewind buffer keeps periodic keyframes of a CPU's state so that it can be sent back to an earlier cycle. The first
+// keyframe holds a full image of the writable memory mapped with cpu_map_memory(); every later one only holds the
+// pages which were written since the keyframe before it. Once the keyframes outgrow the memory budget, the oldest is
+// folded into the image.
+//
+// Only mapped read-write and copy-on-write memory is covered, so any other state the host keeps (memory accessed
+// through the system interface, peripherals) has to be rewound by the host itself. The memory mappings must stay the
+// same while the buffer is in use.
+
+typedef struct RewindBuffer RewindBuffer;
+
+// Creates a rewind buffer which takes a keyframe at most every interval cycles and keeps the total size of its
+// keyframes within budget bytes, although the newest keyframe is always kept. Returns NULL if allocation failed.
+RewindBuffer *rewind_create(Cpu6502 *cpu, uint64_t interval, size_t budget);
+
+void rewind_destroy(RewindBuffer *rewind);
+
+// Takes a keyframe if at least interval cycles have passed since the last one. The host should call this regularly,
+// e.g. after each cpu_run_cycles() call. Returns false if a keyframe was due but could not be allocated.
+bool rewind_update(RewindBuffer *rewind);
+
+// Sends the CPU back to the given cycle by restoring the newest keyframe at or before it, then running the CPU forward
+// through cpu_run_cycles(). Anything the CPU reads through the system interface, including the interrupt lines, is
+// read again while doing so. Keyframes after the cycle are discarded. Returns false if the cycle lies before the oldest
+// keyframe or after the current cycle.
+bool rewind_seek(RewindBuffer *rewind, uint64_t cycle);
+
+// Sends the CPU back by the given number of cycles as with rewind_seek().
+bool rewind_cycles(RewindBuffer *rewind, uint64_t cycles);
+
+// Returns the cycle of the oldest keyframe, which is the furthest the CPU can currently be rewound to.
+uint64_t rewind_get_oldest_cycle(const RewindBuffer *rewind);
+
+size_t rewind_get_keyframe_count(const RewindBuffer *rewind);
+
+// Returns the number of bytes currently taken up by keyframes, which is what the budget limits.
+size_t rewind_get_memory_usage(const RewindBuffer *rewind);
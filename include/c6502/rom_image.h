@@ -0,0 +1,54 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "c6502/cpu.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A ROM image is a program file mapped read-only into the host's address space, so that any number of CPUs running the
+// same program share a single copy of it. CPUs see the image through copy-on-write pages: a CPU only gets memory of its
+// own for the pages it writes to, and the image itself is never modified.
+//
+// The image must stay open for as long as any CPU still maps pages of it which it has not copied.
+
+typedef struct RomImage RomImage;
+
+// Maps the file at the given path. Returns NULL if it could not be opened or mapped, or if it is empty.
+RomImage *rom_image_open(const char *path);
+
+void rom_image_close(RomImage *image);
+
+const uint8_t *rom_image_data(const RomImage *image);
+
+size_t rom_image_size(const RomImage *image);
+
+// Maps the image copy-on-write into len bytes of the CPU's address space from addr, repeating it as often as it fits so
+// that images smaller than the range are mirrored. If the image size is not a multiple of the 256-byte page size, its
+// last page is padded with zeroes. Both addr and len must be multiples of the page size.
+bool rom_image_map(const RomImage *image, Cpu6502 *cpu, uint16_t addr, size_t len);
@@ -0,0 +1,72 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "c6502/cpu.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A scheduler runs a CPU straight through to the next cycle at which a peripheral has asked to be serviced, rather than
+// the host ticking each peripheral along with every cycle. Peripherals register callbacks for absolute values of the
+// CPU's cycle counter, usually re-registering themselves from the callback to run periodically, and catch up on the
+// cycles that have passed since they were last serviced. Events due on the same cycle are serviced in the order they
+// were added.
+
+typedef struct Scheduler Scheduler;
+
+// Called once the CPU has reached the cycle the event was scheduled for. The cycle counter may already be past it
+// when running by instruction. The callback may add and cancel events and drive the CPU's interrupt lines, but must not
+// run the CPU or the scheduler itself.
+typedef void (*SchedulerCallback)(void *userdata, uint64_t due_cycle);
+
+// Creates a scheduler for the given CPU, returning NULL if allocation failed.
+Scheduler *scheduler_create(Cpu6502 *cpu);
+
+void scheduler_destroy(Scheduler *scheduler);
+
+// Schedules a call of callback once the cycle counter reaches at_cycle, which is made at the start of the next run if
+// it is already past. Returns an ID for cancelling the event, or 0 if it could not be stored.
+uint64_t scheduler_add_event(Scheduler *scheduler, uint64_t at_cycle, SchedulerCallback callback, void *userdata);
+
+// Cancels a pending event, returning false if it has already been serviced or cancelled.
+bool scheduler_cancel_event(Scheduler *scheduler, uint64_t id);
+
+// Returns the cycle of the next pending event, or UINT64_MAX if there is none.
+uint64_t scheduler_get_next_event_cycle(const Scheduler *scheduler);
+
+size_t scheduler_get_event_count(const Scheduler *scheduler);
+
+// Runs the CPU for budget cycles with cpu_run_cycles(), servicing each event on exactly the cycle it is due, and
+// returns the number of cycles actually run. As with cpu_run_cycles(), the run ends early if one of the conditions in
+// stop_mask is met.
+uint64_t scheduler_run_cycles(Scheduler *scheduler, uint64_t budget, unsigned int stop_mask);
+
+// Runs the CPU for at least budget cycles with cpu_run_until_cycle(), which allows it to use the block cache and
+// translated code, and returns the number of cycles actually run. Events are serviced at the first instruction or
+// block boundary at or after the cycle they are due.
+uint64_t scheduler_run_instructions(Scheduler *scheduler, uint64_t budget);
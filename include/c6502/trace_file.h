@@ -0,0 +1,74 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "c6502/cpu.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Trace files store CpuTraceRecords in independently compressed blocks. Within a block, each record is delta-encoded
+// against the one before it, so that a PC which simply follows the previous instruction and registers which did not
+// change take up no space at all. An index of the blocks at the end of the file allows seeking by cycle number; if it
+// is missing because the writer never got to close the file, the reader rebuilds it by scanning the blocks.
+
+typedef struct TraceWriter TraceWriter;
+
+typedef struct TraceReader TraceReader;
+
+// Creates a trace file at the given path, returning NULL if it could not be opened.
+TraceWriter *trace_writer_open(const char *path);
+
+// Appends records to the file. Records are buffered and compressed one block at a time, so only every few thousandth
+// call actually does any work. Returns false if writing failed.
+bool trace_writer_append(TraceWriter *writer, const CpuTraceRecord *records, size_t count);
+
+// Appends the records the CPU has written to its trace buffer since *position and advances *position past them. The
+// buffer has to be drained before it wraps around, as overwritten records are lost; in that case, or if writing
+// failed, false is returned.
+bool trace_writer_drain(TraceWriter *writer, const Cpu6502 *cpu, uint64_t *position);
+
+// Appends records as with trace_writer_append(), but with the signature of a TraceConsumer so that the writer can be fed
+// from a trace queue by passing it as the userdata. Write errors are reported by trace_writer_close().
+void trace_writer_consume(void *writer, const CpuTraceRecord *records, size_t count);
+
+// Flushes any buffered records, writes the index and closes the file. Returns false if writing failed at any point.
+bool trace_writer_close(TraceWriter *writer);
+
+// Opens a trace file for reading, returning NULL if it could not be opened or is not a trace file.
+TraceReader *trace_reader_open(const char *path);
+
+void trace_reader_close(TraceReader *reader);
+
+// Returns the total number of records in the file.
+uint64_t trace_reader_get_record_count(const TraceReader *reader);
+
+// Positions the reader at the first record of an instruction that started at or after the given cycle.
+bool trace_reader_seek_cycle(TraceReader *reader, uint64_t cycle);
+
+// Reads the next record, returning false at the end of the file or if the file is corrupt.
+bool trace_reader_next(TraceReader *reader, CpuTraceRecord *record);
@@ -0,0 +1,64 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "c6502/cpu.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A trace queue hands the trace records of a CPU over to a background thread through a lock-free single-producer,
+// single-consumer ring, so that whatever is done with them (formatting, compression, I/O) never runs on the thread
+// driving the CPU.
+
+typedef enum {
+    TRACE_QUEUE_BLOCK, // the CPU waits for the consumer whenever the queue is full, so no records are lost
+    TRACE_QUEUE_DROP, // records which do not fit are dropped and counted
+    TRACE_QUEUE_SAMPLE // once the queue is three quarters full, only every sample_interval-th record is kept
+} TraceQueuePolicy;
+
+// Called on the background thread with the records taken off the queue, in order. A single call never spans the end of
+// the ring, so a batch of records may be delivered over several calls.
+typedef void (*TraceConsumer)(void *userdata, const CpuTraceRecord *records, size_t count);
+
+// Creates a queue holding up to capacity records (rounded up to a power of two) and starts its consumer thread.
+// sample_interval is only used by TRACE_QUEUE_SAMPLE. Returns NULL if the queue or the thread could not be created.
+TraceQueue *trace_queue_create(size_t capacity, TraceQueuePolicy policy, unsigned int sample_interval,
+        TraceConsumer consumer, void *userdata);
+
+// Hands any remaining records to the consumer, then stops its thread and frees the queue. The queue must have been
+// detached from its CPU first.
+void trace_queue_destroy(TraceQueue *queue);
+
+// Waits until the consumer has processed every record queued so far.
+void trace_queue_flush(TraceQueue *queue);
+
+// Returns the number of records which were dropped or sampled out because the consumer did not keep up.
+uint64_t trace_queue_get_dropped(const TraceQueue *queue);
+
+// Queues a record from the producer thread according to the queue's policy.
+void trace_queue_push(TraceQueue *queue, const CpuTraceRecord *record);
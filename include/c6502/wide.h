@@ -0,0 +1,50 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+
+#include "c6502/batch.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The wide interpreter runs many instances of the same program side by side, for example one program evaluated over
+// thousands of different inputs. Instances are taken in groups of WIDE_LANES lanes, whose registers are kept as
+// structures of arrays and operated on with SIMD instructions (AVX2 where the compiler targets it, SSE2 otherwise)
+// for as long as every lane is at the same PC and fetches the same code. Lanes which take a different path, reach a
+// stop condition, run low on budget or meet an instruction the wide interpreter doesn't handle are peeled off and
+// finished by the regular core, so every instance ends in exactly the state batch_run() would leave it in.
+
+#define WIDE_LANES 32
+
+typedef struct {
+    uint64_t lane_instrs; // instructions executed by lanes in lockstep
+    uint64_t diverged; // lanes peeled off because their path left that of their group
+} WideStats;
+
+// Runs count instances as batch_run() would, but on the calling thread and with lanes of the same group executed
+// together. Memory accesses go straight to each instance's address space. stats may be NULL. Returns false if memory
+// could not be allocated, in which case nothing is run.
+bool wide_run(const BatchInstance *instances, BatchResult *results, size_t count, WideStats *stats);
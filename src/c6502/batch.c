@@ -0,0 +1,432 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "c6502/batch.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#define CACHE_LINE_SIZE 64
+#define NO_TASK SIZE_MAX
+#define ABORTED (SIZE_MAX - 1) // a steal lost a race and may be retried
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+#else
+typedef pthread_t Thread;
+#endif
+
+typedef struct Batch Batch;
+
+// the progress of a single instance between slices
+typedef struct {
+    uint64_t cycles;
+    bool started;
+    unsigned int last_worker; // the worker which ran the last slice, whose CPU may still hold the instance
+    uint8_t state[CPU_STATE_SIZE];
+} Task;
+
+// A worker's deque of task indices, after Chase and Lev. The owner pushes and takes at the bottom while thieves steal
+// from the top. A task is only ever on a single deque, so the ring never needs to grow.
+typedef struct {
+    _Atomic int64_t top;
+    uint8_t pad0[CACHE_LINE_SIZE];
+    _Atomic int64_t bottom;
+    uint8_t pad1[CACHE_LINE_SIZE];
+    _Atomic size_t *slots;
+} Deque;
+
+typedef struct {
+    Batch *batch;
+    unsigned int index;
+    Deque deque;
+
+    Cpu6502 *cpu;
+    uint8_t bus_val;
+    size_t loaded; // the task the CPU currently holds, or NO_TASK
+    uint32_t rng; // picks the workers to steal from
+
+    Thread thread;
+    bool started;
+} Worker;
+
+struct Batch {
+    const BatchInstance *instances;
+    BatchResult *results;
+    Task *tasks;
+    uint64_t slice_cycles;
+
+    Worker *workers;
+    unsigned int worker_count;
+    size_t deque_mask;
+
+    uint8_t pad0[CACHE_LINE_SIZE];
+    _Atomic size_t remaining; // the number of tasks which have not finished yet
+    uint8_t pad1[CACHE_LINE_SIZE];
+};
+
+static void _yield(void) {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+static unsigned int _processor_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned int) count : 1;
+#endif
+}
+
+static void _push(Batch *batch, Deque *deque, size_t task) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+
+    atomic_store_explicit(&deque->slots[bottom & batch->deque_mask], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+static size_t _take(Batch *batch, Deque *deque) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NO_TASK;
+    }
+
+    size_t task = atomic_load_explicit(&deque->slots[bottom & batch->deque_mask], memory_order_relaxed);
+
+    if (top == bottom) {
+        // the last task may be stolen at the same time, so it is claimed the same way a thief would
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst,
+                memory_order_relaxed)) {
+            task = NO_TASK;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    return task;
+}
+
+static size_t _steal(Batch *batch, Deque *deque) {
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom) {
+        return NO_TASK;
+    }
+
+    size_t task = atomic_load_explicit(&deque->slots[top & batch->deque_mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst,
+            memory_order_relaxed)) {
+        return ABORTED;
+    }
+
+    return task;
+}
+
+// tries each of the other workers in turn, starting from a random one
+static size_t _steal_any(Worker *worker) {
+    Batch *batch = worker->batch;
+
+    // xorshift32
+    worker->rng ^= worker->rng << 13;
+    worker->rng ^= worker->rng >> 17;
+    worker->rng ^= worker->rng << 5;
+
+    unsigned int start = worker->rng % batch->worker_count;
+    bool aborted = false;
+
+    for (unsigned int i = 0; i < batch->worker_count; i++) {
+        unsigned int victim = (start + i) % batch->worker_count;
+        if (victim == worker->index) {
+            continue;
+        }
+
+        size_t task = _steal(batch, &batch->workers[victim].deque);
+        if (task == ABORTED) {
+            aborted = true;
+        } else if (task != NO_TASK) {
+            return task;
+        }
+    }
+
+    return aborted ? ABORTED : NO_TASK;
+}
+
+// only reached by the reset sequence run when the worker's CPU is created, before any instance has been mapped
+static uint8_t _mem_read(void *userdata, uint16_t addr) {
+    (void) userdata;
+    (void) addr;
+    return 0;
+}
+
+static void _mem_write(void *userdata, uint16_t addr, uint8_t val) {
+    (void) userdata;
+    (void) addr;
+    (void) val;
+}
+
+static uint8_t _bus_read(void *userdata) {
+    return ((Worker *) userdata)->bus_val;
+}
+
+static void _bus_write(void *userdata, uint8_t val) {
+    ((Worker *) userdata)->bus_val = val;
+}
+
+static CpuSystemInterface _worker_iface(Worker *worker) {
+    return (CpuSystemInterface) {_mem_read, _mem_write, _bus_read, _bus_write, NULL, NULL, NULL, worker};
+}
+
+// makes the worker's CPU hold the given task
+static void _load_task(Worker *worker, size_t index) {
+    Batch *batch = worker->batch;
+    const BatchInstance *instance = &batch->instances[index];
+    Task *task = &batch->tasks[index];
+
+    cpu_map_memory(worker->cpu, 0x0000, 0x10000, instance->memory, CPU_PAGE_READ_WRITE);
+    cpu_set_stop_pc(worker->cpu, instance->stop_pc);
+    cpu_set_stop_mnemonic(worker->cpu, instance->stop_mnemonic);
+
+    if (!task->started) {
+        initialize_cpu(worker->cpu, _worker_iface(worker));
+        if (instance->regs != NULL) {
+            *cpu_get_registers(worker->cpu) = *instance->regs;
+        }
+        task->started = true;
+    } else {
+        cpu_load_state(worker->cpu, task->state, CPU_STATE_SIZE);
+    }
+
+    worker->loaded = index;
+}
+
+// runs a slice of the given task, returning true once it has finished
+static bool _run_slice(Worker *worker, size_t index) {
+    Batch *batch = worker->batch;
+    const BatchInstance *instance = &batch->instances[index];
+    Task *task = &batch->tasks[index];
+
+    if (worker->loaded != index || task->last_worker != worker->index) {
+        _load_task(worker, index);
+    }
+    task->last_worker = worker->index;
+
+    uint64_t left = instance->budget - task->cycles;
+    uint64_t slice = left < batch->slice_cycles ? left : batch->slice_cycles;
+    unsigned int stop_mask = instance->stop_mask & ~CPU_STOP_BREAKPOINT;
+
+    task->cycles += cpu_run_cycles(worker->cpu, slice, stop_mask);
+    CpuStopCondition reason = cpu_get_stop_reason(worker->cpu);
+
+    if (reason == CPU_STOP_NONE && task->cycles < instance->budget) {
+        // the task may be stolen before this worker gets back to it
+        cpu_save_state(worker->cpu, task->state);
+        return false;
+    }
+
+    BatchResult *result = &batch->results[index];
+    result->regs = *cpu_get_registers(worker->cpu);
+    result->cycles = task->cycles;
+    result->stop_reason = reason;
+    result->jammed = cpu_is_jammed(worker->cpu);
+
+    worker->loaded = NO_TASK;
+
+    return true;
+}
+
+static void _run_worker(Worker *worker) {
+    Batch *batch = worker->batch;
+
+    while (atomic_load_explicit(&batch->remaining, memory_order_acquire) != 0) {
+        size_t task = _take(batch, &worker->deque);
+        if (task == NO_TASK) {
+            task = _steal_any(worker);
+        }
+
+        if (task == NO_TASK || task == ABORTED) {
+            _yield();
+            continue;
+        }
+
+        if (_run_slice(worker, task)) {
+            atomic_fetch_sub_explicit(&batch->remaining, 1, memory_order_release);
+        } else {
+            _push(batch, &worker->deque, task);
+        }
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI _worker_main(LPVOID arg) {
+    _run_worker(arg);
+    return 0;
+}
+
+static bool _start_thread(Worker *worker) {
+    return (worker->thread = CreateThread(NULL, 0, _worker_main, worker, 0, NULL)) != NULL;
+}
+
+static void _join_thread(Worker *worker) {
+    WaitForSingleObject(worker->thread, INFINITE);
+    CloseHandle(worker->thread);
+}
+#else
+static void *_worker_main(void *arg) {
+    _run_worker(arg);
+    return NULL;
+}
+
+static bool _start_thread(Worker *worker) {
+    return pthread_create(&worker->thread, NULL, _worker_main, worker) == 0;
+}
+
+static void _join_thread(Worker *worker) {
+    pthread_join(worker->thread, NULL);
+}
+#endif
+
+static void _destroy_workers(Batch *batch) {
+    for (unsigned int i = 0; i < batch->worker_count; i++) {
+        Worker *worker = &batch->workers[i];
+        if (worker->cpu != NULL) {
+            cpu_destroy(worker->cpu);
+        }
+        free((void *) worker->deque.slots);
+    }
+
+    free(batch->workers);
+}
+
+static bool _create_workers(Batch *batch, unsigned int count) {
+    if ((batch->workers = calloc(count, sizeof(Worker))) == NULL) {
+        return false;
+    }
+    batch->worker_count = count;
+
+    for (unsigned int i = 0; i < count; i++) {
+        Worker *worker = &batch->workers[i];
+        worker->batch = batch;
+        worker->index = i;
+        worker->loaded = NO_TASK;
+        worker->rng = 2463534242u + i * 0x9E3779B9u;
+        atomic_init(&worker->deque.top, 0);
+        atomic_init(&worker->deque.bottom, 0);
+
+        worker->deque.slots = malloc(sizeof(_Atomic size_t) * (batch->deque_mask + 1));
+        worker->cpu = cpu_create(_worker_iface(worker));
+        if (worker->deque.slots == NULL || worker->cpu == NULL) {
+            _destroy_workers(batch);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool batch_run(const BatchInstance *instances, BatchResult *results, size_t count, unsigned int threads,
+        uint64_t slice_cycles) {
+    if (count == 0) {
+        return true;
+    }
+
+    if (threads == 0) {
+        threads = _processor_count();
+    }
+    if (threads > count) {
+        threads = count;
+    }
+
+    Batch batch = {
+            .instances = instances,
+            .results = results,
+            .slice_cycles = slice_cycles != 0 ? slice_cycles : BATCH_DEFAULT_SLICE
+    };
+
+    // every deque must be able to hold all of the tasks at once
+    size_t capacity = 1;
+    while (capacity < count) {
+        capacity <<= 1;
+    }
+    batch.deque_mask = capacity - 1;
+
+    if ((batch.tasks = calloc(count, sizeof(Task))) == NULL) {
+        return false;
+    }
+
+    if (!_create_workers(&batch, threads)) {
+        free(batch.tasks);
+        return false;
+    }
+
+    // deal the tasks out round-robin, so that each worker starts on a share of its own
+    for (size_t i = 0; i < count; i++) {
+        _push(&batch, &batch.workers[i % threads].deque, i);
+    }
+    atomic_init(&batch.remaining, count);
+
+    // the calling thread is the first worker
+    for (unsigned int i = 1; i < threads; i++) {
+        batch.workers[i].started = _start_thread(&batch.workers[i]);
+    }
+
+    _run_worker(&batch.workers[0]);
+
+    for (unsigned int i = 1; i < threads; i++) {
+        if (batch.workers[i].started) {
+            _join_thread(&batch.workers[i]);
+        }
+    }
+
+    _destroy_workers(&batch);
+    free(batch.tasks);
+
+    return true;
+}
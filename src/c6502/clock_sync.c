@@ -0,0 +1,211 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "c6502/clock_sync.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+    uint32_t ticks; // per cycles CPU cycles
+    uint32_t cycles;
+    ClockTickFn tick;
+    void *userdata;
+
+    // the domain is due anchor_ticks + floor((c - anchor_cycle) * ticks / cycles) ticks once the CPU reaches cycle c
+    uint64_t anchor_cycle;
+    uint64_t anchor_ticks;
+
+    uint64_t done; // the ticks run so far
+    uint64_t output_cycle; // the CPU cycle by which the domain has to be ticked for its next output, or UINT64_MAX
+} Domain;
+
+struct ClockSync {
+    Cpu6502 *cpu;
+
+    Domain *domains;
+    size_t count;
+    size_t cap;
+
+    bool batched; // a batched run is in progress
+    uint64_t run_end; // the cycle the current call to cpu_run_cycles() is meant to end at
+};
+
+// returns the number of ticks the domain is due once the CPU reaches the given cycle
+static uint64_t _ticks_at(Domain *domain, uint64_t cycle) {
+    // moving the anchor forward by whole periods keeps the product below from overflowing
+    uint64_t periods = (cycle - domain->anchor_cycle) / domain->cycles;
+    domain->anchor_cycle += periods * domain->cycles;
+    domain->anchor_ticks += periods * domain->ticks;
+
+    return domain->anchor_ticks + (cycle - domain->anchor_cycle) * domain->ticks / domain->cycles;
+}
+
+// returns the first cycle by which the domain is due at least the given number of ticks, or UINT64_MAX if that is
+// beyond the range of the cycle counter
+static uint64_t _cycle_of_tick(const Domain *domain, uint64_t tick) {
+    uint64_t ahead = tick - domain->anchor_ticks;
+    uint64_t periods = ahead / domain->ticks;
+    uint64_t rest = ((ahead % domain->ticks) * domain->cycles + domain->ticks - 1) / domain->ticks;
+
+    if (periods > (UINT64_MAX - domain->anchor_cycle - rest) / domain->cycles) {
+        return UINT64_MAX;
+    }
+
+    return domain->anchor_cycle + periods * domain->cycles + rest;
+}
+
+static void _set_next_output(Domain *domain, uint64_t ticks) {
+    if (ticks == CLOCK_NO_OUTPUT || ticks > UINT64_MAX - domain->done) {
+        domain->output_cycle = UINT64_MAX;
+        return;
+    }
+
+    // output due right away is produced on the next tick at the earliest
+    domain->output_cycle = _cycle_of_tick(domain, domain->done + (ticks != 0 ? ticks : 1));
+}
+
+static void _advance(Domain *domain, uint64_t cycle) {
+    uint64_t target = _ticks_at(domain, cycle);
+    if (target == domain->done) {
+        return;
+    }
+
+    uint64_t next_output = domain->tick(domain->userdata, target - domain->done);
+    domain->done = target;
+    _set_next_output(domain, next_output);
+}
+
+// makes a batched run stop early enough for the domain's next output
+static void _check_output(ClockSync *sync, const Domain *domain) {
+    if (sync->batched && domain->output_cycle < sync->run_end) {
+        cpu_request_stop(sync->cpu);
+    }
+}
+
+ClockSync *clock_sync_create(Cpu6502 *cpu) {
+    ClockSync *sync = calloc(1, sizeof(ClockSync));
+    if (sync == NULL) {
+        return NULL;
+    }
+
+    sync->cpu = cpu;
+
+    return sync;
+}
+
+void clock_sync_destroy(ClockSync *sync) {
+    free(sync->domains);
+    free(sync);
+}
+
+bool clock_sync_add_domain(ClockSync *sync, uint32_t ticks, uint32_t cycles, ClockTickFn tick, void *userdata) {
+    if (ticks == 0 || cycles == 0) {
+        return false;
+    }
+
+    if (sync->count == sync->cap) {
+        size_t new_cap = sync->cap != 0 ? sync->cap * 2 : 4;
+        Domain *domains = realloc(sync->domains, new_cap * sizeof(Domain));
+        if (domains == NULL) {
+            return false;
+        }
+        sync->domains = domains;
+        sync->cap = new_cap;
+    }
+
+    sync->domains[sync->count++] = (Domain) {
+            .ticks = ticks,
+            .cycles = cycles,
+            .tick = tick,
+            .userdata = userdata,
+            .anchor_cycle = cpu_get_cycle_count(sync->cpu),
+            .anchor_ticks = 0,
+            .done = 0
+    };
+
+    Domain *domain = &sync->domains[sync->count - 1];
+    _set_next_output(domain, tick(userdata, 0));
+
+    return true;
+}
+
+void clock_sync_catch_up(ClockSync *sync, size_t domain) {
+    _advance(&sync->domains[domain], cpu_get_cycle_count(sync->cpu));
+    _check_output(sync, &sync->domains[domain]);
+}
+
+void clock_sync_set_next_output(ClockSync *sync, size_t domain, uint64_t ticks) {
+    _set_next_output(&sync->domains[domain], ticks);
+    _check_output(sync, &sync->domains[domain]);
+}
+
+uint64_t clock_sync_get_ticks(const ClockSync *sync, size_t domain) {
+    return sync->domains[domain].done;
+}
+
+void clock_sync_run(ClockSync *sync, uint64_t cycles) {
+    for (uint64_t i = 0; i < cycles; i++) {
+        cycle_cpu(sync->cpu);
+
+        uint64_t now = cpu_get_cycle_count(sync->cpu);
+        for (size_t d = 0; d < sync->count; d++) {
+            _advance(&sync->domains[d], now);
+        }
+    }
+}
+
+void clock_sync_run_batched(ClockSync *sync, uint64_t cycles) {
+    Cpu6502 *cpu = sync->cpu;
+    uint64_t start = cpu_get_cycle_count(cpu);
+    uint64_t end = cycles < UINT64_MAX - start ? start + cycles : UINT64_MAX;
+
+    sync->batched = true;
+
+    for (uint64_t now = start; now < end; now = cpu_get_cycle_count(cpu)) {
+        uint64_t next = end;
+        for (size_t d = 0; d < sync->count; d++) {
+            Domain *domain = &sync->domains[d];
+            if (domain->output_cycle <= now) {
+                _advance(domain, now);
+            }
+
+            if (domain->output_cycle < next) {
+                next = domain->output_cycle;
+            }
+        }
+
+        sync->run_end = next;
+        cpu_run_cycles(cpu, next - now, 0);
+    }
+
+    sync->batched = false;
+
+    uint64_t now = cpu_get_cycle_count(cpu);
+    for (size_t d = 0; d < sync->count; d++) {
+        _advance(&sync->domains[d], now);
+    }
+}
@@ -25,9 +25,12 @@
 
 #include "c6502/cpu.h"
 #include "c6502/instrs.h"
+#include "c6502/trace_queue.h"
+#include "cpu_internal.h"
 
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,1202 +43,2960 @@
 #define STACK_BOTTOM_ADDR 0x100
 #define BASE_SP 0xFF
 #define DEFAULT_STATUS 0x24 // interrupt-disable and unused flag are set by default
+#define STATUS_C 0x01
+#define STATUS_Z 0x02
+#define STATUS_V 0x40
+#define STATUS_N 0x80
+#define IDLE_MAX_INSTRS 8 // the longest idle loop recognized
+
+#define ASSERT_CYCLE(l, h)  assert(cpu->instr_cycle >= l); \
+                            assert(cpu->instr_cycle <= h)
+
+static const InterruptType INT_NMI = {0xFFFA, false, true, false, false};
+static const InterruptType INT_RST = {0xFFFC, false, false,  false, true};
+static const InterruptType INT_IRQ = {0xFFFE, true,  true,  false, true};
+static const InterruptType INT_BRK = {0xFFFE, false, true,  true,  true};
+
+// the order in which interrupt types are identified in saved states
+static const InterruptType *const g_interrupt_types[] = {NULL, &INT_NMI, &INT_RST, &INT_IRQ, &INT_BRK};
+
+#define STATE_MAGIC "C65S"
+#define STATE_VERSION 1
+
+// flags packed into a single byte of saved states
+#define STATE_NMI_EDGE_DETECTOR 0x01
+#define STATE_IRQ_LINE_READER 0x02
+#define STATE_RST_LINE_READER 0x04
+#define STATE_NMI_HIJACK 0x08
+#define STATE_JAMMED 0x10
+#define STATE_HAS_INSTR 0x20
+
+// records the state at the start of an instruction for logging and tracing
+static void _take_snapshot(Cpu6502 *cpu) {
+    cpu->regs_snapshot = cpu->regs;
+    cpu->cycle_snapshot = cpu->cycle_count;
+}
 
-#define ASSERT_CYCLE(l, h)  assert(g_instr_cycle >= l); \
-                            assert(g_instr_cycle <= h)
+Cpu6502 *cpu_create(CpuSystemInterface system_iface) {
+    Cpu6502 *cpu = calloc(1, sizeof(Cpu6502));
+    if (!cpu) {
+        return NULL;
+    }
 
-InterruptType INT_NMI = {0xFFFA, false, true, false, false};
-InterruptType INT_RST = {0xFFFC, false, false,  false, true};
-InterruptType INT_IRQ = {0xFFFE, true,  true,  false, true};
-InterruptType INT_BRK = {0xFFFE, false, true,  true,  true};
+    for (size_t i = 0; i < 0x100; i++) {
+        cpu->page_alias[i] = i;
+    }
 
-CpuRegisters g_cpu_regs;
+    initialize_cpu(cpu, system_iface);
 
-// interrupt reader lines (delayed by one cycle)
-static bool g_nmi_edge_detector = false;
-static bool g_irq_line_reader = false;
-static bool g_rst_line_reader = false;
-static unsigned int g_nmi_line_last_state = 1;
+    return cpu;
+}
 
-static CpuSystemInterface g_sys_iface;
+static void _drop_owned_page(OwnedPage *owned);
+static void _release_owned_page(Cpu6502 *cpu, uint8_t page);
 
-// state for implementing cycle-accuracy
-uint8_t g_instr_cycle = 1; // this is 1-indexed to match blargg's doc
+void cpu_destroy(Cpu6502 *cpu) {
+    for (size_t page = 0; page < 0x100; page++) {
+        _release_owned_page(cpu, page);
+        _drop_owned_page(cpu->page_snapshot[page]);
+    }
 
-Instruction *g_cur_instr; // the instruction currently being executed
-static uint8_t g_last_opcode; // the last opcode decoded
+    jit_arena_destroy(cpu->jit);
+    free(cpu->block_cache);
+    free(cpu->breakpoints);
+    free(cpu->line_changes);
+    free(cpu);
+}
 
-static uint16_t g_cur_operand; // the operand directly read from PRG
-static uint16_t g_eff_operand; // the effective operand (after being offset)
+void initialize_cpu(Cpu6502 *cpu, CpuSystemInterface system_iface) {
+    cpu->sys_iface = system_iface;
+
+    // clear execution state for init - configuration such as breakpoints is left alone
+    memset(&cpu->regs, 0, sizeof(cpu->regs));
+    cpu->regs.status.serial = DEFAULT_STATUS;
+
+    cpu->nmi_edge_detector = false;
+    cpu->irq_line_reader = false;
+    cpu->rst_line_reader = false;
+    cpu->nmi_line_last_state = 1;
+    cpu->line_change_head = 0;
+    cpu->line_change_count = 0;
+
+    cpu->instr_cycle = 1;
+    cpu->cycle_count = 0;
+    cpu->cur_instr = NULL;
+    cpu->cur_info = NULL;
+    cpu->cur_handler = NULL;
+    cpu->cur_op = NULL;
+    cpu->last_opcode = 0;
+    cpu->operand_cached = false;
+    cpu->cur_operand = 0;
+    cpu->eff_operand = 0;
+
+    cpu->cur_interrupt = NULL;
+    cpu->queued_interrupt = &INT_RST;
+    cpu->nmi_hijack = false;
+
+    cpu->jammed = false;
+    cpu->stop_reason = CPU_STOP_NONE;
+    cpu->idle_watching = false;
+
+    // the system may have reloaded memory behind our back
+    if (cpu->block_cache) {
+        memset(cpu->block_cache, 0, sizeof(CodeBlock) * BLOCK_CACHE_SIZE);
+    }
+    cpu->cur_block = NULL;
 
-static const InterruptType *g_cur_interrupt; // the interrupt type currently being executed
-static const InterruptType *g_queued_interrupt; // the interrupt type currently queued
-static bool g_nmi_hijack; // set when an NMI "hijacks" a software interrupt
+    for (int i = 0; i < 7; i++) {
+        cycle_cpu(cpu);
+    }
 
-static void (*g_log_callback)(char*, CpuRegisters) = NULL;
-static CpuRegisters g_regs_snapshot;
+    _take_snapshot(cpu);
+}
 
-void initialize_cpu(CpuSystemInterface system_iface) {
-    g_sys_iface = system_iface;
+CpuRegisters *cpu_get_registers(Cpu6502 *cpu) {
+    return &cpu->regs;
+}
 
-    memset(&g_cpu_regs, 0, sizeof(g_cpu_regs)); // clear registers for init
-    g_cpu_regs.status.serial = DEFAULT_STATUS;
+// whether anything observes the individual instructions being executed
+static inline bool _is_tracing(const Cpu6502 *cpu) {
+    return cpu->log_callback != NULL || cpu->trace_buf != NULL || cpu->trace_queue != NULL;
+}
 
-    g_queued_interrupt = &INT_RST;
+uint8_t cpu_get_instruction_step(const Cpu6502 *cpu) {
+    return cpu->instr_cycle;
+}
 
-    for (int i = 0; i < 7; i++) {
-        cycle_cpu();
-    }
+const Instruction *cpu_get_current_instruction(const Cpu6502 *cpu) {
+    return cpu->cur_instr;
+}
 
-    g_regs_snapshot = g_cpu_regs;
+void cpu_set_log_callback(Cpu6502 *cpu, void (*callback)(void*, char*, CpuRegisters)) {
+    cpu->log_callback = callback;
+    _take_snapshot(cpu);
 }
 
-CpuRegisters *cpu_get_registers(void) {
-    return &g_cpu_regs;
+void cpu_set_trace_buffer(Cpu6502 *cpu, CpuTraceRecord *buffer, size_t capacity) {
+    cpu->trace_buf = capacity != 0 ? buffer : NULL;
+    cpu->trace_capacity = capacity;
+    cpu->trace_index = 0;
+    cpu->trace_count = 0;
+    _take_snapshot(cpu);
 }
 
-uint8_t cpu_get_instruction_step(void) {
-    return g_instr_cycle;
+uint64_t cpu_get_trace_count(const Cpu6502 *cpu) {
+    return cpu->trace_count;
 }
 
-Instruction *cpu_get_current_instruction(void) {
-    return g_cur_instr;
+void cpu_set_trace_queue(Cpu6502 *cpu, TraceQueue *queue) {
+    cpu->trace_queue = queue;
+    _take_snapshot(cpu);
 }
 
-void cpu_set_log_callback(void (*callback)(char*, CpuRegisters)) {
-    g_log_callback = callback;
+static void _set_line(Cpu6502 *cpu, uint8_t line, bool low) {
+    cpu->pushed_lines = low ? cpu->pushed_lines | line : cpu->pushed_lines & ~line;
 }
 
-static unsigned char _next_prg_byte(void) {
-    return g_sys_iface.mem_read(g_cpu_regs.pc);
+void cpu_set_nmi_line(Cpu6502 *cpu, unsigned int level) {
+    _set_line(cpu, CPU_LINE_NMI, level == 0);
 }
 
-static void _set_alu_flags(uint8_t val) {
-    g_cpu_regs.status.zero = val ? 0 : 1;
-    g_cpu_regs.status.negative = (val & 0x80) ? 1 : 0;
+void cpu_set_irq_line(Cpu6502 *cpu, unsigned int level) {
+    _set_line(cpu, CPU_LINE_IRQ, level == 0);
 }
 
-static void _do_shift(bool right, bool rot) {
-    uint8_t res = right ? g_sys_iface.bus_read() >> 1 : g_sys_iface.bus_read() << 1;
+void cpu_set_rst_line(Cpu6502 *cpu, unsigned int level) {
+    _set_line(cpu, CPU_LINE_RST, level == 0);
+}
 
-    if (rot) {
-        if (right) {
-            res |= g_cpu_regs.status.carry << 7;
-        } else {
-            res |= g_cpu_regs.status.carry;
+bool cpu_schedule_line_change(Cpu6502 *cpu, CpuLine line, unsigned int level, uint64_t at_cycle) {
+    if (cpu->line_change_head == cpu->line_change_count) {
+        cpu->line_change_head = 0;
+        cpu->line_change_count = 0;
+    }
+
+    if (cpu->line_change_count == cpu->line_change_cap) {
+        size_t new_cap = cpu->line_change_cap != 0 ? cpu->line_change_cap * 2 : 16;
+        LineChange *changes = realloc(cpu->line_changes, new_cap * sizeof(LineChange));
+        if (changes == NULL) {
+            return false;
         }
+        cpu->line_changes = changes;
+        cpu->line_change_cap = new_cap;
     }
 
-    if (right) {
-        g_cpu_regs.status.carry = g_sys_iface.bus_read() & 1;
-    } else {
-        g_cpu_regs.status.carry = (g_sys_iface.bus_read() & 0x80) >> 7;
+    // changes are usually scheduled in order, so the search for the insertion point starts from the back
+    size_t pos = cpu->line_change_count;
+    while (pos > cpu->line_change_head && cpu->line_changes[pos - 1].cycle > at_cycle) {
+        cpu->line_changes[pos] = cpu->line_changes[pos - 1];
+        pos--;
     }
 
-    _set_alu_flags(res);
+    cpu->line_changes[pos] = (LineChange) {at_cycle, line, level == 0};
+    cpu->line_change_count++;
 
-    g_sys_iface.bus_write(res);
+    return true;
 }
 
-static void _do_cmp(uint8_t reg, uint8_t m) {
-    g_cpu_regs.status.carry = reg >= m;
-    g_cpu_regs.status.zero = reg == m;
-    g_cpu_regs.status.negative = ((uint8_t) (reg - m)) >> 7;
+void cpu_record_lines(Cpu6502 *cpu, CpuLineEvent *events, size_t capacity) {
+    cpu->line_record = events;
+    cpu->line_record_capacity = events != NULL ? capacity : 0;
+    cpu->line_record_count = 0;
+    cpu->line_record_last = 0xFF;
 }
 
-static void _do_adc(uint8_t m) {
-    uint8_t acc0 = g_cpu_regs.acc;
+size_t cpu_get_line_event_count(const Cpu6502 *cpu) {
+    return cpu->line_record_count;
+}
 
-    g_cpu_regs.acc = (acc0 + m + g_cpu_regs.status.carry);
+void cpu_replay_lines(Cpu6502 *cpu, const CpuLineEvent *events, size_t count) {
+    cpu->line_replay = events;
+    cpu->line_replay_count = events != NULL ? count : 0;
+    cpu->line_replay_next = 0;
+}
 
-    _set_alu_flags(g_cpu_regs.acc);
+uint64_t cpu_get_cycle_count(const Cpu6502 *cpu) {
+    return cpu->cycle_count;
+}
 
-    // unsigned overflow will occur if at least two among the most significant operand bits and the carry bit are set
-    g_cpu_regs.status.carry = ((acc0 + m + g_cpu_regs.status.carry) & 0x100) ? 1 : 0;
+bool cpu_is_jammed(const Cpu6502 *cpu) {
+    return cpu->jammed;
+}
 
-    // signed overflow will occur if the sign of both inputs if different from the sign of the result
-    g_cpu_regs.status.overflow = ((acc0 ^ g_cpu_regs.acc) & (m ^ g_cpu_regs.acc) & 0x80) ? 1 : 0;
+void cpu_set_stop_pc(Cpu6502 *cpu, uint16_t pc) {
+    cpu->stop_pc = pc;
 }
 
-static void _do_sbc(uint8_t m) {
-    _do_adc(~m);
+void cpu_set_stop_mnemonic(Cpu6502 *cpu, Mnemonic mnemonic) {
+    cpu->stop_mnemonic = mnemonic;
 }
 
-void _do_instr_operation() {
-    switch (g_cur_instr->mnemonic) {
-        // storage
-        case LDA:
-            g_cpu_regs.acc = g_sys_iface.bus_read();
+bool cpu_set_breakpoint(Cpu6502 *cpu, uint16_t addr, bool enabled) {
+    if (!cpu->breakpoints) {
+        if (!enabled) {
+            return true;
+        }
 
-            _set_alu_flags(g_cpu_regs.acc);
+        if (!(cpu->breakpoints = calloc(0x10000 / 8, 1))) {
+            return false;
+        }
+    }
 
-            break;
-        case LDX:
-            g_cpu_regs.x = g_sys_iface.bus_read();
+    if (enabled) {
+        cpu->breakpoints[addr >> 3] |= 1 << (addr & 7);
+    } else {
+        cpu->breakpoints[addr >> 3] &= ~(1 << (addr & 7));
+    }
 
-            _set_alu_flags(g_cpu_regs.x);
+    return true;
+}
 
-            break;
-        case LDY:
-            g_cpu_regs.y = g_sys_iface.bus_read();
+void cpu_clear_breakpoints(Cpu6502 *cpu) {
+    free(cpu->breakpoints);
+    cpu->breakpoints = NULL;
+}
 
-            _set_alu_flags(g_cpu_regs.y);
+void cpu_request_stop(Cpu6502 *cpu) {
+    cpu->stop_requested = true;
+}
 
-            break;
-        case LAX: // unofficial
-            g_cpu_regs.acc = g_sys_iface.bus_read();
-            g_cpu_regs.x = g_sys_iface.bus_read();
+void cpu_set_idle_skip(Cpu6502 *cpu, bool enabled) {
+    cpu->idle_skip = enabled;
+    cpu->idle_watching = false;
+}
 
-            _set_alu_flags(g_sys_iface.bus_read());
+uint64_t cpu_get_idle_skipped_cycles(const Cpu6502 *cpu) {
+    return cpu->idle_skipped;
+}
 
-            break;
-        case STA:
-            g_sys_iface.bus_write(g_cpu_regs.acc);
-            break;
-        case STX:
-            g_sys_iface.bus_write(g_cpu_regs.x);
-            break;
-        case STY:
-            g_sys_iface.bus_write(g_cpu_regs.y);
-            break;
-        case TAX:
-            g_cpu_regs.x = g_cpu_regs.acc;
+CpuStopCondition cpu_get_stop_reason(const Cpu6502 *cpu) {
+    return cpu->stop_reason;
+}
 
-            _set_alu_flags(g_cpu_regs.x);
+static void _unlink_page_alias(Cpu6502 *cpu, uint8_t page) {
+    uint8_t prev = page;
+    while (cpu->page_alias[prev] != page) {
+        prev = cpu->page_alias[prev];
+    }
 
-            break;
-        case TAY:
-            g_cpu_regs.y = g_cpu_regs.acc;
+    cpu->page_alias[prev] = cpu->page_alias[page];
+    cpu->page_alias[page] = page;
+}
 
-            _set_alu_flags(g_cpu_regs.y);
+// pages backed by the same host memory share a ring so that a write through one of them is seen by all of them
+static void _link_page_alias(Cpu6502 *cpu, uint8_t page) {
+    if (cpu->page_map[page] == NULL) {
+        return;
+    }
 
-            break;
-        case TSX:
-            g_cpu_regs.x = g_cpu_regs.sp;
+    for (size_t other = 0; other < 0x100; other++) {
+        if (other != page && cpu->page_map[other] == cpu->page_map[page]) {
+            cpu->page_alias[page] = cpu->page_alias[other];
+            cpu->page_alias[other] = page;
+            return;
+        }
+    }
+}
 
-            _set_alu_flags(g_cpu_regs.x);
+// marks the contents of a page, and of any page aliasing the same host memory, as changed
+static inline void _touch_page(Cpu6502 *cpu, uint8_t page) {
+    uint8_t cur = page;
+    do {
+        cpu->page_gen[cur]++;
+        cpu->page_dirty[cur] = cpu->dirty_epoch;
+        cur = cpu->page_alias[cur];
+    } while (cur != page);
+}
 
-            break;
-        case TXA:
-            g_cpu_regs.acc = g_cpu_regs.x;
+static void _drop_owned_page(OwnedPage *owned) {
+    if (owned != NULL && atomic_fetch_sub(&owned->refs, 1) == 1) {
+        free(owned);
+    }
+}
 
-            _set_alu_flags(g_cpu_regs.acc);
+// drops the reference the page table entry holds to the owned page behind it, if any
+static void _release_owned_page(Cpu6502 *cpu, uint8_t page) {
+    _drop_owned_page(cpu->page_owned[page]);
+    cpu->page_owned[page] = NULL;
+}
 
-            break;
-        case TYA:
-            g_cpu_regs.acc = g_cpu_regs.y;
+static void _set_page(Cpu6502 *cpu, uint8_t page, uint8_t *mem, uint8_t flags, OwnedPage *owned) {
+    _unlink_page_alias(cpu, page);
 
-            _set_alu_flags(g_cpu_regs.acc);
+    if (owned != NULL) {
+        atomic_fetch_add(&owned->refs, 1);
+    }
+    _release_owned_page(cpu, page);
 
-            break;
-        case TXS:
-            g_cpu_regs.sp = g_cpu_regs.x;
-            break;
-        // math
-        case ADC: {
-            _do_adc(g_sys_iface.bus_read());
+    cpu->page_map[page] = mem;
+    cpu->page_flags[page] = flags;
+    cpu->page_owned[page] = owned;
+    cpu->page_gen[page]++;
 
-            break;
-        }
-        case SBC: {
-            _do_sbc(g_sys_iface.bus_read());
+    _link_page_alias(cpu, page);
+}
 
-            break;
-        }
-        case DEC: {
-            g_sys_iface.bus_write(g_sys_iface.bus_read() - 1);
+bool cpu_map_memory(Cpu6502 *cpu, uint16_t addr, size_t len, uint8_t *mem, unsigned int flags) {
+    if ((addr & 0xFF) || (len & 0xFF) || addr + len > 0x10000) {
+        return false;
+    }
 
-            _set_alu_flags(g_sys_iface.bus_read());
+    for (size_t i = 0; i < len >> 8; i++) {
+        uint8_t page = (addr >> 8) + i;
 
-            break;
+        if (mem != NULL) {
+            _set_page(cpu, page, mem + (i << 8), flags & ~CPU_PAGE_IDEMPOTENT, NULL);
+        } else {
+            _set_page(cpu, page, NULL, flags & CPU_PAGE_IDEMPOTENT, NULL);
         }
-        case DEX:
-            g_cpu_regs.x--;
-
-            _set_alu_flags(g_cpu_regs.x);
+        cpu->page_dirty[page] = cpu->dirty_epoch;
+    }
 
-            break;
-        case DEY:
-            g_cpu_regs.y--;
+    return true;
+}
 
-            _set_alu_flags(g_cpu_regs.y);
+bool cpu_unmap_memory(Cpu6502 *cpu, uint16_t addr, size_t len) {
+    return cpu_map_memory(cpu, addr, len, NULL, 0);
+}
 
-            break;
-        case INC: {
-            g_sys_iface.bus_write(g_sys_iface.bus_read() + 1);
+// the lowest of the read-write pages mapping the same host memory as the given one
+static uint8_t _first_writable_alias(const Cpu6502 *cpu, uint8_t page) {
+    uint8_t first = page;
+    for (uint8_t alias = cpu->page_alias[page]; alias != page; alias = cpu->page_alias[alias]) {
+        if (alias < first && cpu->page_flags[alias] == CPU_PAGE_READ_WRITE) {
+            first = alias;
+        }
+    }
 
-            _set_alu_flags(g_sys_iface.bus_read());
+    return first;
+}
 
-            break;
-        }
-        case INX:
-            g_cpu_regs.x++;
+// Returns a copy of the host memory behind the page as it is now, reusing the one taken for the previous clone if the
+// page has not been written since.
+static OwnedPage *_snapshot_page(Cpu6502 *cpu, uint8_t page) {
+    if (cpu->page_snapshot[page] != NULL && cpu->snapshot_gen[page] == cpu->page_gen[page]) {
+        return cpu->page_snapshot[page];
+    }
 
-            _set_alu_flags(g_cpu_regs.x);
+    OwnedPage *snapshot = malloc(sizeof(OwnedPage));
+    if (snapshot == NULL) {
+        return NULL;
+    }
+    atomic_init(&snapshot->refs, 1);
+    memcpy(snapshot->data, cpu->page_map[page], sizeof(snapshot->data));
 
-            break;
-        case INY:
-            g_cpu_regs.y++;
+    _drop_owned_page(cpu->page_snapshot[page]);
+    cpu->page_snapshot[page] = snapshot;
+    cpu->snapshot_gen[page] = cpu->page_gen[page];
 
-            _set_alu_flags(g_cpu_regs.y);
+    return snapshot;
+}
 
-            break;
-        case ISC: // unofficial
-            g_sys_iface.bus_write(g_sys_iface.bus_read() + 1);
-            _do_sbc(g_sys_iface.bus_read());
+Cpu6502 *cpu_clone(Cpu6502 *cpu, CpuSystemInterface system_iface) {
+    Cpu6502 *clone = malloc(sizeof(Cpu6502));
+    if (clone == NULL) {
+        return NULL;
+    }
 
-            break;
-        case DCP: // unofficial
-            g_sys_iface.bus_write(g_sys_iface.bus_read() - 1);
-            _do_cmp(g_cpu_regs.acc, g_sys_iface.bus_read());
+    memcpy(clone, cpu, sizeof(Cpu6502));
+    clone->sys_iface = system_iface;
+
+    // the clone starts out owning nothing, so that it can be destroyed at any point below
+    memset(clone->page_owned, 0, sizeof(clone->page_owned));
+    memset(clone->page_snapshot, 0, sizeof(clone->page_snapshot));
+    clone->line_changes = NULL;
+    clone->line_change_cap = 0;
+    clone->breakpoints = NULL;
+    clone->block_cache = NULL;
+    clone->cur_block = NULL;
+    clone->jit = NULL;
+
+    // nor does it report to whatever observes the original
+    clone->log_callback = NULL;
+    clone->trace_buf = NULL;
+    clone->trace_capacity = 0;
+    clone->trace_index = 0;
+    clone->trace_count = 0;
+    clone->trace_queue = NULL;
+    cpu_record_lines(clone, NULL, 0);
+
+    if (cpu->line_changes != NULL) {
+        if ((clone->line_changes = malloc(cpu->line_change_cap * sizeof(LineChange))) == NULL) {
+            cpu_destroy(clone);
+            return NULL;
+        }
+        memcpy(clone->line_changes, cpu->line_changes, cpu->line_change_count * sizeof(LineChange));
+        clone->line_change_cap = cpu->line_change_cap;
+    }
 
-            break;
-        // logic
-        case AND:
-            g_cpu_regs.acc &= g_sys_iface.bus_read();
+    if (cpu->breakpoints != NULL) {
+        if ((clone->breakpoints = malloc(0x10000 / 8)) == NULL) {
+            cpu_destroy(clone);
+            return NULL;
+        }
+        memcpy(clone->breakpoints, cpu->breakpoints, 0x10000 / 8);
+    }
 
-            _set_alu_flags(g_cpu_regs.acc);
+    if ((cpu->block_cache != NULL && !cpu_set_block_cache(clone, true))
+            || (cpu->jit != NULL && (clone->jit = jit_arena_create()) == NULL)) {
+        cpu_destroy(clone);
+        return NULL;
+    }
 
-            break;
-        case SAX: { // unofficial
-            uint8_t res = g_cpu_regs.acc & g_cpu_regs.x;
-            g_sys_iface.bus_write(res);
+    for (size_t page = 0; page < 0x100; page++) {
+        OwnedPage *owned = cpu->page_owned[page];
+
+        if (owned != NULL) {
+            // neither CPU may write to the page in place any more
+            atomic_fetch_add(&owned->refs, 1);
+            clone->page_owned[page] = owned;
+            cpu->page_flags[page] |= CPU_PAGE_COPY_ON_WRITE;
+            clone->page_flags[page] |= CPU_PAGE_COPY_ON_WRITE;
+        } else if (cpu->page_map[page] != NULL && cpu->page_flags[page] == CPU_PAGE_READ_WRITE) {
+            // The host keeps writing its memory through the original, so the clone gets a snapshot of it. Its mirrors
+            // share the snapshot taken for the first of them.
+            uint8_t first = _first_writable_alias(cpu, page);
+            OwnedPage *snapshot = first == page ? _snapshot_page(cpu, page) : clone->page_owned[first];
+            if (snapshot == NULL) {
+                cpu_destroy(clone);
+                return NULL;
+            }
 
-            break;
-        }
-        case ANC: { // unofficial
-            g_cpu_regs.acc &= g_sys_iface.bus_read();
-            g_cpu_regs.status.carry = g_cpu_regs.acc >> 7;
-            break;
+            _set_page(clone, page, snapshot->data, CPU_PAGE_COPY_ON_WRITE, snapshot);
         }
-        case ASL:
-            _do_shift(false, false);
-            break;
-        case LSR:
-            _do_shift(true, false);
-            break;
-        case ROL:
-            _do_shift(false, true);
-            break;
-        case ROR:
-            _do_shift(true, true);
-            break;
-        case ALR: // unofficial
-            _do_shift(true, false);
-            break;
-        case SLO: { // unofficial
-            _do_shift(false, false);
-            g_cpu_regs.acc |= g_sys_iface.bus_read();
 
-            _set_alu_flags(g_cpu_regs.acc);
+        // anything else is either left to the system interface or host memory which the CPU never writes to
+    }
 
-            break;
-        }
-        case RLA: { // unofficial
-            // I think this performs two r/w cycles too
-            _do_shift(false, true);
+    return clone;
+}
 
-            g_cpu_regs.acc &= g_sys_iface.bus_read();
+bool cpu_set_block_cache(Cpu6502 *cpu, bool enabled) {
+    if (!enabled) {
+        free(cpu->block_cache);
+        cpu->block_cache = NULL;
+        cpu->cur_block = NULL;
+        return true;
+    }
 
-            _set_alu_flags(g_cpu_regs.acc);
+    if (!cpu->block_cache && !(cpu->block_cache = calloc(BLOCK_CACHE_SIZE, sizeof(CodeBlock)))) {
+        return false;
+    }
 
-            break;
+    return true;
+}
+
+uint64_t cpu_mark_dirty_pages(Cpu6502 *cpu) {
+    return ++cpu->dirty_epoch;
+}
+
+size_t cpu_dirty_pages_since(const Cpu6502 *cpu, uint64_t mark, uint8_t *pages) {
+    size_t count = 0;
+    for (size_t page = 0; page < 0x100; page++) {
+        if (cpu->page_dirty[page] >= mark) {
+            pages[count++] = page;
         }
-        case ARR: // unofficial
-            g_cpu_regs.acc &= g_sys_iface.bus_read();
+    }
+
+    return count;
+}
 
-            _do_shift(true, true);
+void cpu_invalidate_code(Cpu6502 *cpu, uint16_t addr, size_t len) {
+    if (len == 0) {
+        return;
+    }
 
-            _set_alu_flags(g_cpu_regs.acc);
+    size_t last_page = (addr + len - 1) >> 8;
+    if (last_page > 0xFF) {
+        last_page = 0xFF;
+    }
 
-            g_cpu_regs.status.overflow = (g_cpu_regs.acc >> 5) & 1;
-            g_cpu_regs.status.carry = !((g_cpu_regs.acc >> 6) & 1);
-            
-            break;
-        case SRE: { // unofficial
-            _do_shift(true, false);
+    for (size_t page = addr >> 8; page <= last_page; page++) {
+        _touch_page(cpu, page);
+    }
+}
 
-            g_cpu_regs.acc ^= g_sys_iface.bus_read();
+static inline uint8_t _mem_read(Cpu6502 *cpu, uint16_t addr) {
+    uint8_t *page = cpu->page_map[addr >> 8];
+    if (page != NULL) {
+        return page[addr & 0xFF];
+    }
 
-            _set_alu_flags(g_cpu_regs.acc);
+    return cpu->sys_iface.mem_read(cpu->sys_iface.userdata, addr);
+}
 
-            break;
+// memory the CPU holds the only references to is taken over as is, anything else is copied into a new owned page
+bool cpu_copy_page(Cpu6502 *cpu, uint8_t page) {
+    uint8_t *shared = cpu->page_map[page];
+    OwnedPage *owned = cpu->page_owned[page];
+
+    // every page of the ring maps the same memory, but only the copy-on-write ones follow the copy
+    uint8_t pages[0x100];
+    size_t count = 0;
+    size_t ring_size = 0;
+    uint8_t cur = page;
+    do {
+        if (cpu->page_flags[cur] & CPU_PAGE_COPY_ON_WRITE) {
+            pages[count++] = cur;
         }
-        case RRA: { // unofficial
-            _do_shift(true, true);
-
-            _do_adc(g_sys_iface.bus_read());
+        ring_size++;
+        cur = cpu->page_alias[cur];
+    } while (cur != page);
 
-            break;
+    if (owned != NULL && atomic_load(&owned->refs) == ring_size) {
+        for (size_t i = 0; i < count; i++) {
+            cpu->page_flags[pages[i]] &= ~CPU_PAGE_COPY_ON_WRITE;
         }
-        case AXS: { // unofficial
-            g_cpu_regs.x &= g_cpu_regs.acc;
-            uint8_t res = g_cpu_regs.x - g_sys_iface.bus_read();
+        return true;
+    }
 
-            g_cpu_regs.status.carry = res > g_sys_iface.bus_read();
+    OwnedPage *copy = malloc(sizeof(OwnedPage));
+    if (copy == NULL) {
+        return false;
+    }
+    atomic_init(&copy->refs, 0);
+    memcpy(copy->data, shared, sizeof(copy->data));
 
-            g_cpu_regs.x = res;
+    for (size_t i = 0; i < count; i++) {
+        _set_page(cpu, pages[i], copy->data, cpu->page_flags[pages[i]] & ~CPU_PAGE_COPY_ON_WRITE, copy);
+    }
 
-            _set_alu_flags(g_cpu_regs.x);
+    return true;
+}
 
-            break;
+static inline void _mem_write(Cpu6502 *cpu, uint16_t addr, uint8_t val) {
+    uint8_t *page = cpu->page_map[addr >> 8];
+    if (page != NULL) {
+        uint8_t flags = cpu->page_flags[addr >> 8];
+        if (flags == 0) {
+            page[addr & 0xFF] = val;
+            _touch_page(cpu, addr >> 8);
+            return;
+        } else if (flags & CPU_PAGE_WRITE_IGNORE) {
+            return;
+        } else if (flags == CPU_PAGE_COPY_ON_WRITE && cpu_copy_page(cpu, addr >> 8)) {
+            cpu->page_map[addr >> 8][addr & 0xFF] = val;
+            _touch_page(cpu, addr >> 8);
+            return;
         }
-        case EOR:
-            g_cpu_regs.acc = g_cpu_regs.acc ^ g_sys_iface.bus_read();
+        // writes to read-only pages are passed on to the system so it can e.g. handle bank switching
+    }
 
-            _set_alu_flags(g_cpu_regs.acc);
+    // there is no telling what the system does with the write, so the page is assumed to have changed
+    cpu->page_dirty[addr >> 8] = cpu->dirty_epoch;
+    cpu->sys_iface.mem_write(cpu->sys_iface.userdata, addr, val);
+}
 
-            break;
-        case ORA:
-            g_cpu_regs.acc = g_cpu_regs.acc | g_sys_iface.bus_read();
+static uint8_t _bus_read(Cpu6502 *cpu) {
+    return cpu->sys_iface.bus_read(cpu->sys_iface.userdata);
+}
 
-            _set_alu_flags(g_cpu_regs.acc);
+static void _bus_write(Cpu6502 *cpu, uint8_t val) {
+    cpu->sys_iface.bus_write(cpu->sys_iface.userdata, val);
+}
 
-            break;
-        case BIT:
-            // set negative and overflow flags from memory
-            g_cpu_regs.status.negative = g_sys_iface.bus_read() >> 7;
-            g_cpu_regs.status.overflow = (g_sys_iface.bus_read() >> 6) & 1;
+static unsigned char _next_prg_byte(Cpu6502 *cpu) {
+    return _mem_read(cpu, cpu->regs.pc);
+}
 
-            // mask accumulator with value and set zero flag appropriately
-            g_cpu_regs.status.zero = (g_cpu_regs.acc & g_sys_iface.bus_read()) == 0;
-            break;
-        case TAS: { // unofficial
-            // this some fkn voodo right here
-            g_cpu_regs.sp = g_cpu_regs.acc & g_cpu_regs.x;
-            g_sys_iface.bus_write(g_cpu_regs.sp & ((g_cur_operand >> 8) + 1));
+// The ALU helpers work out all of the flags an operation affects and then replace them in the status register with a
+// single store, rather than updating its bitfields one at a time.
 
-            break;
-        }
-        case LAS: { // unofficial
-            g_cpu_regs.acc = g_sys_iface.bus_read() & g_cpu_regs.sp;
-            g_cpu_regs.x = g_cpu_regs.acc;
-            g_cpu_regs.sp = g_cpu_regs.acc;
+// returns the negative and zero flags for a result
+static inline uint8_t _nz_flags(uint8_t val) {
+    return (val & STATUS_N) | (val ? 0 : STATUS_Z);
+}
 
-            _set_alu_flags(g_cpu_regs.acc);
+// replaces the flags in mask with the given ones
+static inline void _set_flags(Cpu6502 *cpu, uint8_t mask, uint8_t flags) {
+    cpu->regs.status.serial = (cpu->regs.status.serial & ~mask) | flags;
+}
 
-            break;
-        }
-        case XAS: { // unofficial
-            //TODO: this instruction is supposed to take 5 cycles; currently it takes 7
-            g_sys_iface.bus_write(g_cpu_regs.x & ((g_cur_operand >> 8) + 1));
-            break;
-        }
-        case SAY: { // unofficial
-            //TODO: same deal as XAS
-            g_sys_iface.bus_write(g_cpu_regs.y & ((g_cur_operand >> 8) + 1));
-            break;
-        }
-        case AXA: { // unofficial
-            //TODO: same deal as AXA, except it has two addressing modes
-            g_sys_iface.bus_write((g_cpu_regs.acc & g_cpu_regs.x) & 7);
-            break;
-        }
-        case XAA: { // unofficial
-            // even more voodoo
-            g_cpu_regs.acc = (g_cpu_regs.x & 0xEE) | ((g_cpu_regs.x & g_cpu_regs.acc) & 0x11);
-            break;
+static inline void _set_alu_flags(Cpu6502 *cpu, uint8_t val) {
+    _set_flags(cpu, STATUS_N | STATUS_Z, _nz_flags(val));
+}
+
+static void _do_shift(Cpu6502 *cpu, bool right, bool rot) {
+    uint8_t res = right ? _bus_read(cpu) >> 1 : _bus_read(cpu) << 1;
+
+    if (rot) {
+        if (right) {
+            res |= cpu->regs.status.carry << 7;
+        } else {
+            res |= cpu->regs.status.carry;
         }
-        // registers
-        case CLC:
-            g_cpu_regs.status.carry = 0;
-            break;
-        case CLD:
-            g_cpu_regs.status.decimal = 0;
-            break;
-        case CLI:
-            g_cpu_regs.status.interrupt_disable = 0;
-            break;
-        case CLV:
-            g_cpu_regs.status.overflow = 0;
-            break;
-        case CMP:
-            _do_cmp(g_cpu_regs.acc, g_sys_iface.bus_read());
-            break;
-        case CPX:
-            _do_cmp(g_cpu_regs.x, g_sys_iface.bus_read());
-            break;
-        case CPY:
-            _do_cmp(g_cpu_regs.y, g_sys_iface.bus_read());
-            break;
-        case SEC:
-            g_cpu_regs.status.carry = 1;
-            break;
-        case SED:
-            g_cpu_regs.status.decimal = 1;
-            break;
-        case SEI:
-            g_cpu_regs.status.interrupt_disable = 1;
-            break;
-        // misc
-        case NOP:
-            // no-op
-            break;
-        case KIL:
-        default:
-            printf("Encountered %s instruction @ $%04X\n", mnemonic_to_str(g_cur_instr->mnemonic), g_cpu_regs.pc - 1);
-            exit(-1);
     }
-}
 
-static void _reset_instr_state(void) {
-    g_cur_operand = 0; // reset current operand
-    g_eff_operand = 0; // reset effective operand
-    g_sys_iface.bus_write(0); // reset data value
+    uint8_t carry = right ? _bus_read(cpu) & 1 : (_bus_read(cpu) & 0x80) >> 7;
+
+    _set_flags(cpu, STATUS_N | STATUS_Z | STATUS_C, _nz_flags(res) | carry);
 
-    g_instr_cycle = 1; // skip opcode fetching
+    _bus_write(cpu, res);
 }
 
-static void _read_interrupt_lines(void) {
-    g_nmi_edge_detector |= (g_nmi_line_last_state == 1 && g_sys_iface.poll_nmi_line() == 0);
+static void _do_cmp(Cpu6502 *cpu, uint8_t reg, uint8_t m) {
+    _set_flags(cpu, STATUS_N | STATUS_Z | STATUS_C, _nz_flags(reg - m) | (reg >= m));
+}
+
+static void _do_adc(Cpu6502 *cpu, uint8_t m) {
+    uint8_t acc0 = cpu->regs.acc;
+    unsigned int sum = acc0 + m + cpu->regs.status.carry;
+
+    cpu->regs.acc = sum;
+
+    // unsigned overflow will occur if at least two among the most significant operand bits and the carry bit are set
+    uint8_t carry = sum >> 8;
 
-    g_nmi_line_last_state = g_sys_iface.poll_nmi_line();
+    // signed overflow will occur if the sign of both inputs if different from the sign of the result
+    uint8_t overflow = ((acc0 ^ cpu->regs.acc) & (m ^ cpu->regs.acc) & 0x80) >> 1;
 
-    g_irq_line_reader = g_sys_iface.poll_irq_line() == 0;
-    g_rst_line_reader = g_sys_iface.poll_rst_line() == 0;
+    _set_flags(cpu, STATUS_N | STATUS_Z | STATUS_C | STATUS_V, _nz_flags(cpu->regs.acc) | carry | overflow);
 }
 
-static void _poll_interrupts(void) {
-    if (g_nmi_edge_detector) {
-        g_queued_interrupt = &INT_NMI;
-    } else if (g_irq_line_reader && !g_cpu_regs.status.interrupt_disable) {
-        g_queued_interrupt = &INT_IRQ;
-    } else if (g_rst_line_reader) {
-        g_queued_interrupt = &INT_RST;
-    }
+static void _do_sbc(Cpu6502 *cpu, uint8_t m) {
+    _do_adc(cpu, ~m);
 }
 
-static void _execute_interrupt(void) {
-    ASSERT_CYCLE(1, 7);
+static void _op_lda(Cpu6502 *cpu) {
+    cpu->regs.acc = _bus_read(cpu);
 
-    switch (g_instr_cycle) {
-        case 1:
-            _next_prg_byte(); // garbage read
-            g_last_opcode = 0; // BRK
+    _set_alu_flags(cpu, cpu->regs.acc);
+}
 
-            if (g_cur_interrupt == &INT_BRK && g_nmi_edge_detector) {
-                g_nmi_hijack = true;
-            }
+static void _op_ldx(Cpu6502 *cpu) {
+    cpu->regs.x = _bus_read(cpu);
 
-            break;
-        case 2:
-            _next_prg_byte(); // garbage read
-            if (g_cur_interrupt == &INT_BRK) {
-                g_cpu_regs.pc++; // increment PC anyway for software interrupts
-            }
+    _set_alu_flags(cpu, cpu->regs.x);
+}
 
-            if (g_cur_interrupt == &INT_BRK && g_nmi_edge_detector) {
-                g_nmi_hijack = true;
-            }
+static void _op_ldy(Cpu6502 *cpu) {
+    cpu->regs.y = _bus_read(cpu);
 
-            break;
-        case 3:
-            if (g_cur_interrupt->push_pc) {
-                // push PC high, decrement S
-                g_sys_iface.mem_write(STACK_BOTTOM_ADDR + g_cpu_regs.sp, g_cpu_regs.pc >> 8);
-            }
-            g_cpu_regs.sp--;
+    _set_alu_flags(cpu, cpu->regs.y);
+}
 
-            if (g_cur_interrupt == &INT_BRK && g_nmi_edge_detector) {
-                g_nmi_hijack = true;
-            }
+static void _op_lax(Cpu6502 *cpu) { // unofficial
+    cpu->regs.acc = _bus_read(cpu);
+    cpu->regs.x = _bus_read(cpu);
 
-            break;
-        case 4:
-            if (g_cur_interrupt->push_pc) {
-                // push PC low, decrement S
-                g_sys_iface.mem_write(STACK_BOTTOM_ADDR + g_cpu_regs.sp, g_cpu_regs.pc & 0xFF);
-            }
-            g_cpu_regs.sp--;
+    _set_alu_flags(cpu, _bus_read(cpu));
+}
 
-            if (g_cur_interrupt == &INT_BRK && g_nmi_edge_detector) {
-                g_nmi_hijack = true;
-            }
+static void _op_sta(Cpu6502 *cpu) {
+    _bus_write(cpu, cpu->regs.acc);
+}
 
-            break;
-        case 5:
-            if (g_nmi_hijack) {
-                g_cur_interrupt = &INT_NMI;
-                g_nmi_hijack = false;
-            }
+static void _op_stx(Cpu6502 *cpu) {
+    _bus_write(cpu, cpu->regs.x);
+}
 
-            if (g_cur_interrupt->push_pc) {
-                // push P, decrement S, set/clear B
-                g_cpu_regs.status.break_command = g_cur_interrupt->set_b;
+static void _op_sty(Cpu6502 *cpu) {
+    _bus_write(cpu, cpu->regs.y);
+}
 
-                uint8_t val = g_cpu_regs.status.serial;
-                if (g_cur_interrupt == &INT_BRK) {
-                    val |= 0x30;
-                }
-                
-                g_sys_iface.mem_write(STACK_BOTTOM_ADDR + g_cpu_regs.sp, val);
-            }
-            g_cpu_regs.sp--;
-            break;
-        case 6:
-            // clear PC low and set to vector value
-            g_cpu_regs.pc &= ~0xFF;
-            g_cpu_regs.pc |= g_sys_iface.mem_read(g_cur_interrupt->vector_loc);
+static void _op_tax(Cpu6502 *cpu) {
+    cpu->regs.x = cpu->regs.acc;
 
-            if (g_cur_interrupt->set_i) {
-                g_cpu_regs.status.interrupt_disable = 1;
-            }
-            break;
-        case 7: {
-            // clear PC high and set to vector value
-            g_cpu_regs.pc &= ~0xFF00;
-            g_cpu_regs.pc |= (g_sys_iface.mem_read(g_cur_interrupt->vector_loc + 1) << 8);
-            g_instr_cycle = 0; // reset for next instruction
-
-            if (g_cur_interrupt == &INT_NMI) {
-                g_nmi_edge_detector = false;
-            } else if (g_cur_interrupt == &INT_IRQ) {
-                g_irq_line_reader = false;
-            } else if (g_cur_interrupt == &INT_BRK || g_cur_interrupt == &INT_RST) {
-                g_rst_line_reader = false;
-            }
+    _set_alu_flags(cpu, cpu->regs.x);
+}
 
-            g_cur_interrupt = NULL;
+static void _op_tay(Cpu6502 *cpu) {
+    cpu->regs.y = cpu->regs.acc;
 
-            // update the register snapshot to reflect state after the interrupt
-            g_regs_snapshot = g_cpu_regs;
+    _set_alu_flags(cpu, cpu->regs.y);
+}
 
-            break;
-        }
-    }
+static void _op_tsx(Cpu6502 *cpu) {
+    cpu->regs.x = cpu->regs.sp;
+
+    _set_alu_flags(cpu, cpu->regs.x);
 }
 
-static void _handle_rti(void) {
-    ASSERT_CYCLE(2, 6);
-    
-    switch (g_instr_cycle) {
-        case 2:
-            _next_prg_byte(); // garbage read
-            break;
-        case 3:
-            // increment S
-            g_cpu_regs.sp++;
-            break;
-        case 4:
-            // pull P, increment S
-            g_cpu_regs.status.serial = g_sys_iface.mem_read(STACK_BOTTOM_ADDR + g_cpu_regs.sp);
-            g_cpu_regs.sp++;
-            break;
-        case 5:
-            // clear PC low and set to stack value, increment S
-            g_cpu_regs.pc &= ~0xFF;
-            g_cpu_regs.pc |= g_sys_iface.mem_read(STACK_BOTTOM_ADDR + g_cpu_regs.sp);
-            g_cpu_regs.sp++;
+static void _op_txa(Cpu6502 *cpu) {
+    cpu->regs.acc = cpu->regs.x;
 
-            break;
-        case 6:
-            // clear PC high and set to stack value
-            g_cpu_regs.pc &= ~0xFF00;
-            g_cpu_regs.pc |= g_sys_iface.mem_read(STACK_BOTTOM_ADDR + g_cpu_regs.sp) << 8;
+    _set_alu_flags(cpu, cpu->regs.acc);
+}
 
-            g_instr_cycle = 0; // reset for next instruction
-            break;
-    }
+static void _op_tya(Cpu6502 *cpu) {
+    cpu->regs.acc = cpu->regs.y;
+
+    _set_alu_flags(cpu, cpu->regs.acc);
 }
 
-static void _handle_rts(void) {
+static void _op_txs(Cpu6502 *cpu) {
+    cpu->regs.sp = cpu->regs.x;
+}
+
+static void _op_adc(Cpu6502 *cpu) {
+    _do_adc(cpu, _bus_read(cpu));
+}
+
+static void _op_sbc(Cpu6502 *cpu) {
+    _do_sbc(cpu, _bus_read(cpu));
+}
+
+static void _op_dec(Cpu6502 *cpu) {
+    _bus_write(cpu, _bus_read(cpu) - 1);
+
+    _set_alu_flags(cpu, _bus_read(cpu));
+}
+
+static void _op_dex(Cpu6502 *cpu) {
+    cpu->regs.x--;
+
+    _set_alu_flags(cpu, cpu->regs.x);
+}
+
+static void _op_dey(Cpu6502 *cpu) {
+    cpu->regs.y--;
+
+    _set_alu_flags(cpu, cpu->regs.y);
+}
+
+static void _op_inc(Cpu6502 *cpu) {
+    _bus_write(cpu, _bus_read(cpu) + 1);
+
+    _set_alu_flags(cpu, _bus_read(cpu));
+}
+
+static void _op_inx(Cpu6502 *cpu) {
+    cpu->regs.x++;
+
+    _set_alu_flags(cpu, cpu->regs.x);
+}
+
+static void _op_iny(Cpu6502 *cpu) {
+    cpu->regs.y++;
+
+    _set_alu_flags(cpu, cpu->regs.y);
+}
+
+static void _op_isc(Cpu6502 *cpu) { // unofficial
+    _bus_write(cpu, _bus_read(cpu) + 1);
+    _do_sbc(cpu, _bus_read(cpu));
+}
+
+static void _op_dcp(Cpu6502 *cpu) { // unofficial
+    _bus_write(cpu, _bus_read(cpu) - 1);
+    _do_cmp(cpu, cpu->regs.acc, _bus_read(cpu));
+}
+
+static void _op_and(Cpu6502 *cpu) {
+    cpu->regs.acc &= _bus_read(cpu);
+
+    _set_alu_flags(cpu, cpu->regs.acc);
+}
+
+static void _op_sax(Cpu6502 *cpu) { // unofficial
+    uint8_t res = cpu->regs.acc & cpu->regs.x;
+    _bus_write(cpu, res);
+}
+
+static void _op_anc(Cpu6502 *cpu) { // unofficial
+    cpu->regs.acc &= _bus_read(cpu);
+    cpu->regs.status.carry = cpu->regs.acc >> 7;
+}
+
+static void _op_asl(Cpu6502 *cpu) {
+    _do_shift(cpu, false, false);
+}
+
+static void _op_lsr(Cpu6502 *cpu) {
+    _do_shift(cpu, true, false);
+}
+
+static void _op_rol(Cpu6502 *cpu) {
+    _do_shift(cpu, false, true);
+}
+
+static void _op_ror(Cpu6502 *cpu) {
+    _do_shift(cpu, true, true);
+}
+
+static void _op_alr(Cpu6502 *cpu) { // unofficial
+    _do_shift(cpu, true, false);
+}
+
+static void _op_slo(Cpu6502 *cpu) { // unofficial
+    _do_shift(cpu, false, false);
+    cpu->regs.acc |= _bus_read(cpu);
+
+    _set_alu_flags(cpu, cpu->regs.acc);
+}
+
+static void _op_rla(Cpu6502 *cpu) { // unofficial
+    // I think this performs two r/w cycles too
+    _do_shift(cpu, false, true);
+
+    cpu->regs.acc &= _bus_read(cpu);
+
+    _set_alu_flags(cpu, cpu->regs.acc);
+}
+
+static void _op_arr(Cpu6502 *cpu) { // unofficial
+    cpu->regs.acc &= _bus_read(cpu);
+
+    _do_shift(cpu, true, true);
+
+    _set_alu_flags(cpu, cpu->regs.acc);
+
+    cpu->regs.status.overflow = (cpu->regs.acc >> 5) & 1;
+    cpu->regs.status.carry = !((cpu->regs.acc >> 6) & 1);
+}
+
+static void _op_sre(Cpu6502 *cpu) { // unofficial
+    _do_shift(cpu, true, false);
+
+    cpu->regs.acc ^= _bus_read(cpu);
+
+    _set_alu_flags(cpu, cpu->regs.acc);
+}
+
+static void _op_rra(Cpu6502 *cpu) { // unofficial
+    _do_shift(cpu, true, true);
+
+    _do_adc(cpu, _bus_read(cpu));
+}
+
+static void _op_axs(Cpu6502 *cpu) { // unofficial
+    cpu->regs.x &= cpu->regs.acc;
+    uint8_t res = cpu->regs.x - _bus_read(cpu);
+
+    cpu->regs.status.carry = res > _bus_read(cpu);
+
+    cpu->regs.x = res;
+
+    _set_alu_flags(cpu, cpu->regs.x);
+}
+
+static void _op_eor(Cpu6502 *cpu) {
+    cpu->regs.acc = cpu->regs.acc ^ _bus_read(cpu);
+
+    _set_alu_flags(cpu, cpu->regs.acc);
+}
+
+static void _op_ora(Cpu6502 *cpu) {
+    cpu->regs.acc = cpu->regs.acc | _bus_read(cpu);
+
+    _set_alu_flags(cpu, cpu->regs.acc);
+}
+
+static void _op_bit(Cpu6502 *cpu) {
+    // set negative and overflow flags from memory
+    uint8_t flags = _bus_read(cpu) & (STATUS_N | STATUS_V);
+
+    // mask accumulator with value and set zero flag appropriately
+    if ((cpu->regs.acc & _bus_read(cpu)) == 0) {
+        flags |= STATUS_Z;
+    }
+
+    _set_flags(cpu, STATUS_N | STATUS_Z | STATUS_V, flags);
+}
+
+static void _op_tas(Cpu6502 *cpu) { // unofficial
+    // this some fkn voodo right here
+    cpu->regs.sp = cpu->regs.acc & cpu->regs.x;
+    _bus_write(cpu, cpu->regs.sp & ((cpu->cur_operand >> 8) + 1));
+}
+
+static void _op_las(Cpu6502 *cpu) { // unofficial
+    cpu->regs.acc = _bus_read(cpu) & cpu->regs.sp;
+    cpu->regs.x = cpu->regs.acc;
+    cpu->regs.sp = cpu->regs.acc;
+
+    _set_alu_flags(cpu, cpu->regs.acc);
+}
+
+static void _op_xas(Cpu6502 *cpu) { // unofficial
+    //TODO: this instruction is supposed to take 5 cycles; currently it takes 7
+    _bus_write(cpu, cpu->regs.x & ((cpu->cur_operand >> 8) + 1));
+}
+
+static void _op_say(Cpu6502 *cpu) { // unofficial
+    //TODO: same deal as XAS
+    _bus_write(cpu, cpu->regs.y & ((cpu->cur_operand >> 8) + 1));
+}
+
+static void _op_axa(Cpu6502 *cpu) { // unofficial
+    //TODO: same deal as AXA, except it has two addressing modes
+    _bus_write(cpu, (cpu->regs.acc & cpu->regs.x) & 7);
+}
+
+static void _op_xaa(Cpu6502 *cpu) { // unofficial
+    // even more voodoo
+    cpu->regs.acc = (cpu->regs.x & 0xEE) | ((cpu->regs.x & cpu->regs.acc) & 0x11);
+}
+
+static void _op_clc(Cpu6502 *cpu) {
+    cpu->regs.status.carry = 0;
+}
+
+static void _op_cld(Cpu6502 *cpu) {
+    cpu->regs.status.decimal = 0;
+}
+
+static void _op_cli(Cpu6502 *cpu) {
+    cpu->regs.status.interrupt_disable = 0;
+}
+
+static void _op_clv(Cpu6502 *cpu) {
+    cpu->regs.status.overflow = 0;
+}
+
+static void _op_cmp(Cpu6502 *cpu) {
+    _do_cmp(cpu, cpu->regs.acc, _bus_read(cpu));
+}
+
+static void _op_cpx(Cpu6502 *cpu) {
+    _do_cmp(cpu, cpu->regs.x, _bus_read(cpu));
+}
+
+static void _op_cpy(Cpu6502 *cpu) {
+    _do_cmp(cpu, cpu->regs.y, _bus_read(cpu));
+}
+
+static void _op_sec(Cpu6502 *cpu) {
+    cpu->regs.status.carry = 1;
+}
+
+static void _op_sed(Cpu6502 *cpu) {
+    cpu->regs.status.decimal = 1;
+}
+
+static void _op_sei(Cpu6502 *cpu) {
+    cpu->regs.status.interrupt_disable = 1;
+}
+
+static void _op_nop(Cpu6502 *cpu) {
+    // no-op
+    (void) cpu;
+}
+
+static void _op_kil(Cpu6502 *cpu) {
+    // the CPU locks up until it's reset
+    cpu->jammed = true;
+}
+
+// mnemonics which are fully implemented by their handler never reach this
+static void _op_unhandled(Cpu6502 *cpu) {
+    printf("Encountered %s instruction @ $%04X\n", mnemonic_to_str(cpu->cur_instr->mnemonic), cpu->regs.pc - 1);
+    exit(-1);
+}
+
+typedef void (*InstrOperation)(Cpu6502*);
+
+// Indexed by mnemonic and cached when an opcode is fetched. The instruction-granular path calls through the cached
+// pointer as well. Every operation goes through the bus callbacks anyway, and a switch the compiler could inline the
+// operations into measured slower there.
+static const InstrOperation g_instr_operations[] = {
+    [LDA] = _op_lda,
+    [LDX] = _op_ldx,
+    [LDY] = _op_ldy,
+    [STA] = _op_sta,
+    [STX] = _op_stx,
+    [STY] = _op_sty,
+    [TAX] = _op_tax,
+    [TAY] = _op_tay,
+    [TSX] = _op_tsx,
+    [TXA] = _op_txa,
+    [TYA] = _op_tya,
+    [TXS] = _op_txs,
+    [ADC] = _op_adc,
+    [SBC] = _op_sbc,
+    [DEC] = _op_dec,
+    [DEX] = _op_dex,
+    [DEY] = _op_dey,
+    [INC] = _op_inc,
+    [INX] = _op_inx,
+    [INY] = _op_iny,
+    [AND] = _op_and,
+    [ASL] = _op_asl,
+    [LSR] = _op_lsr,
+    [BIT] = _op_bit,
+    [EOR] = _op_eor,
+    [ORA] = _op_ora,
+    [ROL] = _op_rol,
+    [ROR] = _op_ror,
+    [BCC] = _op_unhandled,
+    [BCS] = _op_unhandled,
+    [BNE] = _op_unhandled,
+    [BEQ] = _op_unhandled,
+    [BPL] = _op_unhandled,
+    [BMI] = _op_unhandled,
+    [BVC] = _op_unhandled,
+    [BVS] = _op_unhandled,
+    [JMP] = _op_unhandled,
+    [JSR] = _op_unhandled,
+    [RTI] = _op_unhandled,
+    [RTS] = _op_unhandled,
+    [CLC] = _op_clc,
+    [CLD] = _op_cld,
+    [CLI] = _op_cli,
+    [CLV] = _op_clv,
+    [CMP] = _op_cmp,
+    [CPX] = _op_cpx,
+    [CPY] = _op_cpy,
+    [SEC] = _op_sec,
+    [SED] = _op_sed,
+    [SEI] = _op_sei,
+    [PHA] = _op_unhandled,
+    [PHP] = _op_unhandled,
+    [PLA] = _op_unhandled,
+    [PLP] = _op_unhandled,
+    [BRK] = _op_unhandled,
+    [NOP] = _op_nop,
+    [KIL] = _op_kil,
+    [ANC] = _op_anc,
+    [SLO] = _op_slo,
+    [RLA] = _op_rla,
+    [SRE] = _op_sre,
+    [RRA] = _op_rra,
+    [SAX] = _op_sax,
+    [LAX] = _op_lax,
+    [DCP] = _op_dcp,
+    [ALR] = _op_alr,
+    [XAA] = _op_xaa,
+    [TAS] = _op_tas,
+    [SAY] = _op_say,
+    [XAS] = _op_xas,
+    [AXA] = _op_axa,
+    [ARR] = _op_arr,
+    [LAS] = _op_las,
+    [ISC] = _op_isc,
+    [AXS] = _op_axs,
+};
+
+static inline void _do_instr_operation(Cpu6502 *cpu) {
+    cpu->cur_op(cpu);
+}
+
+static void _reset_instr_state(Cpu6502 *cpu) {
+    cpu->cur_operand = 0; // reset current operand
+    cpu->eff_operand = 0; // reset effective operand
+    _bus_write(cpu, 0); // reset data value
+
+    cpu->instr_cycle = 1; // skip opcode fetching
+}
+
+// returns the lines pulled low as of the current cycle according to the replayed recording
+static uint8_t _replay_lines(Cpu6502 *cpu) {
+    const CpuLineEvent *events = cpu->line_replay;
+    size_t next = cpu->line_replay_next;
+
+    if (next != 0 && events[next - 1].cycle > cpu->cycle_count) {
+        // the CPU was sent back in time, so look for the position again
+        size_t lo = 0;
+        size_t hi = next - 1;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (events[mid].cycle <= cpu->cycle_count) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        next = lo;
+    }
+
+    while (next < cpu->line_replay_count && events[next].cycle <= cpu->cycle_count) {
+        next++;
+    }
+
+    cpu->line_replay_next = next;
+
+    return next != 0 ? events[next - 1].lines : 0;
+}
+
+// applies the scheduled line changes which are due by the current cycle
+static void _apply_line_changes(Cpu6502 *cpu) {
+    while (cpu->line_change_head < cpu->line_change_count
+            && cpu->line_changes[cpu->line_change_head].cycle <= cpu->cycle_count) {
+        const LineChange *change = &cpu->line_changes[cpu->line_change_head++];
+        _set_line(cpu, change->line, change->low);
+    }
+}
+
+// combines the levels set by the host with those of the poll callbacks, recording any change
+static uint8_t _poll_lines(Cpu6502 *cpu) {
+    if (cpu->line_change_head < cpu->line_change_count
+            && cpu->line_changes[cpu->line_change_head].cycle <= cpu->cycle_count) {
+        _apply_line_changes(cpu);
+    }
+
+    const CpuSystemInterface *iface = &cpu->sys_iface;
+    uint8_t lines = cpu->pushed_lines;
+    if (iface->poll_nmi_line != NULL && iface->poll_nmi_line(iface->userdata) == 0) {
+        lines |= CPU_LINE_NMI;
+    }
+    if (iface->poll_irq_line != NULL && iface->poll_irq_line(iface->userdata) == 0) {
+        lines |= CPU_LINE_IRQ;
+    }
+    if (iface->poll_rst_line != NULL && iface->poll_rst_line(iface->userdata) == 0) {
+        lines |= CPU_LINE_RST;
+    }
+
+    if (cpu->line_record != NULL && lines != cpu->line_record_last) {
+        if (cpu->line_record_count < cpu->line_record_capacity) {
+            cpu->line_record[cpu->line_record_count] = (CpuLineEvent) {cpu->cycle_count, lines};
+        }
+        cpu->line_record_count++;
+        cpu->line_record_last = lines;
+    }
+
+    return lines;
+}
+
+static void _read_interrupt_lines(Cpu6502 *cpu) {
+    uint8_t lines = cpu->line_replay != NULL ? _replay_lines(cpu) : _poll_lines(cpu);
+
+    cpu->nmi_edge_detector |= (cpu->nmi_line_last_state == 1 && (lines & CPU_LINE_NMI));
+
+    cpu->nmi_line_last_state = !(lines & CPU_LINE_NMI);
+
+    cpu->irq_line_reader = lines & CPU_LINE_IRQ;
+    cpu->rst_line_reader = lines & CPU_LINE_RST;
+}
+
+static void _poll_interrupts(Cpu6502 *cpu) {
+    if (cpu->nmi_edge_detector) {
+        cpu->queued_interrupt = &INT_NMI;
+    } else if (cpu->irq_line_reader && !cpu->regs.status.interrupt_disable) {
+        cpu->queued_interrupt = &INT_IRQ;
+    } else if (cpu->rst_line_reader) {
+        cpu->queued_interrupt = &INT_RST;
+    }
+}
+
+static void _execute_interrupt(Cpu6502 *cpu) {
+    ASSERT_CYCLE(1, 7);
+
+    switch (cpu->instr_cycle) {
+        case 1:
+            _next_prg_byte(cpu); // garbage read
+            cpu->last_opcode = 0; // BRK
+
+            if (cpu->cur_interrupt == &INT_BRK && cpu->nmi_edge_detector) {
+                cpu->nmi_hijack = true;
+            }
+
+            break;
+        case 2:
+            _next_prg_byte(cpu); // garbage read
+            if (cpu->cur_interrupt == &INT_BRK) {
+                cpu->regs.pc++; // increment PC anyway for software interrupts
+            }
+
+            if (cpu->cur_interrupt == &INT_BRK && cpu->nmi_edge_detector) {
+                cpu->nmi_hijack = true;
+            }
+
+            break;
+        case 3:
+            if (cpu->cur_interrupt->push_pc) {
+                // push PC high, decrement S
+                _mem_write(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp, cpu->regs.pc >> 8);
+            }
+            cpu->regs.sp--;
+
+            if (cpu->cur_interrupt == &INT_BRK && cpu->nmi_edge_detector) {
+                cpu->nmi_hijack = true;
+            }
+
+            break;
+        case 4:
+            if (cpu->cur_interrupt->push_pc) {
+                // push PC low, decrement S
+                _mem_write(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp, cpu->regs.pc & 0xFF);
+            }
+            cpu->regs.sp--;
+
+            if (cpu->cur_interrupt == &INT_BRK && cpu->nmi_edge_detector) {
+                cpu->nmi_hijack = true;
+            }
+
+            break;
+        case 5:
+            if (cpu->nmi_hijack) {
+                cpu->cur_interrupt = &INT_NMI;
+                cpu->nmi_hijack = false;
+            }
+
+            if (cpu->cur_interrupt->push_pc) {
+                // push P, decrement S, set/clear B
+                cpu->regs.status.break_command = cpu->cur_interrupt->set_b;
+
+                uint8_t val = cpu->regs.status.serial;
+                if (cpu->cur_interrupt == &INT_BRK) {
+                    val |= 0x30;
+                }
+                
+                _mem_write(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp, val);
+            }
+            cpu->regs.sp--;
+            break;
+        case 6:
+            // clear PC low and set to vector value
+            cpu->regs.pc &= ~0xFF;
+            cpu->regs.pc |= _mem_read(cpu, cpu->cur_interrupt->vector_loc);
+
+            if (cpu->cur_interrupt->set_i) {
+                cpu->regs.status.interrupt_disable = 1;
+            }
+            break;
+        case 7: {
+            // clear PC high and set to vector value
+            cpu->regs.pc &= ~0xFF00;
+            cpu->regs.pc |= (_mem_read(cpu, cpu->cur_interrupt->vector_loc + 1) << 8);
+            cpu->instr_cycle = 0; // reset for next instruction
+
+            if (cpu->cur_interrupt == &INT_NMI) {
+                cpu->nmi_edge_detector = false;
+            } else if (cpu->cur_interrupt == &INT_IRQ) {
+                cpu->irq_line_reader = false;
+            } else if (cpu->cur_interrupt == &INT_BRK || cpu->cur_interrupt == &INT_RST) {
+                cpu->rst_line_reader = false;
+            }
+
+            cpu->cur_interrupt = NULL;
+
+            // update the register snapshot to reflect state after the interrupt, which ends with this cycle - a BRK
+            // instruction still has to be logged with the state from before it
+            if (cpu->cur_instr == NULL) {
+                _take_snapshot(cpu);
+                cpu->cycle_snapshot++;
+            }
+
+            break;
+        }
+    }
+}
+
+static void _handle_rti(Cpu6502 *cpu) {
+    ASSERT_CYCLE(2, 6);
+    
+    switch (cpu->instr_cycle) {
+        case 2:
+            _next_prg_byte(cpu); // garbage read
+            break;
+        case 3:
+            // increment S
+            cpu->regs.sp++;
+            break;
+        case 4:
+            // pull P, increment S
+            cpu->regs.status.serial = _mem_read(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp);
+            cpu->regs.sp++;
+            break;
+        case 5:
+            // clear PC low and set to stack value, increment S
+            cpu->regs.pc &= ~0xFF;
+            cpu->regs.pc |= _mem_read(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp);
+            cpu->regs.sp++;
+
+            break;
+        case 6:
+            // clear PC high and set to stack value
+            cpu->regs.pc &= ~0xFF00;
+            cpu->regs.pc |= _mem_read(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp) << 8;
+
+            cpu->instr_cycle = 0; // reset for next instruction
+            break;
+    }
+}
+
+static void _handle_rts(Cpu6502 *cpu) {
     ASSERT_CYCLE(2, 6);
     
-    switch (g_instr_cycle) {
+    switch (cpu->instr_cycle) {
         case 2:
-            g_sys_iface.mem_read(g_cpu_regs.pc); // garbage read
+            _mem_read(cpu, cpu->regs.pc); // garbage read
             break;
         case 3:
             // increment S
-            g_cpu_regs.sp++;
+            cpu->regs.sp++;
             break;
         case 4:
             // clear PC low and set to stack value, increment S
-            g_cpu_regs.pc &= ~0xFF;
-            g_cpu_regs.pc |= g_sys_iface.mem_read(STACK_BOTTOM_ADDR + g_cpu_regs.sp);
-            g_cpu_regs.sp++;
+            cpu->regs.pc &= ~0xFF;
+            cpu->regs.pc |= _mem_read(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp);
+            cpu->regs.sp++;
             break;
         case 5:
             // clear PC high and set to stack value
-            g_cpu_regs.pc &= ~0xFF00;
-            g_cpu_regs.pc |= g_sys_iface.mem_read(STACK_BOTTOM_ADDR + g_cpu_regs.sp) << 8;
+            cpu->regs.pc &= ~0xFF00;
+            cpu->regs.pc |= _mem_read(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp) << 8;
 
             break;
         case 6:
             // increment PC
-            g_cpu_regs.pc++;
+            cpu->regs.pc++;
 
-            g_instr_cycle = 0; // reset for next instruction
+            cpu->instr_cycle = 0; // reset for next instruction
     }
 }
 
-static void _handle_stack_push(void) {
+static void _handle_stack_push(Cpu6502 *cpu) {
     ASSERT_CYCLE(2, 3);
 
-    switch (g_instr_cycle) {
+    switch (cpu->instr_cycle) {
         case 2:
-            _next_prg_byte(); // garbage read
+            _next_prg_byte(cpu); // garbage read
 
             break;
         case 3: {
             // push register, decrement S
             uint8_t val;
-            if (g_cur_instr->mnemonic == PHA) {
-                val = g_cpu_regs.acc;
+            if (cpu->cur_instr->mnemonic == PHA) {
+                val = cpu->regs.acc;
             } else {
-                val = g_cpu_regs.status.serial;
+                val = cpu->regs.status.serial;
                 val |= 0x30;
             }
-            g_sys_iface.mem_write(STACK_BOTTOM_ADDR + g_cpu_regs.sp, val);
-            g_cpu_regs.sp--;
-
-            g_instr_cycle = 0; // reset for next instruction
-            break;
+            _mem_write(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp, val);
+            cpu->regs.sp--;
+
+            cpu->instr_cycle = 0; // reset for next instruction
+            break;
+        }
+    }
+}
+
+static void _handle_stack_pull(Cpu6502 *cpu) {
+    ASSERT_CYCLE(2, 4);
+
+    switch (cpu->instr_cycle) {
+        case 2:
+            _next_prg_byte(cpu); // garbage read
+            break;
+        case 3:
+            // increment S
+            cpu->regs.sp++;
+
+            break;
+        case 4: {
+            // pull register
+            uint8_t val = _mem_read(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp);
+            if (cpu->cur_instr->mnemonic == PLA) {
+                cpu->regs.acc = val;
+            } else {
+                cpu->regs.status.serial = val;
+            }
+
+            if (cpu->cur_instr->mnemonic == PLA) {
+                _set_alu_flags(cpu, val);
+            }
+
+            cpu->instr_cycle = 0; // reset for next instruction
+
+            break;
+        }
+    }
+}
+
+static void _handle_jsr(Cpu6502 *cpu) {
+    ASSERT_CYCLE(3, 6);
+
+    switch (cpu->instr_cycle) {
+        case 3:
+            // unsure of what happens here
+            break;
+        case 4:
+            // push PC high, decrement S
+            _mem_write(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp, cpu->regs.pc >> 8);
+            cpu->regs.sp--;
+            break;
+        case 5:
+            // push PC low, decrement S
+            _mem_write(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp, cpu->regs.pc & 0xFF);
+            cpu->regs.sp--;
+
+            break;
+        case 6: {
+            // copy low byte to PC, fetch high byte to PC (but don't increment PC)
+            uint8_t pch = _mem_read(cpu, cpu->regs.pc);
+            cpu->cur_operand |= pch << 8;
+            cpu->eff_operand = cpu->cur_operand;
+
+            cpu->regs.pc = cpu->cur_operand;
+
+            cpu->instr_cycle = 0; // reset for next instruction
+            break;
+        }
+    }
+}
+
+static void _handle_instr_rw(Cpu6502 *cpu, uint8_t offset) {
+    switch (cpu->cur_info->type) {
+        case INS_R:
+            ASSERT_CYCLE(offset, offset);
+
+            _bus_write(cpu, _mem_read(cpu, cpu->eff_operand));
+            _do_instr_operation(cpu);
+
+            cpu->instr_cycle = 0;
+
+            break;
+        case INS_W:
+            ASSERT_CYCLE(offset, offset);
+
+            _do_instr_operation(cpu);
+            _mem_write(cpu, cpu->eff_operand, _bus_read(cpu));
+
+            cpu->instr_cycle = 0;
+
+            break;
+        case INS_RW:
+            ASSERT_CYCLE(offset, offset + 2);
+
+            switch (cpu->instr_cycle - offset) {
+                case 0:
+                    _bus_write(cpu, _mem_read(cpu, cpu->eff_operand));
+                    break;
+                case 1:
+                    _mem_write(cpu, cpu->eff_operand, _bus_read(cpu));
+                    _do_instr_operation(cpu);
+
+                    break;
+                case 2:
+                    _mem_write(cpu, cpu->eff_operand, _bus_read(cpu));
+                    cpu->instr_cycle = 0;
+                    break;
+            }
+
+            break;
+        default:
+            printf("Unhandled instr %s with type %d\n", mnemonic_to_str(cpu->cur_instr->mnemonic),
+                    cpu->cur_info->type);
+            fflush(stdout);
+            assert(false);
+    }
+}
+
+static void _handle_instr_imp(Cpu6502 *cpu) {
+    ASSERT_CYCLE(2, 2);
+
+    switch (cpu->cur_info->type) {
+        case INS_R:
+            _bus_write(cpu, cpu->regs.acc);
+            _do_instr_operation(cpu);
+            break;
+        case INS_W:
+            _do_instr_operation(cpu);
+            cpu->regs.acc = _bus_read(cpu);
+            break;
+        case INS_RW:
+            _bus_write(cpu, cpu->regs.acc);
+            _do_instr_operation(cpu);
+            cpu->regs.acc = _bus_read(cpu);
+            break;
+        case INS_STACK:
+        case INS_REG:
+        case INS_RET:
+        case INS_OTHER:
+            _do_instr_operation(cpu);
+            break;
+        default:
+            assert(false);
+    }
+    cpu->instr_cycle = 0; // reset for next instruction
+}
+
+static void _handle_instr_imm(Cpu6502 *cpu) {
+    ASSERT_CYCLE(2, 2);
+
+    cpu->cur_operand |= _next_prg_byte(cpu); // fetch immediate byte
+    cpu->regs.pc++; // increment PC
+
+    _bus_write(cpu, cpu->cur_operand & 0xFF);
+    _do_instr_operation(cpu);
+
+    cpu->instr_cycle = 0; // reset for next instruction
+}
+
+static void _handle_instr_zrp(Cpu6502 *cpu) {
+    cpu->eff_operand = cpu->cur_operand;
+    _handle_instr_rw(cpu, 3);
+}
+
+static void _handle_instr_zpi(Cpu6502 *cpu) {
+    ASSERT_CYCLE(3, 6);
+
+    if (cpu->instr_cycle == 3) {
+        _bus_write(cpu, _mem_read(cpu, cpu->cur_operand));
+        cpu->eff_operand = (cpu->cur_operand + (cpu->cur_instr->addr_mode == ZPX ? cpu->regs.x : cpu->regs.y)) & 0xFF;
+    } else {
+        _handle_instr_rw(cpu, 4);
+    }
+}
+
+static void _handle_instr_abs(Cpu6502 *cpu) {
+    ASSERT_CYCLE(3, 6);
+
+    if (cpu->instr_cycle == 3) {
+        cpu->cur_operand |= (_next_prg_byte(cpu) << 8); // fetch high byte of operand
+        cpu->regs.pc++; // increment PC
+    } else {
+        cpu->eff_operand = cpu->cur_operand;
+        _handle_instr_rw(cpu, 4);
+    }
+}
+
+static void _handle_instr_abi(Cpu6502 *cpu) {
+    ASSERT_CYCLE(3, 8);
+
+    switch (cpu->instr_cycle) {
+        case 3:
+            cpu->cur_operand |= (_next_prg_byte(cpu) << 8); // fetch high byte of operand
+            cpu->eff_operand = (cpu->cur_operand & 0xFF00)
+                    | ((cpu->cur_operand + (cpu->cur_instr->addr_mode == ABX ? cpu->regs.x : cpu->regs.y)) & 0xFF);
+            cpu->regs.pc++; // increment PC
+
+            break;
+        case 4:
+            _bus_write(cpu, _mem_read(cpu, cpu->eff_operand));
+            // fix effective address
+            if ((cpu->cur_operand & 0xFF) + (cpu->cur_instr->addr_mode == ABX ? cpu->regs.x : cpu->regs.y) >= 0x100) {
+                cpu->eff_operand += 0x100;
+            } else if (cpu->cur_info->type == INS_R) {
+                // we're finished if the high byte was correct
+                _do_instr_operation(cpu);
+
+                cpu->instr_cycle = 0;
+            }
+            break;
+        default:
+            _handle_instr_rw(cpu, 5);
+            break;
+    }
+}
+
+static void _handle_instr_izx(Cpu6502 *cpu) {
+    ASSERT_CYCLE(3, 8);
+
+    switch (cpu->instr_cycle) {
+        case 3:
+            _mem_read(cpu, cpu->cur_operand);
+            cpu->cur_operand = (cpu->cur_operand & 0xFF00) | ((cpu->cur_operand + cpu->regs.x) & 0xFF);
+            break;
+        case 4:
+            cpu->eff_operand = 0;
+            cpu->eff_operand |= _mem_read(cpu, cpu->cur_operand);
+            break;
+        case 5:
+            cpu->eff_operand |= _mem_read(cpu, (cpu->cur_operand & 0xFF00) | ((cpu->cur_operand + 1) & 0xFF)) << 8;
+
+            break;
+        default:
+            _handle_instr_rw(cpu, 6);
+            break;
+    }
+}
+
+static void _handle_instr_izy(Cpu6502 *cpu) {
+    ASSERT_CYCLE(3, 8);
+
+    switch (cpu->instr_cycle) {
+        case 3:
+            cpu->eff_operand &= ~0xFF;
+            cpu->eff_operand |= _mem_read(cpu, cpu->cur_operand);
+            break;
+        case 4:
+            cpu->eff_operand &= ~0xFF00;
+            cpu->eff_operand |= _mem_read(cpu, (cpu->cur_operand & 0xFF00) | ((cpu->cur_operand + 1) & 0xFF)) << 8;
+
+            cpu->eff_operand = (cpu->eff_operand & 0xFF00) | ((cpu->eff_operand + cpu->regs.y) & 0xFF);
+            break;
+        case 5: {
+            _bus_write(cpu, _mem_read(cpu, cpu->eff_operand));
+
+            if (cpu->regs.y > (cpu->eff_operand & 0xFF)) {
+                cpu->eff_operand += 0x100;
+                // need to deal with instr operation on next cycle
+            } else if (cpu->cur_info->type == INS_R) {
+                // we're finished if the high byte was correct, correct value is on bus
+
+                _do_instr_operation(cpu);
+
+                cpu->instr_cycle = 0;
+            }
+
+            break;
+        }
+        default:
+            _handle_instr_rw(cpu, 6);
+            break;
+    }
+}
+
+static void _handle_jmp(Cpu6502 *cpu) {
+    switch (cpu->cur_instr->addr_mode) {
+        case ABS:
+            ASSERT_CYCLE(3, 3);
+            
+            uint8_t pch = _mem_read(cpu, cpu->regs.pc);
+            cpu->regs.pc++;
+
+            cpu->cur_operand |= pch << 8;
+
+            cpu->regs.pc = cpu->cur_operand;
+            
+
+            cpu->instr_cycle = 0;
+            
+            break;
+        case IND:
+            ASSERT_CYCLE(3, 5);
+            switch (cpu->instr_cycle) {
+                case 3:
+                    cpu->cur_operand |= _next_prg_byte(cpu) << 8; // fetch high byte of operand
+                    cpu->regs.pc++; // increment PC
+                    break;
+                case 4:
+                    cpu->eff_operand &= ~0xFF;
+                    cpu->eff_operand |= _mem_read(cpu, cpu->cur_operand); // fetch target low
+
+                    break;
+                case 5:
+                    cpu->regs.pc = 0; // clear PC (technically not accurate, but it has no practical consequence)
+                    // fetch target high to PC
+                    // we technically don't do this properly, but sub-cycle accuracy is not necessarily a goal
+                    // page boundary crossing is not handled correctly - we emulate this bug here
+                    cpu->regs.pc |= (_mem_read(cpu, (cpu->cur_operand & 0xFF00) | ((cpu->cur_operand + 1) & 0xFF)) << 8);
+                    // copy low address byte to PC
+                    cpu->regs.pc |= cpu->eff_operand & 0xFF;
+                    
+                    // this is for logging purposes only
+                    cpu->eff_operand = cpu->regs.pc;
+
+                    cpu->instr_cycle = 0;
+
+                    break;
+            }
+            break;
+        default:
+            assert(false);
+    }
+}
+
+// forward declaration for branch handling
+static void _do_instr_cycle(Cpu6502 *cpu);
+
+static bool _should_take_branch(Cpu6502 *cpu) {
+    switch (cpu->cur_instr->mnemonic) {
+        case BCC:
+            return !cpu->regs.status.carry;
+        case BCS:
+            return cpu->regs.status.carry;
+        case BNE:
+            return !cpu->regs.status.zero;
+        case BEQ:
+            return cpu->regs.status.zero;
+        case BPL:
+            return !cpu->regs.status.negative;
+        case BMI:
+            return cpu->regs.status.negative;
+        case BVC:
+            return !cpu->regs.status.overflow;
+        case BVS:
+            return cpu->regs.status.overflow;
+        default:
+            assert(false);
+            return false;
+    }
+}
+
+// applies the page boundary fix-up to the PC of a taken branch, returning false if the branch stayed on its page
+static bool _fix_branch_page(Cpu6502 *cpu, uint8_t old_pcl) {
+    if ((int8_t) cpu->cur_operand < 0 && -(int8_t) cpu->cur_operand > old_pcl) {
+        cpu->regs.pc -= 0x100;
+    } else if ((int8_t) cpu->cur_operand > 0 && cpu->cur_operand + old_pcl >= 0x100) {
+        cpu->regs.pc += 0x100;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static void _handle_branch(Cpu6502 *cpu) {
+    ASSERT_CYCLE(3, 4);
+
+    switch (cpu->instr_cycle) {
+        case 3:
+            _bus_write(cpu, _mem_read(cpu, cpu->regs.pc));
+
+            cpu->eff_operand = cpu->regs.pc + (int8_t) cpu->cur_operand;
+
+            if (_should_take_branch(cpu)) {
+                _bus_write(cpu, cpu->regs.pc & 0xFF);
+                cpu->regs.pc = (cpu->regs.pc & 0xFF00) | ((cpu->regs.pc + (int8_t) cpu->cur_operand) & 0xFF);
+            } else {
+                // recursive call to fetch the next opcode
+                cpu->instr_cycle = 1;
+                _do_instr_cycle(cpu);
+            }
+            return;
+        case 4: {
+            _poll_interrupts(cpu);
+
+            uint8_t old_pcl = _bus_read(cpu);
+
+            _bus_write(cpu, _mem_read(cpu, cpu->regs.pc));
+
+            if (!_fix_branch_page(cpu, old_pcl)) {
+                // recursive call to fetch the next opcode
+                cpu->instr_cycle = 1;
+                _do_instr_cycle(cpu);
+                return;
+            }
+
+            cpu->instr_cycle = 0;
+
+            break;
+        }
+        default:
+            assert(false);
+    }
+}
+
+static void _handle_brk(Cpu6502 *cpu) {
+    cpu->cur_interrupt = &INT_BRK;
+    _execute_interrupt(cpu);
+}
+
+// indexed by InstructionHandler
+static void (*const g_instr_handlers[])(Cpu6502*) = {
+    [HND_IMP] = _handle_instr_imp,
+    [HND_IMM] = _handle_instr_imm,
+    [HND_ZRP] = _handle_instr_zrp,
+    [HND_ZPI] = _handle_instr_zpi,
+    [HND_ABS] = _handle_instr_abs,
+    [HND_ABI] = _handle_instr_abi,
+    [HND_IZX] = _handle_instr_izx,
+    [HND_IZY] = _handle_instr_izy,
+    [HND_JMP] = _handle_jmp,
+    [HND_JSR] = _handle_jsr,
+    [HND_RTI] = _handle_rti,
+    [HND_RTS] = _handle_rts,
+    [HND_BRANCH] = _handle_branch,
+    [HND_PUSH] = _handle_stack_push,
+    [HND_PULL] = _handle_stack_pull,
+    [HND_BRK] = _handle_brk,
+};
+
+// caches the dispatch targets for the opcode that was just fetched so that no decoding happens on later cycles
+static void _decode_opcode(Cpu6502 *cpu) {
+    cpu->cur_instr = decode_instr(cpu->last_opcode);
+    cpu->cur_info = get_opcode_info(cpu->last_opcode);
+    cpu->cur_handler = g_instr_handlers[cpu->cur_info->handler];
+    cpu->cur_op = g_instr_operations[cpu->cur_info->mnemonic];
+}
+
+static void _trace_last_instr(Cpu6502 *cpu) {
+    CpuTraceRecord queued;
+    CpuTraceRecord *record = cpu->trace_buf != NULL ? &cpu->trace_buf[cpu->trace_index] : &queued;
+
+    record->cycle = cpu->cycle_snapshot;
+    record->pc = cpu->regs_snapshot.pc;
+    record->operand = cpu->cur_operand;
+    record->eff_addr = cpu->eff_operand;
+    record->opcode = cpu->last_opcode;
+    record->bus_val = _bus_read(cpu);
+    record->acc = cpu->regs_snapshot.acc;
+    record->x = cpu->regs_snapshot.x;
+    record->y = cpu->regs_snapshot.y;
+    record->sp = cpu->regs_snapshot.sp;
+    record->status = cpu->regs_snapshot.status.serial;
+
+    if (cpu->trace_queue != NULL) {
+        trace_queue_push(cpu->trace_queue, record);
+    }
+
+    if (cpu->trace_buf != NULL) {
+        if (++cpu->trace_index == cpu->trace_capacity) {
+            cpu->trace_index = 0;
+        }
+        cpu->trace_count++;
+    }
+}
+
+static void _log_last_instr(Cpu6502 *cpu) {
+    if (!_is_tracing(cpu) || cpu->cur_instr == NULL) {
+        return;
+    }
+
+    if (cpu->trace_buf != NULL || cpu->trace_queue != NULL) {
+        _trace_last_instr(cpu);
+    }
+
+    if (cpu->log_callback != NULL) {
+        char instr_str[40];
+        cpu->log_callback(cpu->sys_iface.userdata, cpu_print_current_instruction(cpu, instr_str), cpu->regs_snapshot);
+    }
+
+    _take_snapshot(cpu);
+}
+
+static void _do_instr_cycle(Cpu6502 *cpu) {
+    if (cpu->cur_interrupt) {
+        _execute_interrupt(cpu);
+        return;
+    } else if (cpu->instr_cycle == 1) {
+        _log_last_instr(cpu);
+
+        if (cpu->queued_interrupt) {
+            cpu->cur_instr = NULL;
+            cpu->cur_info = NULL;
+            cpu->cur_interrupt = cpu->queued_interrupt;
+            cpu->queued_interrupt = NULL;
+            cpu->idle_watching = false; // the handler may change whatever the loop is waiting on
+            _execute_interrupt(cpu);
+        } else {
+            cpu->last_opcode = _next_prg_byte(cpu); // store last opcode
+            _decode_opcode(cpu);
+
+            _reset_instr_state(cpu);
+
+            cpu->regs.pc++; // increment PC
+        }
+
+        return;
+    }
+
+    const OpcodeInfo *info = cpu->cur_info;
+
+    if (cpu->instr_cycle == 2 && info->addr_mode != IMP && info->addr_mode != IMM) {
+        // special case
+        if (info->addr_mode == REL) {
+            _poll_interrupts(cpu);
+        }
+
+        // this doesn't execute for implicit/immediate instructions because they have additional steps beyond fetching
+        // on this cycle
+        cpu->cur_operand |= _next_prg_byte(cpu); // fetch low byte of operand
+        cpu->regs.pc++; // increment PC
+        return;
+    }
+
+    cpu->cur_handler(cpu);
+}
+
+static inline void _cycle(Cpu6502 *cpu) {
+    _do_instr_cycle(cpu);
+    
+    if (cpu->queued_interrupt == NULL && cpu->instr_cycle == 0 && !(cpu->cur_instr != NULL && cpu->cur_instr->addr_mode == REL)) {
+        _poll_interrupts(cpu);
+    }
+
+    _read_interrupt_lines(cpu);
+
+    cpu->instr_cycle++;
+    cpu->cycle_count++;
+}
+
+void cycle_cpu(Cpu6502 *cpu) {
+    if (cpu->jammed) {
+        cpu->cycle_count++;
+        return;
+    }
+
+    _cycle(cpu);
+}
+
+// checks the stop conditions which are evaluated right after an opcode fetch or the first cycle of an interrupt
+static CpuStopCondition _check_stop_conditions(Cpu6502 *cpu, unsigned int stop_mask) {
+    if (cpu->cur_interrupt != NULL) {
+        return stop_mask & CPU_STOP_INTERRUPT;
+    }
+
+    uint16_t instr_addr = cpu->regs.pc - 1;
+
+    if ((stop_mask & CPU_STOP_PC) && instr_addr == cpu->stop_pc) {
+        return CPU_STOP_PC;
+    }
+
+    if ((stop_mask & CPU_STOP_MNEMONIC) && cpu->cur_instr->mnemonic == cpu->stop_mnemonic) {
+        return CPU_STOP_MNEMONIC;
+    }
+
+    if ((stop_mask & CPU_STOP_BREAKPOINT) && cpu->breakpoints != NULL
+            && (cpu->breakpoints[instr_addr >> 3] & (1 << (instr_addr & 7)))) {
+        return CPU_STOP_BREAKPOINT;
+    }
+
+    return CPU_STOP_NONE;
+}
+
+// whether reading the address has no side effects
+static bool _is_idempotent(const Cpu6502 *cpu, uint16_t addr) {
+    return cpu->page_map[addr >> 8] != NULL || (cpu->page_flags[addr >> 8] & CPU_PAGE_IDEMPOTENT);
+}
+
+// Checks whether the code at pc is an idle loop which may be skipped, storing the address of the instruction closing
+// it in *end. Only reads without side effects are allowed, both for fetching the code and for the operands, and the
+// loop must be straight-line code ending in a branch or jump back to its start.
+static bool _is_idle_loop(Cpu6502 *cpu, uint16_t pc, uint16_t *end) {
+    uint16_t addr = pc;
+
+    for (unsigned int i = 0; i < IDLE_MAX_INSTRS; i++) {
+        if (!_is_idempotent(cpu, addr)) {
+            return false;
+        }
+
+        const OpcodeInfo *info = get_opcode_info(_mem_read(cpu, addr));
+        uint16_t last = addr + info->len - 1;
+        if (last < addr || !_is_idempotent(cpu, last)) {
+            return false; // the loop must not wrap around the address space
+        }
+
+        uint16_t operand = 0;
+        for (uint8_t b = 1; b < info->len; b++) {
+            operand |= _mem_read(cpu, addr + b) << ((b - 1) * 8);
+        }
+
+        switch (info->type) {
+            case INS_BRANCH:
+                *end = addr;
+                return (uint16_t) (addr + 2 + (int8_t) operand) == pc;
+            case INS_JUMP:
+                *end = addr;
+                return info->mnemonic == JMP && info->addr_mode == ABS && operand == pc;
+            case INS_REG:
+                break;
+            case INS_RW:
+                if (info->addr_mode != IMP) {
+                    return false;
+                }
+                break;
+            case INS_R:
+                switch (info->addr_mode) {
+                    case IMM:
+                    case IMP:
+                        break;
+                    case ZRP:
+                    case ZPX:
+                    case ZPY:
+                        // indexed zero page accesses wrap around within the zero page
+                        if (!_is_idempotent(cpu, 0)) {
+                            return false;
+                        }
+                        break;
+                    case ABS:
+                        if (!_is_idempotent(cpu, operand)) {
+                            return false;
+                        }
+                        break;
+                    case ABX:
+                    case ABY:
+                        // the index may carry into the next page
+                        if (!_is_idempotent(cpu, operand) || !_is_idempotent(cpu, operand + 0x100)) {
+                            return false;
+                        }
+                        break;
+                    default:
+                        return false;
+                }
+                break;
+            default:
+                return false;
+        }
+
+        addr += info->len;
+    }
+
+    return false;
+}
+
+// returns the first cycle at which the interrupt lines might change, as far as is known in advance
+static uint64_t _next_line_change(const Cpu6502 *cpu) {
+    if (cpu->line_replay != NULL) {
+        return cpu->line_replay_next < cpu->line_replay_count
+                ? cpu->line_replay[cpu->line_replay_next].cycle
+                : UINT64_MAX;
+    }
+
+    const CpuSystemInterface *iface = &cpu->sys_iface;
+    if (iface->poll_nmi_line != NULL || iface->poll_irq_line != NULL || iface->poll_rst_line != NULL) {
+        return cpu->cycle_count; // the lines could change at any time
+    }
+
+    return cpu->line_change_head < cpu->line_change_count
+            ? cpu->line_changes[cpu->line_change_head].cycle
+            : UINT64_MAX;
+}
+
+static IdleState _idle_state(Cpu6502 *cpu) {
+    return (IdleState) {
+            .cycle = cpu->cycle_count,
+            .acc = cpu->regs.acc,
+            .x = cpu->regs.x,
+            .y = cpu->regs.y,
+            .sp = cpu->regs.sp,
+            .status = cpu->regs.status.serial,
+            .bus_val = _bus_read(cpu),
+            .lines = cpu->nmi_edge_detector | cpu->irq_line_reader << 1 | cpu->rst_line_reader << 2,
+            .nmi_line_last_state = cpu->nmi_line_last_state,
+            .next_change = _next_line_change(cpu)
+    };
+}
+
+static bool _is_same_idle_state(const IdleState *a, const IdleState *b) {
+    return a->acc == b->acc && a->x == b->x && a->y == b->y && a->sp == b->sp && a->status == b->status
+            && a->bus_val == b->bus_val && a->lines == b->lines && a->nmi_line_last_state == b->nmi_line_last_state;
+}
+
+// Returns the start of the loop closed by the instruction at pc, or -1 if it doesn't jump backwards.
+static int32_t _closed_loop_start(Cpu6502 *cpu, uint16_t pc) {
+    if (!_is_idempotent(cpu, pc)) {
+        return -1;
+    }
+
+    const OpcodeInfo *info = get_opcode_info(_mem_read(cpu, pc));
+    uint16_t last = pc + info->len - 1;
+    if (last < pc || !_is_idempotent(cpu, last)) {
+        return -1;
+    }
+
+    uint16_t start;
+    if (info->type == INS_BRANCH) {
+        start = pc + 2 + (int8_t) _mem_read(cpu, pc + 1);
+    } else if (info->mnemonic == JMP && info->addr_mode == ABS) {
+        start = _mem_read(cpu, pc + 1) | _mem_read(cpu, pc + 2) << 8;
+    } else {
+        return -1;
+    }
+
+    return start <= pc ? start : -1;
+}
+
+// Called between instructions while idle loops may be skipped. Watches for an iteration of an idle loop which leaves
+// the CPU unchanged, after which every further iteration will do the same until something outside the loop changes,
+// and skips as many of them as end before end_cycle. Iterations are compared at the loop's start when running whole
+// instructions. The cycle-stepped core fetches the next opcode on the last cycle of a branch, so the start of a loop
+// closed by one is never seen between instructions there, and iterations are compared at the closing instruction
+// instead. Returns the number of cycles skipped.
+static uint64_t _skip_idle_loop(Cpu6502 *cpu, uint64_t end_cycle, bool by_cycle) {
+    uint16_t pc = cpu->regs.pc;
+
+    if (cpu->idle_watching) {
+        if (pc == cpu->idle_anchor) {
+            IdleState state = _idle_state(cpu);
+            uint64_t skipped = 0;
+
+            // the lines must also have stayed put during the iteration for it to be repeated exactly
+            if (_is_same_idle_state(&state, &cpu->idle_state) && cpu->idle_state.next_change > state.cycle
+                    && !_is_tracing(cpu)) {
+                uint64_t period = state.cycle - cpu->idle_state.cycle;
+                uint64_t until = state.next_change < end_cycle ? state.next_change : end_cycle;
+
+                if (period != 0 && until > cpu->cycle_count) {
+                    skipped = (until - cpu->cycle_count) / period * period;
+                    cpu->cycle_count += skipped;
+                    cpu->idle_skipped += skipped;
+                    state.cycle = cpu->cycle_count;
+                }
+            }
+
+            cpu->idle_state = state;
+            return skipped;
+        }
+
+        // the loop body is straight-line code, so the loop has been left once the PC is anywhere else
+        if (pc >= cpu->idle_pc && pc <= cpu->idle_end) {
+            return 0;
+        }
+
+        cpu->idle_watching = false;
+    }
+
+    int32_t start;
+    if (by_cycle) {
+        start = _closed_loop_start(cpu, pc);
+    } else {
+        // loops are entered by jumping backwards to their start
+        bool jumped = cpu->cur_info != NULL && (cpu->cur_info->type == INS_BRANCH || cpu->cur_info->mnemonic == JMP);
+        start = jumped ? pc : -1;
+    }
+
+    if (start < 0) {
+        return 0;
+    }
+
+    uint64_t gen = cpu->page_gen[start >> 8];
+    if (start == cpu->idle_reject_pc && gen == cpu->idle_reject_gen) {
+        return 0;
+    }
+
+    uint16_t end;
+    if (!_is_idle_loop(cpu, start, &end) || (by_cycle && end != pc)) {
+        cpu->idle_reject_pc = start;
+        cpu->idle_reject_gen = gen;
+        return 0;
+    }
+
+    cpu->idle_watching = true;
+    cpu->idle_pc = start;
+    cpu->idle_end = end;
+    cpu->idle_anchor = pc;
+    cpu->idle_state = _idle_state(cpu);
+
+    return 0;
+}
+
+// whether the CPU is between instructions with nothing else pending, so that an idle loop could be skipped
+static inline bool _can_skip_idle(const Cpu6502 *cpu) {
+    return cpu->idle_skip && cpu->instr_cycle == 1 && cpu->cur_interrupt == NULL && cpu->queued_interrupt == NULL
+            && !cpu->jammed;
+}
+
+uint64_t cpu_run_cycles(Cpu6502 *cpu, uint64_t budget, unsigned int stop_mask) {
+    uint64_t cycles = 0;
+
+    cpu->stop_reason = CPU_STOP_NONE;
+    cpu->stop_requested = false;
+    cpu->idle_watching = false; // the host may have changed memory since the last run
+
+    while (cycles < budget) {
+        if (cpu->jammed) {
+            if (stop_mask & CPU_STOP_KIL) {
+                cpu->stop_reason = CPU_STOP_KIL;
+                break;
+            }
+
+            // nothing will happen for the rest of the budget
+            cpu->cycle_count += budget - cycles;
+            cycles = budget;
+            break;
+        }
+
+        _cycle(cpu);
+        cycles++;
+
+        if (cpu->stop_requested) {
+            cpu->stop_requested = false;
+            cpu->stop_reason = CPU_STOP_REQUESTED;
+            break;
+        }
+
+        if (_can_skip_idle(cpu)) {
+            cycles += _skip_idle_loop(cpu, cpu->cycle_count + (budget - cycles), true);
+        }
+
+        // instruction step 2 immediately follows an opcode fetch or the start of an interrupt sequence
+        if (stop_mask != 0 && cpu->instr_cycle == 2) {
+            CpuStopCondition reason = _check_stop_conditions(cpu, stop_mask);
+            if (reason != CPU_STOP_NONE) {
+                cpu->stop_reason = reason;
+                break;
+            }
+        }
+    }
+
+    return cycles;
+}
+
+static void _fast_instr_rw(Cpu6502 *cpu, InstructionType type) {
+    switch (type) {
+        case INS_R:
+            _bus_write(cpu, _mem_read(cpu, cpu->eff_operand));
+            _do_instr_operation(cpu);
+            break;
+        case INS_W:
+            _do_instr_operation(cpu);
+            _mem_write(cpu, cpu->eff_operand, _bus_read(cpu));
+            break;
+        case INS_RW:
+            _bus_write(cpu, _mem_read(cpu, cpu->eff_operand));
+            _mem_write(cpu, cpu->eff_operand, _bus_read(cpu)); // dummy write
+            _do_instr_operation(cpu);
+            _mem_write(cpu, cpu->eff_operand, _bus_read(cpu));
+            break;
+        default:
+            assert(false);
+    }
+}
+
+// fetches an operand byte into the given bit position, unless the operand was pre-decoded by the block cache
+static inline void _fast_fetch_operand(Cpu6502 *cpu, unsigned int shift) {
+    if (!cpu->operand_cached) {
+        cpu->cur_operand |= _next_prg_byte(cpu) << shift;
+    }
+}
+
+// Executes everything following the opcode fetch of the current instruction in a single pass. The sequence of memory
+// accesses mirrors the cycle-stepped handlers above exactly; only the per-cycle dispatch is skipped. Returns the number
+// of penalty cycles incurred on top of the opcode's base cycle count.
+static unsigned int _fast_exec_instr(Cpu6502 *cpu) {
+    const OpcodeInfo *info = cpu->cur_info;
+    InstructionType type = info->type;
+
+    switch (info->handler) {
+        case HND_IMP:
+            switch (type) {
+                case INS_R:
+                    _bus_write(cpu, cpu->regs.acc);
+                    _do_instr_operation(cpu);
+                    break;
+                case INS_W:
+                    _do_instr_operation(cpu);
+                    cpu->regs.acc = _bus_read(cpu);
+                    break;
+                case INS_RW:
+                    _bus_write(cpu, cpu->regs.acc);
+                    _do_instr_operation(cpu);
+                    cpu->regs.acc = _bus_read(cpu);
+                    break;
+                default:
+                    _do_instr_operation(cpu);
+                    break;
+            }
+            return 0;
+        case HND_IMM:
+            _fast_fetch_operand(cpu, 0); // fetch immediate byte
+            cpu->regs.pc++;
+
+            _bus_write(cpu, cpu->cur_operand & 0xFF);
+            _do_instr_operation(cpu);
+            return 0;
+        case HND_ZRP:
+            _fast_fetch_operand(cpu, 0);
+            cpu->regs.pc++;
+
+            cpu->eff_operand = cpu->cur_operand;
+            _fast_instr_rw(cpu, type);
+            return 0;
+        case HND_ZPI:
+            _fast_fetch_operand(cpu, 0);
+            cpu->regs.pc++;
+
+            _bus_write(cpu, _mem_read(cpu, cpu->cur_operand));
+            cpu->eff_operand = (cpu->cur_operand + (info->addr_mode == ZPX ? cpu->regs.x : cpu->regs.y)) & 0xFF;
+            _fast_instr_rw(cpu, type);
+            return 0;
+        case HND_ABS:
+            _fast_fetch_operand(cpu, 0);
+            cpu->regs.pc++;
+            _fast_fetch_operand(cpu, 8);
+            cpu->regs.pc++;
+
+            cpu->eff_operand = cpu->cur_operand;
+            _fast_instr_rw(cpu, type);
+            return 0;
+        case HND_ABI: {
+            uint8_t index = info->addr_mode == ABX ? cpu->regs.x : cpu->regs.y;
+
+            _fast_fetch_operand(cpu, 0);
+            cpu->regs.pc++;
+            _fast_fetch_operand(cpu, 8);
+            cpu->regs.pc++;
+
+            cpu->eff_operand = (cpu->cur_operand & 0xFF00) | ((cpu->cur_operand + index) & 0xFF);
+
+            _bus_write(cpu, _mem_read(cpu, cpu->eff_operand));
+            if ((cpu->cur_operand & 0xFF) + index >= 0x100) {
+                cpu->eff_operand += 0x100;
+            } else if (type == INS_R) {
+                _do_instr_operation(cpu);
+                return 0;
+            }
+
+            _fast_instr_rw(cpu, type);
+            return info->page_penalty;
+        }
+        case HND_IZX:
+            _fast_fetch_operand(cpu, 0);
+            cpu->regs.pc++;
+
+            _mem_read(cpu, cpu->cur_operand);
+            cpu->cur_operand = (cpu->cur_operand & 0xFF00) | ((cpu->cur_operand + cpu->regs.x) & 0xFF);
+
+            cpu->eff_operand = _mem_read(cpu, cpu->cur_operand);
+            cpu->eff_operand |= _mem_read(cpu, (cpu->cur_operand & 0xFF00) | ((cpu->cur_operand + 1) & 0xFF)) << 8;
+            _fast_instr_rw(cpu, type);
+            return 0;
+        case HND_IZY:
+            _fast_fetch_operand(cpu, 0);
+            cpu->regs.pc++;
+
+            cpu->eff_operand = _mem_read(cpu, cpu->cur_operand);
+            cpu->eff_operand |= _mem_read(cpu, (cpu->cur_operand & 0xFF00) | ((cpu->cur_operand + 1) & 0xFF)) << 8;
+            cpu->eff_operand = (cpu->eff_operand & 0xFF00) | ((cpu->eff_operand + cpu->regs.y) & 0xFF);
+
+            _bus_write(cpu, _mem_read(cpu, cpu->eff_operand));
+            if (cpu->regs.y > (cpu->eff_operand & 0xFF)) {
+                cpu->eff_operand += 0x100;
+            } else if (type == INS_R) {
+                _do_instr_operation(cpu);
+                return 0;
+            }
+
+            _fast_instr_rw(cpu, type);
+            return info->page_penalty;
+        case HND_JMP:
+            _fast_fetch_operand(cpu, 0); // fetch low byte of operand
+            cpu->regs.pc++;
+            _fast_fetch_operand(cpu, 8);
+
+            if (info->addr_mode == ABS) {
+                cpu->regs.pc = cpu->cur_operand;
+            } else {
+                cpu->regs.pc++;
+
+                cpu->eff_operand = _mem_read(cpu, cpu->cur_operand);
+                // page boundary crossing is not handled correctly - we emulate this bug here
+                cpu->regs.pc = (_mem_read(cpu, (cpu->cur_operand & 0xFF00) | ((cpu->cur_operand + 1) & 0xFF)) << 8)
+                        | (cpu->eff_operand & 0xFF);
+                cpu->eff_operand = cpu->regs.pc;
+            }
+            return 0;
+        case HND_JSR:
+            _fast_fetch_operand(cpu, 0); // fetch low byte of operand
+            cpu->regs.pc++;
+
+            // push PC high, then PC low
+            _mem_write(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp, cpu->regs.pc >> 8);
+            cpu->regs.sp--;
+            _mem_write(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp, cpu->regs.pc & 0xFF);
+            cpu->regs.sp--;
+
+            _fast_fetch_operand(cpu, 8);
+            cpu->eff_operand = cpu->cur_operand;
+            cpu->regs.pc = cpu->cur_operand;
+            return 0;
+        case HND_RTI:
+        case HND_RTS:
+            _next_prg_byte(cpu); // garbage read
+            cpu->regs.sp++;
+
+            if (info->handler == HND_RTI) {
+                cpu->regs.status.serial = _mem_read(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp);
+                cpu->regs.sp++;
+            }
+
+            cpu->regs.pc = _mem_read(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp);
+            cpu->regs.sp++;
+            cpu->regs.pc |= _mem_read(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp) << 8;
+
+            if (info->handler == HND_RTS) {
+                cpu->regs.pc++;
+            }
+            return 0;
+        case HND_PUSH: {
+            _next_prg_byte(cpu); // garbage read
+
+            uint8_t val = info->mnemonic == PHA ? cpu->regs.acc : (cpu->regs.status.serial | 0x30);
+            _mem_write(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp, val);
+            cpu->regs.sp--;
+            return 0;
+        }
+        case HND_PULL: {
+            _next_prg_byte(cpu); // garbage read
+            cpu->regs.sp++;
+
+            uint8_t val = _mem_read(cpu, STACK_BOTTOM_ADDR + cpu->regs.sp);
+            if (info->mnemonic == PLA) {
+                cpu->regs.acc = val;
+                _set_alu_flags(cpu, val);
+            } else {
+                cpu->regs.status.serial = val;
+            }
+            return 0;
         }
-    }
-}
+        case HND_BRANCH: {
+            _poll_interrupts(cpu);
 
-static void _handle_stack_pull(void) {
-    ASSERT_CYCLE(2, 4);
+            _fast_fetch_operand(cpu, 0);
+            cpu->regs.pc++;
 
-    switch (g_instr_cycle) {
-        case 2:
-            _next_prg_byte(); // garbage read
-            break;
-        case 3:
-            // increment S
-            g_cpu_regs.sp++;
+            _bus_write(cpu, _mem_read(cpu, cpu->regs.pc));
+            cpu->eff_operand = cpu->regs.pc + (int8_t) cpu->cur_operand;
 
-            break;
-        case 4: {
-            // pull register
-            uint8_t val = g_sys_iface.mem_read(STACK_BOTTOM_ADDR + g_cpu_regs.sp);
-            if (g_cur_instr->mnemonic == PLA) {
-                g_cpu_regs.acc = val;
-            } else {
-                g_cpu_regs.status.serial = val;
+            if (!_should_take_branch(cpu)) {
+                return 0;
             }
 
-            if (g_cur_instr->mnemonic == PLA) {
-                _set_alu_flags(val);
-            }
+            _bus_write(cpu, cpu->regs.pc & 0xFF);
+            cpu->regs.pc = (cpu->regs.pc & 0xFF00) | ((cpu->regs.pc + (int8_t) cpu->cur_operand) & 0xFF);
 
-            g_instr_cycle = 0; // reset for next instruction
+            _poll_interrupts(cpu);
 
-            break;
+            uint8_t old_pcl = _bus_read(cpu);
+            _bus_write(cpu, _mem_read(cpu, cpu->regs.pc));
+
+            return _fix_branch_page(cpu, old_pcl) ? 2 : 1;
         }
+        case HND_BRK:
+            cpu->cur_interrupt = &INT_BRK;
+            cpu->instr_cycle = 2;
+            do {
+                _execute_interrupt(cpu);
+            } while (cpu->instr_cycle++ != 0);
+            return 0;
+        default:
+            assert(false);
+            return 0;
     }
 }
 
-static void _handle_jsr(void) {
-    ASSERT_CYCLE(3, 6);
-
-    switch (g_instr_cycle) {
-        case 3:
-            // unsure of what happens here
+// Decodes the instructions starting at pc into block. Only memory mapped through the page table is cached, since
+// reading through the system interface may have side effects. JSR is never cached since it writes to the stack between
+// its two operand fetches.
+static void _build_block(Cpu6502 *cpu, CodeBlock *block, uint16_t pc) {
+    block->start_pc = pc;
+    block->count = 0;
+    block->hits = 0;
+    block->native = NULL;
+    block->pages[0] = pc >> 8;
+    block->pages[1] = pc >> 8;
+
+    while (block->count < MAX_BLOCK_INSTRS) {
+        uint8_t *page = cpu->page_map[pc >> 8];
+        if (page == NULL) {
             break;
-        case 4:
-            // push PC high, decrement S
-            g_sys_iface.mem_write(STACK_BOTTOM_ADDR + g_cpu_regs.sp, g_cpu_regs.pc >> 8);
-            g_cpu_regs.sp--;
+        }
+
+        uint8_t opcode = page[pc & 0xFF];
+        const OpcodeInfo *info = get_opcode_info(opcode);
+        if (info->handler == HND_JSR) {
             break;
-        case 5:
-            // push PC low, decrement S
-            g_sys_iface.mem_write(STACK_BOTTOM_ADDR + g_cpu_regs.sp, g_cpu_regs.pc & 0xFF);
-            g_cpu_regs.sp--;
+        }
 
+        // the block may span at most two pages so that its validity can be checked cheaply
+        uint8_t last_page = (uint16_t) (pc + info->len - 1) >> 8;
+        if (cpu->page_map[last_page] == NULL
+                || (last_page != block->pages[0] && last_page != (uint8_t) (block->pages[0] + 1))) {
             break;
-        case 6: {
-            // copy low byte to PC, fetch high byte to PC (but don't increment PC)
-            uint8_t pch = g_sys_iface.mem_read(g_cpu_regs.pc);
-            g_cur_operand |= pch << 8;
-            g_eff_operand = g_cur_operand;
+        }
 
-            g_cpu_regs.pc = g_cur_operand;
+        CachedInstr *cached = &block->instrs[block->count];
+        cached->instr = decode_instr(opcode);
+        cached->info = info;
+        cached->pc = pc;
+        cached->opcode = opcode;
+        cached->operand = 0;
 
-            g_instr_cycle = 0; // reset for next instruction
+        for (unsigned int i = 1; i < info->len; i++) {
+            uint16_t addr = pc + i;
+            cached->operand |= cpu->page_map[addr >> 8][addr & 0xFF] << ((i - 1) * 8);
+        }
+
+        block->pages[1] = last_page;
+        block->count++;
+        pc += info->len;
+
+        if (info->type == INS_BRANCH || info->type == INS_JUMP || info->type == INS_RET || info->handler == HND_BRK
+                || info->mnemonic == KIL) {
             break;
         }
     }
+
+    block->page_gens[0] = cpu->page_gen[block->pages[0]];
+    block->page_gens[1] = cpu->page_gen[block->pages[1]];
 }
 
-static bool _handle_stack_instr(void) {
-    switch (g_cur_instr->mnemonic) {
-        case PHA:
-        case PHP:
-            _handle_stack_push();
-            return true;
-        case PLA:
-        case PLP:
-            _handle_stack_pull();
-            return true;
-        default:
-            assert(false);
-    }
+static inline CodeBlock *_block_slot(Cpu6502 *cpu, uint16_t pc) {
+    return &cpu->block_cache[(pc ^ (pc >> 9)) & (BLOCK_CACHE_SIZE - 1)];
 }
 
-static void _handle_instr_rw(uint8_t offset) {
-    switch (get_instr_type(g_cur_instr->mnemonic)) {
-        case INS_R:
-            ASSERT_CYCLE(offset, offset);
+// makes a pre-decoded instruction current as if its opcode and operand had just been fetched
+static void _load_cached_instr(Cpu6502 *cpu, const CachedInstr *cached) {
+    cpu->last_opcode = cached->opcode;
+    cpu->cur_instr = cached->instr;
+    cpu->cur_info = cached->info;
+    cpu->cur_handler = g_instr_handlers[cached->info->handler];
+    cpu->cur_op = g_instr_operations[cached->info->mnemonic];
 
-            g_sys_iface.bus_write(g_sys_iface.mem_read(g_eff_operand));
-            _do_instr_operation();
+    _reset_instr_state(cpu);
 
-            g_instr_cycle = 0;
+    cpu->cur_operand = cached->operand;
+    cpu->operand_cached = true;
+}
 
-            break;
-        case INS_W:
-            ASSERT_CYCLE(offset, offset);
+unsigned int cpu_exec_cached_instr(Cpu6502 *cpu, const CachedInstr *cached) {
+    cpu->regs.pc = cached->pc;
 
-            _do_instr_operation();
-            g_sys_iface.mem_write(g_eff_operand, g_sys_iface.bus_read());
+    _load_cached_instr(cpu, cached);
 
-            g_instr_cycle = 0;
+    cpu->regs.pc++;
 
-            break;
-        case INS_RW:
-            ASSERT_CYCLE(offset, offset + 2);
+    unsigned int cycles = cached->info->cycles + _fast_exec_instr(cpu);
 
-            switch (g_instr_cycle - offset) {
-                case 0:
-                    g_sys_iface.bus_write(g_sys_iface.mem_read(g_eff_operand));
-                    break;
-                case 1:
-                    g_sys_iface.mem_write(g_eff_operand, g_sys_iface.bus_read());
-                    _do_instr_operation();
+    cpu->operand_cached = false;
+    cpu->instr_cycle = 1;
 
-                    break;
-                case 2:
-                    g_sys_iface.mem_write(g_eff_operand, g_sys_iface.bus_read());
-                    g_instr_cycle = 0;
-                    break;
-            }
+    return cycles;
+}
 
-            break;
-        default:
-            printf("Unhandled instr %s with type %d\n", mnemonic_to_str(g_cur_instr->mnemonic),
-                    get_instr_type(g_cur_instr->mnemonic));
-            fflush(stdout);
-            assert(false);
+// Returns the pre-decoded instruction at the current PC, or NULL if it cannot be served from the cache.
+static const CachedInstr *_next_cached_instr(Cpu6502 *cpu) {
+    uint16_t pc = cpu->regs.pc;
+
+    // fast path: continuing straight through the current block
+    CodeBlock *block = cpu->cur_block;
+    if (block != NULL && cpu->block_index < block->count && block->instrs[cpu->block_index].pc == pc
+            && block_is_valid(cpu, block)) {
+        return &block->instrs[cpu->block_index++];
     }
-}
 
-static void _handle_instr_zrp(void) {
-    g_eff_operand = g_cur_operand;
-    _handle_instr_rw(3);
+    block = _block_slot(cpu, pc);
+    if (block->count == 0 || block->start_pc != pc || !block_is_valid(cpu, block)) {
+        _build_block(cpu, block, pc);
+
+        if (block->count == 0) {
+            cpu->cur_block = NULL;
+            return NULL;
+        }
+    }
+
+    cpu->cur_block = block;
+    cpu->block_index = 1;
+    return &block->instrs[0];
 }
 
-static void _handle_instr_zpi(void) {
-    ASSERT_CYCLE(3, 6);
+unsigned int cpu_step_instruction(Cpu6502 *cpu) {
+    unsigned int cycles = 0;
 
-    if (g_instr_cycle == 3) {
-        g_sys_iface.bus_write(g_sys_iface.mem_read(g_cur_operand));
-        g_eff_operand = (g_cur_operand + (g_cur_instr->addr_mode == ZPX ? g_cpu_regs.x : g_cpu_regs.y)) & 0xFF;
-    } else {
-        _handle_instr_rw(4);
+    if (cpu->jammed) {
+        return 0;
     }
-}
 
-static void _handle_instr_abs(void) {
-    ASSERT_CYCLE(3, 6);
+    // anything already in flight (including interrupt sequences) is finished by the cycle-stepped core
+    if (cpu->instr_cycle != 1 || cpu->cur_interrupt != NULL || cpu->queued_interrupt != NULL) {
+        do {
+            cycle_cpu(cpu);
+            cycles++;
+        } while (cpu->instr_cycle != 1 || cpu->cur_interrupt != NULL);
 
-    if (g_instr_cycle == 3) {
-        g_cur_operand |= (_next_prg_byte() << 8); // fetch high byte of operand
-        g_cpu_regs.pc++; // increment PC
+        return cycles;
+    }
+
+    _log_last_instr(cpu);
+
+    const CachedInstr *cached = cpu->block_cache != NULL ? _next_cached_instr(cpu) : NULL;
+    if (cached != NULL) {
+        _load_cached_instr(cpu, cached);
     } else {
-        g_eff_operand = g_cur_operand;
-        _handle_instr_rw(4);
+        cpu->last_opcode = _next_prg_byte(cpu);
+        _decode_opcode(cpu);
+
+        _reset_instr_state(cpu);
     }
-}
 
-static void _handle_instr_abi(void) {
-    ASSERT_CYCLE(3, 8);
+    cpu->regs.pc++;
 
-    switch (g_instr_cycle) {
-        case 3:
-            g_cur_operand |= (_next_prg_byte() << 8); // fetch high byte of operand
-            g_eff_operand = (g_cur_operand & 0xFF00)
-                    | ((g_cur_operand + (g_cur_instr->addr_mode == ABX ? g_cpu_regs.x : g_cpu_regs.y)) & 0xFF);
-            g_cpu_regs.pc++; // increment PC
+    cycles = cpu->cur_info->cycles + _fast_exec_instr(cpu);
+    cpu->cycle_count += cycles;
 
-            break;
-        case 4:
-            g_sys_iface.bus_write(g_sys_iface.mem_read(g_eff_operand));
-            // fix effective address
-            if ((g_cur_operand & 0xFF) + (g_cur_instr->addr_mode == ABX ? g_cpu_regs.x : g_cpu_regs.y) >= 0x100) {
-                g_eff_operand += 0x100;
-            } else if (get_instr_type(g_cur_instr->mnemonic) == INS_R) {
-                // we're finished if the high byte was correct
-                _do_instr_operation();
+    cpu->operand_cached = false;
 
-                g_instr_cycle = 0;
-            }
-            break;
-        default:
-            _handle_instr_rw(5);
-            break;
+    // interrupt lines are only sampled once per instruction in this mode
+    if (cpu->queued_interrupt == NULL && cpu->cur_info->addr_mode != REL) {
+        _poll_interrupts(cpu);
     }
-}
 
-static void _handle_instr_izx(void) {
-    ASSERT_CYCLE(3, 8);
+    _read_interrupt_lines(cpu);
 
-    switch (g_instr_cycle) {
-        case 3:
-            g_sys_iface.mem_read(g_cur_operand);
-            g_cur_operand = (g_cur_operand & 0xFF00) | ((g_cur_operand + g_cpu_regs.x) & 0xFF);
-            break;
-        case 4:
-            g_eff_operand = 0;
-            g_eff_operand |= g_sys_iface.mem_read(g_cur_operand);
-            break;
-        case 5:
-            g_eff_operand |= g_sys_iface.mem_read((g_cur_operand & 0xFF00) | ((g_cur_operand + 1) & 0xFF)) << 8;
+    cpu->instr_cycle = 1;
 
-            break;
-        default:
-            _handle_instr_rw(6);
-            break;
+    return cycles;
+}
+
+static void _discard_native_code(Cpu6502 *cpu) {
+    if (cpu->block_cache == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < BLOCK_CACHE_SIZE; i++) {
+        cpu->block_cache[i].native = NULL;
+        cpu->block_cache[i].hits = 0;
     }
 }
 
-static void _handle_instr_izy(void) {
-    ASSERT_CYCLE(3, 8);
+// whether whole blocks may currently be run without stepping through their instructions one at a time
+static bool _can_run_block(const Cpu6502 *cpu) {
+    return !cpu->jammed && cpu->instr_cycle == 1 && cpu->cur_interrupt == NULL && cpu->queued_interrupt == NULL
+            && !_is_tracing(cpu);
+}
 
-    switch (g_instr_cycle) {
-        case 3:
-            g_eff_operand &= ~0xFF;
-            g_eff_operand |= g_sys_iface.mem_read(g_cur_operand);
-            break;
-        case 4:
-            g_eff_operand &= ~0xFF00;
-            g_eff_operand |= g_sys_iface.mem_read((g_cur_operand & 0xFF00) | ((g_cur_operand + 1) & 0xFF)) << 8;
+// leaves the CPU as if the given instruction had just been stepped through at the end of a block
+static void _finish_block(Cpu6502 *cpu, uint8_t opcode, uint16_t operand) {
+    cpu->last_opcode = opcode;
+    cpu->cur_instr = decode_instr(opcode);
+    cpu->cur_info = get_opcode_info(opcode);
+    cpu->cur_handler = g_instr_handlers[cpu->cur_info->handler];
+    cpu->cur_op = g_instr_operations[cpu->cur_info->mnemonic];
+    cpu->cur_operand = operand;
+    cpu->cur_block = NULL;
+
+    // blocks sample the interrupt lines once at their end
+    if (cpu->queued_interrupt == NULL) {
+        _poll_interrupts(cpu);
+    }
 
-            g_eff_operand = (g_eff_operand & 0xFF00) | ((g_eff_operand + g_cpu_regs.y) & 0xFF);
-            break;
-        case 5: {
-            g_sys_iface.mem_read(g_eff_operand);
+    _read_interrupt_lines(cpu);
+}
 
-            if (g_cpu_regs.y > (g_eff_operand & 0xFF)) {
-                g_eff_operand += 0x100;
-                // need to deal with instr operation on next cycle
-            } else if (get_instr_type(g_cur_instr->mnemonic) == INS_R) {
-                // we're finished if the high byte was correct, correct value is on bus
+// Runs the translated code for the block starting at the current PC, translating it first if it has become hot.
+// Returns the number of instructions executed, which is 0 if the interpreter has to be used instead.
+static unsigned int _run_native_block(Cpu6502 *cpu, uint64_t remaining, uint64_t *cycles) {
+    if (!_can_run_block(cpu) || cpu->block_cache == NULL) {
+        return 0;
+    }
 
-                _do_instr_operation();
+    CodeBlock *block = _block_slot(cpu, cpu->regs.pc);
+    if (block->count == 0 || block->start_pc != cpu->regs.pc || block->count > remaining
+            || !block_is_valid(cpu, block)) {
+        return 0;
+    }
 
-                g_instr_cycle = 0;
-            }
+    if (block->native == NULL) {
+        if (++block->hits < cpu->jit_threshold) {
+            return 0;
+        }
 
-            break;
+        if ((block->native = jit_compile_block(cpu->jit, block)) == NULL) {
+            // usually the arena is full, so start over with only the current block
+            _discard_native_code(cpu);
+            jit_arena_reset(cpu->jit);
+
+            if ((block->native = jit_compile_block(cpu->jit, block)) == NULL) {
+                return 0;
+            }
         }
-        default:
-            _handle_instr_rw(6);
-            break;
     }
+
+    uint32_t res = block->native(cpu);
+    unsigned int executed = JIT_RESULT_INSTRS(res);
+    *cycles += JIT_RESULT_CYCLES(res);
+    cpu->cycle_count += JIT_RESULT_CYCLES(res);
+
+    const CachedInstr *last = &block->instrs[executed - 1];
+    _finish_block(cpu, last->opcode, last->operand);
+
+    return executed;
 }
 
-static void _handle_jmp(void) {
-    switch (g_cur_instr->addr_mode) {
-        case ABS:
-            ASSERT_CYCLE(3, 3);
-            
-            uint8_t pch = g_sys_iface.mem_read(g_cpu_regs.pc);
-            g_cpu_regs.pc++;
+// Runs the ahead-of-time compiled block starting at the current PC. Returns the number of instructions executed, which
+// is 0 if the interpreter has to be used instead.
+static unsigned int _run_static_block(Cpu6502 *cpu, uint64_t remaining, uint64_t *cycles) {
+    if (!_can_run_block(cpu)) {
+        return 0;
+    }
 
-            g_cur_operand |= pch << 8;
+    const CpuStaticBlock *block = cpu->static_lookup(cpu->regs.pc);
+    if (block == NULL || block->instr_count > remaining) {
+        return 0;
+    }
 
-            g_cpu_regs.pc = g_cur_operand;
-            
+    unsigned int block_cycles = block->run(cpu);
+    *cycles += block_cycles;
+    cpu->cycle_count += block_cycles;
 
-            g_instr_cycle = 0;
-            
-            break;
-        case IND:
-            ASSERT_CYCLE(3, 5);
-            switch (g_instr_cycle) {
-                case 3:
-                    g_cur_operand |= _next_prg_byte() << 8; // fetch high byte of operand
-                    g_cpu_regs.pc++; // increment PC
-                    break;
-                case 4:
-                    g_eff_operand &= ~0xFF;
-                    g_eff_operand |= g_sys_iface.mem_read(g_cur_operand); // fetch target low
+    _finish_block(cpu, block->last_opcode, block->last_operand);
 
-                    break;
-                case 5:
-                    g_cpu_regs.pc = 0; // clear PC (technically not accurate, but it has no practical consequence)
-                    // fetch target high to PC
-                    // we technically don't do this properly, but sub-cycle accuracy is not necessarily a goal
-                    // page boundary crossing is not handled correctly - we emulate this bug here
-                    g_cpu_regs.pc |= (g_sys_iface.mem_read((g_cur_operand & 0xFF00) | ((g_cur_operand + 1) & 0xFF)) << 8);
-                    // copy low address byte to PC
-                    g_cpu_regs.pc |= g_eff_operand & 0xFF;
-                    
-                    // this is for logging purposes only
-                    g_eff_operand = g_cpu_regs.pc;
+    return block->instr_count;
+}
 
-                    g_instr_cycle = 0;
+// executes instructions until either count of them have run or the cycle counter has reached end_cycle
+static uint64_t _run_instructions(Cpu6502 *cpu, uint64_t count, uint64_t end_cycle) {
+    uint64_t cycles = 0;
 
-                    break;
+    cpu->idle_watching = false; // the host may have changed memory since the last run
+
+    for (uint64_t i = 0; i < count && cpu->cycle_count < end_cycle;) {
+        // skipping would throw off the instruction count, so it is only done when running up to a cycle
+        if (end_cycle != UINT64_MAX && _can_skip_idle(cpu)) {
+            cycles += _skip_idle_loop(cpu, end_cycle, false);
+            if (cpu->cycle_count >= end_cycle) {
+                break;
             }
+        }
+
+        if (cpu->jammed && end_cycle != UINT64_MAX) {
+            // nothing will happen until the end cycle
+            cycles += end_cycle - cpu->cycle_count;
+            cpu->cycle_count = end_cycle;
             break;
-        default:
-            assert(false);
+        }
+
+        if (cpu->static_lookup != NULL) {
+            unsigned int executed = _run_static_block(cpu, count - i, &cycles);
+            if (executed != 0) {
+                i += executed;
+                continue;
+            }
+        }
+
+        if (cpu->jit != NULL) {
+            unsigned int executed = _run_native_block(cpu, count - i, &cycles);
+            if (executed != 0) {
+                i += executed;
+                continue;
+            }
+        }
+
+        cycles += cpu_step_instruction(cpu);
+        i++;
     }
+
+    return cycles;
 }
 
-// forward declaration for branch handling
-static void _do_instr_cycle(void);
+uint64_t cpu_run_instructions(Cpu6502 *cpu, uint64_t count) {
+    return _run_instructions(cpu, count, UINT64_MAX);
+}
 
-static void _handle_branch(void) {
-    ASSERT_CYCLE(3, 4);
+uint64_t cpu_run_until_cycle(Cpu6502 *cpu, uint64_t cycle) {
+    return _run_instructions(cpu, UINT64_MAX, cycle);
+}
 
-    switch (g_instr_cycle) {
-        case 3:
-            g_sys_iface.bus_write(g_sys_iface.mem_read(g_cpu_regs.pc));
+bool cpu_set_jit(Cpu6502 *cpu, unsigned int hot_threshold) {
+    if (hot_threshold == 0) {
+        _discard_native_code(cpu);
+        jit_arena_destroy(cpu->jit);
+        cpu->jit = NULL;
+        cpu->jit_threshold = 0;
+        return true;
+    }
 
-            g_eff_operand = g_cpu_regs.pc + (int8_t) g_cur_operand;
+    if (cpu->jit == NULL && (cpu->jit = jit_arena_create()) == NULL) {
+        return false;
+    }
 
-            bool should_take;
-            switch (g_cur_instr->mnemonic) {
-                case BCC:
-                    should_take = !g_cpu_regs.status.carry;
-                    break;
-                case BCS:
-                    should_take = g_cpu_regs.status.carry;
-                    break;
-                case BNE:
-                    should_take = !g_cpu_regs.status.zero;
-                    break;
-                case BEQ:
-                    should_take = g_cpu_regs.status.zero;
-                    break;
-                case BPL:
-                    should_take = !g_cpu_regs.status.negative;
-                    break;
-                case BMI:
-                    should_take = g_cpu_regs.status.negative;
-                    break;
-                case BVC:
-                    should_take = !g_cpu_regs.status.overflow;
-                    break;
-                case BVS:
-                    should_take = g_cpu_regs.status.overflow;
-                    break;
-                default:
-                    assert(false);
-            }
+    if (!cpu_set_block_cache(cpu, true)) {
+        return false;
+    }
 
-            if (should_take) {
-                g_sys_iface.bus_write(g_cpu_regs.pc & 0xFF);
-                g_cpu_regs.pc = (g_cpu_regs.pc & 0xFF00) | ((g_cpu_regs.pc + (int8_t) g_cur_operand) & 0xFF);
-            } else {
-                // recursive call to fetch the next opcode
-                g_instr_cycle = 1;
-                _do_instr_cycle();
-            }
-            return;
-        case 4: {
-            _poll_interrupts();
+    cpu->jit_threshold = hot_threshold;
 
-            uint8_t old_pcl = g_sys_iface.bus_read();
+    return true;
+}
 
-            g_sys_iface.bus_write(g_sys_iface.mem_read(g_cpu_regs.pc));
+void cpu_set_static_code(Cpu6502 *cpu, CpuStaticLookup lookup) {
+    cpu->static_lookup = lookup;
+}
 
-            if ((int8_t) g_cur_operand < 0 && -(int8_t) g_cur_operand > old_pcl) {
-                g_cpu_regs.pc -= 0x100;
-            } else if ((int8_t) g_cur_operand > 0 && g_cur_operand + old_pcl >= 0x100) {
-                g_cpu_regs.pc += 0x100;
-            } else {
-                // recursive call to fetch the next opcode
-                g_instr_cycle = 1;
-                _do_instr_cycle();
-                return;
-            }
+uint8_t cpu_read_memory(Cpu6502 *cpu, uint16_t addr) {
+    return _mem_read(cpu, addr);
+}
 
-            g_instr_cycle = 0;
+void cpu_write_memory(Cpu6502 *cpu, uint16_t addr, uint8_t val) {
+    _mem_write(cpu, addr, val);
+}
 
-            break;
-        }
-        default:
-            assert(false);
+static void _put_le(uint8_t *dst, uint64_t val, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = (val >> (i * 8)) & 0xFF;
     }
 }
 
-static void _do_instr_cycle(void) {
-    if (g_cur_interrupt) {
-        _execute_interrupt();
-    } else if (g_instr_cycle == 1) {
-        if (g_log_callback != NULL && g_cur_instr != NULL) {
-            char instr_str[40];
-            g_log_callback(cpu_print_current_instruction(instr_str), g_regs_snapshot);
-            g_regs_snapshot = g_cpu_regs;
-        }
+static uint64_t _get_le(const uint8_t *src, size_t len) {
+    uint64_t val = 0;
+    for (size_t i = 0; i < len; i++) {
+        val |= (uint64_t) src[i] << (i * 8);
+    }
+    return val;
+}
 
-        if (g_queued_interrupt) {
-            g_cur_instr = NULL;
-            g_cur_interrupt = g_queued_interrupt;
-            g_queued_interrupt = NULL;
-            _execute_interrupt();
-        } else {
-            g_last_opcode = _next_prg_byte(); // store last opcode
-            g_cur_instr = decode_instr(g_last_opcode); // fetch and decode opcode
+static void _put_regs(uint8_t *dst, const CpuRegisters *regs) {
+    _put_le(dst, regs->pc, 2);
+    dst[2] = regs->sp;
+    dst[3] = regs->acc;
+    dst[4] = regs->x;
+    dst[5] = regs->y;
+    dst[6] = regs->status.serial;
+}
 
-            _reset_instr_state();
+static void _get_regs(const uint8_t *src, CpuRegisters *regs) {
+    regs->pc = _get_le(src, 2);
+    regs->sp = src[2];
+    regs->acc = src[3];
+    regs->x = src[4];
+    regs->y = src[5];
+    regs->status.serial = src[6];
+}
 
-            g_cpu_regs.pc++; // increment PC
+static uint8_t _interrupt_type_index(const InterruptType *type) {
+    for (uint8_t i = 0; i < sizeof(g_interrupt_types) / sizeof(g_interrupt_types[0]); i++) {
+        if (g_interrupt_types[i] == type) {
+            return i;
         }
+    }
 
-        return;
-    } else if (g_cur_instr->mnemonic == BRK) {
-        g_cur_interrupt = &INT_BRK;
-        _execute_interrupt();
-        return;
-    } else if (g_instr_cycle == 2 && g_cur_instr->addr_mode != IMP && g_cur_instr->addr_mode != IMM) {
-        // special case
-        if (g_cur_instr->addr_mode == REL) {
-            _poll_interrupts();
-        }
+    assert(false);
+    return 0;
+}
 
-        // this doesn't execute for implicit/immediate instructions because they have additional steps beyond fetching
-        // on this cycle
-        g_cur_operand |= _next_prg_byte(); // fetch low byte of operand
-        g_cpu_regs.pc++; // increment PC
-        return;
-    } else {
-        InstructionType type = get_instr_type(g_cur_instr->mnemonic);
-        if (type == INS_JUMP) {
-            if (g_cur_instr->mnemonic == JSR) {
-                _handle_jsr();
-            } else {
-                assert(g_cur_instr->mnemonic == JMP);
-                _handle_jmp();
-            }
-            return;
-        } else if (type == INS_RET) {
-            if (g_cur_instr->mnemonic == RTI) {
-                _handle_rti();
-            } else {
-                assert(g_cur_instr->mnemonic == RTS);
-                _handle_rts();
-            }
-            return;
-        } else if (type == INS_BRANCH) {
-            _handle_branch();
-            return;
-        } else if (type == INS_STACK) {
-            _handle_stack_instr();
-            return;
-        }
+// Layout (version 1, all values little-endian):
+//   0  magic            4  version (16 bits)  6  size (16 bits)     8  cycle count (64 bits)
+//  16  cycle count at the register snapshot (64 bits)
+//  24  registers: PC (16 bits), SP, A, X, Y, P
+//  31  register snapshot, laid out the same way
+//  38  instruction cycle  39  last opcode       40  operand (16 bits)  42  effective operand (16 bits)
+//  44  current interrupt  45  queued interrupt  46  STATE_* flags      47  last NMI line state (32 bits)
+//  51  data bus latch
+void cpu_save_state(Cpu6502 *cpu, uint8_t *buf) {
+    memcpy(buf, STATE_MAGIC, 4);
+    _put_le(buf + 4, STATE_VERSION, 2);
+    _put_le(buf + 6, CPU_STATE_SIZE, 2);
+    _put_le(buf + 8, cpu->cycle_count, 8);
+    _put_le(buf + 16, cpu->cycle_snapshot, 8);
+    _put_regs(buf + 24, &cpu->regs);
+    _put_regs(buf + 31, &cpu->regs_snapshot);
+    buf[38] = cpu->instr_cycle;
+    buf[39] = cpu->last_opcode;
+    _put_le(buf + 40, cpu->cur_operand, 2);
+    _put_le(buf + 42, cpu->eff_operand, 2);
+    buf[44] = _interrupt_type_index(cpu->cur_interrupt);
+    buf[45] = _interrupt_type_index(cpu->queued_interrupt);
+    buf[46] = (cpu->nmi_edge_detector ? STATE_NMI_EDGE_DETECTOR : 0)
+            | (cpu->irq_line_reader ? STATE_IRQ_LINE_READER : 0)
+            | (cpu->rst_line_reader ? STATE_RST_LINE_READER : 0)
+            | (cpu->nmi_hijack ? STATE_NMI_HIJACK : 0)
+            | (cpu->jammed ? STATE_JAMMED : 0)
+            | (cpu->cur_instr != NULL ? STATE_HAS_INSTR : 0);
+    _put_le(buf + 47, cpu->nmi_line_last_state, 4);
+    buf[51] = _bus_read(cpu);
+}
 
-        switch (g_cur_instr->addr_mode) {
-            case IMP:
-                ASSERT_CYCLE(2, 2);
+// whether the instruction cycle of a saved state can occur within its instruction or interrupt sequence
+static bool _is_valid_instr_cycle(const uint8_t *buf) {
+    uint8_t instr_cycle = buf[38];
 
-                switch (get_instr_type(g_cur_instr->mnemonic)) {
-                    case INS_R:
-                        g_sys_iface.bus_write(g_cpu_regs.acc);
-                        _do_instr_operation();
-                        break;
-                    case INS_W:
-                        _do_instr_operation();
-                        g_cpu_regs.acc = g_sys_iface.bus_read();
-                        break;
-                    case INS_RW:
-                        g_sys_iface.bus_write(g_cpu_regs.acc);
-                        _do_instr_operation();
-                        g_cpu_regs.acc = g_sys_iface.bus_read();
-                        break;
-                    case INS_STACK:
-                    case INS_REG:
-                    case INS_RET:
-                    case INS_OTHER:
-                        _do_instr_operation();
-                        break;
-                    default:
-                        assert(false);
-                }
-                g_instr_cycle = 0; // reset for next instruction
-                break;
-            case IMM:
-                ASSERT_CYCLE(2, 2);
-        
-                g_cur_operand |= _next_prg_byte(); // fetch immediate byte
-                g_cpu_regs.pc++; // increment PC
+    if (instr_cycle == 0) {
+        return false;
+    }
 
-                g_sys_iface.bus_write(g_cur_operand & 0xFF);
-                _do_instr_operation();
+    if (buf[44] != 0) {
+        return instr_cycle <= 7;
+    }
 
-                g_instr_cycle = 0; // reset for next instruction
-                break;
-            case ZRP:
-                _handle_instr_zrp();
-                break;
-            case ZPX:
-            case ZPY:
-                _handle_instr_zpi();
-                break;
-            case ABS:
-                _handle_instr_abs();
-                break;
-            case ABX:
-            case ABY:
-                _handle_instr_abi();
-                break;
-            case IZX:
-                _handle_instr_izx();
-                break;
-            case IZY:
-                _handle_instr_izy();
-                break;
-            default:
-                assert(false);
-        }
+    // without an instruction in flight, only the next opcode fetch can be pending
+    if (!(buf[46] & STATE_HAS_INSTR)) {
+        return instr_cycle == 1;
     }
+
+    // crossing a page costs an extra cycle, and a taken branch one more
+    const OpcodeInfo *info = get_opcode_info(buf[39]);
+    return instr_cycle <= info->cycles + (info->addr_mode == REL ? 2 : info->page_penalty);
 }
 
-void cycle_cpu(void) {
-    _do_instr_cycle();
-    
-    if (g_queued_interrupt == NULL && g_instr_cycle == 0 && !(g_cur_instr != NULL && g_cur_instr->addr_mode == REL)) {
-        _poll_interrupts();
+bool cpu_load_state(Cpu6502 *cpu, const uint8_t *buf, size_t len) {
+    const size_t interrupt_type_count = sizeof(g_interrupt_types) / sizeof(g_interrupt_types[0]);
+
+    if (len < CPU_STATE_SIZE || memcmp(buf, STATE_MAGIC, 4) != 0 || _get_le(buf + 4, 2) != STATE_VERSION
+            || _get_le(buf + 6, 2) != CPU_STATE_SIZE || buf[44] >= interrupt_type_count
+            || buf[45] >= interrupt_type_count || !_is_valid_instr_cycle(buf)) {
+        return false;
+    }
+
+    cpu->cycle_count = _get_le(buf + 8, 8);
+    cpu->cycle_snapshot = _get_le(buf + 16, 8);
+    _get_regs(buf + 24, &cpu->regs);
+    _get_regs(buf + 31, &cpu->regs_snapshot);
+    cpu->instr_cycle = buf[38];
+    cpu->last_opcode = buf[39];
+    cpu->cur_operand = _get_le(buf + 40, 2);
+    cpu->eff_operand = _get_le(buf + 42, 2);
+    cpu->cur_interrupt = g_interrupt_types[buf[44]];
+    cpu->queued_interrupt = g_interrupt_types[buf[45]];
+    cpu->nmi_edge_detector = buf[46] & STATE_NMI_EDGE_DETECTOR;
+    cpu->irq_line_reader = buf[46] & STATE_IRQ_LINE_READER;
+    cpu->rst_line_reader = buf[46] & STATE_RST_LINE_READER;
+    cpu->nmi_hijack = buf[46] & STATE_NMI_HIJACK;
+    cpu->jammed = buf[46] & STATE_JAMMED;
+    cpu->nmi_line_last_state = _get_le(buf + 47, 4);
+    _bus_write(cpu, buf[51]);
+
+    if (buf[46] & STATE_HAS_INSTR) {
+        _decode_opcode(cpu);
+    } else {
+        cpu->cur_instr = NULL;
+        cpu->cur_info = NULL;
+        cpu->cur_handler = NULL;
+        cpu->cur_op = NULL;
     }
 
-    _read_interrupt_lines();
+    cpu->operand_cached = false;
+    cpu->cur_block = NULL;
+    cpu->stop_reason = CPU_STOP_NONE;
+    cpu->idle_watching = false;
 
-    g_instr_cycle++;
+    return true;
 }
 
-char *cpu_print_current_instruction(char *target) {
+// formats the machine code, mnemonic and operand of an instruction along with the data it accessed
+static char *_format_instr(char *target, uint8_t opcode, uint16_t operand, uint16_t eff_operand, uint8_t bus_val) {
+    const Instruction *instr = decode_instr(opcode);
+
     char str_machine_code[9];
-    switch (get_instr_len(g_cur_instr)) {
+    switch (get_instr_len(instr)) {
         case 1:
-            sprintf(str_machine_code, "%02X      ", g_last_opcode);
+            sprintf(str_machine_code, "%02X      ", opcode);
             break;
         case 2:
-            sprintf(str_machine_code, "%02X %02X   ", g_last_opcode, g_cur_operand & 0xFF);
+            sprintf(str_machine_code, "%02X %02X   ", opcode, operand & 0xFF);
             break;
         case 3:
-            sprintf(str_machine_code, "%02X %02X %02X", g_last_opcode, g_cur_operand & 0xFF, g_cur_operand >> 8);
+            sprintf(str_machine_code, "%02X %02X %02X", opcode, operand & 0xFF, operand >> 8);
             break;
     }
 
     char str_param[24];
-    InstructionType instr_type = get_instr_type(g_cur_instr->mnemonic);
-    switch (g_cur_instr->addr_mode) {
+    InstructionType instr_type = get_instr_type(instr->mnemonic);
+    switch (instr->addr_mode) {
         case IMM:
-            sprintf(str_param, "#$%02X                   ", g_cur_operand & 0xFF);
+            sprintf(str_param, "#$%02X                   ", operand & 0xFF);
             break;
         case ZRP:
             switch (instr_type) {
                 case INS_R:
                 case INS_RW:
-                    sprintf(str_param, "$%02X              -> $%02X", g_cur_operand & 0xFF, g_sys_iface.bus_read());
+                    sprintf(str_param, "$%02X              -> $%02X", operand & 0xFF, bus_val);
                     break;
                 default:
-                    sprintf(str_param, "$%02X              <- $%02X", g_cur_operand & 0xFF, g_sys_iface.bus_read());
+                    sprintf(str_param, "$%02X              <- $%02X", operand & 0xFF, bus_val);
                     break;
             }
             break;
@@ -1244,23 +3005,23 @@ char *cpu_print_current_instruction(char *target) {
             switch (instr_type) {
                 case INS_R:
                     sprintf(str_param, "$%02X,%c   -> $%04X -> $%02X",
-                            g_cur_operand & 0xFF, g_cur_instr->addr_mode == ZPX ? 'X' : 'Y', g_eff_operand,
-                            g_sys_iface.bus_read());
+                            operand & 0xFF, instr->addr_mode == ZPX ? 'X' : 'Y', eff_operand,
+                            bus_val);
                     break;
                 default:
                     sprintf(str_param, "$%02X,%c   -> $%04X <- $%02X",
-                            g_cur_operand & 0xFF, g_cur_instr->addr_mode == ZPX ? 'X' : 'Y', g_eff_operand,
-                            g_sys_iface.bus_read());
+                            operand & 0xFF, instr->addr_mode == ZPX ? 'X' : 'Y', eff_operand,
+                            bus_val);
                     break;
             }
             break;
         case ABS:
             switch (instr_type) {
                 case INS_R:
-                    sprintf(str_param, "$%04X            -> $%02X", g_cur_operand, g_sys_iface.bus_read());
+                    sprintf(str_param, "$%04X            -> $%02X", operand, bus_val);
                     break;
                 default:
-                    sprintf(str_param, "$%04X            <- $%02X", g_cur_operand, g_sys_iface.bus_read());
+                    sprintf(str_param, "$%04X            <- $%02X", operand, bus_val);
                     break;
             }
             break;
@@ -1269,28 +3030,28 @@ char *cpu_print_current_instruction(char *target) {
             switch (instr_type) {
                 case INS_R:
                     sprintf(str_param, "$%04X,%c -> $%04X -> $%02X",
-                            g_cur_operand, g_cur_instr->addr_mode == ABX ? 'X' : 'Y', g_eff_operand, g_sys_iface.bus_read());
+                            operand, instr->addr_mode == ABX ? 'X' : 'Y', eff_operand, bus_val);
                     break;
                 default:
                     sprintf(str_param, "$%04X,%c -> $%04X <- $%02X",
-                            g_cur_operand, g_cur_instr->addr_mode == ABX ? 'X' : 'Y', g_eff_operand, g_sys_iface.bus_read());
+                            operand, instr->addr_mode == ABX ? 'X' : 'Y', eff_operand, bus_val);
                     break;
             }
             break;
         case REL:
             sprintf(str_param, "#$%02X    -> $%04X       ",
-                    g_cur_operand & 0xFF, g_eff_operand);
+                    operand & 0xFF, eff_operand);
             break;
         case IND:
-            sprintf(str_param, "($%04X) -> $%04X       ", g_cur_operand, g_eff_operand);
+            sprintf(str_param, "($%04X) -> $%04X       ", operand, eff_operand);
             break;
         case IZX:
-            sprintf(str_param, "($%02X,X) -> $%04X -> $%02X", g_cur_operand & 0xFF, g_eff_operand,
-                    g_sys_iface.bus_read());
+            sprintf(str_param, "($%02X,X) -> $%04X -> $%02X", operand & 0xFF, eff_operand,
+                    bus_val);
             break;
         case IZY:
-            sprintf(str_param, "($%02X),Y -> $%04X -> $%02X", g_cur_operand & 0xFF, g_eff_operand,
-                    g_sys_iface.bus_read());
+            sprintf(str_param, "($%02X),Y -> $%04X -> $%02X", operand & 0xFF, eff_operand,
+                    bus_val);
             break;
         case IMP:
             sprintf(str_param, "                       ");
@@ -1299,8 +3060,22 @@ char *cpu_print_current_instruction(char *target) {
 
     sprintf(target, "%s  %s %s",
             str_machine_code,
-            mnemonic_to_str(g_cur_instr->mnemonic),
+            mnemonic_to_str(instr->mnemonic),
             str_param);
 
     return target;
 }
+
+char *cpu_print_current_instruction(Cpu6502 *cpu, char *target) {
+    return _format_instr(target, cpu->last_opcode, cpu->cur_operand, cpu->eff_operand, _bus_read(cpu));
+}
+
+char *cpu_format_trace_record(const CpuTraceRecord *record, char *target) {
+    char instr_str[40];
+    _format_instr(instr_str, record->opcode, record->operand, record->eff_addr, record->bus_val);
+
+    sprintf(target, "%04X  %s  A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%" PRIu64,
+            record->pc, instr_str, record->acc, record->x, record->y, record->status, record->sp, record->cycle);
+
+    return target;
+}
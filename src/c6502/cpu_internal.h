@@ -0,0 +1,222 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "c6502/cpu.h"
+#include "c6502/instrs.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLOCK_CACHE_SIZE 512 // must be a power of two
+#define MAX_BLOCK_INSTRS 16
+
+// translated blocks return the number of cycles they took in the low half and the number of instructions executed in
+// the high half of their result
+#define JIT_RESULT_CYCLES(res) ((res) & 0xFFFF)
+#define JIT_RESULT_INSTRS(res) ((res) >> 16)
+
+typedef struct JitArena JitArena;
+
+typedef uint32_t (*JitBlockFn)(Cpu6502 *cpu);
+
+// everything which decides how an idle loop's next iteration goes, apart from the memory it reads
+typedef struct {
+    uint64_t cycle;
+    uint8_t acc;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t status;
+    uint8_t bus_val;
+    uint8_t lines; // the line readers and the NMI edge detector
+    unsigned int nmi_line_last_state;
+    uint64_t next_change; // the first cycle at which the lines might change
+} IdleState;
+
+// a change of an interrupt line scheduled with cpu_schedule_line_change()
+typedef struct {
+    uint64_t cycle;
+    uint8_t line;
+    bool low;
+} LineChange;
+
+// A page of memory belonging to CPUs rather than to the host, such as the private copy made on the first write to a
+// copy-on-write page. Every page table entry pointing at it holds a reference, as does a snapshot kept for cloning.
+// Clones may run on other threads, so the count is atomic; a page with no references beyond those of the ring of pages
+// mapping it in one CPU can only be reached from that CPU.
+typedef struct {
+    atomic_size_t refs;
+    uint8_t data[0x100];
+} OwnedPage;
+
+// a pre-decoded instruction within a cached basic block
+typedef struct {
+    const Instruction *instr;
+    const OpcodeInfo *info;
+    uint16_t pc;
+    uint16_t operand;
+    uint8_t opcode;
+} CachedInstr;
+
+// a straight-line run of instructions from mapped memory, ending at the first control flow instruction
+typedef struct {
+    uint16_t start_pc;
+    uint8_t count; // 0 if the entry is unused
+    uint8_t pages[2]; // first and last page touched by the block's bytes
+    uint64_t page_gens[2]; // the generations of the above pages when the block was built
+    uint32_t hits; // the number of times the block has been entered since it was built
+    JitBlockFn native; // translated code for the block, or NULL
+    CachedInstr instrs[MAX_BLOCK_INSTRS];
+} CodeBlock;
+
+struct Cpu6502 {
+    CpuSystemInterface sys_iface;
+
+    // host memory backing each 256-byte page, or NULL if accesses should go through the system interface
+    uint8_t *page_map[0x100];
+    uint8_t page_flags[0x100];
+    uint64_t page_gen[0x100]; // bumped whenever the contents or the mapping of a page change through the CPU
+    uint8_t page_alias[0x100]; // the next page in a ring of pages mapped to the same host memory
+    uint64_t page_dirty[0x100]; // the dirty epoch in which each page was last written, see cpu_mark_dirty_pages()
+    uint64_t dirty_epoch;
+    OwnedPage *page_owned[0x100]; // the owned page backing each page, or NULL if it is host memory
+    // Copies of the read-write host memory taken by cpu_clone(), kept for the lowest page of each ring of aliases along
+    // with its generation at the time so that they can be handed to later clones until the page is written again.
+    OwnedPage *page_snapshot[0x100];
+    uint64_t snapshot_gen[0x100];
+
+    CpuRegisters regs;
+
+    // interrupt reader lines (delayed by one cycle)
+    bool nmi_edge_detector;
+    bool irq_line_reader;
+    bool rst_line_reader;
+    unsigned int nmi_line_last_state;
+
+    // interrupt line levels set by the host, as CpuLine flags of the lines pulled low
+    uint8_t pushed_lines;
+    LineChange *line_changes; // pending changes, in the order they take effect
+    size_t line_change_head; // the first change which has not taken effect yet
+    size_t line_change_count;
+    size_t line_change_cap;
+
+    // interrupt line recording and replay, if set
+    CpuLineEvent *line_record;
+    size_t line_record_capacity;
+    size_t line_record_count;
+    uint8_t line_record_last; // the lines as of the last recorded event, or 0xFF before the first
+    const CpuLineEvent *line_replay;
+    size_t line_replay_count;
+    size_t line_replay_next; // the first event which has not yet taken effect
+
+    // state for implementing cycle-accuracy
+    uint8_t instr_cycle; // this is 1-indexed to match blargg's doc
+    uint64_t cycle_count; // the total number of cycles run since initialization
+
+    const Instruction *cur_instr; // the instruction currently being executed
+    const OpcodeInfo *cur_info; // precomputed metadata for the current instruction
+    void (*cur_handler)(Cpu6502*); // executes the cycles of the current instruction following the operand fetch
+    void (*cur_op)(Cpu6502*); // the operation of the current instruction proper
+    uint8_t last_opcode; // the last opcode decoded
+    bool operand_cached; // set when cur_operand was taken from the block cache instead of being fetched
+
+    uint16_t cur_operand; // the operand directly read from PRG
+    uint16_t eff_operand; // the effective operand (after being offset)
+
+    const InterruptType *cur_interrupt; // the interrupt type currently being executed
+    const InterruptType *queued_interrupt; // the interrupt type currently queued
+    bool nmi_hijack; // set when an NMI "hijacks" a software interrupt
+
+    bool jammed; // set when a KIL instruction has locked up the CPU
+
+    void (*log_callback)(void*, char*, CpuRegisters);
+    CpuRegisters regs_snapshot;
+    uint64_t cycle_snapshot; // the cycle count at the time regs_snapshot was taken
+
+    // binary trace ring buffer, if set
+    CpuTraceRecord *trace_buf;
+    size_t trace_capacity;
+    size_t trace_index; // where the next record goes
+    uint64_t trace_count;
+    TraceQueue *trace_queue; // background trace consumer, if set
+
+    // conditions for ending cpu_run_cycles() early
+    uint16_t stop_pc;
+    Mnemonic stop_mnemonic;
+    uint8_t *breakpoints; // bitmap over the address space, allocated on first use
+    CpuStopCondition stop_reason;
+    bool stop_requested; // set by cpu_request_stop() during a run
+
+    // basic block cache used by the instruction-granular mode, allocated when enabled
+    CodeBlock *block_cache;
+    CodeBlock *cur_block; // the block the last instruction was taken from
+    uint8_t block_index; // the index of the next instruction within cur_block
+
+    JitArena *jit; // NULL unless native translation is enabled
+    unsigned int jit_threshold; // the number of entries after which a block is translated
+
+    CpuStaticLookup static_lookup; // ahead-of-time compiled code, if installed
+
+    // idle loop skipping, see cpu_set_idle_skip()
+    bool idle_skip;
+    bool idle_watching; // the loop from idle_pc to idle_end is being watched for an iteration which changes nothing
+    uint16_t idle_pc;
+    uint16_t idle_end; // the address of the branch or jump closing the loop
+    uint16_t idle_anchor; // the address at which iterations are compared
+    uint16_t idle_reject_pc; // the last loop found not to qualify, so that it is not examined on every iteration
+    uint64_t idle_reject_gen; // the generation of its page at the time
+    IdleState idle_state; // the state when the anchor was last passed
+    uint64_t idle_skipped; // the total number of cycles skipped
+};
+
+static inline bool block_is_valid(const Cpu6502 *cpu, const CodeBlock *block) {
+    return block->page_gens[0] == cpu->page_gen[block->pages[0]]
+            && block->page_gens[1] == cpu->page_gen[block->pages[1]];
+}
+
+
+// Makes a copy-on-write page writable, along with the pages mirroring the same memory, so that the memory behind it can
+// be modified directly. Returns false if no copy could be allocated.
+bool cpu_copy_page(Cpu6502 *cpu, uint8_t page);
+
+// Executes a single pre-decoded instruction as cpu_step_instruction() would, but without sampling the interrupt lines,
+// and returns the number of cycles it took. Used by translated code for instructions it does not handle itself.
+unsigned int cpu_exec_cached_instr(Cpu6502 *cpu, const CachedInstr *cached);
+
+// Returns NULL if native translation is not supported on this host.
+JitArena *jit_arena_create(void);
+
+void jit_arena_destroy(JitArena *arena);
+
+// discards all code in the arena
+void jit_arena_reset(JitArena *arena);
+
+// Translates a cached block into native code, returning NULL if the arena is full or its pages could not be made
+// writable or executable.
+JitBlockFn jit_compile_block(JitArena *arena, const CodeBlock *block);
@@ -65,6 +65,267 @@ static const Instruction g_instr_list[] = {
     {SED, IMP}, {SBC, ABY}, {NOP, IMP}, {ISC, ABY}, {NOP, ABX} ,{SBC, ABX}, {INC, ABX}, {ISC, ABX} 
 };
 
+// precomputed per-opcode metadata so that decoding on the hot path is a single lookup
+// cycle counts exclude the page crossing and taken branch penalties
+static const OpcodeInfo g_opcode_info[] = {
+    /* 00 */ {BRK, IMP, INS_OTHER, 2, 7, 0, HND_BRK},
+    /* 01 */ {ORA, IZX, INS_R, 2, 6, 0, HND_IZX},
+    /* 02 */ {KIL, IMP, INS_OTHER, 1, 2, 0, HND_IMP},
+    /* 03 */ {SLO, IZX, INS_RW, 2, 8, 0, HND_IZX},
+    /* 04 */ {NOP, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* 05 */ {ORA, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* 06 */ {ASL, ZRP, INS_RW, 2, 5, 0, HND_ZRP},
+    /* 07 */ {SLO, ZRP, INS_RW, 2, 5, 0, HND_ZRP},
+    /* 08 */ {PHP, IMP, INS_STACK, 1, 3, 0, HND_PUSH},
+    /* 09 */ {ORA, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* 0A */ {ASL, IMP, INS_RW, 1, 2, 0, HND_IMP},
+    /* 0B */ {ANC, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* 0C */ {NOP, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* 0D */ {ORA, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* 0E */ {ASL, ABS, INS_RW, 3, 6, 0, HND_ABS},
+    /* 0F */ {SLO, ABS, INS_RW, 3, 6, 0, HND_ABS},
+    /* 10 */ {BPL, REL, INS_BRANCH, 2, 2, 1, HND_BRANCH},
+    /* 11 */ {ORA, IZY, INS_R, 2, 5, 1, HND_IZY},
+    /* 12 */ {KIL, IMP, INS_OTHER, 1, 2, 0, HND_IMP},
+    /* 13 */ {SLO, IZY, INS_RW, 2, 8, 0, HND_IZY},
+    /* 14 */ {NOP, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* 15 */ {ORA, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* 16 */ {ASL, ZPX, INS_RW, 2, 6, 0, HND_ZPI},
+    /* 17 */ {SLO, ZPX, INS_RW, 2, 6, 0, HND_ZPI},
+    /* 18 */ {CLC, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* 19 */ {ORA, ABY, INS_R, 3, 4, 1, HND_ABI},
+    /* 1A */ {NOP, IMP, INS_R, 1, 2, 0, HND_IMP},
+    /* 1B */ {SLO, ABY, INS_RW, 3, 7, 0, HND_ABI},
+    /* 1C */ {NOP, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* 1D */ {ORA, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* 1E */ {ASL, ABX, INS_RW, 3, 7, 0, HND_ABI},
+    /* 1F */ {SLO, ABX, INS_RW, 3, 7, 0, HND_ABI},
+    /* 20 */ {JSR, ABS, INS_JUMP, 3, 6, 0, HND_JSR},
+    /* 21 */ {AND, IZX, INS_R, 2, 6, 0, HND_IZX},
+    /* 22 */ {KIL, IMP, INS_OTHER, 1, 2, 0, HND_IMP},
+    /* 23 */ {RLA, IZX, INS_RW, 2, 8, 0, HND_IZX},
+    /* 24 */ {BIT, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* 25 */ {AND, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* 26 */ {ROL, ZRP, INS_RW, 2, 5, 0, HND_ZRP},
+    /* 27 */ {RLA, ZRP, INS_RW, 2, 5, 0, HND_ZRP},
+    /* 28 */ {PLP, IMP, INS_STACK, 1, 4, 0, HND_PULL},
+    /* 29 */ {AND, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* 2A */ {ROL, IMP, INS_RW, 1, 2, 0, HND_IMP},
+    /* 2B */ {ANC, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* 2C */ {BIT, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* 2D */ {AND, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* 2E */ {ROL, ABS, INS_RW, 3, 6, 0, HND_ABS},
+    /* 2F */ {RLA, ABS, INS_RW, 3, 6, 0, HND_ABS},
+    /* 30 */ {BMI, REL, INS_BRANCH, 2, 2, 1, HND_BRANCH},
+    /* 31 */ {AND, IZY, INS_R, 2, 5, 1, HND_IZY},
+    /* 32 */ {KIL, IMP, INS_OTHER, 1, 2, 0, HND_IMP},
+    /* 33 */ {RLA, IZY, INS_RW, 2, 8, 0, HND_IZY},
+    /* 34 */ {NOP, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* 35 */ {AND, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* 36 */ {ROL, ZPX, INS_RW, 2, 6, 0, HND_ZPI},
+    /* 37 */ {RLA, ZPX, INS_RW, 2, 6, 0, HND_ZPI},
+    /* 38 */ {SEC, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* 39 */ {AND, ABY, INS_R, 3, 4, 1, HND_ABI},
+    /* 3A */ {NOP, IMP, INS_R, 1, 2, 0, HND_IMP},
+    /* 3B */ {RLA, ABY, INS_RW, 3, 7, 0, HND_ABI},
+    /* 3C */ {NOP, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* 3D */ {AND, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* 3E */ {ROL, ABX, INS_RW, 3, 7, 0, HND_ABI},
+    /* 3F */ {RLA, ABX, INS_RW, 3, 7, 0, HND_ABI},
+    /* 40 */ {RTI, IMP, INS_RET, 1, 6, 0, HND_RTI},
+    /* 41 */ {EOR, IZX, INS_R, 2, 6, 0, HND_IZX},
+    /* 42 */ {KIL, IMP, INS_OTHER, 1, 2, 0, HND_IMP},
+    /* 43 */ {SRE, IZX, INS_RW, 2, 8, 0, HND_IZX},
+    /* 44 */ {NOP, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* 45 */ {EOR, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* 46 */ {LSR, ZRP, INS_RW, 2, 5, 0, HND_ZRP},
+    /* 47 */ {SRE, ZRP, INS_RW, 2, 5, 0, HND_ZRP},
+    /* 48 */ {PHA, IMP, INS_STACK, 1, 3, 0, HND_PUSH},
+    /* 49 */ {EOR, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* 4A */ {LSR, IMP, INS_RW, 1, 2, 0, HND_IMP},
+    /* 4B */ {ALR, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* 4C */ {JMP, ABS, INS_JUMP, 3, 3, 0, HND_JMP},
+    /* 4D */ {EOR, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* 4E */ {LSR, ABS, INS_RW, 3, 6, 0, HND_ABS},
+    /* 4F */ {SRE, ABS, INS_RW, 3, 6, 0, HND_ABS},
+    /* 50 */ {BVC, REL, INS_BRANCH, 2, 2, 1, HND_BRANCH},
+    /* 51 */ {EOR, IZY, INS_R, 2, 5, 1, HND_IZY},
+    /* 52 */ {KIL, IMP, INS_OTHER, 1, 2, 0, HND_IMP},
+    /* 53 */ {SRE, IZY, INS_RW, 2, 8, 0, HND_IZY},
+    /* 54 */ {NOP, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* 55 */ {EOR, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* 56 */ {LSR, ZPX, INS_RW, 2, 6, 0, HND_ZPI},
+    /* 57 */ {SRE, ZPX, INS_RW, 2, 6, 0, HND_ZPI},
+    /* 58 */ {CLI, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* 59 */ {EOR, ABY, INS_R, 3, 4, 1, HND_ABI},
+    /* 5A */ {NOP, IMP, INS_R, 1, 2, 0, HND_IMP},
+    /* 5B */ {SRE, ABY, INS_RW, 3, 7, 0, HND_ABI},
+    /* 5C */ {NOP, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* 5D */ {EOR, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* 5E */ {LSR, ABX, INS_RW, 3, 7, 0, HND_ABI},
+    /* 5F */ {SRE, ABX, INS_RW, 3, 7, 0, HND_ABI},
+    /* 60 */ {RTS, IMP, INS_RET, 1, 6, 0, HND_RTS},
+    /* 61 */ {ADC, IZX, INS_R, 2, 6, 0, HND_IZX},
+    /* 62 */ {KIL, IMP, INS_OTHER, 1, 2, 0, HND_IMP},
+    /* 63 */ {RRA, IZX, INS_RW, 2, 8, 0, HND_IZX},
+    /* 64 */ {NOP, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* 65 */ {ADC, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* 66 */ {ROR, ZRP, INS_RW, 2, 5, 0, HND_ZRP},
+    /* 67 */ {RRA, ZRP, INS_RW, 2, 5, 0, HND_ZRP},
+    /* 68 */ {PLA, IMP, INS_STACK, 1, 4, 0, HND_PULL},
+    /* 69 */ {ADC, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* 6A */ {ROR, IMP, INS_RW, 1, 2, 0, HND_IMP},
+    /* 6B */ {ARR, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* 6C */ {JMP, IND, INS_JUMP, 3, 5, 0, HND_JMP},
+    /* 6D */ {ADC, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* 6E */ {ROR, ABS, INS_RW, 3, 6, 0, HND_ABS},
+    /* 6F */ {RRA, ABS, INS_RW, 3, 6, 0, HND_ABS},
+    /* 70 */ {BVS, REL, INS_BRANCH, 2, 2, 1, HND_BRANCH},
+    /* 71 */ {ADC, IZY, INS_R, 2, 5, 1, HND_IZY},
+    /* 72 */ {KIL, IMP, INS_OTHER, 1, 2, 0, HND_IMP},
+    /* 73 */ {RRA, IZY, INS_RW, 2, 8, 0, HND_IZY},
+    /* 74 */ {NOP, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* 75 */ {ADC, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* 76 */ {ROR, ZPX, INS_RW, 2, 6, 0, HND_ZPI},
+    /* 77 */ {RRA, ZPX, INS_RW, 2, 6, 0, HND_ZPI},
+    /* 78 */ {SEI, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* 79 */ {ADC, ABY, INS_R, 3, 4, 1, HND_ABI},
+    /* 7A */ {NOP, IMP, INS_R, 1, 2, 0, HND_IMP},
+    /* 7B */ {RRA, ABY, INS_RW, 3, 7, 0, HND_ABI},
+    /* 7C */ {NOP, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* 7D */ {ADC, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* 7E */ {ROR, ABX, INS_RW, 3, 7, 0, HND_ABI},
+    /* 7F */ {RRA, ABX, INS_RW, 3, 7, 0, HND_ABI},
+    /* 80 */ {NOP, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* 81 */ {STA, IZX, INS_W, 2, 6, 0, HND_IZX},
+    /* 82 */ {NOP, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* 83 */ {SAX, IZX, INS_W, 2, 6, 0, HND_IZX},
+    /* 84 */ {STY, ZRP, INS_W, 2, 3, 0, HND_ZRP},
+    /* 85 */ {STA, ZRP, INS_W, 2, 3, 0, HND_ZRP},
+    /* 86 */ {STX, ZRP, INS_W, 2, 3, 0, HND_ZRP},
+    /* 87 */ {SAX, ZRP, INS_W, 2, 3, 0, HND_ZRP},
+    /* 88 */ {DEY, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* 89 */ {NOP, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* 8A */ {TXA, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* 8B */ {XAA, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* 8C */ {STY, ABS, INS_W, 3, 4, 0, HND_ABS},
+    /* 8D */ {STA, ABS, INS_W, 3, 4, 0, HND_ABS},
+    /* 8E */ {STX, ABS, INS_W, 3, 4, 0, HND_ABS},
+    /* 8F */ {SAX, ABS, INS_W, 3, 4, 0, HND_ABS},
+    /* 90 */ {BCC, REL, INS_BRANCH, 2, 2, 1, HND_BRANCH},
+    /* 91 */ {STA, IZY, INS_W, 2, 6, 0, HND_IZY},
+    /* 92 */ {KIL, IMP, INS_OTHER, 1, 2, 0, HND_IMP},
+    /* 93 */ {AXA, IZY, INS_RW, 2, 8, 0, HND_IZY},
+    /* 94 */ {STY, ZPX, INS_W, 2, 4, 0, HND_ZPI},
+    /* 95 */ {STA, ZPX, INS_W, 2, 4, 0, HND_ZPI},
+    /* 96 */ {STX, ZPY, INS_W, 2, 4, 0, HND_ZPI},
+    /* 97 */ {SAX, ZPY, INS_W, 2, 4, 0, HND_ZPI},
+    /* 98 */ {TYA, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* 99 */ {STA, ABY, INS_W, 3, 5, 0, HND_ABI},
+    /* 9A */ {TXS, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* 9B */ {TAS, ABY, INS_W, 3, 5, 0, HND_ABI},
+    /* 9C */ {SAY, ABX, INS_RW, 3, 7, 0, HND_ABI},
+    /* 9D */ {STA, ABX, INS_W, 3, 5, 0, HND_ABI},
+    /* 9E */ {XAS, ABY, INS_RW, 3, 7, 0, HND_ABI},
+    /* 9F */ {AXA, ABY, INS_RW, 3, 7, 0, HND_ABI},
+    /* A0 */ {LDY, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* A1 */ {LDA, IZX, INS_R, 2, 6, 0, HND_IZX},
+    /* A2 */ {LDX, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* A3 */ {LAX, IZX, INS_R, 2, 6, 0, HND_IZX},
+    /* A4 */ {LDY, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* A5 */ {LDA, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* A6 */ {LDX, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* A7 */ {LAX, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* A8 */ {TAY, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* A9 */ {LDA, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* AA */ {TAX, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* AB */ {LAX, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* AC */ {LDY, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* AD */ {LDA, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* AE */ {LDX, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* AF */ {LAX, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* B0 */ {BCS, REL, INS_BRANCH, 2, 2, 1, HND_BRANCH},
+    /* B1 */ {LDA, IZY, INS_R, 2, 5, 1, HND_IZY},
+    /* B2 */ {KIL, IMP, INS_OTHER, 1, 2, 0, HND_IMP},
+    /* B3 */ {LAX, IZY, INS_R, 2, 5, 1, HND_IZY},
+    /* B4 */ {LDY, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* B5 */ {LDA, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* B6 */ {LDX, ZPY, INS_R, 2, 4, 0, HND_ZPI},
+    /* B7 */ {LAX, ZPY, INS_R, 2, 4, 0, HND_ZPI},
+    /* B8 */ {CLV, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* B9 */ {LDA, ABY, INS_R, 3, 4, 1, HND_ABI},
+    /* BA */ {TSX, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* BB */ {LAS, ABY, INS_R, 3, 4, 1, HND_ABI},
+    /* BC */ {LDY, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* BD */ {LDA, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* BE */ {LDX, ABY, INS_R, 3, 4, 1, HND_ABI},
+    /* BF */ {LAX, ABY, INS_R, 3, 4, 1, HND_ABI},
+    /* C0 */ {CPY, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* C1 */ {CMP, IZX, INS_R, 2, 6, 0, HND_IZX},
+    /* C2 */ {NOP, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* C3 */ {DCP, IZX, INS_RW, 2, 8, 0, HND_IZX},
+    /* C4 */ {CPY, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* C5 */ {CMP, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* C6 */ {DEC, ZRP, INS_RW, 2, 5, 0, HND_ZRP},
+    /* C7 */ {DCP, ZRP, INS_RW, 2, 5, 0, HND_ZRP},
+    /* C8 */ {INY, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* C9 */ {CMP, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* CA */ {DEX, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* CB */ {AXS, IMM, INS_W, 2, 2, 0, HND_IMM},
+    /* CC */ {CPY, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* CD */ {CMP, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* CE */ {DEC, ABS, INS_RW, 3, 6, 0, HND_ABS},
+    /* CF */ {DCP, ABS, INS_RW, 3, 6, 0, HND_ABS},
+    /* D0 */ {BNE, REL, INS_BRANCH, 2, 2, 1, HND_BRANCH},
+    /* D1 */ {CMP, IZY, INS_R, 2, 5, 1, HND_IZY},
+    /* D2 */ {KIL, IMP, INS_OTHER, 1, 2, 0, HND_IMP},
+    /* D3 */ {DCP, IZY, INS_RW, 2, 8, 0, HND_IZY},
+    /* D4 */ {NOP, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* D5 */ {CMP, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* D6 */ {DEC, ZPX, INS_RW, 2, 6, 0, HND_ZPI},
+    /* D7 */ {DCP, ZPX, INS_RW, 2, 6, 0, HND_ZPI},
+    /* D8 */ {CLD, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* D9 */ {CMP, ABY, INS_R, 3, 4, 1, HND_ABI},
+    /* DA */ {NOP, IMP, INS_R, 1, 2, 0, HND_IMP},
+    /* DB */ {DCP, ABY, INS_RW, 3, 7, 0, HND_ABI},
+    /* DC */ {NOP, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* DD */ {CMP, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* DE */ {DEC, ABX, INS_RW, 3, 7, 0, HND_ABI},
+    /* DF */ {DCP, ABX, INS_RW, 3, 7, 0, HND_ABI},
+    /* E0 */ {CPX, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* E1 */ {SBC, IZX, INS_R, 2, 6, 0, HND_IZX},
+    /* E2 */ {NOP, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* E3 */ {ISC, IZX, INS_RW, 2, 8, 0, HND_IZX},
+    /* E4 */ {CPX, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* E5 */ {SBC, ZRP, INS_R, 2, 3, 0, HND_ZRP},
+    /* E6 */ {INC, ZRP, INS_RW, 2, 5, 0, HND_ZRP},
+    /* E7 */ {ISC, ZRP, INS_RW, 2, 5, 0, HND_ZRP},
+    /* E8 */ {INX, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* E9 */ {SBC, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* EA */ {NOP, IMP, INS_R, 1, 2, 0, HND_IMP},
+    /* EB */ {SBC, IMM, INS_R, 2, 2, 0, HND_IMM},
+    /* EC */ {CPX, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* ED */ {SBC, ABS, INS_R, 3, 4, 0, HND_ABS},
+    /* EE */ {INC, ABS, INS_RW, 3, 6, 0, HND_ABS},
+    /* EF */ {ISC, ABS, INS_RW, 3, 6, 0, HND_ABS},
+    /* F0 */ {BEQ, REL, INS_BRANCH, 2, 2, 1, HND_BRANCH},
+    /* F1 */ {SBC, IZY, INS_R, 2, 5, 1, HND_IZY},
+    /* F2 */ {KIL, IMP, INS_OTHER, 1, 2, 0, HND_IMP},
+    /* F3 */ {ISC, IZY, INS_RW, 2, 8, 0, HND_IZY},
+    /* F4 */ {NOP, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* F5 */ {SBC, ZPX, INS_R, 2, 4, 0, HND_ZPI},
+    /* F6 */ {INC, ZPX, INS_RW, 2, 6, 0, HND_ZPI},
+    /* F7 */ {ISC, ZPX, INS_RW, 2, 6, 0, HND_ZPI},
+    /* F8 */ {SED, IMP, INS_REG, 1, 2, 0, HND_IMP},
+    /* F9 */ {SBC, ABY, INS_R, 3, 4, 1, HND_ABI},
+    /* FA */ {NOP, IMP, INS_R, 1, 2, 0, HND_IMP},
+    /* FB */ {ISC, ABY, INS_RW, 3, 7, 0, HND_ABI},
+    /* FC */ {NOP, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* FD */ {SBC, ABX, INS_R, 3, 4, 1, HND_ABI},
+    /* FE */ {INC, ABX, INS_RW, 3, 7, 0, HND_ABI},
+    /* FF */ {ISC, ABX, INS_RW, 3, 7, 0, HND_ABI},
+};
+
 const char *g_mnemonic_strs[] = {
     "LDA", "LDX", "LDY", "STA", "STX", "STY", "TAX", "TAY",
     "TSX", "TXA", "TYA", "TXS", "ADC", "SBC", "DEC", "DEX",
@@ -120,6 +381,7 @@ const InstructionType get_instr_type(const Mnemonic mnemonic) {
         // unofficial
         case SAX:
         case AXS:
+        case TAS:
             return INS_W;
         case DEC:
         case INC:
@@ -172,8 +434,6 @@ const InstructionType get_instr_type(const Mnemonic mnemonic) {
         case CLV:
         case CLD:
         case SED:
-        // unofficial
-        case TAS:
             return INS_REG;
         case RTS:
         case RTI:
@@ -218,23 +478,10 @@ Instruction *decode_instr(unsigned char opcode) {
     return (Instruction*) &g_instr_list[opcode];
 }
 
-bool can_incur_page_boundary_penalty(const uint8_t opcode) {
-    // all opcodes with an even high nybble don't incur penalties
-    if (!((opcode >> 4) & 1)) {
-        return false;
-    }
-
-    uint8_t low_nybble = opcode & 0xF;
-
-    if ((opcode >> 4) == 0x9) {
-        // for all opcodes 0x9X, only 0x90 incurs a penalty
-        return low_nybble == 0;
-    } else if ((opcode >> 4) == 0xB) {
-        // row 0xBX is unusual - I can't find a pattern in it
-        if (low_nybble == 0x3 || low_nybble == 0xB || low_nybble == 0xE || low_nybble == 0xF) {
-            return true;
-        }
-    }
+const OpcodeInfo *get_opcode_info(uint8_t opcode) {
+    return &g_opcode_info[opcode];
+}
 
-    return low_nybble == 0x0 || low_nybble == 0x1 || low_nybble == 0x9 || low_nybble == 0xC || low_nybble == 0xD;
+bool can_incur_page_boundary_penalty(const uint8_t opcode) {
+    return g_opcode_info[opcode].page_penalty;
 }
@@ -0,0 +1,939 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "c6502/cpu.h"
+#include "c6502/instrs.h"
+#include "cpu_internal.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define ARENA_SIZE (1 << 20)
+#define MAX_BLOCK_CODE 0x2000 // comfortably more than the largest block the translator can produce
+#define MAX_FIXUPS 8
+
+#define BLOCK_INVALIDATED 0x80000000u // set in the result of _jit_fallback() if the running block went stale
+
+// register numbers as encoded in instructions
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RBP 5
+#define RSI 6
+#define RDI 7
+#define R12 12
+#define R14 14
+
+// opcodes of two-operand ALU instructions in their "op r/m32, r32" form
+#define OP_ADD 0x01
+#define OP_OR 0x09
+#define OP_AND 0x21
+#define OP_SUB 0x29
+#define OP_XOR 0x31
+#define OP_TEST 0x85
+#define OP_MOV 0x89
+
+// opcode extensions of the immediate and shift forms
+#define EXT_ADD 0
+#define EXT_OR 1
+#define EXT_AND 4
+#define EXT_SUB 5
+#define EXT_XOR 6
+#define EXT_CMP 7
+#define EXT_SHL 4
+#define EXT_SHR 5
+
+// condition codes
+#define CC_C 0x2
+#define CC_NC 0x3
+#define CC_Z 0x4
+#define CC_NZ 0x5
+#define CC_NS 0x9
+
+#define OFF_STATUS offsetof(Cpu6502, regs.status)
+#define OFF_PC offsetof(Cpu6502, regs.pc)
+#define OFF_SP offsetof(Cpu6502, regs.sp)
+#define OFF_ACC offsetof(Cpu6502, regs.acc)
+#define OFF_X offsetof(Cpu6502, regs.x)
+#define OFF_Y offsetof(Cpu6502, regs.y)
+#define OFF_PAGE_MAP offsetof(Cpu6502, page_map)
+#define OFF_PAGE_FLAGS offsetof(Cpu6502, page_flags)
+#define OFF_PAGE_GEN offsetof(Cpu6502, page_gen)
+#define OFF_PAGE_ALIAS offsetof(Cpu6502, page_alias)
+#define OFF_PAGE_DIRTY offsetof(Cpu6502, page_dirty)
+#define OFF_DIRTY_EPOCH offsetof(Cpu6502, dirty_epoch)
+
+#define EMIT(e, ...) _emit_bytes(e, (const uint8_t[]) {__VA_ARGS__}, sizeof((const uint8_t[]) {__VA_ARGS__}))
+
+// Translated code keeps the CPU context in rbx and the cycles accumulated on top of the static instruction costs in
+// r12d. The negative and zero flags are evaluated lazily: ebp holds a value which is zero iff the zero flag is set, and
+// bit 7 of r14d holds the negative flag. They are only written back to the status register when leaving native code.
+// All other architectural state lives in CpuRegisters.
+
+struct JitArena {
+    uint8_t *base;
+    size_t used;
+    size_t page_size;
+};
+
+typedef struct {
+    uint8_t *code;
+    size_t pos;
+} Emitter;
+
+// positions of rel32 fields which are waiting for the address of a stub
+typedef struct {
+    size_t pos[MAX_FIXUPS];
+    unsigned int count;
+} FixupList;
+
+typedef struct {
+    Emitter e;
+    const CodeBlock *block;
+    size_t instr_start[MAX_BLOCK_INSTRS + 1];
+    unsigned int static_cycles[MAX_BLOCK_INSTRS + 1]; // base cycles of all instructions before the given one
+    FixupList fallback[MAX_BLOCK_INSTRS]; // guards which send an instruction to the interpreter
+    FixupList smc_exit[MAX_BLOCK_INSTRS]; // taken when an instruction wrote to the pages of the block itself
+} Translator;
+
+static uint32_t _jit_fallback(Cpu6502 *cpu, const CachedInstr *instr, const CodeBlock *block) {
+    uint32_t cycles = cpu_exec_cached_instr(cpu, instr);
+
+    return block_is_valid(cpu, block) ? cycles : cycles | BLOCK_INVALIDATED;
+}
+
+static void _emit_bytes(Emitter *e, const uint8_t *bytes, size_t len) {
+    memcpy(e->code + e->pos, bytes, len);
+    e->pos += len;
+}
+
+static void _emit8(Emitter *e, uint8_t val) {
+    e->code[e->pos++] = val;
+}
+
+static void _emit16(Emitter *e, uint16_t val) {
+    memcpy(e->code + e->pos, &val, sizeof(val));
+    e->pos += sizeof(val);
+}
+
+static void _emit32(Emitter *e, uint32_t val) {
+    memcpy(e->code + e->pos, &val, sizeof(val));
+    e->pos += sizeof(val);
+}
+
+static void _emit64(Emitter *e, uint64_t val) {
+    memcpy(e->code + e->pos, &val, sizeof(val));
+    e->pos += sizeof(val);
+}
+
+static void _patch(Emitter *e, size_t fixup, size_t target) {
+    int32_t rel = (int32_t) (target - (fixup + 4));
+    memcpy(e->code + fixup, &rel, sizeof(rel));
+}
+
+// [rbx + disp32] operand with the given register or opcode extension in the reg field
+static void _emit_ctx(Emitter *e, unsigned int reg, uint32_t disp) {
+    _emit8(e, 0x80 | (reg & 7) << 3 | RBX);
+    _emit32(e, disp);
+}
+
+// movzx reg32, byte [rbx + disp]
+static void _emit_load_byte(Emitter *e, unsigned int reg, uint32_t disp) {
+    if (reg >= 8) {
+        _emit8(e, 0x44);
+    }
+    EMIT(e, 0x0F, 0xB6);
+    _emit_ctx(e, reg, disp);
+}
+
+// mov byte [rbx + disp], reg8 (only al, cl, dl and bl are encodable without a prefix)
+static void _emit_store_byte(Emitter *e, uint32_t disp, unsigned int reg) {
+    _emit8(e, 0x88);
+    _emit_ctx(e, reg, disp);
+}
+
+// op byte [rbx + disp], imm8
+static void _emit_ctx_imm8(Emitter *e, unsigned int ext, uint32_t disp, uint8_t imm) {
+    _emit8(e, 0x80);
+    _emit_ctx(e, ext, disp);
+    _emit8(e, imm);
+}
+
+// or byte [rbx + disp], reg8
+static void _emit_ctx_or_reg8(Emitter *e, uint32_t disp, unsigned int reg) {
+    _emit8(e, 0x08);
+    _emit_ctx(e, reg, disp);
+}
+
+// op dst32, src32
+static void _emit_rr(Emitter *e, uint8_t opcode, unsigned int dst, unsigned int src) {
+    if (dst >= 8 || src >= 8) {
+        _emit8(e, 0x40 | (src >= 8) << 2 | (dst >= 8));
+    }
+    _emit8(e, opcode);
+    _emit8(e, 0xC0 | (src & 7) << 3 | (dst & 7));
+}
+
+// op dst32, imm32
+static void _emit_ri(Emitter *e, unsigned int ext, unsigned int dst, uint32_t imm) {
+    if (dst >= 8) {
+        _emit8(e, 0x41);
+    }
+    _emit8(e, 0x81);
+    _emit8(e, 0xC0 | ext << 3 | (dst & 7));
+    _emit32(e, imm);
+}
+
+// shl/shr reg32, count
+static void _emit_shift(Emitter *e, unsigned int ext, unsigned int reg, uint8_t count) {
+    EMIT(e, 0xC1, 0xC0 | ext << 3 | reg, count);
+}
+
+// movzx dst32, src8
+static void _emit_zext8(Emitter *e, unsigned int dst, unsigned int src) {
+    EMIT(e, 0x0F, 0xB6, 0xC0 | dst << 3 | src);
+}
+
+static void _emit_mov_imm(Emitter *e, unsigned int reg, uint32_t imm) {
+    _emit8(e, 0xB8 | reg);
+    _emit32(e, imm);
+}
+
+static void _emit_mov_imm64(Emitter *e, unsigned int reg, uint64_t imm) {
+    EMIT(e, 0x48, 0xB8 | reg);
+    _emit64(e, imm);
+}
+
+// returns the position of the rel32 field
+static size_t _emit_jcc(Emitter *e, unsigned int cc) {
+    EMIT(e, 0x0F, 0x80 | cc);
+    _emit32(e, 0);
+    return e->pos - 4;
+}
+
+static size_t _emit_jmp(Emitter *e) {
+    _emit8(e, 0xE9);
+    _emit32(e, 0);
+    return e->pos - 4;
+}
+
+static void _emit_fixup(Emitter *e, FixupList *list, unsigned int cc) {
+    assert(list->count < MAX_FIXUPS);
+    list->pos[list->count++] = _emit_jcc(e, cc);
+}
+
+static void _emit_set_nz(Emitter *e, unsigned int reg) {
+    _emit_rr(e, OP_MOV, RBP, reg);
+    _emit_rr(e, OP_MOV, R14, reg);
+}
+
+// loads the lazy negative and zero flags from the status register
+static void _emit_load_flags(Emitter *e) {
+    _emit_load_byte(e, RCX, OFF_STATUS);
+    _emit_rr(e, OP_MOV, R14, RCX);
+    _emit_rr(e, OP_MOV, RBP, RCX);
+    _emit_ri(e, EXT_AND, RBP, 0x02);
+    _emit_ri(e, EXT_XOR, RBP, 0x02);
+}
+
+// writes the lazy negative and zero flags back to the status register
+static void _emit_store_flags(Emitter *e) {
+    _emit_load_byte(e, RAX, OFF_STATUS);
+    _emit_ri(e, EXT_AND, RAX, 0x7D);
+    _emit_rr(e, OP_TEST, RBP, RBP);
+    EMIT(e, 0x75, 0x03); // jnz over the next instruction
+    EMIT(e, 0x83, 0xC8, 0x02); // or eax, 2
+    _emit_rr(e, OP_MOV, RCX, R14);
+    _emit_ri(e, EXT_AND, RCX, 0x80);
+    _emit_rr(e, OP_OR, RAX, RCX);
+    _emit_store_byte(e, OFF_STATUS, RAX);
+}
+
+static void _emit_prologue(Emitter *e) {
+    EMIT(e, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56); // push rbx, rbp, r12, r13, r14
+    EMIT(e, 0x48, 0x89, 0xFB); // mov rbx, rdi
+    _emit_rr(e, OP_XOR, R12, R12);
+    _emit_load_flags(e);
+}
+
+// Leaves the block after the given number of instructions. If pc is negative, the PC has already been updated by the
+// interpreter.
+static void _emit_exit(Emitter *e, unsigned int instrs, unsigned int cycles, int32_t pc) {
+    _emit_store_flags(e);
+
+    if (pc >= 0) {
+        EMIT(e, 0x66, 0xC7);
+        _emit_ctx(e, 0, OFF_PC);
+        _emit16(e, (uint16_t) pc);
+    }
+
+    _emit_rr(e, OP_MOV, RAX, R12);
+    _emit_ri(e, EXT_ADD, RAX, cycles | instrs << 16);
+
+    EMIT(e, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3); // pop r14, r13, r12, rbp, rbx; ret
+}
+
+// Hands instruction k to the interpreter. When emitted as an out-of-line stub, execution continues with the native
+// code for the next instruction afterwards. Returns true if the block ends here.
+static bool _emit_fallback(Translator *t, unsigned int k, bool stub) {
+    Emitter *e = &t->e;
+    const CachedInstr *instr = &t->block->instrs[k];
+
+    _emit_store_flags(e);
+
+    EMIT(e, 0x48, 0x89, 0xDF); // mov rdi, rbx
+    _emit_mov_imm64(e, RSI, (uint64_t) (uintptr_t) instr);
+    _emit_mov_imm64(e, RDX, (uint64_t) (uintptr_t) t->block);
+    _emit_mov_imm64(e, RAX, (uint64_t) (uintptr_t) _jit_fallback);
+    EMIT(e, 0xFF, 0xD0); // call rax
+
+    _emit_load_flags(e);
+
+    // the interpreter reports the full cost of the instruction, including its base cycles
+    _emit_rr(e, OP_MOV, RCX, RAX);
+    _emit_ri(e, EXT_AND, RCX, ~BLOCK_INVALIDATED);
+    _emit_rr(e, OP_ADD, R12, RCX);
+    _emit_ri(e, EXT_SUB, R12, instr->info->cycles);
+
+    if (k == t->block->count - 1u) {
+        _emit_exit(e, k + 1, t->static_cycles[k + 1], -1);
+        return true;
+    }
+
+    _emit_rr(e, OP_TEST, RAX, RAX);
+    size_t valid = _emit_jcc(e, CC_NS);
+    _emit_exit(e, k + 1, t->static_cycles[k + 1], -1);
+    _patch(e, valid, e->pos);
+
+    if (stub) {
+        _patch(e, _emit_jmp(e), t->instr_start[k + 1]);
+    }
+
+    return false;
+}
+
+// sends instruction k to the interpreter if the given page is not mapped
+static void _emit_guard_page(Translator *t, unsigned int k, uint8_t page) {
+    Emitter *e = &t->e;
+
+    EMIT(e, 0x48, 0x8B); // mov rax, [rbx + disp32]
+    _emit_ctx(e, RAX, OFF_PAGE_MAP + page * sizeof(uint8_t*));
+    EMIT(e, 0x48, 0x85, 0xC0); // test rax, rax
+    _emit_fixup(e, &t->fallback[k], CC_Z);
+}
+
+// Looks up the host page of the address in edx and leaves it in r8, sending instruction k to the interpreter if the
+// access would have to go through the system interface.
+static void _emit_guard_access(Translator *t, unsigned int k, bool write) {
+    Emitter *e = &t->e;
+
+    _emit_rr(e, OP_MOV, RAX, RDX);
+    _emit_shift(e, EXT_SHR, RAX, 8);
+
+    if (write) {
+        EMIT(e, 0x80, 0xBC, 0x03); // cmp byte [rbx + rax + disp32], 0
+        _emit32(e, OFF_PAGE_FLAGS);
+        _emit8(e, 0);
+        _emit_fixup(e, &t->fallback[k], CC_NZ);
+    }
+
+    EMIT(e, 0x48, 0x8B, 0x84, 0xC3); // mov rax, [rbx + rax * 8 + disp32]
+    _emit32(e, OFF_PAGE_MAP);
+    EMIT(e, 0x48, 0x85, 0xC0); // test rax, rax
+    _emit_fixup(e, &t->fallback[k], CC_Z);
+    EMIT(e, 0x49, 0x89, 0xC0); // mov r8, rax
+}
+
+// reads the byte at edx from the page in r8 into ecx
+static void _emit_read(Emitter *e) {
+    _emit_zext8(e, RAX, RDX);
+    EMIT(e, 0x41, 0x0F, 0xB6, 0x0C, 0x00); // movzx ecx, byte [r8 + rax]
+}
+
+// Writes cl to edx in the page in r8 and marks the page (and its aliases) as changed and dirty. If the block's own code
+// was written, it is left after instruction k.
+static void _emit_write(Translator *t, unsigned int k) {
+    Emitter *e = &t->e;
+    const CodeBlock *block = t->block;
+
+    _emit_zext8(e, RAX, RDX);
+    EMIT(e, 0x41, 0x88, 0x0C, 0x00); // mov [r8 + rax], cl
+
+    _emit_rr(e, OP_MOV, RAX, RDX);
+    _emit_shift(e, EXT_SHR, RAX, 8);
+    _emit_rr(e, OP_MOV, RCX, RAX);
+    _emit_rr(e, OP_XOR, RDI, RDI);
+    EMIT(e, 0x48, 0x8B, 0x93); // mov rdx, [rbx + disp32], as the address is no longer needed
+    _emit32(e, OFF_DIRTY_EPOCH);
+
+    size_t loop = e->pos;
+    EMIT(e, 0x48, 0xFF, 0x84, 0xC3); // inc qword [rbx + rax * 8 + disp32]
+    _emit32(e, OFF_PAGE_GEN);
+    EMIT(e, 0x48, 0x89, 0x94, 0xC3); // mov [rbx + rax * 8 + disp32], rdx
+    _emit32(e, OFF_PAGE_DIRTY);
+    for (unsigned int i = 0; i < 2; i++) {
+        EMIT(e, 0x3D); // cmp eax, imm32
+        _emit32(e, block->pages[i]);
+        EMIT(e, 0x75, 0x05); // jne over the next instruction
+        _emit_mov_imm(e, RDI, 1);
+    }
+    EMIT(e, 0x0F, 0xB6, 0x84, 0x03); // movzx eax, byte [rbx + rax + disp32]
+    _emit32(e, OFF_PAGE_ALIAS);
+    _emit_rr(e, 0x39, RAX, RCX); // cmp eax, ecx
+    EMIT(e, 0x75, (uint8_t) (loop - (e->pos + 2))); // jne loop
+
+    if (k != block->count - 1u) {
+        _emit_rr(e, OP_TEST, RDI, RDI);
+        _emit_fixup(e, &t->smc_exit[k], CC_NZ);
+    }
+}
+
+// Computes the effective address of a memory operand into edx, guarding the pages of any dummy reads the interpreter
+// would make. For the indexed absolute modes, esi is left non-zero if the indexing crossed a page.
+static void _emit_address(Translator *t, unsigned int k) {
+    Emitter *e = &t->e;
+    const CachedInstr *instr = &t->block->instrs[k];
+
+    switch (instr->info->addr_mode) {
+        case ZRP:
+        case ABS:
+            _emit_mov_imm(e, RDX, instr->operand);
+            break;
+        case ZPX:
+        case ZPY:
+            _emit_load_byte(e, RDX, instr->info->addr_mode == ZPX ? OFF_X : OFF_Y);
+            EMIT(e, 0x80, 0xC2, instr->operand & 0xFF); // add dl, imm8
+            _emit_guard_page(t, k, 0);
+            break;
+        case ABX:
+        case ABY:
+            _emit_load_byte(e, RDX, instr->info->addr_mode == ABX ? OFF_X : OFF_Y);
+            _emit_ri(e, EXT_ADD, RDX, instr->operand);
+            _emit_rr(e, OP_MOV, RSI, RDX);
+            _emit_ri(e, EXT_XOR, RSI, instr->operand);
+            _emit_ri(e, EXT_AND, RSI, 0xFF00);
+            _emit_ri(e, EXT_AND, RDX, 0xFFFF);
+            _emit_guard_page(t, k, instr->operand >> 8);
+            break;
+        default:
+            assert(false);
+    }
+}
+
+static uint32_t _reg_offset(Mnemonic mnemonic) {
+    switch (mnemonic) {
+        case LDX:
+        case STX:
+        case CPX:
+        case INX:
+        case DEX:
+            return OFF_X;
+        case LDY:
+        case STY:
+        case CPY:
+        case INY:
+        case DEY:
+            return OFF_Y;
+        default:
+            return OFF_ACC;
+    }
+}
+
+// ecx := shifted ecx, updating the carry and lazy flags
+static void _emit_shift_op(Emitter *e, Mnemonic mnemonic) {
+    bool rot = mnemonic == ROL || mnemonic == ROR;
+
+    if (rot) {
+        _emit_load_byte(e, RSI, OFF_STATUS);
+        _emit_ri(e, EXT_AND, RSI, 0x01);
+    }
+
+    _emit_rr(e, OP_MOV, RDI, RCX);
+    if (mnemonic == ASL || mnemonic == ROL) {
+        _emit_shift(e, EXT_SHR, RDI, 7);
+        _emit_shift(e, EXT_SHL, RCX, 1);
+    } else {
+        _emit_ri(e, EXT_AND, RDI, 0x01);
+        _emit_shift(e, EXT_SHR, RCX, 1);
+        if (rot) {
+            _emit_shift(e, EXT_SHL, RSI, 7);
+        }
+    }
+
+    if (rot) {
+        _emit_rr(e, OP_OR, RCX, RSI);
+    }
+    _emit_zext8(e, RCX, RCX);
+
+    _emit_ctx_imm8(e, EXT_AND, OFF_STATUS, 0xFE);
+    _emit_rr(e, OP_MOV, RAX, RDI);
+    _emit_ctx_or_reg8(e, OFF_STATUS, RAX);
+
+    _emit_set_nz(e, RCX);
+}
+
+// acc := acc + ecx + carry, as in _do_adc()
+static void _emit_adc(Emitter *e) {
+    _emit_load_byte(e, RAX, OFF_ACC);
+    _emit_rr(e, OP_MOV, RDI, RAX);
+    _emit_load_byte(e, RSI, OFF_STATUS);
+    _emit_ri(e, EXT_AND, RSI, 0x01);
+    _emit_rr(e, OP_ADD, RAX, RCX);
+    _emit_rr(e, OP_ADD, RAX, RSI);
+
+    // carry out of bit 7
+    _emit_rr(e, OP_MOV, RSI, RAX);
+    _emit_shift(e, EXT_SHR, RSI, 8);
+    _emit_zext8(e, RAX, RAX);
+
+    // signed overflow, shifted into bit 6
+    _emit_rr(e, OP_XOR, RDI, RAX);
+    _emit_rr(e, OP_XOR, RCX, RAX);
+    _emit_rr(e, OP_AND, RDI, RCX);
+    _emit_ri(e, EXT_AND, RDI, 0x80);
+    _emit_shift(e, EXT_SHR, RDI, 1);
+    _emit_rr(e, OP_OR, RSI, RDI);
+
+    _emit_load_byte(e, RCX, OFF_STATUS);
+    _emit_ri(e, EXT_AND, RCX, 0xBE);
+    _emit_rr(e, OP_OR, RCX, RSI);
+    _emit_store_byte(e, OFF_STATUS, RCX);
+
+    _emit_store_byte(e, OFF_ACC, RAX);
+    _emit_set_nz(e, RAX);
+}
+
+// executes the operation of a read instruction on the operand in ecx
+static void _emit_read_op(Emitter *e, Mnemonic mnemonic) {
+    switch (mnemonic) {
+        case LDA:
+        case LDX:
+        case LDY:
+            _emit_store_byte(e, _reg_offset(mnemonic), RCX);
+            _emit_set_nz(e, RCX);
+            break;
+        case AND:
+        case ORA:
+        case EOR:
+            _emit_load_byte(e, RAX, OFF_ACC);
+            _emit_rr(e, mnemonic == AND ? OP_AND : mnemonic == ORA ? OP_OR : OP_XOR, RAX, RCX);
+            _emit_store_byte(e, OFF_ACC, RAX);
+            _emit_set_nz(e, RAX);
+            break;
+        case ADC:
+            _emit_adc(e);
+            break;
+        case SBC:
+            _emit_ri(e, EXT_XOR, RCX, 0xFF);
+            _emit_adc(e);
+            break;
+        case CMP:
+        case CPX:
+        case CPY:
+            _emit_load_byte(e, RAX, _reg_offset(mnemonic));
+            _emit_rr(e, OP_SUB, RAX, RCX);
+            EMIT(e, 0x0F, 0x90 | CC_NC, 0xC0 | RDX); // setnc dl
+            _emit_zext8(e, RAX, RAX);
+            _emit_set_nz(e, RAX);
+            _emit_ctx_imm8(e, EXT_AND, OFF_STATUS, 0xFE);
+            _emit_ctx_or_reg8(e, OFF_STATUS, RDX);
+            break;
+        case BIT:
+            _emit_load_byte(e, RAX, OFF_ACC);
+            _emit_rr(e, OP_AND, RAX, RCX);
+            _emit_rr(e, OP_MOV, RBP, RAX);
+            _emit_rr(e, OP_MOV, R14, RCX);
+            _emit_rr(e, OP_MOV, RAX, RCX);
+            _emit_ri(e, EXT_AND, RAX, 0x40);
+            _emit_ctx_imm8(e, EXT_AND, OFF_STATUS, 0xBF);
+            _emit_ctx_or_reg8(e, OFF_STATUS, RAX);
+            break;
+        case NOP:
+            break;
+        default:
+            assert(false);
+    }
+}
+
+static void _emit_implied(Emitter *e, Mnemonic mnemonic) {
+    switch (mnemonic) {
+        case TAX:
+        case TAY:
+        case TXA:
+        case TYA:
+        case TSX:
+        case TXS: {
+            uint32_t src = mnemonic == TAX || mnemonic == TAY ? OFF_ACC
+                    : mnemonic == TSX ? OFF_SP
+                    : mnemonic == TYA ? OFF_Y
+                    : OFF_X;
+            uint32_t dst = mnemonic == TAX || mnemonic == TSX ? OFF_X
+                    : mnemonic == TAY ? OFF_Y
+                    : mnemonic == TXS ? OFF_SP
+                    : OFF_ACC;
+
+            _emit_load_byte(e, RAX, src);
+            _emit_store_byte(e, dst, RAX);
+            if (mnemonic != TXS) {
+                _emit_set_nz(e, RAX);
+            }
+            break;
+        }
+        case INX:
+        case INY:
+        case DEX:
+        case DEY:
+            _emit_load_byte(e, RAX, _reg_offset(mnemonic));
+            EMIT(e, 0xFE, mnemonic == INX || mnemonic == INY ? 0xC0 : 0xC8); // inc/dec al
+            _emit_zext8(e, RAX, RAX);
+            _emit_store_byte(e, _reg_offset(mnemonic), RAX);
+            _emit_set_nz(e, RAX);
+            break;
+        case ASL:
+        case LSR:
+        case ROL:
+        case ROR:
+            _emit_load_byte(e, RCX, OFF_ACC);
+            _emit_shift_op(e, mnemonic);
+            _emit_store_byte(e, OFF_ACC, RCX);
+            break;
+        case CLC:
+            _emit_ctx_imm8(e, EXT_AND, OFF_STATUS, 0xFE);
+            break;
+        case SEC:
+            _emit_ctx_imm8(e, EXT_OR, OFF_STATUS, 0x01);
+            break;
+        case CLI:
+            _emit_ctx_imm8(e, EXT_AND, OFF_STATUS, 0xFB);
+            break;
+        case SEI:
+            _emit_ctx_imm8(e, EXT_OR, OFF_STATUS, 0x04);
+            break;
+        case CLD:
+            _emit_ctx_imm8(e, EXT_AND, OFF_STATUS, 0xF7);
+            break;
+        case SED:
+            _emit_ctx_imm8(e, EXT_OR, OFF_STATUS, 0x08);
+            break;
+        case CLV:
+            _emit_ctx_imm8(e, EXT_AND, OFF_STATUS, 0xBF);
+            break;
+        case NOP:
+            break;
+        default:
+            assert(false);
+    }
+}
+
+static void _emit_branch(Translator *t, unsigned int k) {
+    Emitter *e = &t->e;
+    const CachedInstr *instr = &t->block->instrs[k];
+
+    uint16_t next = instr->pc + 2;
+    uint16_t target = next + (int8_t) instr->operand;
+    unsigned int taken_cycles = t->static_cycles[k + 1] + ((target >> 8) != (next >> 8) ? 2 : 1);
+
+    // both dummy reads of the interpreter hit the page following the operand
+    _emit_guard_page(t, k, next >> 8);
+
+    unsigned int cc;
+    switch (instr->info->mnemonic) {
+        case BCC:
+        case BCS:
+            EMIT(e, 0xF6); // test byte [rbx + disp32], imm8
+            _emit_ctx(e, 0, OFF_STATUS);
+            _emit8(e, 0x01);
+            cc = instr->info->mnemonic == BCS ? CC_NZ : CC_Z;
+            break;
+        case BVC:
+        case BVS:
+            EMIT(e, 0xF6);
+            _emit_ctx(e, 0, OFF_STATUS);
+            _emit8(e, 0x40);
+            cc = instr->info->mnemonic == BVS ? CC_NZ : CC_Z;
+            break;
+        case BNE:
+        case BEQ:
+            _emit_rr(e, OP_TEST, RBP, RBP);
+            cc = instr->info->mnemonic == BEQ ? CC_Z : CC_NZ;
+            break;
+        case BPL:
+        case BMI:
+            EMIT(e, 0x41, 0xF7, 0xC6); // test r14d, imm32
+            _emit32(e, 0x80);
+            cc = instr->info->mnemonic == BMI ? CC_NZ : CC_Z;
+            break;
+        default:
+            assert(false);
+            return;
+    }
+
+    size_t taken = _emit_jcc(e, cc);
+    _emit_exit(e, k + 1, t->static_cycles[k + 1], next);
+    _patch(e, taken, e->pos);
+    _emit_exit(e, k + 1, taken_cycles, target);
+}
+
+static bool _is_native(const CachedInstr *instr) {
+    Mnemonic mnemonic = instr->info->mnemonic;
+    AddressingMode mode = instr->info->addr_mode;
+
+    switch (mode) {
+        case REL:
+            return true;
+        case IMP:
+            switch (mnemonic) {
+                case TAX: case TAY: case TXA: case TYA: case TSX: case TXS:
+                case INX: case INY: case DEX: case DEY:
+                case ASL: case LSR: case ROL: case ROR:
+                case CLC: case SEC: case CLI: case SEI: case CLD: case SED: case CLV:
+                case NOP:
+                    return true;
+                default:
+                    return false;
+            }
+        case ABS:
+            if (mnemonic == JMP) {
+                return true;
+            }
+            // fall through
+        case IMM:
+        case ZRP:
+        case ZPX:
+        case ZPY:
+        case ABX:
+        case ABY:
+            switch (mnemonic) {
+                case LDA: case LDX: case LDY: case AND: case ORA: case EOR:
+                case ADC: case SBC: case CMP: case CPX: case CPY: case BIT: case NOP:
+                    return true;
+                case STA: case STX: case STY:
+                case INC: case DEC: case ASL: case LSR: case ROL: case ROR:
+                    return mode != IMM;
+                default:
+                    return false;
+            }
+        default:
+            return false;
+    }
+}
+
+// translates instruction k, returning true if the block ends with it
+static bool _translate_instr(Translator *t, unsigned int k) {
+    Emitter *e = &t->e;
+    const CachedInstr *instr = &t->block->instrs[k];
+    Mnemonic mnemonic = instr->info->mnemonic;
+
+    if (!_is_native(instr)) {
+        return _emit_fallback(t, k, false);
+    }
+
+    if (instr->info->addr_mode == REL) {
+        _emit_branch(t, k);
+        return true;
+    } else if (mnemonic == JMP) {
+        _emit_exit(e, k + 1, t->static_cycles[k + 1], instr->operand);
+        return true;
+    } else if (instr->info->addr_mode == IMP) {
+        _emit_implied(e, mnemonic);
+        return false;
+    } else if (instr->info->addr_mode == IMM) {
+        _emit_mov_imm(e, RCX, instr->operand);
+        _emit_read_op(e, mnemonic);
+        return false;
+    }
+
+    _emit_address(t, k);
+
+    switch (instr->info->type) {
+        case INS_R:
+            _emit_guard_access(t, k, false);
+            _emit_read(e);
+
+            if (instr->info->page_penalty) {
+                _emit_rr(e, OP_TEST, RSI, RSI);
+                EMIT(e, 0x0F, 0x90 | CC_NZ, 0xC0 | RAX); // setnz al
+                _emit_zext8(e, RAX, RAX);
+                _emit_rr(e, OP_ADD, R12, RAX);
+            }
+
+            _emit_read_op(e, mnemonic);
+            break;
+        case INS_W:
+            _emit_guard_access(t, k, true);
+            _emit_load_byte(e, RCX, _reg_offset(mnemonic));
+            _emit_write(t, k);
+            break;
+        case INS_RW:
+            _emit_guard_access(t, k, true);
+            _emit_read(e);
+
+            if (mnemonic == INC || mnemonic == DEC) {
+                EMIT(e, 0xFE, mnemonic == INC ? 0xC1 : 0xC9); // inc/dec cl
+                _emit_zext8(e, RCX, RCX);
+                _emit_set_nz(e, RCX);
+            } else {
+                _emit_shift_op(e, mnemonic);
+            }
+
+            _emit_write(t, k);
+            break;
+        default:
+            assert(false);
+    }
+
+    return false;
+}
+
+JitArena *jit_arena_create(void) {
+    JitArena *arena = calloc(1, sizeof(JitArena));
+    if (!arena) {
+        return NULL;
+    }
+
+    // the arena is never writable and executable at once, so it starts out writable and each translated block is made
+    // executable once it is complete
+    arena->base = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena->base == MAP_FAILED) {
+        free(arena);
+        return NULL;
+    }
+
+    arena->page_size = (size_t) sysconf(_SC_PAGESIZE);
+
+    return arena;
+}
+
+void jit_arena_destroy(JitArena *arena) {
+    if (!arena) {
+        return;
+    }
+
+    munmap(arena->base, ARENA_SIZE);
+    free(arena);
+}
+
+void jit_arena_reset(JitArena *arena) {
+    arena->used = 0;
+}
+
+JitBlockFn jit_compile_block(JitArena *arena, const CodeBlock *block) {
+    if (ARENA_SIZE - arena->used < MAX_BLOCK_CODE) {
+        return NULL;
+    }
+
+    // the block may share its first page with the end of the previous one, which is safe to make writable for a moment
+    // because no translated code runs while a block is being translated
+    size_t prot_start = arena->used & ~(arena->page_size - 1);
+    size_t prot_len = ((arena->used + MAX_BLOCK_CODE + arena->page_size - 1) & ~(arena->page_size - 1)) - prot_start;
+    if (mprotect(arena->base + prot_start, prot_len, PROT_READ | PROT_WRITE) != 0) {
+        return NULL;
+    }
+
+    Translator t;
+    memset(&t, 0, sizeof(t));
+    t.e.code = arena->base + arena->used;
+    t.block = block;
+
+    for (unsigned int k = 0; k < block->count; k++) {
+        t.static_cycles[k + 1] = t.static_cycles[k] + block->instrs[k].info->cycles;
+    }
+
+    _emit_prologue(&t.e);
+
+    bool ended = false;
+    for (unsigned int k = 0; k < block->count && !ended; k++) {
+        t.instr_start[k] = t.e.pos;
+        ended = _translate_instr(&t, k);
+    }
+
+    if (!ended) {
+        const CachedInstr *last = &block->instrs[block->count - 1];
+        t.instr_start[block->count] = t.e.pos;
+        _emit_exit(&t.e, block->count, t.static_cycles[block->count], (uint16_t) (last->pc + last->info->len));
+    }
+
+    // out-of-line paths
+    for (unsigned int k = 0; k < block->count; k++) {
+        const CachedInstr *instr = &block->instrs[k];
+
+        if (t.fallback[k].count > 0) {
+            for (unsigned int i = 0; i < t.fallback[k].count; i++) {
+                _patch(&t.e, t.fallback[k].pos[i], t.e.pos);
+            }
+            _emit_fallback(&t, k, true);
+        }
+
+        if (t.smc_exit[k].count > 0) {
+            for (unsigned int i = 0; i < t.smc_exit[k].count; i++) {
+                _patch(&t.e, t.smc_exit[k].pos[i], t.e.pos);
+            }
+            _emit_exit(&t.e, k + 1, t.static_cycles[k + 1], (uint16_t) (instr->pc + instr->info->len));
+        }
+    }
+
+    assert(t.e.pos <= MAX_BLOCK_CODE);
+
+    if (mprotect(arena->base + prot_start, prot_len, PROT_READ | PROT_EXEC) != 0) {
+        return NULL;
+    }
+
+    JitBlockFn fn = (JitBlockFn) (uintptr_t) t.e.code;
+    arena->used = (arena->used + t.e.pos + 15) & ~(size_t) 15;
+
+    return fn;
+}
+
+#else
+
+JitArena *jit_arena_create(void) {
+    return NULL;
+}
+
+void jit_arena_destroy(JitArena *arena) {
+    (void) arena;
+}
+
+void jit_arena_reset(JitArena *arena) {
+    (void) arena;
+}
+
+JitBlockFn jit_compile_block(JitArena *arena, const CodeBlock *block) {
+    (void) arena;
+    (void) block;
+    return NULL;
+}
+
+#endif
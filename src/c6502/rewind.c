@@ -0,0 +1,312 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "c6502/rewind.h"
+#include "cpu_internal.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGE_SIZE 0x100
+#define PAGE_COUNT 0x100
+
+typedef struct {
+    uint8_t state[CPU_STATE_SIZE];
+    uint64_t cycle;
+    size_t page_count;
+    uint8_t *page_indices; // the pages written since the previous keyframe
+    uint8_t *pages; // their contents at the time of the keyframe, PAGE_SIZE bytes each
+} Keyframe;
+
+struct RewindBuffer {
+    Cpu6502 *cpu;
+    uint64_t interval;
+    size_t budget;
+    size_t usage;
+
+    // memory as of the oldest keyframe, with NULL for pages which were not mapped at the time
+    uint8_t *image[PAGE_COUNT];
+
+    Keyframe *keyframes; // oldest first
+    size_t keyframe_count;
+    size_t keyframe_cap;
+
+    uint64_t mark; // the dirty page mark taken with the newest keyframe
+};
+
+// Whether the page is mapped read-write or copy-on-write and is the lowest of the pages aliasing its memory, so that
+// memory which is mirrored across several pages is only captured once.
+static bool _is_captured_page(const Cpu6502 *cpu, uint8_t page) {
+    if (cpu->page_map[page] == NULL
+            || (cpu->page_flags[page] != CPU_PAGE_READ_WRITE && cpu->page_flags[page] != CPU_PAGE_COPY_ON_WRITE)) {
+        return false;
+    }
+
+    for (uint8_t alias = cpu->page_alias[page]; alias != page; alias = cpu->page_alias[alias]) {
+        if (alias < page) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// the memory accounted for a keyframe
+static size_t _keyframe_size(const Keyframe *keyframe) {
+    return sizeof(Keyframe) + keyframe->page_count * (PAGE_SIZE + 1);
+}
+
+static void _free_keyframe(Keyframe *keyframe) {
+    free(keyframe->page_indices);
+    free(keyframe->pages);
+}
+
+RewindBuffer *rewind_create(Cpu6502 *cpu, uint64_t interval, size_t budget) {
+    RewindBuffer *rewind = calloc(1, sizeof(RewindBuffer));
+    if (rewind == NULL) {
+        return NULL;
+    }
+
+    rewind->cpu = cpu;
+    rewind->interval = interval;
+    rewind->budget = budget;
+
+    return rewind;
+}
+
+void rewind_destroy(RewindBuffer *rewind) {
+    for (size_t i = 0; i < rewind->keyframe_count; i++) {
+        _free_keyframe(&rewind->keyframes[i]);
+    }
+
+    for (size_t page = 0; page < PAGE_COUNT; page++) {
+        free(rewind->image[page]);
+    }
+
+    free(rewind->keyframes);
+    free(rewind);
+}
+
+// takes the first keyframe, which gets its memory from the image
+static bool _capture_image(RewindBuffer *rewind) {
+    const Cpu6502 *cpu = rewind->cpu;
+
+    for (size_t page = 0; page < PAGE_COUNT; page++) {
+        if (!_is_captured_page(cpu, page)) {
+            continue;
+        }
+
+        if (rewind->image[page] == NULL) {
+            if ((rewind->image[page] = malloc(PAGE_SIZE)) == NULL) {
+                return false;
+            }
+            rewind->usage += PAGE_SIZE;
+        }
+
+        memcpy(rewind->image[page], cpu->page_map[page], PAGE_SIZE);
+    }
+
+    return true;
+}
+
+// collects the pages written since the newest keyframe into the given one
+static bool _capture_pages(RewindBuffer *rewind, Keyframe *keyframe) {
+    const Cpu6502 *cpu = rewind->cpu;
+
+    uint8_t dirty[PAGE_COUNT];
+    size_t dirty_count = cpu_dirty_pages_since(cpu, rewind->mark, dirty);
+
+    size_t count = 0;
+    uint8_t indices[PAGE_COUNT];
+    for (size_t i = 0; i < dirty_count; i++) {
+        if (_is_captured_page(cpu, dirty[i])) {
+            indices[count++] = dirty[i];
+        }
+    }
+
+    if (count == 0) {
+        return true;
+    }
+
+    keyframe->page_indices = malloc(count);
+    keyframe->pages = malloc(count * PAGE_SIZE);
+    if (keyframe->page_indices == NULL || keyframe->pages == NULL) {
+        return false;
+    }
+
+    memcpy(keyframe->page_indices, indices, count);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(keyframe->pages + i * PAGE_SIZE, cpu->page_map[indices[i]], PAGE_SIZE);
+    }
+    keyframe->page_count = count;
+
+    return true;
+}
+
+// folds the second oldest keyframe's pages into the image, making it the oldest
+static void _drop_oldest(RewindBuffer *rewind) {
+    Keyframe *next = &rewind->keyframes[1];
+
+    for (size_t i = 0; i < next->page_count; i++) {
+        uint8_t *page = rewind->image[next->page_indices[i]];
+
+        // the image covers every captured page as long as the mappings stay the same
+        if (page != NULL) {
+            memcpy(page, next->pages + i * PAGE_SIZE, PAGE_SIZE);
+        }
+    }
+
+    rewind->usage -= _keyframe_size(&rewind->keyframes[0]) + next->page_count * (PAGE_SIZE + 1);
+    _free_keyframe(&rewind->keyframes[0]);
+    _free_keyframe(next);
+    next->page_count = 0;
+    next->page_indices = NULL;
+    next->pages = NULL;
+
+    memmove(rewind->keyframes, rewind->keyframes + 1, (rewind->keyframe_count - 1) * sizeof(Keyframe));
+    rewind->keyframe_count--;
+}
+
+bool rewind_update(RewindBuffer *rewind) {
+    Cpu6502 *cpu = rewind->cpu;
+
+    if (rewind->keyframe_count != 0
+            && cpu->cycle_count - rewind->keyframes[rewind->keyframe_count - 1].cycle < rewind->interval) {
+        return true;
+    }
+
+    if (rewind->keyframe_count == rewind->keyframe_cap) {
+        size_t new_cap = rewind->keyframe_cap != 0 ? rewind->keyframe_cap * 2 : 16;
+        Keyframe *keyframes = realloc(rewind->keyframes, new_cap * sizeof(Keyframe));
+        if (keyframes == NULL) {
+            return false;
+        }
+        rewind->keyframes = keyframes;
+        rewind->keyframe_cap = new_cap;
+    }
+
+    Keyframe *keyframe = &rewind->keyframes[rewind->keyframe_count];
+    memset(keyframe, 0, sizeof(Keyframe));
+    keyframe->cycle = cpu->cycle_count;
+    cpu_save_state(cpu, keyframe->state);
+
+    bool captured = rewind->keyframe_count == 0 ? _capture_image(rewind) : _capture_pages(rewind, keyframe);
+    if (!captured) {
+        _free_keyframe(keyframe);
+        return false;
+    }
+
+    rewind->keyframe_count++;
+    rewind->usage += _keyframe_size(keyframe);
+    rewind->mark = cpu_mark_dirty_pages(cpu);
+
+    while (rewind->usage > rewind->budget && rewind->keyframe_count > 1) {
+        _drop_oldest(rewind);
+    }
+
+    return true;
+}
+
+// writes the memory as of the given keyframe back to the mapped pages
+static void _restore_memory(RewindBuffer *rewind, size_t index) {
+    Cpu6502 *cpu = rewind->cpu;
+
+    const uint8_t *contents[PAGE_COUNT];
+    for (size_t page = 0; page < PAGE_COUNT; page++) {
+        contents[page] = rewind->image[page];
+    }
+
+    for (size_t k = 1; k <= index; k++) {
+        const Keyframe *keyframe = &rewind->keyframes[k];
+        for (size_t i = 0; i < keyframe->page_count; i++) {
+            contents[keyframe->page_indices[i]] = keyframe->pages + i * PAGE_SIZE;
+        }
+    }
+
+    for (size_t page = 0; page < PAGE_COUNT; page++) {
+        if (contents[page] == NULL || !_is_captured_page(cpu, page)) {
+            continue;
+        }
+
+        // shared memory is left alone unless it has to change
+        if (cpu->page_flags[page] == CPU_PAGE_COPY_ON_WRITE
+                && (memcmp(cpu->page_map[page], contents[page], PAGE_SIZE) == 0 || !cpu_copy_page(cpu, page))) {
+            continue;
+        }
+
+        memcpy(cpu->page_map[page], contents[page], PAGE_SIZE);
+    }
+
+    cpu_invalidate_code(cpu, 0, 0x10000);
+}
+
+bool rewind_seek(RewindBuffer *rewind, uint64_t cycle) {
+    Cpu6502 *cpu = rewind->cpu;
+
+    if (rewind->keyframe_count == 0 || cycle < rewind->keyframes[0].cycle || cycle > cpu->cycle_count) {
+        return false;
+    }
+
+    size_t index = rewind->keyframe_count - 1;
+    while (rewind->keyframes[index].cycle > cycle) {
+        index--;
+    }
+
+    _restore_memory(rewind, index);
+    cpu_load_state(cpu, rewind->keyframes[index].state, CPU_STATE_SIZE);
+
+    // the keyframes after the one restored belong to a future which may not happen again
+    while (rewind->keyframe_count > index + 1) {
+        Keyframe *discarded = &rewind->keyframes[--rewind->keyframe_count];
+        rewind->usage -= _keyframe_size(discarded);
+        _free_keyframe(discarded);
+    }
+    rewind->mark = cpu_mark_dirty_pages(cpu);
+
+    while (cpu->cycle_count < cycle) {
+        cpu_run_cycles(cpu, cycle - cpu->cycle_count, 0);
+    }
+
+    return true;
+}
+
+bool rewind_cycles(RewindBuffer *rewind, uint64_t cycles) {
+    uint64_t now = rewind->cpu->cycle_count;
+    return cycles <= now && rewind_seek(rewind, now - cycles);
+}
+
+uint64_t rewind_get_oldest_cycle(const RewindBuffer *rewind) {
+    return rewind->keyframe_count != 0 ? rewind->keyframes[0].cycle : rewind->cpu->cycle_count;
+}
+
+size_t rewind_get_keyframe_count(const RewindBuffer *rewind) {
+    return rewind->keyframe_count;
+}
+
+size_t rewind_get_memory_usage(const RewindBuffer *rewind) {
+    return rewind->usage;
+}
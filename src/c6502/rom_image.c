@@ -0,0 +1,163 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "c6502/rom_image.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define PAGE_SIZE 0x100
+
+struct RomImage {
+    const uint8_t *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+};
+
+#ifdef _WIN32
+static bool _map_file(RomImage *image, const char *path) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || (uint64_t) size.QuadPart > SIZE_MAX) {
+        CloseHandle(file);
+        return false;
+    }
+
+    // the mapping keeps the file open on its own
+    image->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (image->mapping == NULL) {
+        return false;
+    }
+
+    if ((image->data = MapViewOfFile(image->mapping, FILE_MAP_READ, 0, 0, 0)) == NULL) {
+        CloseHandle(image->mapping);
+        return false;
+    }
+    image->size = (size_t) size.QuadPart;
+
+    return true;
+}
+
+static void _unmap_file(RomImage *image) {
+    UnmapViewOfFile(image->data);
+    CloseHandle(image->mapping);
+}
+#else
+static bool _map_file(RomImage *image, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t) st.st_size > SIZE_MAX) {
+        close(fd);
+        return false;
+    }
+
+    // the mapping keeps the file open on its own
+    void *data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    image->data = data;
+    image->size = (size_t) st.st_size;
+
+    return true;
+}
+
+static void _unmap_file(RomImage *image) {
+    munmap((void*) image->data, image->size);
+}
+#endif
+
+RomImage *rom_image_open(const char *path) {
+    RomImage *image = calloc(1, sizeof(RomImage));
+    if (image == NULL) {
+        return NULL;
+    }
+
+    if (!_map_file(image, path)) {
+        free(image);
+        return NULL;
+    }
+
+    return image;
+}
+
+void rom_image_close(RomImage *image) {
+    _unmap_file(image);
+    free(image);
+}
+
+const uint8_t *rom_image_data(const RomImage *image) {
+    return image->data;
+}
+
+size_t rom_image_size(const RomImage *image) {
+    return image->size;
+}
+
+bool rom_image_map(const RomImage *image, Cpu6502 *cpu, uint16_t addr, size_t len) {
+    if ((addr & 0xFF) || (len & 0xFF) || addr + len > 0x10000) {
+        return false;
+    }
+
+    // The host pages the image is mapped into are zero-filled past its end, which covers the padding. The CPU never
+    // writes to copy-on-write pages, so the memory being read-only is not a concern.
+    size_t span = (image->size + PAGE_SIZE - 1) & ~(size_t) (PAGE_SIZE - 1);
+    for (size_t offset = 0; offset < len; offset += span) {
+        size_t chunk = len - offset < span ? len - offset : span;
+        if (!cpu_map_memory(cpu, addr + offset, chunk, (uint8_t*) image->data, CPU_PAGE_COPY_ON_WRITE)) {
+            return false;
+        }
+    }
+
+    return true;
+}
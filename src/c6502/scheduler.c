@@ -0,0 +1,215 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "c6502/scheduler.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+    uint64_t cycle;
+    uint64_t id; // also orders events due on the same cycle, as IDs are handed out in ascending order
+    SchedulerCallback callback;
+    void *userdata;
+} Event;
+
+struct Scheduler {
+    Cpu6502 *cpu;
+
+    Event *heap; // a binary min-heap ordered by cycle, then ID
+    size_t count;
+    size_t cap;
+
+    uint64_t next_id;
+};
+
+static bool _is_before(const Event *a, const Event *b) {
+    return a->cycle != b->cycle ? a->cycle < b->cycle : a->id < b->id;
+}
+
+static void _swap(Event *a, Event *b) {
+    Event tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void _sift_up(Scheduler *scheduler, size_t index) {
+    Event *heap = scheduler->heap;
+
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (!_is_before(&heap[index], &heap[parent])) {
+            break;
+        }
+
+        _swap(&heap[index], &heap[parent]);
+        index = parent;
+    }
+}
+
+static void _sift_down(Scheduler *scheduler, size_t index) {
+    Event *heap = scheduler->heap;
+
+    for (;;) {
+        size_t first = index;
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+
+        if (left < scheduler->count && _is_before(&heap[left], &heap[first])) {
+            first = left;
+        }
+        if (right < scheduler->count && _is_before(&heap[right], &heap[first])) {
+            first = right;
+        }
+
+        if (first == index) {
+            break;
+        }
+
+        _swap(&heap[index], &heap[first]);
+        index = first;
+    }
+}
+
+static void _remove_at(Scheduler *scheduler, size_t index) {
+    scheduler->heap[index] = scheduler->heap[--scheduler->count];
+
+    if (index < scheduler->count) {
+        _sift_up(scheduler, index);
+        _sift_down(scheduler, index);
+    }
+}
+
+Scheduler *scheduler_create(Cpu6502 *cpu) {
+    Scheduler *scheduler = calloc(1, sizeof(Scheduler));
+    if (scheduler == NULL) {
+        return NULL;
+    }
+
+    scheduler->cpu = cpu;
+    scheduler->next_id = 1;
+
+    return scheduler;
+}
+
+void scheduler_destroy(Scheduler *scheduler) {
+    free(scheduler->heap);
+    free(scheduler);
+}
+
+uint64_t scheduler_add_event(Scheduler *scheduler, uint64_t at_cycle, SchedulerCallback callback, void *userdata) {
+    if (scheduler->count == scheduler->cap) {
+        size_t new_cap = scheduler->cap != 0 ? scheduler->cap * 2 : 16;
+        Event *heap = realloc(scheduler->heap, new_cap * sizeof(Event));
+        if (heap == NULL) {
+            return 0;
+        }
+        scheduler->heap = heap;
+        scheduler->cap = new_cap;
+    }
+
+    uint64_t id = scheduler->next_id++;
+    scheduler->heap[scheduler->count] = (Event) {at_cycle, id, callback, userdata};
+    _sift_up(scheduler, scheduler->count++);
+
+    return id;
+}
+
+bool scheduler_cancel_event(Scheduler *scheduler, uint64_t id) {
+    for (size_t i = 0; i < scheduler->count; i++) {
+        if (scheduler->heap[i].id == id) {
+            _remove_at(scheduler, i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint64_t scheduler_get_next_event_cycle(const Scheduler *scheduler) {
+    return scheduler->count != 0 ? scheduler->heap[0].cycle : UINT64_MAX;
+}
+
+size_t scheduler_get_event_count(const Scheduler *scheduler) {
+    return scheduler->count;
+}
+
+// calls back all events which are due by the current cycle, including ones added by the callbacks themselves
+static void _service_events(Scheduler *scheduler) {
+    uint64_t now = cpu_get_cycle_count(scheduler->cpu);
+
+    while (scheduler->count != 0 && scheduler->heap[0].cycle <= now) {
+        Event event = scheduler->heap[0];
+        _remove_at(scheduler, 0);
+
+        event.callback(event.userdata, event.cycle);
+    }
+}
+
+// returns the cycle at which a run of the given budget ends, saturating instead of wrapping around
+static uint64_t _end_cycle(const Scheduler *scheduler, uint64_t budget) {
+    uint64_t now = cpu_get_cycle_count(scheduler->cpu);
+    return budget < UINT64_MAX - now ? now + budget : UINT64_MAX;
+}
+
+uint64_t scheduler_run_cycles(Scheduler *scheduler, uint64_t budget, unsigned int stop_mask) {
+    Cpu6502 *cpu = scheduler->cpu;
+    uint64_t start = cpu_get_cycle_count(cpu);
+    uint64_t end = _end_cycle(scheduler, budget);
+
+    _service_events(scheduler);
+
+    while (cpu_get_cycle_count(cpu) < end) {
+        uint64_t now = cpu_get_cycle_count(cpu);
+        uint64_t next = scheduler_get_next_event_cycle(scheduler);
+
+        cpu_run_cycles(cpu, (next < end ? next : end) - now, stop_mask);
+        _service_events(scheduler);
+
+        if (cpu_get_stop_reason(cpu) != CPU_STOP_NONE) {
+            break;
+        }
+    }
+
+    return cpu_get_cycle_count(cpu) - start;
+}
+
+uint64_t scheduler_run_instructions(Scheduler *scheduler, uint64_t budget) {
+    Cpu6502 *cpu = scheduler->cpu;
+    uint64_t start = cpu_get_cycle_count(cpu);
+    uint64_t end = _end_cycle(scheduler, budget);
+
+    _service_events(scheduler);
+
+    while (cpu_get_cycle_count(cpu) < end) {
+        uint64_t next = scheduler_get_next_event_cycle(scheduler);
+
+        cpu_run_until_cycle(cpu, next < end ? next : end);
+        _service_events(scheduler);
+    }
+
+    return cpu_get_cycle_count(cpu) - start;
+}
@@ -0,0 +1,787 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _MSC_VER
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "c6502/trace_file.h"
+#include "c6502/instrs.h"
+#include "cpu_internal.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define FSEEK64 _fseeki64
+#define FTELL64 _ftelli64
+#else
+#define FSEEK64 fseeko
+#define FTELL64 ftello
+#endif
+
+#define FILE_MAGIC "C65T"
+#define INDEX_MAGIC "C65X"
+#define FILE_VERSION 1
+#define FILE_HEADER_SIZE 8 // magic, version, reserved
+#define BLOCK_HEADER_SIZE 20 // record count, raw size, packed size, first cycle
+#define INDEX_ENTRY_SIZE 20 // offset, first cycle, record count
+#define TRAILER_SIZE 16 // index offset, block count, magic
+
+#define BLOCK_RECORDS 4096
+#define MAX_ENCODED_RECORD 32
+#define MAX_RAW_SIZE (BLOCK_RECORDS * MAX_ENCODED_RECORD)
+#define MAX_PACKED_SIZE (MAX_RAW_SIZE + MAX_RAW_SIZE / 255 + 16)
+
+// which fields of an encoded record differ from what the previous record predicts
+#define TAG_PC 0x01 // the PC does not follow the previous instruction
+#define TAG_ACC 0x02
+#define TAG_X 0x04
+#define TAG_Y 0x08
+#define TAG_SP 0x10
+#define TAG_STATUS 0x20
+#define TAG_EFF_ADDR 0x40 // the effective address is stored explicitly
+#define TAG_EFF_OPERAND 0x80 // the effective address equals the operand
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 0xFFFF
+
+typedef struct {
+    uint64_t offset; // of the block header
+    uint64_t first_cycle;
+    uint32_t record_count;
+} BlockInfo;
+
+typedef struct {
+    BlockInfo *blocks;
+    size_t count;
+    size_t cap;
+} BlockIndex;
+
+struct TraceWriter {
+    FILE *file;
+    bool failed;
+    uint64_t offset; // the current end of the file
+
+    CpuTraceRecord prev;
+    uint64_t first_cycle;
+    uint32_t record_count; // in the current block
+    size_t raw_len;
+    uint8_t raw[MAX_RAW_SIZE];
+    uint8_t packed[MAX_PACKED_SIZE];
+    uint32_t lz_table[1 << LZ_HASH_BITS]; // positions plus one, so that 0 marks an empty slot
+
+    BlockIndex index;
+};
+
+struct TraceReader {
+    FILE *file;
+    BlockIndex index;
+    uint64_t record_count;
+
+    size_t next_block; // the block to load once the current one is exhausted
+    uint32_t block_remaining; // records left in the current block
+    CpuTraceRecord prev;
+    size_t raw_len;
+    size_t raw_pos;
+    uint8_t raw[MAX_RAW_SIZE];
+    uint8_t packed[MAX_PACKED_SIZE];
+
+    bool has_pending; // set when pending was read ahead by a seek
+    CpuTraceRecord pending;
+};
+
+static void _put_u16(uint8_t *dst, uint16_t val) {
+    dst[0] = val & 0xFF;
+    dst[1] = val >> 8;
+}
+
+static void _put_u32(uint8_t *dst, uint32_t val) {
+    for (int i = 0; i < 4; i++) {
+        dst[i] = (val >> (i * 8)) & 0xFF;
+    }
+}
+
+static void _put_u64(uint8_t *dst, uint64_t val) {
+    for (int i = 0; i < 8; i++) {
+        dst[i] = (val >> (i * 8)) & 0xFF;
+    }
+}
+
+static uint16_t _get_u16(const uint8_t *src) {
+    return src[0] | (src[1] << 8);
+}
+
+static uint32_t _get_u32(const uint8_t *src) {
+    uint32_t val = 0;
+    for (int i = 0; i < 4; i++) {
+        val |= (uint32_t) src[i] << (i * 8);
+    }
+    return val;
+}
+
+static uint64_t _get_u64(const uint8_t *src) {
+    uint64_t val = 0;
+    for (int i = 0; i < 8; i++) {
+        val |= (uint64_t) src[i] << (i * 8);
+    }
+    return val;
+}
+
+static size_t _put_varint(uint8_t *dst, uint64_t val) {
+    size_t len = 0;
+    while (val >= 0x80) {
+        dst[len++] = (val & 0x7F) | 0x80;
+        val >>= 7;
+    }
+    dst[len++] = val;
+    return len;
+}
+
+static bool _get_varint(const uint8_t *src, size_t len, size_t *pos, uint64_t *val) {
+    *val = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        if (*pos >= len) {
+            return false;
+        }
+
+        uint8_t byte = src[(*pos)++];
+        *val |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool _index_add(BlockIndex *index, BlockInfo info) {
+    if (index->count == index->cap) {
+        size_t new_cap = index->cap != 0 ? index->cap * 2 : 64;
+        BlockInfo *blocks = realloc(index->blocks, new_cap * sizeof(BlockInfo));
+        if (blocks == NULL) {
+            return false;
+        }
+        index->blocks = blocks;
+        index->cap = new_cap;
+    }
+
+    index->blocks[index->count++] = info;
+    return true;
+}
+
+// the address the instruction following the given one would start at
+static uint16_t _predict_pc(const CpuTraceRecord *prev) {
+    return prev->pc + get_opcode_info(prev->opcode)->len;
+}
+
+static uint16_t _operand_mask(uint8_t opcode) {
+    switch (get_opcode_info(opcode)->len) {
+        case 2:
+            return 0xFF;
+        case 3:
+            return 0xFFFF;
+        default:
+            return 0;
+    }
+}
+
+// Compresses src into dst, which must have room for at least len + len / 255 + 16 bytes, and returns the compressed
+// length. The output is a series of sequences, each consisting of a token byte holding the literal length in its high
+// nibble and the match length minus LZ_MIN_MATCH in its low one, extra length bytes for the literals if the nibble is
+// 15, the literals themselves, and then a 16-bit match offset followed by extra length bytes for the match. The last
+// sequence has no match.
+static size_t _lz_emit(uint8_t *dst, size_t op, const uint8_t *lits, size_t lit_len, size_t offset, size_t match_len) {
+    size_t match_code = match_len != 0 ? match_len - LZ_MIN_MATCH : 0;
+    dst[op++] = ((lit_len < 15 ? lit_len : 15) << 4) | (match_code < 15 ? match_code : 15);
+
+    if (lit_len >= 15) {
+        size_t rest = lit_len - 15;
+        for (; rest >= 255; rest -= 255) {
+            dst[op++] = 255;
+        }
+        dst[op++] = rest;
+    }
+
+    memcpy(dst + op, lits, lit_len);
+    op += lit_len;
+
+    if (match_len != 0) {
+        _put_u16(dst + op, offset);
+        op += 2;
+
+        if (match_code >= 15) {
+            size_t rest = match_code - 15;
+            for (; rest >= 255; rest -= 255) {
+                dst[op++] = 255;
+            }
+            dst[op++] = rest;
+        }
+    }
+
+    return op;
+}
+
+// table must have room for 1 << LZ_HASH_BITS entries
+static size_t _lz_compress(const uint8_t *src, size_t len, uint8_t *dst, uint32_t *table) {
+    memset(table, 0, sizeof(uint32_t) << LZ_HASH_BITS);
+
+    size_t ip = 0;
+    size_t anchor = 0;
+    size_t op = 0;
+
+    while (ip + LZ_MIN_MATCH <= len) {
+        uint32_t seq;
+        memcpy(&seq, src + ip, sizeof(seq));
+        uint32_t hash = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+
+        size_t cand = table[hash];
+        table[hash] = ip + 1;
+
+        uint32_t cand_seq;
+        if (cand != 0 && ip - (cand - 1) <= LZ_MAX_OFFSET
+                && (memcpy(&cand_seq, src + cand - 1, sizeof(cand_seq)), cand_seq == seq)) {
+            size_t ref = cand - 1;
+            size_t match_len = LZ_MIN_MATCH;
+            while (ip + match_len < len && src[ref + match_len] == src[ip + match_len]) {
+                match_len++;
+            }
+
+            op = _lz_emit(dst, op, src + anchor, ip - anchor, ip - ref, match_len);
+            ip += match_len;
+            anchor = ip;
+        } else {
+            ip++;
+        }
+    }
+
+    return _lz_emit(dst, op, src + anchor, len - anchor, 0, 0);
+}
+
+static bool _lz_read_len(const uint8_t *src, size_t len, size_t *ip, size_t *val) {
+    uint8_t byte;
+    do {
+        if (*ip >= len) {
+            return false;
+        }
+        byte = src[(*ip)++];
+        *val += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// returns false if src is corrupt or does not decompress to exactly dst_len bytes
+static bool _lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_len) {
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < len) {
+        uint8_t token = src[ip++];
+
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && !_lz_read_len(src, len, &ip, &lit_len)) {
+            return false;
+        }
+        if (lit_len > len - ip || lit_len > dst_len - op) {
+            return false;
+        }
+        memcpy(dst + op, src + ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        if (ip == len) {
+            break;
+        }
+
+        if (len - ip < 2) {
+            return false;
+        }
+        size_t offset = _get_u16(src + ip);
+        ip += 2;
+
+        size_t match_len = token & 0xF;
+        if (match_len == 15 && !_lz_read_len(src, len, &ip, &match_len)) {
+            return false;
+        }
+        match_len += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > op || match_len > dst_len - op) {
+            return false;
+        }
+
+        // the match may overlap the bytes it produces
+        for (size_t i = 0; i < match_len; i++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+
+    return op == dst_len;
+}
+
+static bool _write(TraceWriter *writer, const void *data, size_t len) {
+    if (!writer->failed && fwrite(data, 1, len, writer->file) != len) {
+        writer->failed = true;
+    }
+    writer->offset += len;
+    return !writer->failed;
+}
+
+static bool _flush_block(TraceWriter *writer) {
+    if (writer->record_count == 0) {
+        return !writer->failed;
+    }
+
+    size_t packed_len = _lz_compress(writer->raw, writer->raw_len, writer->packed, writer->lz_table);
+
+    uint8_t header[BLOCK_HEADER_SIZE];
+    _put_u32(header, writer->record_count);
+    _put_u32(header + 4, writer->raw_len);
+    _put_u32(header + 8, packed_len);
+    _put_u64(header + 12, writer->first_cycle);
+
+    BlockInfo info = {writer->offset, writer->first_cycle, writer->record_count};
+    if (!_index_add(&writer->index, info)) {
+        writer->failed = true;
+    }
+
+    _write(writer, header, sizeof(header));
+    _write(writer, writer->packed, packed_len);
+
+    writer->record_count = 0;
+    writer->raw_len = 0;
+
+    return !writer->failed;
+}
+
+static void _encode_record(TraceWriter *writer, const CpuTraceRecord *record) {
+    const CpuTraceRecord *prev = &writer->prev;
+
+    if (writer->record_count == 0) {
+        // every block starts from scratch so that it can be decoded on its own
+        memset(&writer->prev, 0, sizeof(writer->prev));
+        writer->prev.cycle = record->cycle;
+        writer->first_cycle = record->cycle;
+    }
+
+    uint16_t operand = record->operand & _operand_mask(record->opcode);
+
+    uint8_t tag = 0;
+    tag |= record->pc != _predict_pc(prev) ? TAG_PC : 0;
+    tag |= record->acc != prev->acc ? TAG_ACC : 0;
+    tag |= record->x != prev->x ? TAG_X : 0;
+    tag |= record->y != prev->y ? TAG_Y : 0;
+    tag |= record->sp != prev->sp ? TAG_SP : 0;
+    tag |= record->status != prev->status ? TAG_STATUS : 0;
+    if (record->eff_addr == operand) {
+        tag |= TAG_EFF_OPERAND;
+    } else if (record->eff_addr != prev->eff_addr) {
+        tag |= TAG_EFF_ADDR;
+    }
+
+    uint8_t *dst = writer->raw + writer->raw_len;
+    size_t len = 0;
+
+    dst[len++] = tag;
+    dst[len++] = record->opcode;
+    for (uint16_t mask = _operand_mask(record->opcode), shift = 0; mask != 0; mask >>= 8, shift += 8) {
+        dst[len++] = (operand >> shift) & 0xFF;
+    }
+    dst[len++] = record->bus_val;
+    len += _put_varint(dst + len, record->cycle - prev->cycle);
+
+    if (tag & TAG_PC) {
+        // branch targets are usually close by, so the difference is zigzag-encoded to keep it short
+        int16_t delta = (int16_t) (record->pc - _predict_pc(prev));
+        len += _put_varint(dst + len, (uint16_t) ((delta << 1) ^ (delta >> 15)));
+    }
+    if (tag & TAG_ACC) {
+        dst[len++] = record->acc;
+    }
+    if (tag & TAG_X) {
+        dst[len++] = record->x;
+    }
+    if (tag & TAG_Y) {
+        dst[len++] = record->y;
+    }
+    if (tag & TAG_SP) {
+        dst[len++] = record->sp;
+    }
+    if (tag & TAG_STATUS) {
+        dst[len++] = record->status;
+    }
+    if (tag & TAG_EFF_ADDR) {
+        _put_u16(dst + len, record->eff_addr);
+        len += 2;
+    }
+
+    writer->raw_len += len;
+    writer->record_count++;
+
+    writer->prev = *record;
+    writer->prev.operand = operand;
+}
+
+TraceWriter *trace_writer_open(const char *path) {
+    TraceWriter *writer = calloc(1, sizeof(TraceWriter));
+    if (writer == NULL) {
+        return NULL;
+    }
+
+    if ((writer->file = fopen(path, "wb")) == NULL) {
+        free(writer);
+        return NULL;
+    }
+
+    uint8_t header[FILE_HEADER_SIZE] = {0};
+    memcpy(header, FILE_MAGIC, 4);
+    _put_u16(header + 4, FILE_VERSION);
+    _write(writer, header, sizeof(header));
+
+    return writer;
+}
+
+bool trace_writer_append(TraceWriter *writer, const CpuTraceRecord *records, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        _encode_record(writer, &records[i]);
+
+        if (writer->record_count == BLOCK_RECORDS) {
+            _flush_block(writer);
+        }
+    }
+
+    return !writer->failed;
+}
+
+void trace_writer_consume(void *writer, const CpuTraceRecord *records, size_t count) {
+    trace_writer_append(writer, records, count);
+}
+
+bool trace_writer_drain(TraceWriter *writer, const Cpu6502 *cpu, uint64_t *position) {
+    if (cpu->trace_buf == NULL) {
+        return !writer->failed;
+    }
+
+    bool complete = true;
+    if (cpu->trace_count - *position > cpu->trace_capacity) {
+        *position = cpu->trace_count - cpu->trace_capacity;
+        complete = false;
+    }
+
+    while (*position < cpu->trace_count) {
+        size_t start = *position % cpu->trace_capacity;
+        size_t count = cpu->trace_capacity - start;
+        if (count > cpu->trace_count - *position) {
+            count = cpu->trace_count - *position;
+        }
+
+        trace_writer_append(writer, cpu->trace_buf + start, count);
+        *position += count;
+    }
+
+    return complete && !writer->failed;
+}
+
+bool trace_writer_close(TraceWriter *writer) {
+    _flush_block(writer);
+
+    uint64_t index_offset = writer->offset;
+    for (size_t i = 0; i < writer->index.count; i++) {
+        const BlockInfo *info = &writer->index.blocks[i];
+
+        uint8_t entry[INDEX_ENTRY_SIZE];
+        _put_u64(entry, info->offset);
+        _put_u64(entry + 8, info->first_cycle);
+        _put_u32(entry + 16, info->record_count);
+        _write(writer, entry, sizeof(entry));
+    }
+
+    uint8_t trailer[TRAILER_SIZE];
+    _put_u64(trailer, index_offset);
+    _put_u32(trailer + 8, writer->index.count);
+    memcpy(trailer + 12, INDEX_MAGIC, 4);
+    _write(writer, trailer, sizeof(trailer));
+
+    bool res = !writer->failed;
+    if (fclose(writer->file) != 0) {
+        res = false;
+    }
+
+    free(writer->index.blocks);
+    free(writer);
+
+    return res;
+}
+
+static bool _read_at(FILE *file, uint64_t offset, void *data, size_t len) {
+    return FSEEK64(file, offset, SEEK_SET) == 0 && fread(data, 1, len, file) == len;
+}
+
+static bool _read_index(TraceReader *reader, uint64_t file_size) {
+    uint8_t trailer[TRAILER_SIZE];
+    if (file_size < FILE_HEADER_SIZE + TRAILER_SIZE
+            || !_read_at(reader->file, file_size - TRAILER_SIZE, trailer, sizeof(trailer))
+            || memcmp(trailer + 12, INDEX_MAGIC, 4) != 0) {
+        return false;
+    }
+
+    uint64_t index_offset = _get_u64(trailer);
+    uint32_t block_count = _get_u32(trailer + 8);
+    if (index_offset > file_size - TRAILER_SIZE || (file_size - index_offset - TRAILER_SIZE) / INDEX_ENTRY_SIZE != block_count
+            || FSEEK64(reader->file, index_offset, SEEK_SET) != 0) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < block_count; i++) {
+        uint8_t entry[INDEX_ENTRY_SIZE];
+        if (fread(entry, 1, sizeof(entry), reader->file) != sizeof(entry)) {
+            return false;
+        }
+
+        BlockInfo info = {_get_u64(entry), _get_u64(entry + 8), _get_u32(entry + 16)};
+        if (!_index_add(&reader->index, info)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// rebuilds the index of a file which was never closed, ignoring a partially written block at the end
+static bool _scan_blocks(TraceReader *reader, uint64_t file_size) {
+    reader->index.count = 0;
+
+    uint64_t offset = FILE_HEADER_SIZE;
+    while (offset + BLOCK_HEADER_SIZE <= file_size) {
+        uint8_t header[BLOCK_HEADER_SIZE];
+        if (!_read_at(reader->file, offset, header, sizeof(header))) {
+            break;
+        }
+
+        uint64_t packed_len = _get_u32(header + 8);
+        if (offset + BLOCK_HEADER_SIZE + packed_len > file_size) {
+            break;
+        }
+
+        BlockInfo info = {offset, _get_u64(header + 12), _get_u32(header)};
+        if (!_index_add(&reader->index, info)) {
+            return false;
+        }
+
+        offset += BLOCK_HEADER_SIZE + packed_len;
+    }
+
+    return true;
+}
+
+TraceReader *trace_reader_open(const char *path) {
+    TraceReader *reader = calloc(1, sizeof(TraceReader));
+    if (reader == NULL) {
+        return NULL;
+    }
+
+    if ((reader->file = fopen(path, "rb")) == NULL) {
+        free(reader);
+        return NULL;
+    }
+
+    uint8_t header[FILE_HEADER_SIZE];
+    uint64_t file_size = 0;
+    bool valid = fread(header, 1, sizeof(header), reader->file) == sizeof(header)
+            && memcmp(header, FILE_MAGIC, 4) == 0 && _get_u16(header + 4) == FILE_VERSION
+            && FSEEK64(reader->file, 0, SEEK_END) == 0;
+    if (valid) {
+        file_size = FTELL64(reader->file);
+        valid = _read_index(reader, file_size) || _scan_blocks(reader, file_size);
+    }
+
+    if (!valid) {
+        trace_reader_close(reader);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < reader->index.count; i++) {
+        reader->record_count += reader->index.blocks[i].record_count;
+    }
+
+    return reader;
+}
+
+void trace_reader_close(TraceReader *reader) {
+    fclose(reader->file);
+    free(reader->index.blocks);
+    free(reader);
+}
+
+uint64_t trace_reader_get_record_count(const TraceReader *reader) {
+    return reader->record_count;
+}
+
+static bool _load_block(TraceReader *reader, size_t block) {
+    const BlockInfo *info = &reader->index.blocks[block];
+
+    uint8_t header[BLOCK_HEADER_SIZE];
+    if (!_read_at(reader->file, info->offset, header, sizeof(header))) {
+        return false;
+    }
+
+    uint32_t record_count = _get_u32(header);
+    size_t raw_len = _get_u32(header + 4);
+    size_t packed_len = _get_u32(header + 8);
+    if (record_count != info->record_count || record_count > BLOCK_RECORDS || raw_len > MAX_RAW_SIZE
+            || packed_len > MAX_PACKED_SIZE || fread(reader->packed, 1, packed_len, reader->file) != packed_len
+            || !_lz_decompress(reader->packed, packed_len, reader->raw, raw_len)) {
+        return false;
+    }
+
+    memset(&reader->prev, 0, sizeof(reader->prev));
+    reader->prev.cycle = _get_u64(header + 12);
+    reader->raw_len = raw_len;
+    reader->raw_pos = 0;
+    reader->block_remaining = record_count;
+    reader->next_block = block + 1;
+
+    return true;
+}
+
+static bool _decode_record(TraceReader *reader, CpuTraceRecord *record) {
+    const CpuTraceRecord *prev = &reader->prev;
+    const uint8_t *src = reader->raw;
+    size_t len = reader->raw_len;
+    size_t pos = reader->raw_pos;
+
+    if (len - pos < 3) {
+        return false;
+    }
+
+    uint8_t tag = src[pos++];
+    *record = *prev;
+    record->opcode = src[pos++];
+    record->pc = _predict_pc(prev);
+
+    uint16_t mask = _operand_mask(record->opcode);
+    record->operand = 0;
+    for (uint16_t shift = 0; mask >> shift != 0; shift += 8) {
+        if (pos >= len) {
+            return false;
+        }
+        record->operand |= src[pos++] << shift;
+    }
+
+    if (pos >= len) {
+        return false;
+    }
+    record->bus_val = src[pos++];
+
+    uint64_t val;
+    if (!_get_varint(src, len, &pos, &val)) {
+        return false;
+    }
+    record->cycle = prev->cycle + val;
+
+    if (tag & TAG_PC) {
+        if (!_get_varint(src, len, &pos, &val)) {
+            return false;
+        }
+        int16_t delta = (int16_t) ((val >> 1) ^ -(int64_t) (val & 1));
+        record->pc += delta;
+    }
+
+    uint8_t *regs[] = {&record->acc, &record->x, &record->y, &record->sp, &record->status};
+    for (int i = 0; i < 5; i++) {
+        if (tag & (TAG_ACC << i)) {
+            if (pos >= len) {
+                return false;
+            }
+            *regs[i] = src[pos++];
+        }
+    }
+
+    if (tag & TAG_EFF_OPERAND) {
+        record->eff_addr = record->operand;
+    } else if (tag & TAG_EFF_ADDR) {
+        if (len - pos < 2) {
+            return false;
+        }
+        record->eff_addr = _get_u16(src + pos);
+        pos += 2;
+    }
+
+    reader->raw_pos = pos;
+    reader->block_remaining--;
+    reader->prev = *record;
+
+    return true;
+}
+
+static bool _read_next(TraceReader *reader, CpuTraceRecord *record) {
+    while (reader->block_remaining == 0) {
+        if (reader->next_block >= reader->index.count || !_load_block(reader, reader->next_block)) {
+            return false;
+        }
+    }
+
+    return _decode_record(reader, record);
+}
+
+bool trace_reader_seek_cycle(TraceReader *reader, uint64_t cycle) {
+    // find the last block starting at or before the cycle
+    size_t lo = 0;
+    size_t hi = reader->index.count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (reader->index.blocks[mid].first_cycle <= cycle) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    reader->next_block = lo;
+    reader->block_remaining = 0;
+    reader->has_pending = false;
+
+    while (_read_next(reader, &reader->pending)) {
+        if (reader->pending.cycle >= cycle) {
+            reader->has_pending = true;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool trace_reader_next(TraceReader *reader, CpuTraceRecord *record) {
+    if (reader->has_pending) {
+        *record = reader->pending;
+        reader->has_pending = false;
+        return true;
+    }
+
+    return _read_next(reader, record);
+}
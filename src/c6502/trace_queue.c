@@ -0,0 +1,262 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "c6502/trace_queue.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+#define CACHE_LINE_SIZE 64
+#define CONSUMER_IDLE_US 100 // how long the consumer sleeps when it finds the queue empty
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+#else
+typedef pthread_t Thread;
+#endif
+
+struct TraceQueue {
+    CpuTraceRecord *records;
+    size_t mask; // capacity - 1
+
+    TraceQueuePolicy policy;
+    unsigned int sample_interval;
+
+    TraceConsumer consumer;
+    void *userdata;
+    Thread thread;
+
+    // the padding keeps the fields written by either side on cache lines of their own
+
+    uint8_t pad0[CACHE_LINE_SIZE];
+    _Atomic uint64_t head; // the number of records consumed so far, written only by the consumer
+
+    uint8_t pad1[CACHE_LINE_SIZE];
+    _Atomic uint64_t tail; // the number of records queued so far, written only by the producer
+    uint64_t cached_head; // the producer's last look at head, which saves it from reading the consumer's cache line
+    unsigned int sample_counter;
+    _Atomic uint64_t dropped;
+
+    uint8_t pad2[CACHE_LINE_SIZE];
+    atomic_bool stopping;
+};
+
+static void _yield(void) {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+static void _idle(void) {
+#ifdef _WIN32
+    Sleep(1);
+#else
+    nanosleep(&(struct timespec) {0, CONSUMER_IDLE_US * 1000}, NULL);
+#endif
+}
+
+// hands everything currently in the queue to the consumer, returning false if it was empty
+static bool _consume(TraceQueue *queue) {
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == tail) {
+        return false;
+    }
+
+    while (head != tail) {
+        size_t start = head & queue->mask;
+        size_t count = queue->mask + 1 - start;
+        if (count > tail - head) {
+            count = tail - head;
+        }
+
+        queue->consumer(queue->userdata, queue->records + start, count);
+        head += count;
+    }
+
+    atomic_store_explicit(&queue->head, head, memory_order_release);
+
+    return true;
+}
+
+static void _run_consumer(TraceQueue *queue) {
+    for (;;) {
+        // the flag has to be read before the queue is drained for the last time so that nothing pushed before it was
+        // set can be missed
+        bool stopping = atomic_load_explicit(&queue->stopping, memory_order_acquire);
+
+        if (!_consume(queue)) {
+            if (stopping) {
+                return;
+            }
+
+            _idle();
+        }
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI _consumer_main(LPVOID arg) {
+    _run_consumer(arg);
+    return 0;
+}
+
+static bool _start_thread(TraceQueue *queue) {
+    return (queue->thread = CreateThread(NULL, 0, _consumer_main, queue, 0, NULL)) != NULL;
+}
+
+static void _join_thread(TraceQueue *queue) {
+    WaitForSingleObject(queue->thread, INFINITE);
+    CloseHandle(queue->thread);
+}
+#else
+static void *_consumer_main(void *arg) {
+    _run_consumer(arg);
+    return NULL;
+}
+
+static bool _start_thread(TraceQueue *queue) {
+    return pthread_create(&queue->thread, NULL, _consumer_main, queue) == 0;
+}
+
+static void _join_thread(TraceQueue *queue) {
+    pthread_join(queue->thread, NULL);
+}
+#endif
+
+TraceQueue *trace_queue_create(size_t capacity, TraceQueuePolicy policy, unsigned int sample_interval,
+        TraceConsumer consumer, void *userdata) {
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+
+    TraceQueue *queue = calloc(1, sizeof(TraceQueue));
+    if (queue == NULL) {
+        return NULL;
+    }
+
+    if ((queue->records = malloc(rounded * sizeof(CpuTraceRecord))) == NULL) {
+        free(queue);
+        return NULL;
+    }
+
+    queue->mask = rounded - 1;
+    queue->policy = policy;
+    queue->sample_interval = sample_interval != 0 ? sample_interval : 1;
+    queue->consumer = consumer;
+    queue->userdata = userdata;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->cached_head = 0;
+    queue->sample_counter = 0;
+    atomic_init(&queue->dropped, 0);
+    atomic_init(&queue->stopping, false);
+
+    if (!_start_thread(queue)) {
+        free(queue->records);
+        free(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+void trace_queue_destroy(TraceQueue *queue) {
+    atomic_store_explicit(&queue->stopping, true, memory_order_release);
+    _join_thread(queue);
+
+    free(queue->records);
+    free(queue);
+}
+
+void trace_queue_flush(TraceQueue *queue) {
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    while (atomic_load_explicit(&queue->head, memory_order_acquire) != tail) {
+        _yield();
+    }
+}
+
+uint64_t trace_queue_get_dropped(const TraceQueue *queue) {
+    return atomic_load_explicit(&queue->dropped, memory_order_relaxed);
+}
+
+static void _drop(TraceQueue *queue) {
+    // only the producer writes the counter, so it does not need a read-modify-write
+    uint64_t dropped = atomic_load_explicit(&queue->dropped, memory_order_relaxed);
+    atomic_store_explicit(&queue->dropped, dropped + 1, memory_order_relaxed);
+}
+
+void trace_queue_push(TraceQueue *queue, const CpuTraceRecord *record) {
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint64_t capacity = queue->mask + 1;
+
+    if (tail - queue->cached_head > capacity / 4 * 3) {
+        queue->cached_head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+        switch (queue->policy) {
+            case TRACE_QUEUE_BLOCK:
+                while (tail - queue->cached_head == capacity) {
+                    _yield();
+                    queue->cached_head = atomic_load_explicit(&queue->head, memory_order_acquire);
+                }
+                break;
+            case TRACE_QUEUE_DROP:
+                if (tail - queue->cached_head == capacity) {
+                    _drop(queue);
+                    return;
+                }
+                break;
+            case TRACE_QUEUE_SAMPLE: {
+                uint64_t used = tail - queue->cached_head;
+                if (used == capacity || (used > capacity / 4 * 3
+                        && ++queue->sample_counter % queue->sample_interval != 0)) {
+                    _drop(queue);
+                    return;
+                }
+                break;
+            }
+        }
+    }
+
+    queue->records[tail & queue->mask] = *record;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
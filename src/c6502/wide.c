@@ -0,0 +1,777 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "c6502/wide.h"
+
+#include "c6502/cpu.h"
+#include "c6502/instrs.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VEC_BYTES 32
+typedef __m256i Vec;
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VEC_BYTES 16
+typedef __m128i Vec;
+#else
+#define VEC_BYTES 8
+typedef struct {
+    uint8_t b[VEC_BYTES];
+} Vec;
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define STACK_BOTTOM_ADDR 0x100
+// enough for the longest instruction plus the opcode fetch of the next, so that the regular core sees every stop
+#define MIN_LANE_BUDGET 8
+
+// The registers of a group of lanes, one array element per lane. C, Z, V and N are kept as masks which are all ones
+// while the flag is set, and the remaining bits of the status register (I, D, B and the unused bit) as they are.
+typedef struct {
+    _Alignas(32) uint8_t a[WIDE_LANES];
+    _Alignas(32) uint8_t x[WIDE_LANES];
+    _Alignas(32) uint8_t y[WIDE_LANES];
+    _Alignas(32) uint8_t sp[WIDE_LANES];
+    _Alignas(32) uint8_t c[WIDE_LANES];
+    _Alignas(32) uint8_t z[WIDE_LANES];
+    _Alignas(32) uint8_t v[WIDE_LANES];
+    _Alignas(32) uint8_t n[WIDE_LANES];
+    _Alignas(32) uint8_t p[WIDE_LANES];
+    _Alignas(32) uint8_t m[WIDE_LANES]; // the value read or written by the current instruction
+
+    uint16_t addr[WIDE_LANES]; // the effective address of the current instruction
+    uint16_t next_pc[WIDE_LANES];
+    uint64_t cycles[WIDE_LANES];
+    size_t instance[WIDE_LANES];
+
+    uint32_t active; // a bit for each lane which is still run by the group
+    uint16_t pc;
+} Group;
+
+typedef struct {
+    const BatchInstance *instances;
+    BatchResult *results;
+    WideStats stats;
+
+    Cpu6502 *cpu; // the regular core, which starts and finishes every lane
+    uint8_t bus_val;
+} Wide;
+
+#if defined(__AVX2__)
+static inline Vec _vload(const uint8_t *p) { return _mm256_load_si256((const __m256i *) p); }
+static inline void _vstore(uint8_t *p, Vec v) { _mm256_store_si256((__m256i *) p, v); }
+static inline Vec _vset(uint8_t x) { return _mm256_set1_epi8((char) x); }
+static inline Vec _vadd(Vec a, Vec b) { return _mm256_add_epi8(a, b); }
+static inline Vec _vsub(Vec a, Vec b) { return _mm256_sub_epi8(a, b); }
+static inline Vec _vand(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+static inline Vec _vor(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+static inline Vec _vxor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+static inline Vec _vandnot(Vec a, Vec b) { return _mm256_andnot_si256(a, b); }
+static inline Vec _veq(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+static inline Vec _vmaxu(Vec a, Vec b) { return _mm256_max_epu8(a, b); }
+static inline Vec _vsign(Vec a) { return _mm256_cmpgt_epi8(_mm256_setzero_si256(), a); }
+static inline Vec _vshr1(Vec a) { return _mm256_and_si256(_mm256_srli_epi16(a, 1), _vset(0x7F)); }
+#elif VEC_BYTES == 16
+static inline Vec _vload(const uint8_t *p) { return _mm_load_si128((const __m128i *) p); }
+static inline void _vstore(uint8_t *p, Vec v) { _mm_store_si128((__m128i *) p, v); }
+static inline Vec _vset(uint8_t x) { return _mm_set1_epi8((char) x); }
+static inline Vec _vadd(Vec a, Vec b) { return _mm_add_epi8(a, b); }
+static inline Vec _vsub(Vec a, Vec b) { return _mm_sub_epi8(a, b); }
+static inline Vec _vand(Vec a, Vec b) { return _mm_and_si128(a, b); }
+static inline Vec _vor(Vec a, Vec b) { return _mm_or_si128(a, b); }
+static inline Vec _vxor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+static inline Vec _vandnot(Vec a, Vec b) { return _mm_andnot_si128(a, b); }
+static inline Vec _veq(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+static inline Vec _vmaxu(Vec a, Vec b) { return _mm_max_epu8(a, b); }
+static inline Vec _vsign(Vec a) { return _mm_cmpgt_epi8(_mm_setzero_si128(), a); }
+static inline Vec _vshr1(Vec a) { return _mm_and_si128(_mm_srli_epi16(a, 1), _vset(0x7F)); }
+#else
+// without SIMD support, the lanes of a vector are simply looped over
+
+#define VEC_MAP(expr) \
+    Vec r; \
+    for (size_t i = 0; i < VEC_BYTES; i++) { \
+        r.b[i] = (uint8_t) (expr); \
+    } \
+    return r;
+
+static inline Vec _vload(const uint8_t *p) { VEC_MAP(p[i]) }
+static inline void _vstore(uint8_t *p, Vec v) {
+    for (size_t i = 0; i < VEC_BYTES; i++) {
+        p[i] = v.b[i];
+    }
+}
+static inline Vec _vset(uint8_t x) { VEC_MAP(x) }
+static inline Vec _vadd(Vec a, Vec b) { VEC_MAP(a.b[i] + b.b[i]) }
+static inline Vec _vsub(Vec a, Vec b) { VEC_MAP(a.b[i] - b.b[i]) }
+static inline Vec _vand(Vec a, Vec b) { VEC_MAP(a.b[i] & b.b[i]) }
+static inline Vec _vor(Vec a, Vec b) { VEC_MAP(a.b[i] | b.b[i]) }
+static inline Vec _vxor(Vec a, Vec b) { VEC_MAP(a.b[i] ^ b.b[i]) }
+static inline Vec _vandnot(Vec a, Vec b) { VEC_MAP(~a.b[i] & b.b[i]) }
+static inline Vec _veq(Vec a, Vec b) { VEC_MAP(a.b[i] == b.b[i] ? 0xFF : 0) }
+static inline Vec _vmaxu(Vec a, Vec b) { VEC_MAP(a.b[i] > b.b[i] ? a.b[i] : b.b[i]) }
+static inline Vec _vsign(Vec a) { VEC_MAP(a.b[i] & 0x80 ? 0xFF : 0) }
+static inline Vec _vshr1(Vec a) { VEC_MAP(a.b[i] >> 1) }
+#endif
+
+// all ones where a >= b, unsigned
+static inline Vec _vgeu(Vec a, Vec b) {
+    return _veq(_vmaxu(a, b), a);
+}
+
+// all ones where the given bit is set
+static inline Vec _vbit(Vec a, uint8_t bit) {
+    return _veq(_vand(a, _vset(bit)), _vset(bit));
+}
+
+static inline Vec _vzero(Vec a) {
+    return _veq(a, _vset(0));
+}
+
+static inline unsigned int _lowest_lane(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline unsigned int _lane_count(uint32_t mask) {
+    unsigned int count = 0;
+    for (; mask != 0; mask &= mask - 1) {
+        count++;
+    }
+    return count;
+}
+
+static uint8_t _mem_read(void *userdata, uint16_t addr) {
+    (void) userdata;
+    (void) addr;
+    return 0; // only reached by the reset sequence run when the CPU is created, before anything has been mapped
+}
+
+static void _mem_write(void *userdata, uint16_t addr, uint8_t val) {
+    (void) userdata;
+    (void) addr;
+    (void) val;
+}
+
+static uint8_t _bus_read(void *userdata) {
+    return ((Wide *) userdata)->bus_val;
+}
+
+static void _bus_write(void *userdata, uint8_t val) {
+    ((Wide *) userdata)->bus_val = val;
+}
+
+// points the regular core at the instance and puts it through the reset sequence
+static void _reset_instance(Wide *wide, const BatchInstance *instance) {
+    CpuSystemInterface iface = {_mem_read, _mem_write, _bus_read, _bus_write, NULL, NULL, NULL, wide};
+
+    cpu_map_memory(wide->cpu, 0x0000, 0x10000, instance->memory, CPU_PAGE_READ_WRITE);
+    cpu_set_stop_pc(wide->cpu, instance->stop_pc);
+    cpu_set_stop_mnemonic(wide->cpu, instance->stop_mnemonic);
+    initialize_cpu(wide->cpu, iface);
+
+    if (instance->regs != NULL) {
+        *cpu_get_registers(wide->cpu) = *instance->regs;
+    }
+}
+
+static void _start_lane(Wide *wide, Group *group, unsigned int lane, size_t index) {
+    _reset_instance(wide, &wide->instances[index]);
+
+    const CpuRegisters *regs = cpu_get_registers(wide->cpu);
+    uint8_t status = regs->status.serial;
+
+    group->a[lane] = regs->acc;
+    group->x[lane] = regs->x;
+    group->y[lane] = regs->y;
+    group->sp[lane] = regs->sp;
+    group->c[lane] = status & 0x01 ? 0xFF : 0;
+    group->z[lane] = status & 0x02 ? 0xFF : 0;
+    group->v[lane] = status & 0x40 ? 0xFF : 0;
+    group->n[lane] = status & 0x80 ? 0xFF : 0;
+    group->p[lane] = status & 0x3C;
+    group->next_pc[lane] = regs->pc;
+    group->cycles[lane] = 0;
+    group->instance[lane] = index;
+    group->active |= 1u << lane;
+}
+
+// hands the lane over to the regular core at the given PC, which runs it to the end
+static void _finish_lane(Wide *wide, Group *group, unsigned int lane, uint16_t pc) {
+    size_t index = group->instance[lane];
+    const BatchInstance *instance = &wide->instances[index];
+
+    // the reset sequence only reads memory, so it can simply be run again
+    _reset_instance(wide, instance);
+
+    CpuRegisters *regs = cpu_get_registers(wide->cpu);
+    regs->pc = pc;
+    regs->acc = group->a[lane];
+    regs->x = group->x[lane];
+    regs->y = group->y[lane];
+    regs->sp = group->sp[lane];
+    regs->status.serial = group->p[lane] | (group->c[lane] & 0x01) | (group->z[lane] & 0x02) | (group->v[lane] & 0x40)
+            | (group->n[lane] & 0x80);
+
+    uint64_t cycles = group->cycles[lane];
+    cycles += cpu_run_cycles(wide->cpu, instance->budget - cycles, instance->stop_mask & ~CPU_STOP_BREAKPOINT);
+
+    BatchResult *result = &wide->results[index];
+    result->regs = *cpu_get_registers(wide->cpu);
+    result->cycles = cycles;
+    result->stop_reason = cpu_get_stop_reason(wide->cpu);
+    result->jammed = cpu_is_jammed(wide->cpu);
+
+    group->active &= ~(1u << lane);
+}
+
+static bool _is_supported(Mnemonic mnemonic) {
+    switch (mnemonic) {
+        case LDA: case LDX: case LDY: case STA: case STX: case STY:
+        case TAX: case TAY: case TSX: case TXA: case TYA: case TXS:
+        case ADC: case SBC: case AND: case ORA: case EOR: case BIT: case CMP: case CPX: case CPY:
+        case INC: case DEC: case INX: case INY: case DEX: case DEY:
+        case ASL: case LSR: case ROL: case ROR:
+        case BCC: case BCS: case BNE: case BEQ: case BPL: case BMI: case BVC: case BVS:
+        case JMP: case JSR: case RTS:
+        case CLC: case CLD: case CLI: case CLV: case SEC: case SED: case SEI:
+        case PHA: case PHP: case PLA: case PLP:
+        case NOP:
+            return true;
+        default:
+            return false; // interrupts and unofficial opcodes are left to the regular core
+    }
+}
+
+static inline void _set_nz(Group *group, size_t k, Vec val) {
+    _vstore(group->n + k, _vsign(val));
+    _vstore(group->z + k, _vzero(val));
+}
+
+// executes an instruction which reads the operand in group->m, mirroring the regular core's _do_adc(), _do_cmp() and
+// friends
+static void _exec_read(Group *group, Mnemonic mnemonic) {
+    for (size_t k = 0; k < WIDE_LANES; k += VEC_BYTES) {
+        Vec m = _vload(group->m + k);
+        Vec a = _vload(group->a + k);
+
+        switch (mnemonic) {
+            case LDA:
+                _vstore(group->a + k, m);
+                _set_nz(group, k, m);
+                break;
+            case LDX:
+                _vstore(group->x + k, m);
+                _set_nz(group, k, m);
+                break;
+            case LDY:
+                _vstore(group->y + k, m);
+                _set_nz(group, k, m);
+                break;
+            case SBC:
+                m = _vxor(m, _vset(0xFF));
+                // fall through
+            case ADC: {
+                Vec sum = _vadd(_vadd(a, m), _vand(_vload(group->c + k), _vset(1)));
+
+                // the carry out of bit 7 is the majority of the operands' top bits and the carry into it
+                _vstore(group->c + k, _vsign(_vor(_vand(a, m), _vandnot(sum, _vor(a, m)))));
+                _vstore(group->v + k, _vsign(_vand(_vxor(a, sum), _vxor(m, sum))));
+                _vstore(group->a + k, sum);
+                _set_nz(group, k, sum);
+                break;
+            }
+            case AND:
+                a = _vand(a, m);
+                _vstore(group->a + k, a);
+                _set_nz(group, k, a);
+                break;
+            case ORA:
+                a = _vor(a, m);
+                _vstore(group->a + k, a);
+                _set_nz(group, k, a);
+                break;
+            case EOR:
+                a = _vxor(a, m);
+                _vstore(group->a + k, a);
+                _set_nz(group, k, a);
+                break;
+            case BIT:
+                _vstore(group->n + k, _vsign(m));
+                _vstore(group->v + k, _vsign(_vadd(m, m)));
+                _vstore(group->z + k, _vzero(_vand(a, m)));
+                break;
+            case CMP:
+            case CPX:
+            case CPY: {
+                Vec reg = mnemonic == CMP ? a : _vload(mnemonic == CPX ? group->x + k : group->y + k);
+                _vstore(group->c + k, _vgeu(reg, m));
+                _set_nz(group, k, _vsub(reg, m));
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+// executes a read-modify-write instruction on the values in vals
+static void _exec_modify(Group *group, Mnemonic mnemonic, uint8_t *vals) {
+    for (size_t k = 0; k < WIDE_LANES; k += VEC_BYTES) {
+        Vec val = _vload(vals + k);
+        Vec c = _vload(group->c + k);
+        Vec res;
+
+        switch (mnemonic) {
+            case ASL:
+                res = _vadd(val, val);
+                c = _vsign(val);
+                break;
+            case LSR:
+                res = _vshr1(val);
+                c = _vbit(val, 0x01);
+                break;
+            case ROL:
+                res = _vor(_vadd(val, val), _vand(c, _vset(0x01)));
+                c = _vsign(val);
+                break;
+            case ROR:
+                res = _vor(_vshr1(val), _vand(c, _vset(0x80)));
+                c = _vbit(val, 0x01);
+                break;
+            case INC:
+                res = _vadd(val, _vset(1));
+                break;
+            default: // DEC
+                res = _vsub(val, _vset(1));
+                break;
+        }
+
+        _vstore(vals + k, res);
+        _vstore(group->c + k, c);
+        _set_nz(group, k, res);
+    }
+}
+
+// executes an instruction which only involves registers
+static void _exec_implied(Group *group, Mnemonic mnemonic) {
+    for (size_t k = 0; k < WIDE_LANES; k += VEC_BYTES) {
+        Vec res;
+        uint8_t *dest;
+
+        switch (mnemonic) {
+            case TAX: res = _vload(group->a + k); dest = group->x; break;
+            case TAY: res = _vload(group->a + k); dest = group->y; break;
+            case TSX: res = _vload(group->sp + k); dest = group->x; break;
+            case TXA: res = _vload(group->x + k); dest = group->a; break;
+            case TYA: res = _vload(group->y + k); dest = group->a; break;
+            case INX: res = _vadd(_vload(group->x + k), _vset(1)); dest = group->x; break;
+            case INY: res = _vadd(_vload(group->y + k), _vset(1)); dest = group->y; break;
+            case DEX: res = _vsub(_vload(group->x + k), _vset(1)); dest = group->x; break;
+            case DEY: res = _vsub(_vload(group->y + k), _vset(1)); dest = group->y; break;
+            case TXS:
+                _vstore(group->sp + k, _vload(group->x + k));
+                continue;
+            case CLC:
+            case SEC:
+                _vstore(group->c + k, _vset(mnemonic == SEC ? 0xFF : 0));
+                continue;
+            case CLV:
+                _vstore(group->v + k, _vset(0));
+                continue;
+            case CLD:
+            case CLI:
+                _vstore(group->p + k, _vandnot(_vset(mnemonic == CLD ? 0x08 : 0x04), _vload(group->p + k)));
+                continue;
+            case SED:
+            case SEI:
+                _vstore(group->p + k, _vor(_vload(group->p + k), _vset(mnemonic == SED ? 0x08 : 0x04)));
+                continue;
+            default: // NOP
+                continue;
+        }
+
+        _vstore(dest + k, res);
+        _set_nz(group, k, res);
+    }
+}
+
+// leaves all ones in group->m for the lanes which take the branch
+static void _eval_branch(Group *group, Mnemonic mnemonic) {
+    for (size_t k = 0; k < WIDE_LANES; k += VEC_BYTES) {
+        Vec flag;
+        bool set;
+
+        switch (mnemonic) {
+            case BCC: flag = _vload(group->c + k); set = false; break;
+            case BCS: flag = _vload(group->c + k); set = true; break;
+            case BNE: flag = _vload(group->z + k); set = false; break;
+            case BEQ: flag = _vload(group->z + k); set = true; break;
+            case BPL: flag = _vload(group->n + k); set = false; break;
+            case BMI: flag = _vload(group->n + k); set = true; break;
+            case BVC: flag = _vload(group->v + k); set = false; break;
+            default: flag = _vload(group->v + k); set = true; break; // BVS
+        }
+
+        _vstore(group->m + k, set ? flag : _vxor(flag, _vset(0xFF)));
+    }
+}
+
+// Computes the effective address of the current instruction for each lane, returning a mask of the lanes which cross
+// a page and so may take a cycle longer.
+static uint32_t _resolve_addrs(Wide *wide, Group *group, const OpcodeInfo *info, uint16_t operand) {
+    uint32_t crossed = 0;
+
+    for (uint32_t rest = group->active; rest != 0; rest &= rest - 1) {
+        unsigned int lane = _lowest_lane(rest);
+        const uint8_t *mem = wide->instances[group->instance[lane]].memory;
+        uint16_t addr;
+
+        switch (info->addr_mode) {
+            case ZRP:
+            case ABS:
+                addr = operand;
+                break;
+            case ZPX:
+                addr = (operand + group->x[lane]) & 0xFF;
+                break;
+            case ZPY:
+                addr = (operand + group->y[lane]) & 0xFF;
+                break;
+            case ABX:
+            case ABY: {
+                uint8_t index = info->addr_mode == ABX ? group->x[lane] : group->y[lane];
+                addr = operand + index;
+                if ((operand & 0xFF) + index >= 0x100) {
+                    crossed |= 1u << lane;
+                }
+                break;
+            }
+            case IZX: {
+                uint8_t ptr = operand + group->x[lane];
+                addr = mem[ptr] | mem[(uint8_t) (ptr + 1)] << 8;
+                break;
+            }
+            default: { // IZY
+                uint16_t base = mem[operand] | mem[(uint8_t) (operand + 1)] << 8;
+                addr = base + group->y[lane];
+                if ((base & 0xFF) + group->y[lane] >= 0x100) {
+                    crossed |= 1u << lane;
+                }
+                break;
+            }
+        }
+
+        group->addr[lane] = addr;
+    }
+
+    return crossed;
+}
+
+static void _gather(Wide *wide, Group *group) {
+    for (uint32_t rest = group->active; rest != 0; rest &= rest - 1) {
+        unsigned int lane = _lowest_lane(rest);
+        group->m[lane] = wide->instances[group->instance[lane]].memory[group->addr[lane]];
+    }
+}
+
+static void _scatter(Wide *wide, Group *group, const uint8_t *vals) {
+    for (uint32_t rest = group->active; rest != 0; rest &= rest - 1) {
+        unsigned int lane = _lowest_lane(rest);
+        wide->instances[group->instance[lane]].memory[group->addr[lane]] = vals[lane];
+    }
+}
+
+// handles the stack and control flow instructions, which are done lane by lane
+static void _exec_flow(Wide *wide, Group *group, const OpcodeInfo *info, uint16_t operand) {
+    uint16_t pc = group->pc;
+
+    if (info->mnemonic == PHP) {
+        for (size_t k = 0; k < WIDE_LANES; k += VEC_BYTES) {
+            Vec status = _vor(_vload(group->p + k), _vset(0x30));
+            status = _vor(status, _vand(_vload(group->c + k), _vset(0x01)));
+            status = _vor(status, _vand(_vload(group->z + k), _vset(0x02)));
+            status = _vor(status, _vand(_vload(group->v + k), _vset(0x40)));
+            status = _vor(status, _vand(_vload(group->n + k), _vset(0x80)));
+            _vstore(group->m + k, status);
+        }
+    }
+
+    for (uint32_t rest = group->active; rest != 0; rest &= rest - 1) {
+        unsigned int lane = _lowest_lane(rest);
+        uint8_t *mem = wide->instances[group->instance[lane]].memory;
+        uint8_t *sp = &group->sp[lane];
+
+        switch (info->mnemonic) {
+            case PHA:
+                mem[STACK_BOTTOM_ADDR + (*sp)--] = group->a[lane];
+                break;
+            case PHP:
+                mem[STACK_BOTTOM_ADDR + (*sp)--] = group->m[lane];
+                break;
+            case PLA:
+            case PLP:
+                group->m[lane] = mem[STACK_BOTTOM_ADDR + ++*sp];
+                break;
+            case JMP:
+                if (info->addr_mode == IND) {
+                    // the pointer's high byte is read from the same page as its low byte
+                    group->next_pc[lane] = mem[operand] | mem[(operand & 0xFF00) | ((operand + 1) & 0xFF)] << 8;
+                } else {
+                    group->next_pc[lane] = operand;
+                }
+                break;
+            case JSR: {
+                uint16_t ret = pc + 2;
+                mem[STACK_BOTTOM_ADDR + (*sp)--] = ret >> 8;
+                mem[STACK_BOTTOM_ADDR + (*sp)--] = ret & 0xFF;
+                group->next_pc[lane] = operand;
+                break;
+            }
+            case RTS: {
+                uint16_t ret = mem[STACK_BOTTOM_ADDR + ++*sp];
+                ret |= mem[STACK_BOTTOM_ADDR + ++*sp] << 8;
+                group->next_pc[lane] = ret + 1;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    if (info->mnemonic == PLA) {
+        for (size_t k = 0; k < WIDE_LANES; k += VEC_BYTES) {
+            Vec val = _vload(group->m + k);
+            _vstore(group->a + k, val);
+            _set_nz(group, k, val);
+        }
+    } else if (info->mnemonic == PLP) {
+        for (size_t k = 0; k < WIDE_LANES; k += VEC_BYTES) {
+            Vec val = _vload(group->m + k);
+            _vstore(group->p + k, _vand(val, _vset(0x3C)));
+            _vstore(group->c + k, _vbit(val, 0x01));
+            _vstore(group->z + k, _vbit(val, 0x02));
+            _vstore(group->v + k, _vbit(val, 0x40));
+            _vstore(group->n + k, _vsign(val));
+        }
+    }
+}
+
+// Returns the PC which most of the lanes have arrived at, so that as many as possible stay together.
+static uint16_t _pick_path(const Group *group) {
+    uint16_t best = group->next_pc[_lowest_lane(group->active)];
+    unsigned int best_count = 0;
+
+    for (uint32_t rest = group->active; rest != 0; rest &= rest - 1) {
+        uint16_t pc = group->next_pc[_lowest_lane(rest)];
+        unsigned int count = 0;
+
+        for (uint32_t other = group->active; other != 0; other &= other - 1) {
+            count += group->next_pc[_lowest_lane(other)] == pc;
+        }
+
+        if (count > best_count) {
+            best = pc;
+            best_count = count;
+        }
+    }
+
+    return best;
+}
+
+// executes a single instruction in every lane of the group
+static void _step(Wide *wide, Group *group) {
+    uint16_t pc = group->pc;
+    const uint8_t *code = wide->instances[group->instance[_lowest_lane(group->active)]].memory;
+
+    uint8_t opcode = code[pc];
+    const OpcodeInfo *info = get_opcode_info(opcode);
+    uint8_t lo = code[(uint16_t) (pc + 1)];
+    uint8_t hi = code[(uint16_t) (pc + 2)];
+    uint16_t operand = info->len > 2 ? lo | hi << 8 : info->len > 1 ? lo : 0;
+
+    // lanes which fetch different code, or which the regular core has to see through to their end, leave the group
+    for (uint32_t rest = group->active; rest != 0; rest &= rest - 1) {
+        unsigned int lane = _lowest_lane(rest);
+        const BatchInstance *instance = &wide->instances[group->instance[lane]];
+        const uint8_t *mem = instance->memory;
+
+        if (mem[pc] != opcode || (info->len > 1 && mem[(uint16_t) (pc + 1)] != lo)
+                || (info->len > 2 && mem[(uint16_t) (pc + 2)] != hi)) {
+            wide->stats.diverged++;
+            _finish_lane(wide, group, lane, pc);
+        } else if (instance->budget - group->cycles[lane] < MIN_LANE_BUDGET
+                || ((instance->stop_mask & CPU_STOP_PC) && pc == instance->stop_pc)
+                || ((instance->stop_mask & CPU_STOP_MNEMONIC) && info->mnemonic == instance->stop_mnemonic)
+                || !_is_supported(info->mnemonic)) {
+            _finish_lane(wide, group, lane, pc);
+        }
+    }
+
+    if (group->active == 0) {
+        return;
+    }
+
+    Mnemonic mnemonic = info->mnemonic;
+    uint32_t penalized = 0;
+
+    if (info->addr_mode != IMM && info->addr_mode != IMP && info->addr_mode != REL && info->addr_mode != IND
+            && mnemonic != JMP && mnemonic != JSR) {
+        penalized = _resolve_addrs(wide, group, info, operand) & (info->page_penalty ? 0xFFFFFFFF : 0);
+    }
+
+    bool per_lane_pc = false;
+
+    switch (mnemonic) {
+        case LDA: case LDX: case LDY: case ADC: case SBC: case AND: case ORA: case EOR: case BIT:
+        case CMP: case CPX: case CPY:
+            if (info->addr_mode == IMM) {
+                for (size_t lane = 0; lane < WIDE_LANES; lane++) {
+                    group->m[lane] = (uint8_t) operand;
+                }
+            } else {
+                _gather(wide, group);
+            }
+            _exec_read(group, mnemonic);
+            break;
+        case STA:
+            _scatter(wide, group, group->a);
+            break;
+        case STX:
+            _scatter(wide, group, group->x);
+            break;
+        case STY:
+            _scatter(wide, group, group->y);
+            break;
+        case ASL: case LSR: case ROL: case ROR: case INC: case DEC:
+            if (info->addr_mode == IMP) {
+                _exec_modify(group, mnemonic, group->a);
+            } else {
+                _gather(wide, group);
+                _exec_modify(group, mnemonic, group->m);
+                _scatter(wide, group, group->m);
+            }
+            break;
+        case BCC: case BCS: case BNE: case BEQ: case BPL: case BMI: case BVC: case BVS: {
+            _eval_branch(group, mnemonic);
+
+            uint16_t next = pc + 2;
+            uint16_t target = next + (int8_t) operand;
+            for (uint32_t rest = group->active; rest != 0; rest &= rest - 1) {
+                unsigned int lane = _lowest_lane(rest);
+                if (group->m[lane]) {
+                    group->next_pc[lane] = target;
+                    group->cycles[lane] += (target & 0xFF00) != (next & 0xFF00) ? 2 : 1;
+                } else {
+                    group->next_pc[lane] = next;
+                }
+            }
+            per_lane_pc = true;
+            break;
+        }
+        case PHA: case PHP: case PLA: case PLP:
+            _exec_flow(wide, group, info, operand);
+            break;
+        case JMP: case JSR: case RTS:
+            _exec_flow(wide, group, info, operand);
+            per_lane_pc = true;
+            break;
+        default:
+            _exec_implied(group, mnemonic);
+            break;
+    }
+
+    for (uint32_t rest = group->active; rest != 0; rest &= rest - 1) {
+        unsigned int lane = _lowest_lane(rest);
+        group->cycles[lane] += info->cycles + ((penalized >> lane) & 1);
+    }
+    wide->stats.lane_instrs += _lane_count(group->active);
+
+    if (!per_lane_pc) {
+        group->pc = pc + info->len;
+        return;
+    }
+
+    group->pc = _pick_path(group);
+
+    for (uint32_t rest = group->active; rest != 0; rest &= rest - 1) {
+        unsigned int lane = _lowest_lane(rest);
+        if (group->next_pc[lane] != group->pc) {
+            wide->stats.diverged++;
+            _finish_lane(wide, group, lane, group->next_pc[lane]);
+        }
+    }
+}
+
+bool wide_run(const BatchInstance *instances, BatchResult *results, size_t count, WideStats *stats) {
+    Wide wide = {.instances = instances, .results = results};
+
+    CpuSystemInterface iface = {_mem_read, _mem_write, _bus_read, _bus_write, NULL, NULL, NULL, &wide};
+    if ((wide.cpu = cpu_create(iface)) == NULL) {
+        return false;
+    }
+
+    for (size_t start = 0; start < count; start += WIDE_LANES) {
+        Group group = {.active = 0};
+
+        size_t lanes = count - start < WIDE_LANES ? count - start : WIDE_LANES;
+        for (unsigned int lane = 0; lane < lanes; lane++) {
+            _start_lane(&wide, &group, lane, start + lane);
+        }
+
+        // lanes which don't start out where most of the others do never join the group
+        group.pc = _pick_path(&group);
+        for (unsigned int lane = 0; lane < lanes; lane++) {
+            if (group.next_pc[lane] != group.pc) {
+                _finish_lane(&wide, &group, lane, group.next_pc[lane]);
+            }
+        }
+
+        while (group.active != 0) {
+            _step(&wide, &group);
+        }
+    }
+
+    cpu_destroy(wide.cpu);
+
+    if (stats != NULL) {
+        *stats = wide.stats;
+    }
+
+    return true;
+}
@@ -25,20 +25,42 @@
 
 #pragma once
 
+#include "c6502/cpu.h"
+
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
-typedef struct {
-    unsigned char *data;
-    size_t size;
-} DataBlob;
-
 bool load_cpu_test(char *file_name);
 
 void pump_cpu(void);
 
-uint8_t system_memory_read(uint16_t addr);
-void system_memory_write(uint16_t addr, uint8_t val);
+// maps the test system's RAM and program into the CPU's page table
+void map_system_memory(void);
+
+// the system interface of the test system, for tests which replace only some of its callbacks
+uint8_t system_memory_read(void *userdata, uint16_t addr);
+void system_memory_write(void *userdata, uint16_t addr, uint8_t val);
+uint8_t system_bus_read(void *userdata);
+void system_bus_write(void *userdata, uint8_t val);
+unsigned int poll_nmi_line(void *userdata);
+unsigned int poll_irq_line(void *userdata);
+unsigned int poll_rst_line(void *userdata);
+
+// the registers after an instruction and the number of cycles it took
+typedef struct {
+    unsigned int cycles;
+    CpuRegisters regs;
+} TestStep;
+
+// Loads a program and steps through it instruction by instruction straight from the system interface, stopping after
+// max_steps instructions or before anything would jam the CPU. Stores the number of steps recorded in count.
+bool record_test_steps(char *file_name, TestStep *steps, size_t max_steps, size_t *count);
+
+// checks the registers of the given CPU against the expected ones
+bool check_cpu_registers(Cpu6502 *cpu, const CpuRegisters *expected);
+
+// checks the registers of the test CPU against the expected ones
+bool check_test_registers(const CpuRegisters *expected);
 
 bool do_cpu_tests(char *res_prefix);
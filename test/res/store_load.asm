@@ -231,6 +231,32 @@ NOP                 ; perform assertions:
                     ; $0008 = 0x42
                     ; $0009 = 0x52
 
+;;;;;;;;;;;;;;;;
+; indirect indexed reads
+;;;;;;;;;;;;;;;;
+
+LDA #$40            ; a = 0x40
+STA $30             ; write a=0x40 to $0030
+LDA #$02            ; a = 0x02
+STA $31             ; write a=0x02 to $0031
+LDA #$07            ; a = 0x07
+STA $0245           ; write a=7 to $0245
+LDY #$05            ; y = 0x05
+
+LDA #$00            ; reset acc
+LDA ($30),Y         ; a = $0240+5 = $0245 = 0x07 (no page crossing)
+STA $40             ; write a=7 to $0040
+CLC                 ; clear carry
+ADC ($30),Y         ; a = 0x07 + $0245 = 0x0E
+STA $41             ; write a=0x0E to $0041
+LDA #$07            ; a = 0x07
+CMP ($30),Y         ; compare a=7 with $0245 = 0x07
+NOP                 ; perform assertions:
+                    ; $0040 = 0x07
+                    ; $0041 = 0x0E
+                    ; z = 1
+                    ; c = 1
+
 ; remaining instruction+addressing combos are redundant due to shared implementations
 
 .org $BFFA
@@ -28,6 +28,7 @@
 
 #include "c6502/cpu.h"
 #include "c6502/instrs.h"
+#include "c6502/rom_image.h"
 
 #include <errno.h>
 #include <stdbool.h>
@@ -37,149 +38,277 @@
 
 extern bool test_addition(void);
 extern bool test_arithmetic(void);
+extern bool test_batch(void);
+extern bool test_block_cache(void);
 extern bool test_branch(void);
+extern bool test_clock_sync(void);
+extern bool test_clone(void);
+extern bool test_dirty_pages(void);
+extern bool test_fast(void);
+extern bool test_idle_skip(void);
 extern bool test_interrupt(void);
+extern bool test_jit(void);
+extern bool test_line_push(void);
+extern bool test_line_replay(void);
 extern bool test_logic(void);
+extern bool test_memory_map(void);
+extern bool test_opcode_info(void);
+extern bool test_rewind(void);
+extern bool test_rom_image(void);
+extern bool test_run(void);
+extern bool test_save_state(void);
+extern bool test_scheduler(void);
 extern bool test_stack(void);
+extern bool test_static_recomp(void);
 extern bool test_status(void);
 extern bool test_store_load(void);
 extern bool test_subtraction(void);
+extern bool test_trace(void);
+extern bool test_trace_file(void);
+extern bool test_trace_queue(void);
+extern bool test_wide(void);
+
+Cpu6502 *g_test_cpu;
+
+#define MAX_IMAGES 16
+#define PRG_PAGES 0x80
 
 static unsigned char g_sys_ram[0x800];
 static uint8_t g_sys_bus;
-static DataBlob g_program;
+
+// Program images are opened once and shared by every test loading them. Pages the CPU writes to through the system
+// interface are copied on the first write, as the pages mapped by map_system_memory() are.
+static struct {
+    char *name;
+    RomImage *image;
+} g_images[MAX_IMAGES];
+static size_t g_image_count;
+static const RomImage *g_program;
+static uint8_t *g_program_copies[PRG_PAGES];
 
 static char *g_res_prefix;
 
-static DataBlob _load_file(FILE *file) {
-    if (fseek(file, 0L, SEEK_END) != 0) {
-        printf("Failed to seek to file end\n");
-        exit(-1);
+static const RomImage *_open_image(char *file_name) {
+    for (size_t i = 0; i < g_image_count; i++) {
+        if (strcmp(g_images[i].name, file_name) == 0) {
+            return g_images[i].image;
+        }
     }
-    size_t size = ftell(file);
-    if (fseek(file, 0, SEEK_SET) != 0) {
-        printf("Failed to seek to file start\n");
+
+    if (g_image_count == MAX_IMAGES) {
+        printf("Too many program files\n");
         exit(-1);
     }
 
-    unsigned char *data = malloc(size);
-    if (!data || !fread(data, size, 1, file)) {
-        printf("Failed to read file (errno: %d)\n", errno);
-        exit(-1);
+    char *qualified = malloc(strlen(file_name) + strlen(g_res_prefix) + 2);
+    sprintf(qualified, "%s/%s", g_res_prefix, file_name);
+    RomImage *image = rom_image_open(qualified);
+    free(qualified);
+
+    if (!image) {
+        return NULL;
     }
 
-    return (DataBlob) {data, size};
+    g_images[g_image_count].name = malloc(strlen(file_name) + 1);
+    strcpy(g_images[g_image_count].name, file_name);
+    g_images[g_image_count].image = image;
+    g_image_count++;
+
+    return image;
+}
+
+static void _close_images(void) {
+    for (size_t i = 0; i < g_image_count; i++) {
+        free(g_images[i].name);
+        rom_image_close(g_images[i].image);
+    }
+    g_image_count = 0;
 }
 
-static void _log_callback(char *instr_str, CpuRegisters last_regs) {
+static void _drop_program_copies(void) {
+    for (size_t i = 0; i < PRG_PAGES; i++) {
+        free(g_program_copies[i]);
+        g_program_copies[i] = NULL;
+    }
+}
+
+// translates a CPU address in the program area to an offset into the program, or returns false if it lies past its end
+static bool _program_offset(uint16_t addr, size_t *offset) {
+    size_t size = rom_image_size(g_program);
+
+    addr %= 0x8000;
+
+    // mirroring
+    if (addr >= 0x4000 && size <= 0x4000) {
+        addr -= 0x4000;
+    }
+
+    *offset = addr;
+    return addr < size;
+}
+
+static void _log_callback(void *userdata, char *instr_str, CpuRegisters last_regs) {
+    (void) userdata;
     printf("%04X %s %02X\n", last_regs.pc, instr_str, last_regs.sp);
 }
 
-uint8_t system_memory_read(uint16_t addr) {
+uint8_t system_memory_read(void *userdata, uint16_t addr) {
+    (void) userdata;
     if (addr < 0x2000) {
         return g_sys_ram[addr % sizeof(g_sys_ram)];
     } else if (addr >= 0x8000) {
-        addr %= 0x8000;
-
-         // mirroring
-        if (addr >= 0x4000 && g_program.size <= 0x4000) {
-            addr -= 0x4000;
-        }
-
-        if (addr >= g_program.size) {
+        size_t offset;
+        if (!_program_offset(addr, &offset)) {
             return 0;
         }
 
-        return g_program.data[addr];
+        uint8_t *copy = g_program_copies[offset >> 8];
+        return copy != NULL ? copy[offset & 0xFF] : rom_image_data(g_program)[offset];
     } else {
         return 0;
     }
 }
 
-void system_memory_write(uint16_t addr, uint8_t val) {
+void system_memory_write(void *userdata, uint16_t addr, uint8_t val) {
+    (void) userdata;
     if (addr < 0x2000) {
         g_sys_ram[addr % sizeof(g_sys_ram)] = val;
     } else if (addr >= 0x8000) {
-        addr %= 0x8000;
-
-        // mirroring
-        if (addr >= 0x4000 && g_program.size <= 0x4000) {
-            addr -= 0x4000;
+        size_t offset;
+        if (!_program_offset(addr, &offset)) {
+            return;
         }
 
-        if (addr >= g_program.size) {
-            return;
+        uint8_t **copy = &g_program_copies[offset >> 8];
+        if (*copy == NULL) {
+            size_t page_start = offset & ~(size_t) 0xFF;
+            size_t page_len = rom_image_size(g_program) - page_start;
+
+            if (!(*copy = calloc(1, 0x100))) {
+                printf("Failed to copy program page\n");
+                exit(-1);
+            }
+            memcpy(*copy, rom_image_data(g_program) + page_start, page_len < 0x100 ? page_len : 0x100);
         }
 
-        g_program.data[addr] = val;
+        (*copy)[offset & 0xFF] = val;
     }
 }
 
-uint8_t system_bus_read(void) {
+uint8_t system_bus_read(void *userdata) {
+    (void) userdata;
     return g_sys_bus;
 }
 
-void system_bus_write(uint8_t val) {
+void system_bus_write(void *userdata, uint8_t val) {
+    (void) userdata;
     g_sys_bus = val;
 }
 
-unsigned int poll_nmi_line(void) {
+unsigned int poll_nmi_line(void *userdata) {
+    (void) userdata;
     return 1;
 }
 
-unsigned int poll_irq_line(void) {
+unsigned int poll_irq_line(void *userdata) {
+    (void) userdata;
     return 1;
 }
 
-unsigned int poll_rst_line(void) {
+unsigned int poll_rst_line(void *userdata) {
+    (void) userdata;
     return 1;
 }
 
 
 bool load_cpu_test(char *file_name) {
-    char *qualified = malloc(strlen(file_name) + strlen(g_res_prefix) + 2);
-    sprintf(qualified, "%s/%s", g_res_prefix, file_name);
-
-    FILE *program_file = fopen(qualified, "rb");
-
-    if (!program_file) {
+    if (!(g_program = _open_image(file_name))) {
         printf("Could not open program file %s. Errno: %d\n", file_name, errno);
         return false;
     }
 
-    g_program = _load_file(program_file);
-
-    if (!g_program.data) {
-        printf("Failed to load program %s.\n", file_name);
-        exit(-1);
-    }
-
+    _drop_program_copies();
     memset(g_sys_ram, 0, sizeof(g_sys_ram));
 
-    initialize_cpu((CpuSystemInterface){
+    CpuSystemInterface iface = {
             system_memory_read,
             system_memory_write,
             system_bus_read,
             system_bus_write,
             poll_nmi_line,
             poll_irq_line,
-            poll_rst_line
-    });
-    //cpu_set_log_callback(_log_callback);
+            poll_rst_line,
+            NULL
+    };
+
+    if (g_test_cpu) {
+        initialize_cpu(g_test_cpu, iface);
+    } else if (!(g_test_cpu = cpu_create(iface))) {
+        printf("Failed to create CPU.\n");
+        exit(-1);
+    }
+    //cpu_set_log_callback(g_test_cpu, _log_callback);
+
+    cpu_set_stop_mnemonic(g_test_cpu, NOP);
 
     printf("Successfully loaded program file %s.\n", file_name);
+
+    return true;
+}
+
+void map_system_memory(void) {
+    for (uint16_t addr = 0; addr < 0x2000; addr += sizeof(g_sys_ram)) {
+        cpu_map_memory(g_test_cpu, addr, sizeof(g_sys_ram), g_sys_ram, CPU_PAGE_READ_WRITE);
+    }
+
+    // programs are mirrored the same way as in system_memory_read
+    size_t prg_size = rom_image_size(g_program) <= 0x4000 ? 0x4000 : 0x8000;
+    if (rom_image_size(g_program) >= prg_size) {
+        rom_image_map(g_program, g_test_cpu, 0x8000, 0x8000);
+    }
 }
 
 void unload_cpu_test() {
-    free(g_program.data);
+    _drop_program_copies();
 }
 
 void pump_cpu(void) {
-    do {
-        cycle_cpu();
-    } while (!(cpu_get_current_instruction() != NULL
-            && cpu_get_current_instruction()->mnemonic == NOP
-            && cpu_get_instruction_step() == 1));
+    cpu_run_cycles(g_test_cpu, UINT64_MAX, CPU_STOP_MNEMONIC);
+}
+
+bool record_test_steps(char *file_name, TestStep *steps, size_t max_steps, size_t *count) {
+    if (!load_cpu_test(file_name)) {
+        return false;
+    }
+
+    *count = 0;
+    while (*count < max_steps) {
+        // some of the programs eventually run off into garbage, so we stop before anything jams the CPU
+        if (decode_instr(system_memory_read(NULL, cpu_get_registers(g_test_cpu)->pc))->mnemonic == KIL) {
+            break;
+        }
+
+        unsigned int cycles = cpu_step_instruction(g_test_cpu);
+        steps[(*count)++] = (TestStep) {cycles, *cpu_get_registers(g_test_cpu)};
+    }
+
+    return true;
+}
+
+bool check_cpu_registers(Cpu6502 *cpu, const CpuRegisters *expected) {
+    CpuRegisters *regs = cpu_get_registers(cpu);
+    ASSERT_EQ(expected->pc, regs->pc);
+    ASSERT_EQ(expected->sp, regs->sp);
+    ASSERT_EQ(expected->acc, regs->acc);
+    ASSERT_EQ(expected->x, regs->x);
+    ASSERT_EQ(expected->y, regs->y);
+    ASSERT_EQ(expected->status.serial, regs->status.serial);
+
+    return true;
+}
+
+bool check_test_registers(const CpuRegisters *expected) {
+    return check_cpu_registers(g_test_cpu, expected);
 }
 
 bool do_cpu_tests(char *res_prefix) {
@@ -189,13 +318,37 @@ bool do_cpu_tests(char *res_prefix) {
 
     res &= test_addition();
     res &= test_arithmetic();
+    res &= test_batch();
+    res &= test_block_cache();
     res &= test_branch();
+    res &= test_clock_sync();
+    res &= test_clone();
+    res &= test_dirty_pages();
+    res &= test_fast();
+    res &= test_idle_skip();
     res &= test_interrupt();
+    res &= test_jit();
+    res &= test_line_push();
+    res &= test_line_replay();
     res &= test_logic();
+    res &= test_memory_map();
+    res &= test_opcode_info();
+    res &= test_rewind();
+    res &= test_rom_image();
+    res &= test_run();
+    res &= test_save_state();
+    res &= test_scheduler();
     res &= test_stack();
+    res &= test_static_recomp();
     res &= test_status();
     res &= test_store_load();
     res &= test_subtraction();
+    res &= test_trace();
+    res &= test_trace_file();
+    res &= test_trace_queue();
+    res &= test_wide();
+
+    _close_images();
 
     return res;
 }
@@ -28,7 +28,7 @@
 
 #include "c6502/cpu.h"
 
-extern CpuRegisters g_cpu_regs;
+extern Cpu6502 *g_test_cpu;
 
 bool test_addition(void) {
     if (!load_cpu_test("addition.bin")) {
@@ -36,53 +36,53 @@ bool test_addition(void) {
     }
 
     pump_cpu();
-    ASSERT_EQ(0x02, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
-    ASSERT_EQ(0, g_cpu_regs.status.overflow);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
+    ASSERT_EQ(0x02, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
 
     pump_cpu();
-    ASSERT_EQ(0x01, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
-    ASSERT_EQ(0, g_cpu_regs.status.overflow);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
+    ASSERT_EQ(0x01, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
 
     pump_cpu();
-    ASSERT_EQ(0x80, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
-    ASSERT_EQ(1, g_cpu_regs.status.overflow);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
+    ASSERT_EQ(0x80, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
 
     pump_cpu();
-    ASSERT_EQ(0x00, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
-    ASSERT_EQ(1, g_cpu_regs.status.overflow);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
+    ASSERT_EQ(0x00, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
 
     pump_cpu();
-    ASSERT_EQ(0x02, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
-    ASSERT_EQ(0, g_cpu_regs.status.overflow);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
+    ASSERT_EQ(0x02, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
 
     pump_cpu();
-    ASSERT_EQ(0x80, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
-    ASSERT_EQ(1, g_cpu_regs.status.overflow);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
+    ASSERT_EQ(0x80, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
 
     pump_cpu();
-    ASSERT_EQ(0x00, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
-    ASSERT_EQ(0, g_cpu_regs.status.overflow);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
+    ASSERT_EQ(0x00, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
 
     return true;
 }
@@ -28,7 +28,7 @@
 
 #include "c6502/cpu.h"
 
-extern CpuRegisters g_cpu_regs;
+extern Cpu6502 *g_test_cpu;
 
 bool test_arithmetic(void) {
     if (!load_cpu_test("arithmetic.bin")) {
@@ -38,134 +38,134 @@ bool test_arithmetic(void) {
     // test INX
 
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.x);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.x);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x80, g_cpu_regs.x);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x80, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x81, g_cpu_regs.x);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x81, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test INY
 
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.y);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->y);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.y);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->y);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x80, g_cpu_regs.y);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x80, cpu_get_registers(g_test_cpu)->y);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x81, g_cpu_regs.y);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x81, cpu_get_registers(g_test_cpu)->y);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test INC
 
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x80, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x80, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x81, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x81, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test DEX
 
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.x);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.x);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0xFF, g_cpu_regs.x);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0xFF, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x7F, g_cpu_regs.x);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x7F, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test DEY
 
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.y);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->y);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.y);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->y);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0xFF, g_cpu_regs.y);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0xFF, cpu_get_registers(g_test_cpu)->y);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x7F, g_cpu_regs.y);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x7F, cpu_get_registers(g_test_cpu)->y);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test DEC
 
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0xFF, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0xFF, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x7F, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x7F, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     return true;
 }
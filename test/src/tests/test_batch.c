@@ -0,0 +1,185 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/batch.h"
+#include "c6502/cpu.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INSTANCE_COUNT 64
+#define MEMORY_SIZE 0x10000
+#define LOOP_EXIT 0x8017
+
+// sums 1 to ($00) into $01-$02, then either jams or spins forever depending on $03
+static const uint8_t g_program[] = {
+    0xA9, 0x00, // LDA #$00
+    0x85, 0x01, // STA $01
+    0x85, 0x02, // STA $02
+    0xA6, 0x00, // LDX $00
+    0xF0, 0x0E, // BEQ done
+    0x8A, // loop: TXA
+    0x18, // CLC
+    0x65, 0x01, // ADC $01
+    0x85, 0x01, // STA $01
+    0x90, 0x02, // BCC skip
+    0xE6, 0x02, // INC $02
+    0xCA, // skip: DEX
+    0xD0, 0xF3, // BNE loop
+    0xEA, // NOP
+    0xA5, 0x03, // done: LDA $03
+    0xF0, 0x01, // BEQ hang
+    0x02, // KIL
+    0x4C, 0x1D, 0x80, // hang: JMP hang
+};
+
+static uint8_t *g_memory;
+static uint8_t *g_ref_memory;
+
+static uint8_t _mem_read(void *userdata, uint16_t addr) {
+    (void) userdata;
+    return g_ref_memory[addr];
+}
+
+static void _mem_write(void *userdata, uint16_t addr, uint8_t val) {
+    (void) userdata;
+    g_ref_memory[addr] = val;
+}
+
+static void _init_instances(BatchInstance *instances, CpuRegisters *regs) {
+    for (size_t i = 0; i < INSTANCE_COUNT; i++) {
+        uint8_t *memory = &g_memory[i * MEMORY_SIZE];
+        memset(memory, 0, MEMORY_SIZE);
+        memcpy(&memory[0x8000], g_program, sizeof(g_program));
+        memory[0xFFFC] = 0x00;
+        memory[0xFFFD] = 0x80;
+        memory[0x00] = (uint8_t) (i * 7);
+        memory[0x03] = i % 3;
+
+        // some instances skip clearing the sum, starting from registers of their own
+        regs[i] = (CpuRegisters) {.status.serial = 0x24, .pc = 0x8006, .sp = 0xFD, .acc = (uint8_t) i, .x = 0, .y = 1};
+
+        instances[i] = (BatchInstance) {
+                .memory = memory,
+                .regs = i % 5 == 0 ? &regs[i] : NULL,
+                .budget = 2000 + i * 97,
+                .stop_mask = i % 4 == 0 ? CPU_STOP_PC | CPU_STOP_KIL : CPU_STOP_KIL,
+                .stop_pc = LOOP_EXIT
+        };
+    }
+}
+
+// runs an instance on a CPU of its own in one go
+static bool _run_reference(Cpu6502 *cpu, const BatchInstance *instance, BatchResult *result) {
+    g_ref_memory = instance->memory;
+
+    CpuSystemInterface iface = {_mem_read, _mem_write, system_bus_read, system_bus_write, NULL, NULL, NULL, NULL};
+    initialize_cpu(cpu, iface);
+    if (instance->regs != NULL) {
+        *cpu_get_registers(cpu) = *instance->regs;
+    }
+
+    cpu_set_stop_pc(cpu, instance->stop_pc);
+    result->cycles = cpu_run_cycles(cpu, instance->budget, instance->stop_mask);
+    result->regs = *cpu_get_registers(cpu);
+    result->stop_reason = cpu_get_stop_reason(cpu);
+    result->jammed = cpu_is_jammed(cpu);
+
+    return true;
+}
+
+static bool _check_results(const BatchResult *expected, const BatchResult *results, const uint8_t *expected_memory) {
+    for (size_t i = 0; i < INSTANCE_COUNT; i++) {
+        ASSERT_EQ((unsigned int) expected[i].cycles, (unsigned int) results[i].cycles);
+        ASSERT_EQ(expected[i].stop_reason, results[i].stop_reason);
+        ASSERT_EQ(expected[i].jammed, results[i].jammed);
+        ASSERT_EQ(expected[i].regs.pc, results[i].regs.pc);
+        ASSERT_EQ(expected[i].regs.sp, results[i].regs.sp);
+        ASSERT_EQ(expected[i].regs.acc, results[i].regs.acc);
+        ASSERT_EQ(expected[i].regs.x, results[i].regs.x);
+        ASSERT_EQ(expected[i].regs.y, results[i].regs.y);
+        ASSERT_EQ(expected[i].regs.status.serial, results[i].regs.status.serial);
+    }
+
+    ASSERT_EQ(0, memcmp(expected_memory, g_memory, (size_t) INSTANCE_COUNT * MEMORY_SIZE));
+
+    return true;
+}
+
+bool test_batch(void) {
+    static BatchInstance instances[INSTANCE_COUNT];
+    static CpuRegisters regs[INSTANCE_COUNT];
+    static BatchResult expected[INSTANCE_COUNT];
+    static BatchResult results[INSTANCE_COUNT];
+
+    g_memory = malloc((size_t) INSTANCE_COUNT * MEMORY_SIZE);
+    uint8_t *expected_memory = malloc((size_t) INSTANCE_COUNT * MEMORY_SIZE);
+    ASSERT_EQ(true, (g_memory != NULL && expected_memory != NULL));
+
+    _init_instances(instances, regs);
+
+    CpuSystemInterface iface = {_mem_read, _mem_write, system_bus_read, system_bus_write, NULL, NULL, NULL, NULL};
+    g_ref_memory = g_memory;
+    Cpu6502 *cpu = cpu_create(iface);
+    ASSERT_EQ(true, (cpu != NULL));
+
+    for (size_t i = 0; i < INSTANCE_COUNT; i++) {
+        _run_reference(cpu, &instances[i], &expected[i]);
+    }
+    cpu_destroy(cpu);
+    memcpy(expected_memory, g_memory, (size_t) INSTANCE_COUNT * MEMORY_SIZE);
+
+    // every kind of ending is covered
+    ASSERT_EQ(CPU_STOP_PC, expected[4].stop_reason);
+    ASSERT_EQ(CPU_STOP_KIL, expected[1].stop_reason);
+    ASSERT_EQ(CPU_STOP_NONE, expected[3].stop_reason);
+    ASSERT_EQ(true, (expected[INSTANCE_COUNT - 1].cycles == instances[INSTANCE_COUNT - 1].budget));
+
+    // short slices make instances change hands between workers all the time
+    const unsigned int threads[] = {1, 4, 0};
+    const uint64_t slices[] = {0, 37, 1000};
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        for (size_t s = 0; s < sizeof(slices) / sizeof(slices[0]); s++) {
+            _init_instances(instances, regs);
+            memset(results, 0, sizeof(results));
+
+            ASSERT_EQ(true, batch_run(instances, results, INSTANCE_COUNT, threads[t], slices[s]));
+            if (!_check_results(expected, results, expected_memory)) {
+                return false;
+            }
+        }
+    }
+
+    ASSERT_EQ(true, batch_run(instances, results, 0, 4, 0));
+
+    free(expected_memory);
+    free(g_memory);
+
+    return true;
+}
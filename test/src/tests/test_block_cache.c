@@ -0,0 +1,120 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_STEPS 4096
+
+extern Cpu6502 *g_test_cpu;
+
+static TestStep g_steps[MAX_STEPS];
+
+// runs a program instruction by instruction straight from the system interface, then again from mapped memory with the
+// block cache enabled, and checks that both runs agree after every instruction
+static bool _compare_cached(char *file_name) {
+    size_t step_count;
+    if (!record_test_steps(file_name, g_steps, MAX_STEPS, &step_count) || !load_cpu_test(file_name)) {
+        return false;
+    }
+
+    map_system_memory();
+    ASSERT_EQ(true, cpu_set_block_cache(g_test_cpu, true));
+
+    for (size_t i = 0; i < step_count; i++) {
+        ASSERT_EQ(g_steps[i].cycles, cpu_step_instruction(g_test_cpu));
+
+        if (!check_test_registers(&g_steps[i].regs)) {
+            return false;
+        }
+    }
+
+    cpu_set_block_cache(g_test_cpu, false);
+    cpu_unmap_memory(g_test_cpu, 0x0000, 0x10000);
+
+    return true;
+}
+
+static bool _test_self_modifying(void) {
+    static uint8_t code[0x100];
+
+    // $0200: LDX #$00
+    // $0202: INC $0201
+    // $0205: JMP $0200
+    const uint8_t program[] = {0xA2, 0x00, 0xEE, 0x01, 0x02, 0x4C, 0x00, 0x02};
+
+    if (!load_cpu_test("branch.bin")) {
+        return false;
+    }
+
+    memset(code, 0, sizeof(code));
+    memcpy(code, program, sizeof(program));
+
+    ASSERT_EQ(true, cpu_map_memory(g_test_cpu, 0x0200, 0x100, code, CPU_PAGE_READ_WRITE));
+    ASSERT_EQ(true, cpu_set_block_cache(g_test_cpu, true));
+
+    CpuRegisters *regs = cpu_get_registers(g_test_cpu);
+    regs->pc = 0x0200;
+
+    // the INC rewrites the operand of the LDX each time around, so a stale block would keep loading the same value
+    for (unsigned int i = 0; i < 4; i++) {
+        ASSERT_EQ(2, cpu_step_instruction(g_test_cpu));
+        ASSERT_EQ(i, regs->x);
+        ASSERT_EQ(6, cpu_step_instruction(g_test_cpu));
+        ASSERT_EQ(3, cpu_step_instruction(g_test_cpu));
+        ASSERT_EQ(0x0200, regs->pc);
+    }
+
+    // modifications made by the host have to be announced explicitly
+    code[0x01] = 0x40;
+    cpu_invalidate_code(g_test_cpu, 0x0201, 1);
+    cpu_step_instruction(g_test_cpu);
+    ASSERT_EQ(0x40, regs->x);
+
+    cpu_set_block_cache(g_test_cpu, false);
+    cpu_unmap_memory(g_test_cpu, 0x0200, 0x100);
+
+    return true;
+}
+
+bool test_block_cache(void) {
+    char *programs[] = {
+        "addition.bin", "arithmetic.bin", "branch.bin", "interrupt.bin", "logic.bin",
+        "stack.bin", "status.bin", "store_load.bin", "subtraction.bin"
+    };
+
+    for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        if (!_compare_cached(programs[i])) {
+            return false;
+        }
+    }
+
+    return _test_self_modifying();
+}
@@ -28,7 +28,7 @@
 
 #include "c6502/cpu.h"
 
-extern CpuRegisters g_cpu_regs;
+extern Cpu6502 *g_test_cpu;
 
 bool test_branch(void) {
     if (!load_cpu_test("branch.bin")) {
@@ -37,43 +37,43 @@ bool test_branch(void) {
 
     // test JMP (indirect)
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.x);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->x);
 
     // test JMP (indirect)
     pump_cpu();
-    ASSERT_EQ(2, g_cpu_regs.x);
+    ASSERT_EQ(2, cpu_get_registers(g_test_cpu)->x);
 
     // test JMP
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.x);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->x);
 
     // test JSR
     pump_cpu();
-    ASSERT_EQ(7, g_cpu_regs.x);
+    ASSERT_EQ(7, cpu_get_registers(g_test_cpu)->x);
 
     // test BEQ, BNE
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.x);
-    ASSERT_EQ(2, g_cpu_regs.y);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(2, cpu_get_registers(g_test_cpu)->y);
 
     // test BCS, BCC
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.x);
-    ASSERT_EQ(2, g_cpu_regs.y);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(2, cpu_get_registers(g_test_cpu)->y);
 
     // test BPL, BMI
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.x);
-    ASSERT_EQ(2, g_cpu_regs.y);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(2, cpu_get_registers(g_test_cpu)->y);
 
     // set overflow flag explicitly so we can test branching based on its value
-    g_cpu_regs.status.overflow = 1;
+    cpu_get_registers(g_test_cpu)->status.overflow = 1;
 
     // test BVS, BVC
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.x);
-    ASSERT_EQ(2, g_cpu_regs.y);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(2, cpu_get_registers(g_test_cpu)->y);
 
     return true;
 }
@@ -0,0 +1,220 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/clock_sync.h"
+#include "c6502/cpu.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define RUN_CYCLES 200000
+#define VIDEO_HIGH_TICKS 1000
+#define VIDEO_LOW_TICKS 20
+#define VIDEO_RESET_TICKS 7
+#define MAX_TOGGLES 2048
+
+typedef struct {
+    uint64_t ticks;
+    uint64_t next_toggle; // the tick on which the NMI line next changes
+    bool low;
+    unsigned int calls;
+    uint64_t toggle_cycles[MAX_TOGGLES]; // the CPU cycles at which the NMI line changed
+    size_t toggle_count;
+} Video;
+
+typedef struct {
+    uint64_t ticks;
+    unsigned int calls;
+} Audio;
+
+static Cpu6502 *g_cpu;
+static ClockSync *g_sync;
+static Video g_video;
+static Audio g_audio;
+static uint8_t g_mem[0x10000];
+
+// Records the video and audio tick counters seen by the CPU into RAM, with a write to the video chip every 256
+// iterations which makes its next NMI come sooner than planned. NMIs count up $10-$11.
+static const uint8_t g_program[] = {
+    0xA2, 0x00, // LDX #$00
+    0xAD, 0x02, 0x20, // loop: LDA $2002
+    0x9D, 0x00, 0x02, // STA $0200,X
+    0xAD, 0x03, 0x20, // LDA $2003
+    0x9D, 0x00, 0x03, // STA $0300,X
+    0xE8, // INX
+    0xD0, 0xF1, // BNE loop
+    0x8D, 0x00, 0x20, // STA $2000
+    0x4C, 0x02, 0x80, // JMP loop
+};
+
+static const uint8_t g_handler[] = {
+    0xE6, 0x10, // INC $10
+    0xD0, 0x02, // BNE done
+    0xE6, 0x11, // INC $11
+    0x40, // done: RTI
+};
+
+static uint64_t _video_tick(void *userdata, uint64_t ticks) {
+    Video *video = userdata;
+    video->calls++;
+
+    uint64_t target = video->ticks + ticks;
+    while (video->next_toggle <= target) {
+        video->low = !video->low;
+        cpu_set_nmi_line(g_cpu, video->low ? 0 : 1);
+        if (video->toggle_count < MAX_TOGGLES) {
+            video->toggle_cycles[video->toggle_count++] = cpu_get_cycle_count(g_cpu);
+        }
+        video->next_toggle += video->low ? VIDEO_LOW_TICKS : VIDEO_HIGH_TICKS;
+    }
+    video->ticks = target;
+
+    return video->next_toggle - video->ticks;
+}
+
+static uint64_t _audio_tick(void *userdata, uint64_t ticks) {
+    Audio *audio = userdata;
+    audio->calls++;
+    audio->ticks += ticks;
+
+    return CLOCK_NO_OUTPUT;
+}
+
+static uint8_t _mem_read(void *userdata, uint16_t addr) {
+    (void) userdata;
+    if (addr == 0x2002) {
+        clock_sync_catch_up(g_sync, 0);
+        return g_video.ticks & 0xFF;
+    } else if (addr == 0x2003) {
+        clock_sync_catch_up(g_sync, 1);
+        return g_audio.ticks & 0xFF;
+    }
+
+    return g_mem[addr];
+}
+
+static void _mem_write(void *userdata, uint16_t addr, uint8_t val) {
+    (void) userdata;
+    if (addr == 0x2000) {
+        clock_sync_catch_up(g_sync, 0);
+        if (!g_video.low) {
+            g_video.next_toggle = g_video.ticks + VIDEO_RESET_TICKS;
+            clock_sync_set_next_output(g_sync, 0, VIDEO_RESET_TICKS);
+        }
+        return;
+    }
+
+    g_mem[addr] = val;
+}
+
+static bool _setup(void) {
+    memset(g_mem, 0, sizeof(g_mem));
+    memcpy(&g_mem[0x8000], g_program, sizeof(g_program));
+    memcpy(&g_mem[0x9000], g_handler, sizeof(g_handler));
+    g_mem[0xFFFA] = 0x00;
+    g_mem[0xFFFB] = 0x90;
+    g_mem[0xFFFC] = 0x00;
+    g_mem[0xFFFD] = 0x80;
+
+    memset(&g_video, 0, sizeof(g_video));
+    g_video.next_toggle = VIDEO_HIGH_TICKS;
+    g_audio = (Audio) {0, 0};
+
+    CpuSystemInterface iface = {_mem_read, _mem_write, system_bus_read, system_bus_write, NULL, NULL, NULL, NULL};
+    if (g_cpu != NULL) {
+        initialize_cpu(g_cpu, iface);
+    } else if ((g_cpu = cpu_create(iface)) == NULL) {
+        return false;
+    }
+    cpu_set_nmi_line(g_cpu, 1);
+
+    g_sync = clock_sync_create(g_cpu);
+    ASSERT_EQ(true, (g_sync != NULL));
+    ASSERT_EQ(true, clock_sync_add_domain(g_sync, 3, 1, _video_tick, &g_video));
+    ASSERT_EQ(true, clock_sync_add_domain(g_sync, 5, 3, _audio_tick, &g_audio));
+    ASSERT_EQ(false, clock_sync_add_domain(g_sync, 0, 1, _audio_tick, &g_audio));
+
+    return true;
+}
+
+bool test_clock_sync(void) {
+    static uint8_t expected_ram[0x800];
+    static uint64_t expected_toggles[MAX_TOGGLES];
+
+    if (!_setup()) {
+        return false;
+    }
+
+    uint64_t start = cpu_get_cycle_count(g_cpu);
+    clock_sync_run(g_sync, RUN_CYCLES);
+
+    ASSERT_EQ(RUN_CYCLES * 3, (unsigned int) clock_sync_get_ticks(g_sync, 0));
+    ASSERT_EQ(RUN_CYCLES * 5 / 3, (unsigned int) clock_sync_get_ticks(g_sync, 1));
+    ASSERT_EQ((unsigned int) g_video.ticks, (unsigned int) clock_sync_get_ticks(g_sync, 0));
+    ASSERT_EQ((unsigned int) g_audio.ticks, (unsigned int) clock_sync_get_ticks(g_sync, 1));
+    ASSERT_EQ(true, ((g_mem[0x10] | g_mem[0x11] << 8) > 100));
+
+    memcpy(expected_ram, g_mem, sizeof(expected_ram));
+    memcpy(expected_toggles, g_video.toggle_cycles, sizeof(expected_toggles));
+    size_t expected_toggle_count = g_video.toggle_count;
+    CpuRegisters expected_regs = *cpu_get_registers(g_cpu);
+    unsigned int lockstep_calls = g_video.calls + g_audio.calls;
+    clock_sync_destroy(g_sync);
+
+    // batched runs of any length end up in exactly the same place with far fewer ticks
+    if (!_setup()) {
+        return false;
+    }
+
+    ASSERT_EQ((unsigned int) start, (unsigned int) cpu_get_cycle_count(g_cpu));
+    uint64_t chunks[] = {1, 999, 12345, 3, RUN_CYCLES};
+    for (size_t i = 0; cpu_get_cycle_count(g_cpu) - start < RUN_CYCLES; i++) {
+        uint64_t left = RUN_CYCLES - (cpu_get_cycle_count(g_cpu) - start);
+        clock_sync_run_batched(g_sync, chunks[i] < left ? chunks[i] : left);
+    }
+
+    ASSERT_EQ(RUN_CYCLES * 3, (unsigned int) clock_sync_get_ticks(g_sync, 0));
+    ASSERT_EQ(RUN_CYCLES * 5 / 3, (unsigned int) clock_sync_get_ticks(g_sync, 1));
+    ASSERT_EQ(0, memcmp(expected_ram, g_mem, sizeof(expected_ram)));
+
+    // the video chip changed the NMI line on exactly the same cycles
+    ASSERT_EQ((unsigned int) expected_toggle_count, (unsigned int) g_video.toggle_count);
+    ASSERT_EQ(0, memcmp(expected_toggles, g_video.toggle_cycles, expected_toggle_count * sizeof(uint64_t)));
+
+    if (!check_cpu_registers(g_cpu, &expected_regs)) {
+        return false;
+    }
+
+    ASSERT_EQ(true, (g_video.calls + g_audio.calls < lockstep_calls / 4));
+
+    clock_sync_destroy(g_sync);
+    cpu_destroy(g_cpu);
+    g_cpu = NULL;
+
+    return true;
+}
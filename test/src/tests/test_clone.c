@@ -0,0 +1,211 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define BRANCHES 8
+#define PREFIX_CYCLES 5000
+#define BRANCH_CYCLES 3000
+#define INPUT_ADDR 0x4000
+
+// Adds an input read from the system to a table in RAM, through one of its mirrors, and stores the sums in the ROM.
+static const uint8_t g_program[] = {
+    0xA2, 0x00, // LDX #$00
+    0xAD, 0x00, 0x40, // loop: LDA $4000
+    0x18, // CLC
+    0x7D, 0x00, 0x02, // ADC $0200,X
+    0x9D, 0x00, 0x0A, // STA $0A00,X
+    0x9D, 0x00, 0x90, // STA $9000,X
+    0xE8, // INX
+    0xE6, 0x10, // INC $10
+    0x4C, 0x02, 0x80, // JMP loop
+};
+
+typedef struct {
+    uint8_t ram[0x800];
+    uint8_t rom[0x8000];
+    uint8_t bus;
+    uint8_t input;
+} System;
+
+static uint8_t _mem_read(void *userdata, uint16_t addr) {
+    System *sys = userdata;
+    return addr == INPUT_ADDR ? sys->input : 0;
+}
+
+static void _mem_write(void *userdata, uint16_t addr, uint8_t val) {
+    (void) userdata;
+    (void) addr;
+    (void) val;
+}
+
+static uint8_t _bus_read(void *userdata) {
+    return ((System*) userdata)->bus;
+}
+
+static void _bus_write(void *userdata, uint8_t val) {
+    ((System*) userdata)->bus = val;
+}
+
+static CpuSystemInterface _init_system(System *sys, uint8_t input) {
+    memset(sys, 0, sizeof(System));
+    memcpy(sys->rom, g_program, sizeof(g_program));
+    sys->rom[0x7FFC] = 0x00;
+    sys->rom[0x7FFD] = 0x80;
+    sys->input = input;
+
+    return (CpuSystemInterface) {_mem_read, _mem_write, _bus_read, _bus_write, NULL, NULL, NULL, sys};
+}
+
+// creates a CPU running from the system's own memory, with the RAM mirrored four times
+static Cpu6502 *_create_cpu(System *sys, uint8_t input) {
+    CpuSystemInterface iface = _init_system(sys, input);
+
+    Cpu6502 *cpu = cpu_create(iface);
+    if (cpu == NULL) {
+        return NULL;
+    }
+
+    for (uint16_t addr = 0; addr < 0x2000; addr += sizeof(sys->ram)) {
+        cpu_map_memory(cpu, addr, sizeof(sys->ram), sys->ram, CPU_PAGE_READ_WRITE);
+    }
+    cpu_map_memory(cpu, 0x8000, sizeof(sys->rom), sys->rom, CPU_PAGE_COPY_ON_WRITE);
+    initialize_cpu(cpu, iface);
+
+    return cpu;
+}
+
+static bool _check_same(Cpu6502 *expected, Cpu6502 *actual) {
+    ASSERT_EQ((unsigned int) cpu_get_cycle_count(expected), (unsigned int) cpu_get_cycle_count(actual));
+
+    CpuRegisters *expected_regs = cpu_get_registers(expected);
+    CpuRegisters *actual_regs = cpu_get_registers(actual);
+    ASSERT_EQ(expected_regs->pc, actual_regs->pc);
+    ASSERT_EQ(expected_regs->sp, actual_regs->sp);
+    ASSERT_EQ(expected_regs->acc, actual_regs->acc);
+    ASSERT_EQ(expected_regs->x, actual_regs->x);
+    ASSERT_EQ(expected_regs->y, actual_regs->y);
+    ASSERT_EQ(expected_regs->status.serial, actual_regs->status.serial);
+
+    for (uint32_t addr = 0; addr < 0x10000; addr++) {
+        if (addr < 0x2000 || addr >= 0x8000) {
+            ASSERT_EQ(cpu_read_memory(expected, addr), cpu_read_memory(actual, addr));
+        }
+    }
+
+    return true;
+}
+
+bool test_clone(void) {
+    static System sys;
+    static System ref_sys;
+    static System branch_sys[BRANCHES];
+    Cpu6502 *branches[BRANCHES];
+
+    Cpu6502 *cpu = _create_cpu(&sys, 3);
+    ASSERT_EQ(true, (cpu != NULL));
+    cpu_set_block_cache(cpu, true);
+    cpu_run_cycles(cpu, PREFIX_CYCLES, 0);
+
+    static uint8_t ram[0x800];
+    memcpy(ram, sys.ram, sizeof(ram));
+
+    // every branch starts from the same point but reads a different input
+    for (size_t i = 0; i < BRANCHES; i++) {
+        branches[i] = cpu_clone(cpu, _init_system(&branch_sys[i], (uint8_t) (i + 5)));
+        ASSERT_EQ(true, (branches[i] != NULL));
+    }
+
+    for (size_t i = 0; i < BRANCHES; i++) {
+        if (i % 2 == 0) {
+            cpu_run_cycles(branches[i], BRANCH_CYCLES, 0);
+        } else {
+            cpu_run_instructions(branches[i], BRANCH_CYCLES / 4);
+        }
+    }
+
+    // the branches keep their memory to themselves
+    static const uint8_t zero_ram[0x800];
+    ASSERT_EQ(0, memcmp(ram, sys.ram, sizeof(ram)));
+    for (size_t i = 0; i < BRANCHES; i++) {
+        ASSERT_EQ(0, memcmp(zero_ram, branch_sys[i].ram, sizeof(zero_ram)));
+    }
+
+    // the original carries on unaffected, in the host's memory
+    cpu_run_cycles(cpu, BRANCH_CYCLES, 0);
+
+    Cpu6502 *ref = _create_cpu(&ref_sys, 3);
+    ASSERT_EQ(true, (ref != NULL));
+    cpu_run_cycles(ref, PREFIX_CYCLES + BRANCH_CYCLES, 0);
+    if (!_check_same(ref, cpu)) {
+        return false;
+    }
+    ASSERT_EQ(0, memcmp(ref_sys.ram, sys.ram, sizeof(ram)));
+    ASSERT_EQ(0, memcmp(ref_sys.rom, sys.rom, sizeof(sys.rom)));
+    ASSERT_EQ(0x00, sys.rom[0x1000]);
+    cpu_destroy(ref);
+
+    // each branch matches a CPU which was given its input after the prefix, without touching the host's memory
+    for (size_t i = 0; i < BRANCHES; i++) {
+        ref = _create_cpu(&ref_sys, 3);
+        ASSERT_EQ(true, (ref != NULL));
+        cpu_run_cycles(ref, PREFIX_CYCLES, 0);
+        ref_sys.input = (uint8_t) (i + 5);
+        if (i % 2 == 0) {
+            cpu_run_cycles(ref, BRANCH_CYCLES, 0);
+        } else {
+            cpu_run_instructions(ref, BRANCH_CYCLES / 4);
+        }
+
+        if (!_check_same(ref, branches[i])) {
+            return false;
+        }
+        cpu_destroy(ref);
+    }
+
+    // clones of clones share in the same way, and outlive the CPU they came from
+    cpu_destroy(cpu);
+    Cpu6502 *twin = cpu_clone(branches[1], _init_system(&sys, 6));
+    ASSERT_EQ(true, (twin != NULL));
+    cpu_run_cycles(twin, BRANCH_CYCLES, 0);
+    cpu_run_cycles(branches[1], BRANCH_CYCLES, 0);
+    if (!_check_same(branches[1], twin)) {
+        return false;
+    }
+    ASSERT_EQ(true, (cpu_read_memory(twin, 0x0210) != cpu_read_memory(branches[2], 0x0210)));
+
+    cpu_destroy(twin);
+    for (size_t i = 0; i < BRANCHES; i++) {
+        cpu_destroy(branches[i]);
+    }
+
+    return true;
+}
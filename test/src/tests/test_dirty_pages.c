@@ -0,0 +1,183 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// Writes once to memory mapped in each of the ways a page can be.
+static const uint8_t g_program[] = {
+    0xA9, 0x11, // LDA #$11
+    0x8D, 0x00, 0x03, // STA $0300, RAM mirrored four times
+    0x8D, 0x05, 0x20, // STA $2005, the system interface
+    0x8D, 0x00, 0x30, // STA $3000, ignored
+    0x8D, 0x00, 0x40, // STA $4000, read-only so passed on to the system
+    0x8D, 0x00, 0x90, // STA $9000, copy-on-write
+    0x02, // KIL
+};
+
+// A loop hot enough to be translated to native code.
+static const uint8_t g_loop[] = {
+    0xA2, 0x00, // LDX #$00
+    0xE8, // loop: INX
+    0x8E, 0x00, 0x05, // STX $0500
+    0x4C, 0x02, 0x81, // JMP loop
+};
+
+typedef struct {
+    uint8_t ram[0x800];
+    uint8_t ignored[0x100];
+    uint8_t read_only[0x100];
+    uint8_t rom[0x8000];
+    uint8_t bus;
+} System;
+
+static uint8_t _mem_read(void *userdata, uint16_t addr) {
+    (void) userdata;
+    (void) addr;
+    return 0;
+}
+
+static void _mem_write(void *userdata, uint16_t addr, uint8_t val) {
+    (void) userdata;
+    (void) addr;
+    (void) val;
+}
+
+static uint8_t _bus_read(void *userdata) {
+    return ((System*) userdata)->bus;
+}
+
+static void _bus_write(void *userdata, uint8_t val) {
+    ((System*) userdata)->bus = val;
+}
+
+static bool _check_pages(Cpu6502 *cpu, uint64_t mark, const uint8_t *expected, size_t expected_count) {
+    uint8_t pages[0x100];
+    size_t count = cpu_dirty_pages_since(cpu, mark, pages);
+
+    ASSERT_EQ((unsigned int) expected_count, (unsigned int) count);
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_EQ(expected[i], pages[i]);
+    }
+
+    return true;
+}
+
+bool test_dirty_pages(void) {
+    static System sys;
+
+    memset(&sys, 0, sizeof(sys));
+    memcpy(sys.rom, g_program, sizeof(g_program));
+    memcpy(&sys.rom[0x100], g_loop, sizeof(g_loop));
+    sys.rom[0x7FFC] = 0x00;
+    sys.rom[0x7FFD] = 0x80;
+
+    CpuSystemInterface iface = {_mem_read, _mem_write, _bus_read, _bus_write, NULL, NULL, NULL, &sys};
+    Cpu6502 *cpu = cpu_create(iface);
+    ASSERT_EQ(true, (cpu != NULL));
+
+    for (uint16_t addr = 0; addr < 0x2000; addr += sizeof(sys.ram)) {
+        cpu_map_memory(cpu, addr, sizeof(sys.ram), sys.ram, CPU_PAGE_READ_WRITE);
+    }
+    cpu_map_memory(cpu, 0x3000, sizeof(sys.ignored), sys.ignored, CPU_PAGE_WRITE_IGNORE);
+    cpu_map_memory(cpu, 0x4000, sizeof(sys.read_only), sys.read_only, CPU_PAGE_READ_ONLY);
+    cpu_map_memory(cpu, 0x8000, sizeof(sys.rom), sys.rom, CPU_PAGE_COPY_ON_WRITE);
+    initialize_cpu(cpu, iface);
+
+    // everything but the dropped write counts, with the mirrors of the RAM
+    uint64_t first = cpu_mark_dirty_pages(cpu);
+    ASSERT_EQ(true, (first != 0));
+    cpu_run_cycles(cpu, 1000, CPU_STOP_KIL);
+    ASSERT_EQ(CPU_STOP_KIL, cpu_get_stop_reason(cpu));
+
+    static const uint8_t written[] = {0x03, 0x0B, 0x13, 0x1B, 0x20, 0x40, 0x90};
+    if (!_check_pages(cpu, first, written, sizeof(written))) {
+        return false;
+    }
+
+    // marks only cover what happens after them, and the earlier ones stay valid
+    uint64_t second = cpu_mark_dirty_pages(cpu);
+    ASSERT_EQ(true, (second > first));
+    if (!_check_pages(cpu, second, NULL, 0)) {
+        return false;
+    }
+
+    cpu_invalidate_code(cpu, 0x8080, 0x100);
+    cpu_map_memory(cpu, 0x5000, sizeof(sys.ignored), sys.ignored, CPU_PAGE_READ_WRITE);
+    static const uint8_t changed[] = {0x50, 0x80, 0x81};
+    if (!_check_pages(cpu, second, changed, sizeof(changed))) {
+        return false;
+    }
+    static const uint8_t all[] = {0x03, 0x0B, 0x13, 0x1B, 0x20, 0x40, 0x50, 0x80, 0x81, 0x90};
+    if (!_check_pages(cpu, first, all, sizeof(all))) {
+        return false;
+    }
+
+    uint8_t pages[0x100];
+    ASSERT_EQ(0x100, (unsigned int) cpu_dirty_pages_since(cpu, 0, pages));
+
+    // a clone inherits the marks, but the two are tracked separately from then on
+    Cpu6502 *clone = cpu_clone(cpu, iface);
+    ASSERT_EQ(true, (clone != NULL));
+    if (!_check_pages(clone, first, all, sizeof(all))) {
+        return false;
+    }
+    uint64_t clone_mark = cpu_mark_dirty_pages(clone);
+    cpu_write_memory(clone, 0x0700, 0x22);
+    static const uint8_t clone_written[] = {0x07, 0x0F, 0x17, 0x1F};
+    if (!_check_pages(clone, clone_mark, clone_written, sizeof(clone_written))) {
+        return false;
+    }
+    if (!_check_pages(cpu, clone_mark, NULL, 0)) {
+        return false;
+    }
+    cpu_destroy(clone);
+
+    // writes made by translated code are tracked as well
+    if (cpu_set_jit(cpu, 1)) {
+        initialize_cpu(cpu, iface);
+        cpu_get_registers(cpu)->pc = 0x8100;
+        cpu_run_instructions(cpu, 61);
+        ASSERT_EQ(0x8102, cpu_get_registers(cpu)->pc);
+
+        // whole iterations, so that none of the instructions are left to the interpreter
+        uint64_t native = cpu_mark_dirty_pages(cpu);
+        cpu_run_instructions(cpu, 30);
+
+        static const uint8_t loop_written[] = {0x05, 0x0D, 0x15, 0x1D};
+        if (!_check_pages(cpu, native, loop_written, sizeof(loop_written))) {
+            return false;
+        }
+    }
+
+    cpu_destroy(cpu);
+
+    return true;
+}
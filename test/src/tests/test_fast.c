@@ -0,0 +1,107 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+#include "c6502/instrs.h"
+
+#include <stdint.h>
+
+#define MAX_BOUNDARIES 4096
+
+extern Cpu6502 *g_test_cpu;
+
+typedef struct {
+    uint64_t cycle;
+    CpuRegisters regs;
+} Boundary;
+
+static Boundary g_boundaries[MAX_BOUNDARIES];
+
+// runs a program with both the cycle-stepped core and the instruction-granular mode and checks that they agree on the
+// register state at every instruction boundary visible to both, as well as on the cycle counts between them
+static bool _compare_modes(char *file_name) {
+    if (!load_cpu_test(file_name)) {
+        return false;
+    }
+
+    size_t boundary_count = 0;
+    uint64_t cycle = 0;
+    while (boundary_count < MAX_BOUNDARIES) {
+        cycle_cpu(g_test_cpu);
+        cycle++;
+
+        if (cpu_get_instruction_step(g_test_cpu) == 1) {
+            CpuRegisters *regs = cpu_get_registers(g_test_cpu);
+
+            // some of the programs eventually run off into garbage, so we stop before anything jams the CPU
+            if (decode_instr(system_memory_read(NULL, regs->pc))->mnemonic == KIL) {
+                break;
+            }
+
+            g_boundaries[boundary_count++] = (Boundary) {cycle, *regs};
+        }
+    }
+
+    if (!load_cpu_test(file_name)) {
+        return false;
+    }
+
+    cycle = 0;
+    for (size_t i = 0; i < boundary_count; i++) {
+        while (cycle < g_boundaries[i].cycle) {
+            cycle += cpu_step_instruction(g_test_cpu);
+        }
+
+        ASSERT_EQ((unsigned int) g_boundaries[i].cycle, (unsigned int) cycle);
+
+        CpuRegisters *regs = cpu_get_registers(g_test_cpu);
+        ASSERT_EQ(g_boundaries[i].regs.pc, regs->pc);
+        ASSERT_EQ(g_boundaries[i].regs.sp, regs->sp);
+        ASSERT_EQ(g_boundaries[i].regs.acc, regs->acc);
+        ASSERT_EQ(g_boundaries[i].regs.x, regs->x);
+        ASSERT_EQ(g_boundaries[i].regs.y, regs->y);
+        ASSERT_EQ(g_boundaries[i].regs.status.serial, regs->status.serial);
+    }
+
+    return true;
+}
+
+bool test_fast(void) {
+    char *programs[] = {
+        "addition.bin", "arithmetic.bin", "branch.bin", "interrupt.bin", "logic.bin",
+        "stack.bin", "status.bin", "store_load.bin", "subtraction.bin"
+    };
+
+    for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        if (!_compare_modes(programs[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,247 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define RUN_CYCLES 100000
+#define FRAME_CYCLES 2000
+#define NMI_CYCLES 10
+#define CHUNK_CYCLES 3001
+
+static Cpu6502 *g_cpu;
+static uint8_t g_ram[0x800];
+static uint8_t g_prg[0x8000];
+static unsigned int g_io_reads;
+
+// waits for the NMI handler to set $10, then counts the frame in $11-$12 and does some busywork
+static const uint8_t g_flag_program[] = {
+    0xA5, 0x10, // wait: LDA $10
+    0xF0, 0xFC, // BEQ wait
+    0xA9, 0x00, // LDA #$00
+    0x85, 0x10, // STA $10
+    0xE6, 0x11, // INC $11
+    0xD0, 0x02, // BNE work
+    0xE6, 0x12, // INC $12
+    0xA2, 0x20, // work: LDX #$20
+    0xCA, // loop: DEX
+    0xD0, 0xFD, // BNE loop
+    0x4C, 0x00, 0x80, // JMP wait
+};
+
+// spins on a JMP to itself while the NMI handler does the work
+static const uint8_t g_jmp_program[] = {
+    0x4C, 0x00, 0x80, // JMP *
+};
+
+// polls an I/O register
+static const uint8_t g_io_program[] = {
+    0xAD, 0x02, 0x20, // wait: LDA $2002
+    0x10, 0xFB, // BPL wait
+    0x4C, 0x00, 0x80, // JMP wait
+};
+
+static const uint8_t g_handler[] = {
+    0xE6, 0x10, // INC $10
+    0xE6, 0x13, // INC $13
+    0x40, // RTI
+};
+
+static uint8_t _mem_read(void *userdata, uint16_t addr) {
+    (void) userdata;
+    if (addr < sizeof(g_ram)) {
+        return g_ram[addr];
+    } else if (addr >= 0x8000) {
+        return g_prg[addr - 0x8000];
+    } else if (addr == 0x2002) {
+        g_io_reads++;
+    }
+
+    return 0;
+}
+
+static void _mem_write(void *userdata, uint16_t addr, uint8_t val) {
+    (void) userdata;
+    if (addr < sizeof(g_ram)) {
+        g_ram[addr] = val;
+    }
+}
+
+typedef enum {
+    MODE_CYCLES,
+    MODE_INSTRUCTIONS,
+    MODE_BLOCKS,
+    MODE_COUNT
+} RunMode;
+
+static bool _setup(const uint8_t *program, size_t len, bool idle_skip, bool polled) {
+    memset(g_ram, 0, sizeof(g_ram));
+    memset(g_prg, 0, sizeof(g_prg));
+    memcpy(g_prg, program, len);
+    memcpy(&g_prg[0x1000], g_handler, sizeof(g_handler));
+    g_prg[0x7FFA] = 0x00;
+    g_prg[0x7FFB] = 0x90;
+    g_prg[0x7FFC] = 0x00;
+    g_prg[0x7FFD] = 0x80;
+    g_io_reads = 0;
+
+    CpuSystemInterface iface = {
+            _mem_read,
+            _mem_write,
+            system_bus_read,
+            system_bus_write,
+            polled ? poll_nmi_line : NULL,
+            NULL,
+            NULL,
+            NULL
+    };
+    if (g_cpu != NULL) {
+        cpu_set_nmi_line(g_cpu, 1); // the last run may have ended in the middle of a pulse
+        initialize_cpu(g_cpu, iface);
+    } else if ((g_cpu = cpu_create(iface)) == NULL) {
+        return false;
+    }
+
+    cpu_map_memory(g_cpu, 0x0000, sizeof(g_ram), g_ram, CPU_PAGE_READ_WRITE);
+    cpu_map_memory(g_cpu, 0x8000, sizeof(g_prg), g_prg, CPU_PAGE_READ_ONLY);
+    cpu_set_block_cache(g_cpu, false);
+    cpu_set_idle_skip(g_cpu, idle_skip);
+
+    // an NMI at the start of every frame
+    uint64_t start = cpu_get_cycle_count(g_cpu);
+    for (uint64_t frame = FRAME_CYCLES; frame < RUN_CYCLES + FRAME_CYCLES; frame += FRAME_CYCLES) {
+        ASSERT_EQ(true, cpu_schedule_line_change(g_cpu, CPU_LINE_NMI, 0, start + frame));
+        ASSERT_EQ(true, cpu_schedule_line_change(g_cpu, CPU_LINE_NMI, 1, start + frame + NMI_CYCLES));
+    }
+
+    return true;
+}
+
+static void _run(RunMode mode) {
+    uint64_t end = cpu_get_cycle_count(g_cpu) + RUN_CYCLES;
+
+    while (cpu_get_cycle_count(g_cpu) < end) {
+        uint64_t left = end - cpu_get_cycle_count(g_cpu);
+        uint64_t chunk = left < CHUNK_CYCLES ? left : CHUNK_CYCLES;
+
+        if (mode != MODE_CYCLES) {
+            cpu_run_until_cycle(g_cpu, cpu_get_cycle_count(g_cpu) + chunk);
+        } else {
+            cpu_run_cycles(g_cpu, chunk, 0);
+        }
+    }
+}
+
+// runs the program with and without skipping idle loops, which must end up in exactly the same state
+static bool _check_program(const uint8_t *program, size_t len, RunMode mode) {
+    static uint8_t expected_ram[0x800];
+
+    if (!_setup(program, len, false, false)) {
+        return false;
+    }
+
+    uint64_t skipped_before = cpu_get_idle_skipped_cycles(g_cpu);
+    if (mode == MODE_BLOCKS) {
+        ASSERT_EQ(true, cpu_set_block_cache(g_cpu, true));
+    }
+    _run(mode);
+
+    uint64_t expected_cycle = cpu_get_cycle_count(g_cpu);
+    ASSERT_EQ(true, (cpu_get_idle_skipped_cycles(g_cpu) == skipped_before));
+    CpuRegisters expected_regs = *cpu_get_registers(g_cpu);
+    memcpy(expected_ram, g_ram, sizeof(g_ram));
+
+    if (!_setup(program, len, true, false)) {
+        return false;
+    }
+
+    skipped_before = cpu_get_idle_skipped_cycles(g_cpu);
+    if (mode == MODE_BLOCKS) {
+        ASSERT_EQ(true, cpu_set_block_cache(g_cpu, true));
+    }
+    _run(mode);
+
+    ASSERT_EQ((unsigned int) expected_cycle, (unsigned int) cpu_get_cycle_count(g_cpu));
+    ASSERT_EQ(0, memcmp(expected_ram, g_ram, sizeof(g_ram)));
+
+    if (!check_cpu_registers(g_cpu, &expected_regs)) {
+        return false;
+    }
+
+    // every frame before the end was handled, and most of the time was spent waiting
+    ASSERT_EQ(RUN_CYCLES / FRAME_CYCLES - 1, g_ram[0x13]);
+    ASSERT_EQ(true, (cpu_get_idle_skipped_cycles(g_cpu) - skipped_before > RUN_CYCLES / 2));
+
+    return true;
+}
+
+bool test_idle_skip(void) {
+    for (RunMode mode = MODE_CYCLES; mode < MODE_COUNT; mode++) {
+        if (!_check_program(g_flag_program, sizeof(g_flag_program), mode)
+                || !_check_program(g_jmp_program, sizeof(g_jmp_program), mode)) {
+            return false;
+        }
+    }
+
+    // I/O registers are only skipped over when marked as idempotent
+    if (!_setup(g_io_program, sizeof(g_io_program), true, false)) {
+        return false;
+    }
+
+    uint64_t skipped = cpu_get_idle_skipped_cycles(g_cpu);
+    _run(MODE_CYCLES);
+    ASSERT_EQ(true, (cpu_get_idle_skipped_cycles(g_cpu) == skipped));
+    unsigned int all_reads = g_io_reads;
+
+    if (!_setup(g_io_program, sizeof(g_io_program), true, false)) {
+        return false;
+    }
+
+    cpu_map_memory(g_cpu, 0x2000, 0x100, NULL, CPU_PAGE_IDEMPOTENT);
+    skipped = cpu_get_idle_skipped_cycles(g_cpu);
+    _run(MODE_CYCLES);
+    ASSERT_EQ(true, (cpu_get_idle_skipped_cycles(g_cpu) > skipped));
+    ASSERT_EQ(true, (g_io_reads < all_reads / 10));
+    cpu_unmap_memory(g_cpu, 0x2000, 0x100);
+
+    // nothing is known about lines which are polled
+    if (!_setup(g_flag_program, sizeof(g_flag_program), true, true)) {
+        return false;
+    }
+
+    skipped = cpu_get_idle_skipped_cycles(g_cpu);
+    _run(MODE_CYCLES);
+    ASSERT_EQ(true, (cpu_get_idle_skipped_cycles(g_cpu) == skipped));
+
+    cpu_destroy(g_cpu);
+    g_cpu = NULL;
+
+    return true;
+}
@@ -28,7 +28,7 @@
 
 #include "c6502/cpu.h"
 
-extern CpuRegisters g_cpu_regs;
+extern Cpu6502 *g_test_cpu;
 
 bool test_interrupt(void) {
     if (!load_cpu_test("interrupt.bin")) {
@@ -36,10 +36,10 @@ bool test_interrupt(void) {
     }
 
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.x);
-    ASSERT_EQ(1, g_cpu_regs.y);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->y);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
 
     return true;
 }
\ No newline at end of file
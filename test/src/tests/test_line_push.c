@@ -0,0 +1,174 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+
+#include <stdint.h>
+
+#define RUN_CYCLES 3000
+
+extern Cpu6502 *g_test_cpu;
+
+typedef struct {
+    uint64_t first;
+    uint64_t last;
+    uint8_t lines;
+} Pulse;
+
+// the lines are pulled low during these cycles
+static const Pulse g_pulses[] = {
+    {200, 260, CPU_LINE_IRQ},
+    {500, 503, CPU_LINE_NMI},
+    {900, 905, CPU_LINE_IRQ | CPU_LINE_NMI},
+    {1500, 1510, CPU_LINE_NMI},
+    {1800, 2100, CPU_LINE_IRQ},
+    {2400, 2402, CPU_LINE_RST},
+};
+
+#define PULSE_COUNT (sizeof(g_pulses) / sizeof(g_pulses[0]))
+
+static CpuRegisters g_history[RUN_CYCLES];
+
+static unsigned int _poll_line(uint8_t line) {
+    uint64_t cycle = cpu_get_cycle_count(g_test_cpu);
+    for (size_t i = 0; i < PULSE_COUNT; i++) {
+        if (cycle >= g_pulses[i].first && cycle <= g_pulses[i].last && (g_pulses[i].lines & line)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static unsigned int _poll_nmi(void *userdata) {
+    (void) userdata;
+    return _poll_line(CPU_LINE_NMI);
+}
+
+static unsigned int _poll_irq(void *userdata) {
+    (void) userdata;
+    return _poll_line(CPU_LINE_IRQ);
+}
+
+static unsigned int _poll_rst(void *userdata) {
+    (void) userdata;
+    return _poll_line(CPU_LINE_RST);
+}
+
+static bool _load(bool polled) {
+    if (!load_cpu_test("interrupt.bin")) {
+        return false;
+    }
+
+    CpuSystemInterface iface = {
+            system_memory_read,
+            system_memory_write,
+            system_bus_read,
+            system_bus_write,
+            polled ? _poll_nmi : NULL,
+            polled ? _poll_irq : NULL,
+            polled ? _poll_rst : NULL,
+            NULL
+    };
+    initialize_cpu(g_test_cpu, iface);
+
+    return true;
+}
+
+static void _set_lines(uint8_t lines, unsigned int level) {
+    if (lines & CPU_LINE_NMI) {
+        cpu_set_nmi_line(g_test_cpu, level);
+    }
+    if (lines & CPU_LINE_IRQ) {
+        cpu_set_irq_line(g_test_cpu, level);
+    }
+    if (lines & CPU_LINE_RST) {
+        cpu_set_rst_line(g_test_cpu, level);
+    }
+}
+
+static bool _schedule_lines(uint8_t lines, unsigned int level, uint64_t cycle) {
+    for (uint8_t line = CPU_LINE_NMI; line <= CPU_LINE_RST; line <<= 1) {
+        if ((lines & line) && !cpu_schedule_line_change(g_test_cpu, line, level, cycle)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool test_line_push(void) {
+    if (!_load(true)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < RUN_CYCLES; i++) {
+        cycle_cpu(g_test_cpu);
+        g_history[i] = *cpu_get_registers(g_test_cpu);
+    }
+
+    // setting the levels right before the cycles in which the callbacks would have returned them behaves the same
+    if (!_load(false)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < RUN_CYCLES; i++) {
+        uint64_t cycle = cpu_get_cycle_count(g_test_cpu);
+        for (size_t p = 0; p < PULSE_COUNT; p++) {
+            if (cycle == g_pulses[p].first) {
+                _set_lines(g_pulses[p].lines, 0);
+            } else if (cycle == g_pulses[p].last + 1) {
+                _set_lines(g_pulses[p].lines, 1);
+            }
+        }
+
+        cycle_cpu(g_test_cpu);
+        if (!check_test_registers(&g_history[i])) {
+            return false;
+        }
+    }
+
+    // and so does scheduling them all up front, even out of order
+    if (!_load(false)) {
+        return false;
+    }
+
+    for (size_t p = PULSE_COUNT; p-- > 0;) {
+        ASSERT_EQ(true, _schedule_lines(g_pulses[p].lines, 1, g_pulses[p].last + 1));
+        ASSERT_EQ(true, _schedule_lines(g_pulses[p].lines, 0, g_pulses[p].first));
+    }
+
+    for (size_t i = 0; i < RUN_CYCLES; i++) {
+        cycle_cpu(g_test_cpu);
+        if (!check_test_registers(&g_history[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,186 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+
+#include <stdint.h>
+
+#define RUN_CYCLES 3000
+#define MAX_EVENTS 32
+#define SPLIT_CYCLE 1000
+
+extern Cpu6502 *g_test_cpu;
+
+typedef struct {
+    uint64_t first;
+    uint64_t last;
+    uint8_t lines;
+} Pulse;
+
+// the host pulls the lines low during these cycles
+static const Pulse g_pulses[] = {
+    {200, 260, CPU_LINE_IRQ},
+    {500, 503, CPU_LINE_NMI},
+    {900, 905, CPU_LINE_IRQ | CPU_LINE_NMI},
+    {1500, 1510, CPU_LINE_NMI},
+    {1800, 2100, CPU_LINE_IRQ},
+    {2400, 2402, CPU_LINE_RST},
+};
+
+static unsigned int g_poll_count;
+static CpuRegisters g_history[RUN_CYCLES];
+static uint8_t g_memory[0x10000];
+
+static unsigned int _poll_line(uint8_t line) {
+    g_poll_count++;
+
+    uint64_t cycle = cpu_get_cycle_count(g_test_cpu);
+    for (size_t i = 0; i < sizeof(g_pulses) / sizeof(g_pulses[0]); i++) {
+        if (cycle >= g_pulses[i].first && cycle <= g_pulses[i].last && (g_pulses[i].lines & line)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static unsigned int _poll_nmi(void *userdata) {
+    (void) userdata;
+    return _poll_line(CPU_LINE_NMI);
+}
+
+static unsigned int _poll_irq(void *userdata) {
+    (void) userdata;
+    return _poll_line(CPU_LINE_IRQ);
+}
+
+static unsigned int _poll_rst(void *userdata) {
+    (void) userdata;
+    return _poll_line(CPU_LINE_RST);
+}
+
+static bool _load(void) {
+    if (!load_cpu_test("interrupt.bin")) {
+        return false;
+    }
+
+    CpuSystemInterface iface = {
+            system_memory_read,
+            system_memory_write,
+            system_bus_read,
+            system_bus_write,
+            _poll_nmi,
+            _poll_irq,
+            _poll_rst,
+            NULL
+    };
+    initialize_cpu(g_test_cpu, iface);
+
+    return true;
+}
+
+// advances the CPU by at least one cycle, either cycle by cycle or an instruction at a time
+static void _advance(bool step) {
+    if (step) {
+        cpu_step_instruction(g_test_cpu);
+    } else {
+        cycle_cpu(g_test_cpu);
+    }
+}
+
+static bool _test_replay(bool step) {
+    static CpuLineEvent events[MAX_EVENTS];
+
+    if (!_load()) {
+        return false;
+    }
+
+    cpu_record_lines(g_test_cpu, events, MAX_EVENTS);
+
+    uint8_t split_state[CPU_STATE_SIZE];
+    size_t split_index = 0;
+    size_t count = 0;
+    for (; cpu_get_cycle_count(g_test_cpu) < RUN_CYCLES; count++) {
+        if (split_index == 0 && cpu_get_cycle_count(g_test_cpu) >= SPLIT_CYCLE) {
+            cpu_save_state(g_test_cpu, split_state);
+            for (uint32_t addr = 0; addr < 0x10000; addr++) {
+                g_memory[addr] = system_memory_read(NULL, addr);
+            }
+            split_index = count;
+        }
+
+        _advance(step);
+        g_history[count] = *cpu_get_registers(g_test_cpu);
+    }
+
+    // only the changes are recorded, starting with the state found when recording started
+    size_t event_count = cpu_get_line_event_count(g_test_cpu);
+    ASSERT_EQ(true, (event_count <= MAX_EVENTS));
+    ASSERT_EQ(true, (event_count >= 2));
+    ASSERT_EQ(0, events[0].lines);
+    cpu_record_lines(g_test_cpu, NULL, 0);
+
+    // the replay reproduces the run without polling the host at all
+    if (!_load()) {
+        return false;
+    }
+
+    cpu_replay_lines(g_test_cpu, events, event_count);
+    g_poll_count = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        _advance(step);
+        if (!check_test_registers(&g_history[i])) {
+            return false;
+        }
+    }
+
+    ASSERT_EQ(0, g_poll_count);
+
+    // and it picks up from the right place after being sent back in time
+    for (uint32_t addr = 0; addr < 0x10000; addr++) {
+        system_memory_write(NULL, addr, g_memory[addr]);
+    }
+    cpu_load_state(g_test_cpu, split_state, CPU_STATE_SIZE);
+
+    for (size_t i = split_index; i < count; i++) {
+        _advance(step);
+        if (!check_test_registers(&g_history[i])) {
+            return false;
+        }
+    }
+
+    ASSERT_EQ(0, g_poll_count);
+    cpu_replay_lines(g_test_cpu, NULL, 0);
+
+    return true;
+}
+
+bool test_line_replay(void) {
+    return _test_replay(false) && _test_replay(true);
+}
@@ -28,7 +28,7 @@
 
 #include "c6502/cpu.h"
 
-extern CpuRegisters g_cpu_regs;
+extern Cpu6502 *g_test_cpu;
 
 bool test_logic(void) {
     if (!load_cpu_test("logic.bin")) {
@@ -38,177 +38,177 @@ bool test_logic(void) {
     // test AND
 
     pump_cpu();
-    ASSERT_EQ(12, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(12, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x80, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x80, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test EOR
 
     pump_cpu();
-    ASSERT_EQ(12, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(12, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0xCC, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0xCC, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test ORA
 
     pump_cpu();
-    ASSERT_EQ(0x3F, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x3F, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0xFF, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0xFF, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test ASL
 
     pump_cpu();
-    ASSERT_EQ(14, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(14, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0xFE, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0xFE, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(2, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(2, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test ASL (memory)
 
     pump_cpu();
-    ASSERT_EQ(14, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(14, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0xFE, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0xFE, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test LSR
 
     pump_cpu();
-    ASSERT_EQ(3, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(3, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(3, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(3, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test ROL
 
     pump_cpu();
-    ASSERT_EQ(14, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(14, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(15, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(15, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0xFF, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0xFF, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(3, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(3, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test LSR
 
     pump_cpu();
-    ASSERT_EQ(3, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(3, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x83, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x83, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x83, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x83, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     return true;
 }
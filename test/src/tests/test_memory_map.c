@@ -0,0 +1,68 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+
+#include <string.h>
+
+extern Cpu6502 *g_test_cpu;
+
+bool test_memory_map(void) {
+    static uint8_t page_2[0x100];
+    static uint8_t page_3[0x100];
+
+    if (!load_cpu_test("branch.bin")) {
+        return false;
+    }
+
+    memset(page_2, 0, sizeof(page_2));
+    memset(page_3, 0, sizeof(page_3));
+
+    ASSERT_EQ(false, cpu_map_memory(g_test_cpu, 0x0210, 0x100, page_2, CPU_PAGE_READ_WRITE));
+    ASSERT_EQ(true, cpu_map_memory(g_test_cpu, 0x0200, 0x100, page_2, CPU_PAGE_READ_WRITE));
+    ASSERT_EQ(true, cpu_map_memory(g_test_cpu, 0x0300, 0x100, page_3, CPU_PAGE_WRITE_IGNORE));
+
+    // the indirect jump target is written to and read back from the mapped page without touching system RAM
+    pump_cpu();
+    ASSERT_EQ(0x00, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(0x11, page_2[0x50]);
+    ASSERT_EQ(0x80, page_2[0x51]);
+    ASSERT_EQ(0x00, system_memory_read(NULL, 0x0250));
+
+    // the write to $0300 is dropped while the page boundary bug still reads $0200 from the mapped page
+    pump_cpu();
+    ASSERT_EQ(0x02, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(0x00, page_3[0x00]);
+    ASSERT_EQ(0x00, system_memory_read(NULL, 0x0300));
+    ASSERT_EQ(0x28, page_2[0xFF]);
+    ASSERT_EQ(0x80, page_2[0x00]);
+
+    cpu_unmap_memory(g_test_cpu, 0x0200, 0x200);
+
+    return true;
+}
@@ -0,0 +1,60 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+
+#include "c6502/instrs.h"
+
+bool test_opcode_info(void) {
+    // the precomputed table must agree with the slow-path classification for every opcode
+    for (unsigned int opcode = 0; opcode <= 0xFF; opcode++) {
+        const Instruction *instr = decode_instr(opcode);
+        const OpcodeInfo *info = get_opcode_info(opcode);
+        InstructionType type = get_instr_type(instr->mnemonic);
+
+        ASSERT_EQ(instr->mnemonic, info->mnemonic);
+        ASSERT_EQ(instr->addr_mode, info->addr_mode);
+        ASSERT_EQ(type, info->type);
+        ASSERT_EQ(get_instr_len(instr), info->len);
+
+        bool penalty = type == INS_BRANCH
+                || (type == INS_R && (instr->addr_mode == ABX || instr->addr_mode == ABY || instr->addr_mode == IZY));
+        ASSERT_EQ(penalty, info->page_penalty);
+        ASSERT_EQ(penalty, can_incur_page_boundary_penalty(opcode));
+    }
+
+    // spot-check base cycle counts
+    ASSERT_EQ(7, get_opcode_info(0x00)->cycles); // BRK
+    ASSERT_EQ(6, get_opcode_info(0x20)->cycles); // JSR
+    ASSERT_EQ(5, get_opcode_info(0x6C)->cycles); // JMP (ind)
+    ASSERT_EQ(2, get_opcode_info(0xA9)->cycles); // LDA #imm
+    ASSERT_EQ(4, get_opcode_info(0xBD)->cycles); // LDA abs,x
+    ASSERT_EQ(5, get_opcode_info(0x9D)->cycles); // STA abs,x
+    ASSERT_EQ(7, get_opcode_info(0xFE)->cycles); // INC abs,x
+    ASSERT_EQ(5, get_opcode_info(0xB1)->cycles); // LDA (ind),y
+    ASSERT_EQ(8, get_opcode_info(0xD3)->cycles); // DCP (ind),y
+
+    return true;
+}
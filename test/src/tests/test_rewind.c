@@ -0,0 +1,174 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+#include "c6502/rewind.h"
+
+#include <stdint.h>
+
+#define RUN_CYCLES 3000
+#define KEYFRAME_INTERVAL 64
+#define SEEK_STRIDE 37 // co-prime with the interval, so that seeks land at every offset from a keyframe
+
+extern Cpu6502 *g_test_cpu;
+
+typedef struct {
+    CpuRegisters regs;
+    uint32_t ram_hash;
+} CycleState;
+
+static CycleState g_history[RUN_CYCLES + 1]; // indexed by the cycles run since the start of the program
+static uint64_t g_start_cycle;
+
+static CycleState _capture(void) {
+    uint32_t hash = 2166136261u;
+    for (uint16_t addr = 0; addr < 0x800; addr++) {
+        hash = (hash ^ system_memory_read(NULL, addr)) * 16777619u;
+    }
+
+    return (CycleState) {*cpu_get_registers(g_test_cpu), hash};
+}
+
+static bool _check_state(uint64_t offset) {
+    ASSERT_EQ((unsigned int) (g_start_cycle + offset), (unsigned int) cpu_get_cycle_count(g_test_cpu));
+
+    CycleState expected = g_history[offset];
+    CycleState actual = _capture();
+    ASSERT_EQ(expected.regs.pc, actual.regs.pc);
+    ASSERT_EQ(expected.regs.sp, actual.regs.sp);
+    ASSERT_EQ(expected.regs.acc, actual.regs.acc);
+    ASSERT_EQ(expected.regs.x, actual.regs.x);
+    ASSERT_EQ(expected.regs.y, actual.regs.y);
+    ASSERT_EQ(expected.regs.status.serial, actual.regs.status.serial);
+    ASSERT_EQ(expected.ram_hash, actual.ram_hash);
+
+    return true;
+}
+
+// runs the program cycle by cycle, recording the history and keeping the rewind buffer up to date
+static bool _record(RewindBuffer *rewind) {
+    g_start_cycle = cpu_get_cycle_count(g_test_cpu);
+    g_history[0] = _capture();
+    ASSERT_EQ(true, rewind_update(rewind));
+
+    for (uint64_t offset = 1; offset <= RUN_CYCLES; offset++) {
+        cycle_cpu(g_test_cpu);
+        g_history[offset] = _capture();
+        ASSERT_EQ(true, rewind_update(rewind));
+    }
+
+    return true;
+}
+
+static bool _test_program(char *file_name) {
+    if (!load_cpu_test(file_name)) {
+        return false;
+    }
+
+    map_system_memory();
+
+    RewindBuffer *rewind = rewind_create(g_test_cpu, KEYFRAME_INTERVAL, SIZE_MAX);
+    ASSERT_EQ(true, (rewind != NULL));
+
+    if (!_record(rewind)) {
+        return false;
+    }
+
+    // seeking backwards through the whole run, then replaying a bit past the target each time
+    for (uint64_t target = RUN_CYCLES - SEEK_STRIDE / 2; target >= SEEK_STRIDE; target -= SEEK_STRIDE) {
+        ASSERT_EQ(true, rewind_seek(rewind, g_start_cycle + target));
+        if (!_check_state(target)) {
+            return false;
+        }
+
+        cpu_run_cycles(g_test_cpu, SEEK_STRIDE / 2, 0);
+        if (!_check_state(target + SEEK_STRIDE / 2)) {
+            return false;
+        }
+    }
+
+    uint64_t offset = cpu_get_cycle_count(g_test_cpu) - g_start_cycle;
+    ASSERT_EQ(true, rewind_cycles(rewind, 5));
+    if (!_check_state(offset - 5)) {
+        return false;
+    }
+
+    // neither the future nor the time before the first keyframe can be sought to
+    ASSERT_EQ(false, rewind_seek(rewind, g_start_cycle + RUN_CYCLES));
+    ASSERT_EQ(false, rewind_seek(rewind, g_start_cycle - 1));
+
+    rewind_destroy(rewind);
+    cpu_unmap_memory(g_test_cpu, 0x0000, 0x10000);
+
+    return true;
+}
+
+// a small budget drops the oldest keyframes, after which they cannot be sought to any more
+static bool _test_budget(void) {
+    if (!load_cpu_test("stack.bin")) {
+        return false;
+    }
+
+    map_system_memory();
+
+    size_t budget = 24 * 1024; // the RAM and program image takes up 18 KiB of this
+    RewindBuffer *rewind = rewind_create(g_test_cpu, KEYFRAME_INTERVAL, budget);
+    ASSERT_EQ(true, (rewind != NULL));
+
+    if (!_record(rewind)) {
+        return false;
+    }
+
+    ASSERT_EQ(true, (rewind_get_memory_usage(rewind) <= budget));
+    ASSERT_EQ(true, (rewind_get_keyframe_count(rewind) > 1));
+    ASSERT_EQ(true, (rewind_get_oldest_cycle(rewind) > g_start_cycle));
+    ASSERT_EQ(false, rewind_seek(rewind, g_start_cycle));
+
+    uint64_t oldest = rewind_get_oldest_cycle(rewind);
+    ASSERT_EQ(true, rewind_seek(rewind, oldest));
+    if (!_check_state(oldest - g_start_cycle)) {
+        return false;
+    }
+
+    rewind_destroy(rewind);
+    cpu_unmap_memory(g_test_cpu, 0x0000, 0x10000);
+
+    return true;
+}
+
+bool test_rewind(void) {
+    char *programs[] = {"arithmetic.bin", "stack.bin", "store_load.bin"};
+
+    for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        if (!_test_program(programs[i])) {
+            return false;
+        }
+    }
+
+    return _test_budget();
+}
@@ -0,0 +1,168 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+#include "c6502/rom_image.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define IMAGE_PATH "c6502_test.bin"
+#define IMAGE_SIZE 0x200
+
+// Writes to the ROM and reads the values back through its mirrors, which are $200 bytes apart.
+static const uint8_t g_program[] = {
+    0xA9, 0x5A, // LDA #$5A
+    0x8D, 0x00, 0x81, // STA $8100
+    0xAD, 0x00, 0x83, // LDA $8300
+    0x85, 0x00, // STA $00
+    0xEE, 0x10, 0x81, // INC $8110
+    0xAD, 0x10, 0x85, // LDA $8510
+    0x85, 0x01, // STA $01
+    0x02, // KIL
+};
+
+typedef struct {
+    uint8_t ram[0x100];
+    uint8_t bus;
+    unsigned int rom_writes; // writes to the ROM which reached the system
+} System;
+
+static uint8_t _mem_read(void *userdata, uint16_t addr) {
+    System *sys = userdata;
+    return addr < 0x100 ? sys->ram[addr] : 0;
+}
+
+static void _mem_write(void *userdata, uint16_t addr, uint8_t val) {
+    System *sys = userdata;
+    if (addr < 0x100) {
+        sys->ram[addr] = val;
+    } else if (addr >= 0x8000) {
+        sys->rom_writes++;
+    }
+}
+
+static uint8_t _bus_read(void *userdata) {
+    return ((System*) userdata)->bus;
+}
+
+static void _bus_write(void *userdata, uint8_t val) {
+    ((System*) userdata)->bus = val;
+}
+
+static bool _write_image(void) {
+    uint8_t image[IMAGE_SIZE] = {0};
+    memcpy(image, g_program, sizeof(g_program));
+    image[0x110] = 0x41;
+    image[0x1FC] = 0x00;
+    image[0x1FD] = 0x80;
+
+    FILE *file = fopen(IMAGE_PATH, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool written = fwrite(image, sizeof(image), 1, file) == 1;
+
+    return fclose(file) == 0 && written;
+}
+
+static Cpu6502 *_create_cpu(System *sys, const RomImage *image) {
+    memset(sys, 0, sizeof(System));
+
+    CpuSystemInterface iface = {_mem_read, _mem_write, _bus_read, _bus_write, NULL, NULL, NULL, sys};
+    Cpu6502 *cpu = cpu_create(iface);
+    if (cpu == NULL) {
+        return NULL;
+    }
+
+    // the CPU was reset before the image was mapped
+    rom_image_map(image, cpu, 0x8000, 0x8000);
+    initialize_cpu(cpu, iface);
+
+    return cpu;
+}
+
+static bool _check_run(Cpu6502 *cpu, System *sys) {
+    cpu_run_cycles(cpu, 1000, CPU_STOP_KIL);
+    ASSERT_EQ(CPU_STOP_KIL, cpu_get_stop_reason(cpu));
+
+    ASSERT_EQ(0x5A, sys->ram[0x00]);
+    ASSERT_EQ(0x42, sys->ram[0x01]);
+    ASSERT_EQ(0x5A, cpu_read_memory(cpu, 0xFF00));
+    ASSERT_EQ(0x42, cpu_read_memory(cpu, 0xFF10));
+    ASSERT_EQ(0, sys->rom_writes);
+
+    return true;
+}
+
+bool test_rom_image(void) {
+    static System sys_a;
+    static System sys_b;
+
+    ASSERT_EQ(true, (rom_image_open("c6502_missing.bin") == NULL));
+
+    ASSERT_EQ(true, _write_image());
+    RomImage *image = rom_image_open(IMAGE_PATH);
+    ASSERT_EQ(true, (image != NULL));
+    ASSERT_EQ(IMAGE_SIZE, (unsigned int) rom_image_size(image));
+    ASSERT_EQ(0xA9, rom_image_data(image)[0]);
+
+    Cpu6502 *cpu_a = _create_cpu(&sys_a, image);
+    Cpu6502 *cpu_b = _create_cpu(&sys_b, image);
+    ASSERT_EQ(true, (cpu_a != NULL && cpu_b != NULL));
+    ASSERT_EQ(false, rom_image_map(image, cpu_a, 0x8010, 0x100));
+
+    // the writes of one CPU are seen through all of its mirrors but not by the image or the other CPU
+    if (!_check_run(cpu_a, &sys_a)) {
+        return false;
+    }
+    ASSERT_EQ(0x00, rom_image_data(image)[0x100]);
+    ASSERT_EQ(0x41, rom_image_data(image)[0x110]);
+    ASSERT_EQ(0x00, cpu_read_memory(cpu_b, 0x8100));
+    ASSERT_EQ(0x41, cpu_read_memory(cpu_b, 0x8110));
+
+    // the same goes for code run from the block cache
+    cpu_set_block_cache(cpu_b, true);
+    if (!_check_run(cpu_b, &sys_b)) {
+        return false;
+    }
+    cpu_write_memory(cpu_b, 0x8100, 0x77);
+    ASSERT_EQ(0x77, cpu_read_memory(cpu_b, 0xA100));
+    ASSERT_EQ(0x5A, cpu_read_memory(cpu_a, 0xA100));
+
+    // pages which were never written still come from the image
+    ASSERT_EQ(0xA9, cpu_read_memory(cpu_a, 0xE000));
+
+    cpu_destroy(cpu_a);
+    cpu_destroy(cpu_b);
+    rom_image_close(image);
+    remove(IMAGE_PATH);
+
+    return true;
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+#include "c6502/instrs.h"
+
+extern Cpu6502 *g_test_cpu;
+
+bool test_run(void) {
+    if (!load_cpu_test("branch.bin")) {
+        return false;
+    }
+
+    // the budget is respected when no stop condition applies
+    ASSERT_EQ(5, (unsigned int) cpu_run_cycles(g_test_cpu, 5, 0));
+    ASSERT_EQ(CPU_STOP_NONE, cpu_get_stop_reason(g_test_cpu));
+
+    // stop right after the opcode at $8012 (LDX #$00) is fetched
+    cpu_set_stop_pc(g_test_cpu, 0x8012);
+    cpu_run_cycles(g_test_cpu, 1000, CPU_STOP_PC);
+    ASSERT_EQ(CPU_STOP_PC, cpu_get_stop_reason(g_test_cpu));
+    ASSERT_EQ(0x8013, cpu_get_registers(g_test_cpu)->pc);
+    ASSERT_EQ(LDX, cpu_get_current_instruction(g_test_cpu)->mnemonic);
+    ASSERT_EQ(2, cpu_get_instruction_step(g_test_cpu));
+
+    // breakpoints take precedence over a stop PC that isn't reached first
+    cpu_set_stop_pc(g_test_cpu, 0x802B);
+    cpu_set_breakpoint(g_test_cpu, 0x8028, true);
+    cpu_run_cycles(g_test_cpu, 1000, CPU_STOP_PC | CPU_STOP_BREAKPOINT);
+    ASSERT_EQ(CPU_STOP_BREAKPOINT, cpu_get_stop_reason(g_test_cpu));
+    ASSERT_EQ(0x8029, cpu_get_registers(g_test_cpu)->pc);
+    ASSERT_EQ(0x00, cpu_get_registers(g_test_cpu)->x);
+
+    // the stop PC is reached next, and the remainder of the LDX has been executed in the meantime
+    cpu_run_cycles(g_test_cpu, 1000, CPU_STOP_PC | CPU_STOP_BREAKPOINT);
+    ASSERT_EQ(CPU_STOP_PC, cpu_get_stop_reason(g_test_cpu));
+    ASSERT_EQ(0x02, cpu_get_registers(g_test_cpu)->x);
+
+    cpu_clear_breakpoints(g_test_cpu);
+
+    return true;
+}
@@ -0,0 +1,185 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define RESUME_CYCLES 200
+#define MAX_SPLIT_CYCLE 600
+#define SPLIT_STRIDE 7 // co-prime with every instruction length, so that splits land on every cycle of an instruction
+
+// offsets into the saved state, see cpu_save_state()
+#define STATE_INSTR_CYCLE 38
+#define STATE_LAST_OPCODE 39
+#define STATE_CUR_INTERRUPT 44
+#define STATE_FLAGS 46
+#define STATE_HAS_INSTR 0x20
+
+extern Cpu6502 *g_test_cpu;
+
+typedef struct {
+    uint64_t cycle;
+    uint8_t step;
+    CpuRegisters regs;
+} CycleState;
+
+static CycleState g_expected[RESUME_CYCLES];
+static uint8_t g_memory[0x10000];
+
+// checks that a state with the byte at offset replaced by val is rejected
+static bool _check_rejected(const uint8_t *state, size_t offset, uint8_t val) {
+    uint8_t bad[CPU_STATE_SIZE];
+    memcpy(bad, state, CPU_STATE_SIZE);
+    bad[offset] = val;
+
+    bool loaded = cpu_load_state(g_test_cpu, bad, CPU_STATE_SIZE);
+    ASSERT_EQ(false, loaded);
+
+    return true;
+}
+
+static CycleState _capture(void) {
+    return (CycleState) {cpu_get_cycle_count(g_test_cpu), cpu_get_instruction_step(g_test_cpu),
+            *cpu_get_registers(g_test_cpu)};
+}
+
+// saves the state after split_cycle cycles, then checks that a freshly reset CPU which loads it carries on exactly like
+// the original one
+static bool _check_resume(char *file_name, uint64_t split_cycle) {
+    if (!load_cpu_test(file_name)) {
+        return false;
+    }
+
+    cpu_run_cycles(g_test_cpu, split_cycle, 0);
+
+    uint8_t state[CPU_STATE_SIZE];
+    cpu_save_state(g_test_cpu, state);
+    for (uint32_t addr = 0; addr < 0x10000; addr++) {
+        g_memory[addr] = system_memory_read(NULL, addr);
+    }
+
+    for (size_t i = 0; i < RESUME_CYCLES; i++) {
+        cycle_cpu(g_test_cpu);
+        g_expected[i] = _capture();
+    }
+
+    if (!load_cpu_test(file_name)) {
+        return false;
+    }
+
+    for (uint32_t addr = 0; addr < 0x10000; addr++) {
+        system_memory_write(NULL, addr, g_memory[addr]);
+    }
+
+    bool loaded = cpu_load_state(g_test_cpu, state, sizeof(state));
+    ASSERT_EQ(true, loaded);
+
+    // a loaded state saves back to the same bytes
+    uint8_t resaved[CPU_STATE_SIZE];
+    cpu_save_state(g_test_cpu, resaved);
+    bool same = memcmp(state, resaved, CPU_STATE_SIZE) == 0;
+    ASSERT_EQ(true, same);
+
+    for (size_t i = 0; i < RESUME_CYCLES; i++) {
+        cycle_cpu(g_test_cpu);
+        CycleState actual = _capture();
+
+        ASSERT_EQ((unsigned int) g_expected[i].cycle, (unsigned int) actual.cycle);
+        ASSERT_EQ(g_expected[i].step, actual.step);
+        ASSERT_EQ(g_expected[i].regs.pc, actual.regs.pc);
+        ASSERT_EQ(g_expected[i].regs.sp, actual.regs.sp);
+        ASSERT_EQ(g_expected[i].regs.acc, actual.regs.acc);
+        ASSERT_EQ(g_expected[i].regs.x, actual.regs.x);
+        ASSERT_EQ(g_expected[i].regs.y, actual.regs.y);
+        ASSERT_EQ(g_expected[i].regs.status.serial, actual.regs.status.serial);
+    }
+
+    return true;
+}
+
+bool test_save_state(void) {
+    char *programs[] = {"arithmetic.bin", "branch.bin", "interrupt.bin", "stack.bin"};
+
+    for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        for (uint64_t split = 0; split < MAX_SPLIT_CYCLE; split += SPLIT_STRIDE) {
+            if (!_check_resume(programs[i], split)) {
+                return false;
+            }
+        }
+    }
+
+    // states from other versions or of the wrong size are rejected
+    uint8_t state[CPU_STATE_SIZE];
+    cpu_save_state(g_test_cpu, state);
+
+    bool loaded = cpu_load_state(g_test_cpu, state, CPU_STATE_SIZE - 1);
+    ASSERT_EQ(false, loaded);
+
+    state[4]++;
+    loaded = cpu_load_state(g_test_cpu, state, CPU_STATE_SIZE);
+    ASSERT_EQ(false, loaded);
+
+    // states which cannot occur are rejected without touching the CPU
+    if (!load_cpu_test("arithmetic.bin")) {
+        return false;
+    }
+
+    cpu_run_cycles(g_test_cpu, 20, 0);
+    cpu_save_state(g_test_cpu, state);
+    uint64_t cycle = cpu_get_cycle_count(g_test_cpu);
+
+    // no cycle 0 in any instruction
+    if (!_check_rejected(state, STATE_INSTR_CYCLE, 0)) {
+        return false;
+    }
+
+    // past the opcode fetch with neither an instruction nor an interrupt sequence
+    state[STATE_CUR_INTERRUPT] = 0;
+    state[STATE_FLAGS] &= ~STATE_HAS_INSTR;
+    if (!_check_rejected(state, STATE_INSTR_CYCLE, 2)) {
+        return false;
+    }
+
+    // past the last cycle of an LDA #imm, which takes two
+    state[STATE_FLAGS] |= STATE_HAS_INSTR;
+    state[STATE_LAST_OPCODE] = 0xA9;
+    if (!_check_rejected(state, STATE_INSTR_CYCLE, 3)) {
+        return false;
+    }
+
+    ASSERT_EQ((unsigned int) cycle, (unsigned int) cpu_get_cycle_count(g_test_cpu));
+
+    // its second cycle is fine
+    state[STATE_INSTR_CYCLE] = 2;
+    loaded = cpu_load_state(g_test_cpu, state, CPU_STATE_SIZE);
+    ASSERT_EQ(true, loaded);
+
+    return true;
+}
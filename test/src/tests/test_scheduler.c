@@ -0,0 +1,218 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+#include "c6502/scheduler.h"
+
+#include <stdint.h>
+
+#define TIMER_PERIOD 100
+#define IRQ_PERIOD 700
+#define IRQ_LENGTH 20
+#define RUN_CYCLES 5000
+#define MAX_OVERSHOOT 200 // a block of translated code can run well past the event
+
+extern Cpu6502 *g_test_cpu;
+
+typedef struct {
+    Scheduler *scheduler;
+    unsigned int calls;
+    uint64_t max_lateness;
+    bool exact;
+} Timer;
+
+static char g_order[4];
+static size_t g_order_count;
+static CpuRegisters g_irq_regs[RUN_CYCLES / IRQ_PERIOD + 1];
+static size_t g_irq_count;
+
+static void _timer_tick(void *userdata, uint64_t due_cycle) {
+    Timer *timer = userdata;
+    uint64_t now = cpu_get_cycle_count(g_test_cpu);
+
+    timer->calls++;
+    timer->exact &= now == due_cycle;
+    if (now - due_cycle > timer->max_lateness) {
+        timer->max_lateness = now - due_cycle;
+    }
+
+    scheduler_add_event(timer->scheduler, due_cycle + TIMER_PERIOD, _timer_tick, timer);
+}
+
+static void _record_order(void *userdata, uint64_t due_cycle) {
+    (void) due_cycle;
+    g_order[g_order_count++] = *(char*) userdata;
+}
+
+static void _release_irq(void *userdata, uint64_t due_cycle) {
+    (void) userdata;
+    (void) due_cycle;
+    cpu_set_irq_line(g_test_cpu, 1);
+}
+
+static void _raise_irq(void *userdata, uint64_t due_cycle) {
+    Scheduler *scheduler = userdata;
+
+    g_irq_regs[g_irq_count++] = *cpu_get_registers(g_test_cpu);
+    cpu_set_irq_line(g_test_cpu, 0);
+
+    scheduler_add_event(scheduler, due_cycle + IRQ_LENGTH, _release_irq, NULL);
+    scheduler_add_event(scheduler, due_cycle + IRQ_PERIOD, _raise_irq, scheduler);
+}
+
+static bool _test_timer(bool by_instruction) {
+    if (!load_cpu_test("arithmetic.bin")) {
+        return false;
+    }
+
+    map_system_memory();
+    cpu_set_block_cache(g_test_cpu, by_instruction);
+
+    Scheduler *scheduler = scheduler_create(g_test_cpu);
+    ASSERT_EQ(true, (scheduler != NULL));
+
+    uint64_t start = cpu_get_cycle_count(g_test_cpu);
+    Timer timer = {scheduler, 0, 0, true};
+    scheduler_add_event(scheduler, start + TIMER_PERIOD, _timer_tick, &timer);
+
+    // the budgets do not line up with the events
+    uint64_t run = 0;
+    while (run < RUN_CYCLES) {
+        run += by_instruction ? scheduler_run_instructions(scheduler, 777) : scheduler_run_cycles(scheduler, 777, 0);
+    }
+
+    ASSERT_EQ(true, (run >= RUN_CYCLES));
+    ASSERT_EQ((unsigned int) (run / TIMER_PERIOD), timer.calls);
+    ASSERT_EQ(1, (unsigned int) scheduler_get_event_count(scheduler));
+    ASSERT_EQ((unsigned int) (start + (timer.calls + 1) * TIMER_PERIOD),
+            (unsigned int) scheduler_get_next_event_cycle(scheduler));
+
+    if (by_instruction) {
+        ASSERT_EQ(true, (timer.max_lateness < MAX_OVERSHOOT));
+    } else {
+        ASSERT_EQ(true, timer.exact);
+        ASSERT_EQ(RUN_CYCLES + 777 - RUN_CYCLES % 777, (unsigned int) run);
+    }
+
+    scheduler_destroy(scheduler);
+    cpu_set_block_cache(g_test_cpu, false);
+    cpu_unmap_memory(g_test_cpu, 0x0000, 0x10000);
+
+    return true;
+}
+
+// events due on the same cycle are serviced in the order they were added, and cancelled ones not at all
+static bool _test_order(void) {
+    if (!load_cpu_test("arithmetic.bin")) {
+        return false;
+    }
+
+    Scheduler *scheduler = scheduler_create(g_test_cpu);
+    ASSERT_EQ(true, (scheduler != NULL));
+
+    static char names[] = "abcd";
+    uint64_t at = cpu_get_cycle_count(g_test_cpu) + 50;
+    scheduler_add_event(scheduler, at + 1, _record_order, &names[3]);
+    scheduler_add_event(scheduler, at, _record_order, &names[0]);
+    uint64_t cancelled = scheduler_add_event(scheduler, at, _record_order, &names[1]);
+    scheduler_add_event(scheduler, at, _record_order, &names[2]);
+
+    ASSERT_EQ(true, scheduler_cancel_event(scheduler, cancelled));
+    ASSERT_EQ(false, scheduler_cancel_event(scheduler, cancelled));
+    ASSERT_EQ(3, (unsigned int) scheduler_get_event_count(scheduler));
+
+    g_order_count = 0;
+    scheduler_run_cycles(scheduler, 100, 0);
+
+    ASSERT_EQ(3, (unsigned int) g_order_count);
+    ASSERT_EQ('a', g_order[0]);
+    ASSERT_EQ('c', g_order[1]);
+    ASSERT_EQ('d', g_order[2]);
+    ASSERT_EQ(true, (scheduler_get_next_event_cycle(scheduler) == UINT64_MAX));
+
+    scheduler_destroy(scheduler);
+
+    return true;
+}
+
+// a peripheral driving the IRQ line from events behaves exactly as one ticked along with every cycle
+static bool _test_lockstep(void) {
+    if (!load_cpu_test("interrupt.bin")) {
+        return false;
+    }
+
+    uint64_t start = cpu_get_cycle_count(g_test_cpu);
+    CpuRegisters expected[RUN_CYCLES / IRQ_PERIOD + 1];
+    size_t expected_count = 0;
+
+    for (uint64_t cycle = start; cycle < start + RUN_CYCLES; cycle++) {
+        uint64_t offset = cycle - start;
+        if (offset % IRQ_PERIOD == 0 && offset != 0) {
+            expected[expected_count++] = *cpu_get_registers(g_test_cpu);
+            cpu_set_irq_line(g_test_cpu, 0);
+        } else if (offset % IRQ_PERIOD == IRQ_LENGTH && offset > IRQ_PERIOD) {
+            cpu_set_irq_line(g_test_cpu, 1);
+        }
+
+        cycle_cpu(g_test_cpu);
+    }
+
+    CpuRegisters final = *cpu_get_registers(g_test_cpu);
+    cpu_set_irq_line(g_test_cpu, 1);
+
+    if (!load_cpu_test("interrupt.bin")) {
+        return false;
+    }
+
+    Scheduler *scheduler = scheduler_create(g_test_cpu);
+    ASSERT_EQ(true, (scheduler != NULL));
+
+    g_irq_count = 0;
+    scheduler_add_event(scheduler, start + IRQ_PERIOD, _raise_irq, scheduler);
+    ASSERT_EQ(RUN_CYCLES, (unsigned int) scheduler_run_cycles(scheduler, RUN_CYCLES, 0));
+
+    ASSERT_EQ((unsigned int) expected_count, (unsigned int) g_irq_count);
+    for (size_t i = 0; i < expected_count; i++) {
+        ASSERT_EQ(expected[i].pc, g_irq_regs[i].pc);
+        ASSERT_EQ(expected[i].sp, g_irq_regs[i].sp);
+        ASSERT_EQ(expected[i].status.serial, g_irq_regs[i].status.serial);
+    }
+
+    if (!check_test_registers(&final)) {
+        return false;
+    }
+
+    scheduler_destroy(scheduler);
+    cpu_set_irq_line(g_test_cpu, 1);
+
+    return true;
+}
+
+bool test_scheduler(void) {
+    return _test_timer(false) && _test_timer(true) && _test_order() && _test_lockstep();
+}
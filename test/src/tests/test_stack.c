@@ -28,7 +28,7 @@
 
 #include "c6502/cpu.h"
 
-extern CpuRegisters g_cpu_regs;
+extern Cpu6502 *g_test_cpu;
 
 bool test_stack(void) {
     if (!load_cpu_test("stack.bin")) {
@@ -36,22 +36,22 @@ bool test_stack(void) {
     }
 
     pump_cpu();
-    ASSERT_EQ(0x01, g_cpu_regs.acc);
-    ASSERT_EQ(0xFD, g_cpu_regs.x);
-    ASSERT_EQ(0x02, g_cpu_regs.y);
-    ASSERT_EQ(0xFF, g_cpu_regs.sp);
+    ASSERT_EQ(0x01, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0xFD, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(0x02, cpu_get_registers(g_test_cpu)->y);
+    ASSERT_EQ(0xFF, cpu_get_registers(g_test_cpu)->sp);
 
     pump_cpu();
-    ASSERT_EQ(0x01, g_cpu_regs.acc);
-    ASSERT_EQ(0x00, g_cpu_regs.x);
-    ASSERT_EQ(0x02, g_cpu_regs.y);
-    ASSERT_EQ(0xFF, g_cpu_regs.sp);
+    ASSERT_EQ(0x01, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0x00, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(0x02, cpu_get_registers(g_test_cpu)->y);
+    ASSERT_EQ(0xFF, cpu_get_registers(g_test_cpu)->sp);
 
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
-    ASSERT_EQ(1, g_cpu_regs.status.interrupt_disable);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.interrupt_disable);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
 
     return true;
 }
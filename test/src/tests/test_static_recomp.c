@@ -0,0 +1,126 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+
+#include <stdint.h>
+
+#define MAX_STEPS 4096
+
+extern Cpu6502 *g_test_cpu;
+
+#ifdef C6502_TEST_RECOMP
+
+// generated at build time by c6502_recomp
+extern const CpuStaticBlock *addition_lookup(uint16_t pc);
+extern const CpuStaticBlock *arithmetic_lookup(uint16_t pc);
+extern const CpuStaticBlock *branch_lookup(uint16_t pc);
+extern const CpuStaticBlock *interrupt_lookup(uint16_t pc);
+extern const CpuStaticBlock *logic_lookup(uint16_t pc);
+extern const CpuStaticBlock *stack_lookup(uint16_t pc);
+extern const CpuStaticBlock *status_lookup(uint16_t pc);
+extern const CpuStaticBlock *store_load_lookup(uint16_t pc);
+extern const CpuStaticBlock *subtraction_lookup(uint16_t pc);
+
+static TestStep g_steps[MAX_STEPS];
+
+// Runs a program through the interpreter, then again with its ahead-of-time compiled blocks installed. The compiled
+// run has to agree with the interpreter at the end of every block.
+static bool _compare_static(char *file_name, CpuStaticLookup lookup) {
+    size_t step_count;
+    if (!record_test_steps(file_name, g_steps, MAX_STEPS, &step_count) || !load_cpu_test(file_name)) {
+        return false;
+    }
+
+    // the reset vector has to lead into compiled code, or nothing would be compared
+    uint16_t reset_vector = system_memory_read(NULL, 0xFFFC) | (system_memory_read(NULL, 0xFFFD) << 8);
+    bool compiled = lookup(reset_vector) != NULL;
+    ASSERT_EQ(true, compiled);
+
+    cpu_set_static_code(g_test_cpu, lookup);
+
+    size_t done = 0;
+    while (done < step_count) {
+        // step exactly one compiled block (or one interpreted instruction) at a time
+        const CpuStaticBlock *block = lookup(cpu_get_registers(g_test_cpu)->pc);
+        size_t chunk = block != NULL ? block->instr_count : 1;
+        if (chunk > step_count - done) {
+            chunk = step_count - done;
+        }
+
+        unsigned int expected_cycles = 0;
+        for (size_t i = done; i < done + chunk; i++) {
+            expected_cycles += g_steps[i].cycles;
+        }
+
+        ASSERT_EQ(expected_cycles, (unsigned int) cpu_run_instructions(g_test_cpu, chunk));
+        done += chunk;
+
+        if (!check_test_registers(&g_steps[done - 1].regs)) {
+            return false;
+        }
+    }
+
+    cpu_set_static_code(g_test_cpu, NULL);
+
+    return true;
+}
+
+bool test_static_recomp(void) {
+    struct {
+        char *file_name;
+        CpuStaticLookup lookup;
+    } programs[] = {
+        {"addition.bin", addition_lookup},
+        {"arithmetic.bin", arithmetic_lookup},
+        {"branch.bin", branch_lookup},
+        {"interrupt.bin", interrupt_lookup},
+        {"logic.bin", logic_lookup},
+        {"stack.bin", stack_lookup},
+        {"status.bin", status_lookup},
+        {"store_load.bin", store_load_lookup},
+        {"subtraction.bin", subtraction_lookup}
+    };
+
+    for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        if (!_compare_static(programs[i].file_name, programs[i].lookup)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#else
+
+bool test_static_recomp(void) {
+    // the recompiler isn't being built, so there's no generated code to check
+    return true;
+}
+
+#endif
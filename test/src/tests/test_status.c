@@ -28,7 +28,7 @@
 
 #include "c6502/cpu.h"
 
-extern CpuRegisters g_cpu_regs;
+extern Cpu6502 *g_test_cpu;
 
 bool test_status(void) {
     if (!load_cpu_test("status.bin")) {
@@ -37,17 +37,17 @@ bool test_status(void) {
 
     // test explicit flag-setting
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.interrupt_disable);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.interrupt_disable);
 
     // set overflow flag explicitly so we can test clearing it in code
-    g_cpu_regs.status.overflow = 1;
+    cpu_get_registers(g_test_cpu)->status.overflow = 1;
 
     // test explicit flag-clearing
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.interrupt_disable);
-    ASSERT_EQ(0, g_cpu_regs.status.overflow);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.interrupt_disable);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.overflow);
 
     // test comparison instructions
 
@@ -55,55 +55,90 @@ bool test_status(void) {
 
     // a = v
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     // a > v
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     // a < v
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     // a > v && a is neg && v is neg
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     // a > v && a is neg && v is pos
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     // a < v && a is neg && v is neg
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test CPX
 
     // x == v
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     // test CPY
 
     // y == v
     pump_cpu();
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
+
+    // a pointer to the registers held across calls sees the flags set by the core and its changes are picked up
+    if (!load_cpu_test("status.bin")) {
+       return false;
+    }
+
+    CpuRegisters *regs = cpu_get_registers(g_test_cpu);
+
+    // SEC, SEI
+    pump_cpu();
+    ASSERT_EQ(1, regs->status.carry);
+    ASSERT_EQ(1, regs->status.interrupt_disable);
+
+    regs->status.overflow = 1;
+
+    // NOP, CLC
+    cpu_run_instructions(g_test_cpu, 2);
+    ASSERT_EQ(0, regs->status.carry);
+    ASSERT_EQ(1, regs->status.overflow);
+
+    // CLI
+    cpu_step_instruction(g_test_cpu);
+    ASSERT_EQ(0, regs->status.interrupt_disable);
+    ASSERT_EQ(1, regs->status.overflow);
+
+    // CLV
+    cycle_cpu(g_test_cpu);
+    cycle_cpu(g_test_cpu);
+    ASSERT_EQ(0, regs->status.overflow);
+
+    regs->status.carry = 1;
+
+    // NOP
+    cpu_run_instructions(g_test_cpu, 1);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
 
     return true;
 }
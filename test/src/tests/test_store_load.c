@@ -28,6 +28,8 @@
 
 #include "c6502/cpu.h"
 
+extern Cpu6502 *g_test_cpu;
+
 bool test_store_load(void) {
     if (!load_cpu_test("store_load.bin")) {
        return false;
@@ -36,85 +38,92 @@ bool test_store_load(void) {
     // ACCUMULATOR TESTS
     // test zero-page addressing
     pump_cpu();
-    ASSERT_EQ(1, system_memory_read(0x10));
-    ASSERT_EQ(1, system_memory_read(0x90));
-    ASSERT_EQ(1, system_memory_read(0xFF));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x10));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x90));
+    ASSERT_EQ(1, system_memory_read(NULL, 0xFF));
 
     // test zero-page loading
     pump_cpu();
-    ASSERT_EQ(1, cpu_get_registers()->acc);
-    ASSERT_EQ(1, cpu_get_registers()->x);
-    ASSERT_EQ(1, cpu_get_registers()->y);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->x);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->y);
 
     // test zero-page (x-indexed) addressing
     pump_cpu();
-    ASSERT_EQ(1, system_memory_read(0x12));
-    ASSERT_EQ(1, system_memory_read(0x92));
-    ASSERT_EQ(1, system_memory_read(0x01));
-    ASSERT_EQ(1, system_memory_read(0xA1));
-    ASSERT_EQ(1, system_memory_read(0x02));
-    ASSERT_EQ(1, system_memory_read(0x11));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x12));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x92));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x01));
+    ASSERT_EQ(1, system_memory_read(NULL, 0xA1));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x02));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x11));
 
     // test absolute addressing
     pump_cpu();
-    ASSERT_EQ(1, system_memory_read(0x0023));
-    ASSERT_EQ(1, system_memory_read(0x0303));
-    ASSERT_EQ(1, system_memory_read(0x0103));
-    ASSERT_EQ(1, system_memory_read(0x0203));
-    ASSERT_EQ(1, system_memory_read(0x0303));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0023));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0303));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0103));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0203));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0303));
 
     // test absolute (x-indexed) addressing
     pump_cpu();
-    ASSERT_EQ(1, system_memory_read(0x0025));
-    ASSERT_EQ(1, system_memory_read(0x0305));
-    ASSERT_EQ(1, system_memory_read(0x0105));
-    ASSERT_EQ(1, system_memory_read(0x0205));
-    ASSERT_EQ(1, system_memory_read(0x0305));
-    ASSERT_EQ(1, system_memory_read(0x0005));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0025));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0305));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0105));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0205));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0305));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0005));
 
     // test absolute (y-indexed) addressing
     pump_cpu();
-    ASSERT_EQ(1, system_memory_read(0x0026));
-    ASSERT_EQ(1, system_memory_read(0x0006));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0026));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0006));
 
     // test indexed indirect addressing
     pump_cpu();
-    ASSERT_EQ(1, system_memory_read(0x0213));
-    ASSERT_EQ(1, system_memory_read(0x1302));
-    ASSERT_EQ(1, system_memory_read(0x0302));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0213));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x1302));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0302));
 
     // test indirect indexed addressing
     pump_cpu();
-    ASSERT_EQ(1, system_memory_read(0x0215));
-    ASSERT_EQ(1, system_memory_read(0x1304));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x0215));
+    ASSERT_EQ(1, system_memory_read(NULL, 0x1304));
 
     // X REGISTER TESTS
     // test zero-page addressing
     pump_cpu();
-    ASSERT_EQ(2, system_memory_read(0x10));
-    ASSERT_EQ(2, system_memory_read(0x90));
-    ASSERT_EQ(2, system_memory_read(0xFF));
+    ASSERT_EQ(2, system_memory_read(NULL, 0x10));
+    ASSERT_EQ(2, system_memory_read(NULL, 0x90));
+    ASSERT_EQ(2, system_memory_read(NULL, 0xFF));
 
     // test zero-page (y-indexed) addressing
     pump_cpu();
-    ASSERT_EQ(2, system_memory_read(0x14));
-    ASSERT_EQ(2, system_memory_read(0x94));
-    ASSERT_EQ(2, system_memory_read(0x03));
-    ASSERT_EQ(2, system_memory_read(0xA0));
-    ASSERT_EQ(2, system_memory_read(0x00));
-    ASSERT_EQ(2, system_memory_read(0x20));
+    ASSERT_EQ(2, system_memory_read(NULL, 0x14));
+    ASSERT_EQ(2, system_memory_read(NULL, 0x94));
+    ASSERT_EQ(2, system_memory_read(NULL, 0x03));
+    ASSERT_EQ(2, system_memory_read(NULL, 0xA0));
+    ASSERT_EQ(2, system_memory_read(NULL, 0x00));
+    ASSERT_EQ(2, system_memory_read(NULL, 0x20));
 
     // Y REGISTER TESTS
     // test zero-page addressing
     pump_cpu();
-    ASSERT_EQ(4, system_memory_read(0x10));
-    ASSERT_EQ(4, system_memory_read(0x90));
-    ASSERT_EQ(4, system_memory_read(0xFF));
+    ASSERT_EQ(4, system_memory_read(NULL, 0x10));
+    ASSERT_EQ(4, system_memory_read(NULL, 0x90));
+    ASSERT_EQ(4, system_memory_read(NULL, 0xFF));
 
     // transfer tests
     pump_cpu();
-    ASSERT_EQ(0x42, system_memory_read(0x08));
-    ASSERT_EQ(0x52, system_memory_read(0x09));
+    ASSERT_EQ(0x42, system_memory_read(NULL, 0x08));
+    ASSERT_EQ(0x52, system_memory_read(NULL, 0x09));
+
+    // indirect indexed reads
+    pump_cpu();
+    ASSERT_EQ(0x07, system_memory_read(NULL, 0x40));
+    ASSERT_EQ(0x0E, system_memory_read(NULL, 0x41));
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
 
     return true;
 }
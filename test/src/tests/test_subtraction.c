@@ -28,7 +28,7 @@
 
 #include "c6502/cpu.h"
 
-extern CpuRegisters g_cpu_regs;
+extern Cpu6502 *g_test_cpu;
 
 bool test_subtraction(void) {
     if (!load_cpu_test("subtraction.bin")) {
@@ -36,46 +36,46 @@ bool test_subtraction(void) {
     }
 
     pump_cpu();
-    ASSERT_EQ(0x10, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.overflow);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x10, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x0F, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.overflow);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x0F, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.overflow);
-    ASSERT_EQ(1, g_cpu_regs.status.zero);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0xF0, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(0, g_cpu_regs.status.overflow);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0xF0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0xA0, g_cpu_regs.acc);
-    ASSERT_EQ(0, g_cpu_regs.status.carry);
-    ASSERT_EQ(1, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.overflow);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0xA0, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     pump_cpu();
-    ASSERT_EQ(0x60, g_cpu_regs.acc);
-    ASSERT_EQ(1, g_cpu_regs.status.carry);
-    ASSERT_EQ(0, g_cpu_regs.status.negative);
-    ASSERT_EQ(1, g_cpu_regs.status.overflow);
-    ASSERT_EQ(0, g_cpu_regs.status.zero);
+    ASSERT_EQ(0x60, cpu_get_registers(g_test_cpu)->acc);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.carry);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.negative);
+    ASSERT_EQ(1, cpu_get_registers(g_test_cpu)->status.overflow);
+    ASSERT_EQ(0, cpu_get_registers(g_test_cpu)->status.zero);
 
     return true;
 }
@@ -0,0 +1,200 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+#include "c6502/instrs.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_INSTRS 2048
+#define RING_CAPACITY 16
+
+extern Cpu6502 *g_test_cpu;
+
+typedef struct {
+    char str[40];
+    CpuRegisters regs;
+} LogLine;
+
+static LogLine g_log_lines[MAX_INSTRS];
+static size_t g_log_count;
+
+static CpuTraceRecord g_records[MAX_INSTRS];
+static CpuTraceRecord g_ring[RING_CAPACITY];
+
+static void _log_callback(void *userdata, char *instr_str, CpuRegisters last_regs) {
+    (void) userdata;
+    if (g_log_count < MAX_INSTRS) {
+        strcpy(g_log_lines[g_log_count].str, instr_str);
+        g_log_lines[g_log_count].regs = last_regs;
+        g_log_count++;
+    }
+}
+
+// runs a program with the cycle-stepped core while both logging and tracing, and checks that the trace records agree
+// with the log lines, then runs it again instruction by instruction through a small ring buffer and checks that the ring
+// ends up holding the most recent records of the first run
+static bool _compare_trace(char *file_name) {
+    if (!load_cpu_test(file_name)) {
+        return false;
+    }
+
+    g_log_count = 0;
+    cpu_set_log_callback(g_test_cpu, _log_callback);
+    cpu_set_trace_buffer(g_test_cpu, g_records, MAX_INSTRS);
+
+    while (cpu_get_trace_count(g_test_cpu) < MAX_INSTRS - 1) {
+        cycle_cpu(g_test_cpu);
+
+        if (cpu_get_instruction_step(g_test_cpu) == 1) {
+            // some of the programs eventually run off into garbage, so we stop before anything jams the CPU
+            if (decode_instr(system_memory_read(NULL, cpu_get_registers(g_test_cpu)->pc))->mnemonic == KIL) {
+                break;
+            }
+        }
+    }
+
+    cpu_set_log_callback(g_test_cpu, NULL);
+    cpu_set_trace_buffer(g_test_cpu, NULL, 0);
+
+    size_t record_count = g_log_count;
+    bool nonzero = record_count > RING_CAPACITY;
+    ASSERT_EQ(true, nonzero);
+
+    for (size_t i = 0; i < record_count; i++) {
+        const CpuTraceRecord *record = &g_records[i];
+        const LogLine *line = &g_log_lines[i];
+
+        ASSERT_EQ(line->regs.pc, record->pc);
+        ASSERT_EQ(line->regs.acc, record->acc);
+        ASSERT_EQ(line->regs.x, record->x);
+        ASSERT_EQ(line->regs.y, record->y);
+        ASSERT_EQ(line->regs.sp, record->sp);
+        ASSERT_EQ(line->regs.status.serial, record->status);
+
+        char formatted[CPU_TRACE_LINE_MAX];
+        cpu_format_trace_record(record, formatted);
+        bool matches = strstr(formatted, line->str) == formatted + 6;
+        ASSERT_EQ(true, matches);
+
+        // the cycle counts are checked against the instruction-granular mode below
+        bool ascending = i == 0 || record->cycle > g_records[i - 1].cycle;
+        ASSERT_EQ(true, ascending);
+    }
+
+    if (!load_cpu_test(file_name)) {
+        return false;
+    }
+
+    cpu_set_trace_buffer(g_test_cpu, g_ring, RING_CAPACITY);
+
+    while (cpu_get_trace_count(g_test_cpu) < record_count) {
+        cpu_step_instruction(g_test_cpu);
+    }
+
+    uint64_t trace_count = cpu_get_trace_count(g_test_cpu);
+    ASSERT_EQ((unsigned int) record_count, (unsigned int) trace_count);
+
+    cpu_set_trace_buffer(g_test_cpu, NULL, 0);
+
+    for (uint64_t i = trace_count - RING_CAPACITY; i < trace_count; i++) {
+        const CpuTraceRecord *expected = &g_records[i];
+        const CpuTraceRecord *actual = &g_ring[i % RING_CAPACITY];
+        ASSERT_EQ((unsigned int) expected->cycle, (unsigned int) actual->cycle);
+        ASSERT_EQ(expected->pc, actual->pc);
+        ASSERT_EQ(expected->opcode, actual->opcode);
+        ASSERT_EQ(expected->operand, actual->operand);
+        ASSERT_EQ(expected->eff_addr, actual->eff_addr);
+        ASSERT_EQ(expected->bus_val, actual->bus_val);
+        ASSERT_EQ(expected->acc, actual->acc);
+        ASSERT_EQ(expected->status, actual->status);
+    }
+
+    return true;
+}
+
+static void _count_log_lines(void *userdata, char *instr_str, CpuRegisters last_regs) {
+    (void) instr_str;
+    (void) last_regs;
+    (*(unsigned int*) userdata)++;
+}
+
+// two CPUs sharing a log callback can tell their lines apart through the userdata of their system interfaces
+static bool _test_log_userdata(void) {
+    unsigned int counts[2] = {0, 0};
+
+    if (!load_cpu_test("branch.bin")) {
+        return false;
+    }
+
+    Cpu6502 *cpus[2];
+    for (size_t i = 0; i < 2; i++) {
+        CpuSystemInterface iface = {
+                system_memory_read,
+                system_memory_write,
+                system_bus_read,
+                system_bus_write,
+                poll_nmi_line,
+                poll_irq_line,
+                poll_rst_line,
+                &counts[i]
+        };
+        cpus[i] = cpu_create(iface);
+        ASSERT_EQ(true, (cpus[i] != NULL));
+        cpu_set_log_callback(cpus[i], _count_log_lines);
+    }
+
+    for (unsigned int i = 0; i < 5; i++) {
+        cpu_step_instruction(cpus[0]);
+    }
+    for (unsigned int i = 0; i < 3; i++) {
+        cpu_step_instruction(cpus[1]);
+    }
+
+    // a line is only logged once the next instruction starts, so each CPU still has one pending
+    ASSERT_EQ(4, counts[0]);
+    ASSERT_EQ(2, counts[1]);
+
+    cpu_destroy(cpus[0]);
+    cpu_destroy(cpus[1]);
+
+    return true;
+}
+
+bool test_trace(void) {
+    char *programs[] = {"branch.bin", "interrupt.bin", "stack.bin", "store_load.bin"};
+
+    for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        if (!_compare_trace(programs[i])) {
+            return false;
+        }
+    }
+
+    return _test_log_userdata();
+}
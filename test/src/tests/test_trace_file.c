@@ -0,0 +1,185 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+#include "c6502/trace_file.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TRACE_PATH "c6502_test.trace"
+#define TRUNCATED_PATH "c6502_test_truncated.trace"
+
+#define INSTR_COUNT 20000
+#define DRAIN_INTERVAL 1000
+#define RING_CAPACITY 1500 // deliberately not a multiple of the drain interval
+
+extern Cpu6502 *g_test_cpu;
+
+static CpuTraceRecord g_expected[INSTR_COUNT];
+static CpuTraceRecord g_ring[RING_CAPACITY];
+
+static bool _records_equal(const CpuTraceRecord *a, const CpuTraceRecord *b) {
+    return a->cycle == b->cycle && a->pc == b->pc && a->operand == b->operand && a->eff_addr == b->eff_addr
+            && a->opcode == b->opcode && a->bus_val == b->bus_val && a->acc == b->acc && a->x == b->x
+            && a->y == b->y && a->sp == b->sp && a->status == b->status;
+}
+
+// copies all but the last few bytes of the blocks in a trace file, as if the writer had been interrupted
+static bool _truncate_copy(const char *src_path, const char *dst_path) {
+    FILE *src = fopen(src_path, "rb");
+    FILE *dst = fopen(dst_path, "wb");
+    if (src == NULL || dst == NULL) {
+        return false;
+    }
+
+    // the trailer holds the offset of the index, which follows the last block
+    uint8_t trailer[16];
+    fseek(src, -16, SEEK_END);
+    if (fread(trailer, 1, sizeof(trailer), src) != sizeof(trailer)) {
+        return false;
+    }
+
+    long index_offset = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16);
+    fseek(src, 0, SEEK_SET);
+    for (long i = 0; i < index_offset - 10; i++) {
+        fputc(fgetc(src), dst);
+    }
+
+    fclose(src);
+    fclose(dst);
+
+    return true;
+}
+
+bool test_trace_file(void) {
+    // the interrupt program ends up running BRKs in a loop, which gives a long trace with plenty of control flow
+    if (!load_cpu_test("interrupt.bin")) {
+        return false;
+    }
+
+    cpu_set_trace_buffer(g_test_cpu, g_expected, INSTR_COUNT);
+    cpu_run_instructions(g_test_cpu, INSTR_COUNT);
+    cpu_set_trace_buffer(g_test_cpu, NULL, 0);
+
+    if (!load_cpu_test("interrupt.bin")) {
+        return false;
+    }
+
+    TraceWriter *writer = trace_writer_open(TRACE_PATH);
+    bool opened = writer != NULL;
+    ASSERT_EQ(true, opened);
+
+    cpu_set_trace_buffer(g_test_cpu, g_ring, RING_CAPACITY);
+
+    uint64_t position = 0;
+    for (size_t i = 0; i < INSTR_COUNT; i += DRAIN_INTERVAL) {
+        cpu_run_instructions(g_test_cpu, DRAIN_INTERVAL);
+
+        bool drained = trace_writer_drain(writer, g_test_cpu, &position);
+        ASSERT_EQ(true, drained);
+    }
+
+    cpu_set_trace_buffer(g_test_cpu, NULL, 0);
+
+    bool closed = trace_writer_close(writer);
+    ASSERT_EQ(true, closed);
+
+    // the last instruction's record is only written once the next one starts
+    uint64_t record_count = position;
+    ASSERT_EQ(INSTR_COUNT - 1, (unsigned int) record_count);
+
+    TraceReader *reader = trace_reader_open(TRACE_PATH);
+    opened = reader != NULL;
+    ASSERT_EQ(true, opened);
+    ASSERT_EQ((unsigned int) record_count, (unsigned int) trace_reader_get_record_count(reader));
+
+    CpuTraceRecord record;
+    for (uint64_t i = 0; i < record_count; i++) {
+        bool read = trace_reader_next(reader, &record);
+        ASSERT_EQ(true, read);
+
+        bool equal = _records_equal(&g_expected[i], &record);
+        ASSERT_EQ(true, equal);
+    }
+
+    bool at_end = !trace_reader_next(reader, &record);
+    ASSERT_EQ(true, at_end);
+
+    // seek to block boundaries and the records around them, both exactly and to a cycle within the previous record
+    uint64_t seek_targets[] = {0, 1, 4095, 4096, 4097, 8191, 12288, 15000, INSTR_COUNT - 2};
+    for (size_t i = 0; i < sizeof(seek_targets) / sizeof(seek_targets[0]); i++) {
+        uint64_t target = seek_targets[i];
+
+        bool found = trace_reader_seek_cycle(reader, g_expected[target].cycle);
+        ASSERT_EQ(true, found);
+        trace_reader_next(reader, &record);
+        bool equal = _records_equal(&g_expected[target], &record);
+        ASSERT_EQ(true, equal);
+
+        if (target != 0) {
+            found = trace_reader_seek_cycle(reader, g_expected[target - 1].cycle + 1);
+            ASSERT_EQ(true, found);
+            trace_reader_next(reader, &record);
+            equal = _records_equal(&g_expected[target], &record);
+            ASSERT_EQ(true, equal);
+        }
+    }
+
+    bool past_end = !trace_reader_seek_cycle(reader, g_expected[record_count - 1].cycle + 1);
+    ASSERT_EQ(true, past_end);
+
+    trace_reader_close(reader);
+
+    // without its index, the file is scanned for complete blocks
+    bool copied = _truncate_copy(TRACE_PATH, TRUNCATED_PATH);
+    ASSERT_EQ(true, copied);
+
+    reader = trace_reader_open(TRUNCATED_PATH);
+    opened = reader != NULL;
+    ASSERT_EQ(true, opened);
+
+    uint64_t truncated_count = trace_reader_get_record_count(reader);
+    ASSERT_EQ(4096 * 4, (unsigned int) truncated_count);
+
+    for (uint64_t i = 0; i < truncated_count; i++) {
+        bool read = trace_reader_next(reader, &record);
+        ASSERT_EQ(true, read);
+
+        bool equal = _records_equal(&g_expected[i], &record);
+        ASSERT_EQ(true, equal);
+    }
+
+    trace_reader_close(reader);
+
+    remove(TRACE_PATH);
+    remove(TRUNCATED_PATH);
+
+    return true;
+}
@@ -0,0 +1,130 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+#include "cpu_tester.h"
+
+#include "c6502/cpu.h"
+#include "c6502/trace_queue.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define INSTR_COUNT 20000
+#define QUEUE_CAPACITY 64
+#define SAMPLE_INTERVAL 4
+
+extern Cpu6502 *g_test_cpu;
+
+static CpuTraceRecord g_expected[INSTR_COUNT];
+static CpuTraceRecord g_received[INSTR_COUNT];
+static size_t g_received_count;
+static bool g_slow_consumer;
+
+static void _consume(void *userdata, const CpuTraceRecord *records, size_t count) {
+    (void) userdata;
+    memcpy(g_received + g_received_count, records, count * sizeof(CpuTraceRecord));
+    g_received_count += count;
+
+    // simulates an expensive consumer so that the queue fills up
+    if (g_slow_consumer) {
+        for (volatile unsigned int i = 0; i < 100000; i++) {
+        }
+    }
+}
+
+static bool _records_equal(const CpuTraceRecord *a, const CpuTraceRecord *b) {
+    return a->cycle == b->cycle && a->pc == b->pc && a->operand == b->operand && a->eff_addr == b->eff_addr
+            && a->opcode == b->opcode && a->bus_val == b->bus_val && a->acc == b->acc && a->x == b->x
+            && a->y == b->y && a->sp == b->sp && a->status == b->status;
+}
+
+// runs the interrupt program through a queue with the given policy and returns the number of records dropped, or -1 if
+// the records which made it through are not an ordered subset of the expected ones
+static long _run_queued(TraceQueuePolicy policy, bool slow) {
+    if (!load_cpu_test("interrupt.bin")) {
+        return -1;
+    }
+
+    g_received_count = 0;
+    g_slow_consumer = slow;
+
+    TraceQueue *queue = trace_queue_create(QUEUE_CAPACITY, policy, SAMPLE_INTERVAL, _consume, NULL);
+    if (queue == NULL) {
+        return -1;
+    }
+
+    cpu_set_trace_queue(g_test_cpu, queue);
+    cpu_run_instructions(g_test_cpu, INSTR_COUNT);
+    cpu_set_trace_queue(g_test_cpu, NULL);
+
+    trace_queue_flush(queue);
+    uint64_t dropped = trace_queue_get_dropped(queue);
+    trace_queue_destroy(queue);
+
+    if (g_received_count + dropped != INSTR_COUNT - 1) {
+        return -1;
+    }
+
+    size_t next = 0;
+    for (size_t i = 0; i < g_received_count; i++) {
+        while (next < INSTR_COUNT - 1 && !_records_equal(&g_expected[next], &g_received[i])) {
+            next++;
+        }
+
+        if (next++ == INSTR_COUNT - 1) {
+            return -1;
+        }
+    }
+
+    return (long) dropped;
+}
+
+bool test_trace_queue(void) {
+    if (!load_cpu_test("interrupt.bin")) {
+        return false;
+    }
+
+    cpu_set_trace_buffer(g_test_cpu, g_expected, INSTR_COUNT);
+    cpu_run_instructions(g_test_cpu, INSTR_COUNT);
+    cpu_set_trace_buffer(g_test_cpu, NULL, 0);
+
+    // blocking must deliver every record even if the consumer falls behind
+    ASSERT_EQ(0, (unsigned int) _run_queued(TRACE_QUEUE_BLOCK, false));
+    ASSERT_EQ(0, (unsigned int) _run_queued(TRACE_QUEUE_BLOCK, true));
+
+    for (size_t i = 0; i < INSTR_COUNT - 1; i++) {
+        bool equal = _records_equal(&g_expected[i], &g_received[i]);
+        ASSERT_EQ(true, equal);
+    }
+
+    // the others may lose records, but must account for them and keep the rest in order
+    bool consistent = _run_queued(TRACE_QUEUE_DROP, true) >= 0;
+    ASSERT_EQ(true, consistent);
+    consistent = _run_queued(TRACE_QUEUE_SAMPLE, true) >= 0;
+    ASSERT_EQ(true, consistent);
+
+    return true;
+}
@@ -0,0 +1,289 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_assert.h"
+
+#include "c6502/batch.h"
+#include "c6502/wide.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMORY_SIZE 0x10000
+#define ALU_LANES 256
+#define FLOW_LANES 96
+
+// For the value in $00, stores the results and status of each ALU operation with every possible operand in a table.
+// Every lane follows the same path.
+static const uint8_t g_alu_program[] = {
+    0xA0, 0x00, // LDY #$00
+    0x84, 0x02, // loop: STY $02
+    0x18, // CLC
+    0xA5, 0x00, // LDA $00
+    0x65, 0x02, // ADC $02
+    0x99, 0x00, 0x02, // STA $0200,Y
+    0x08, // PHP
+    0x68, // PLA
+    0x99, 0x00, 0x03, // STA $0300,Y
+    0x38, // SEC
+    0xA5, 0x00, // LDA $00
+    0xE5, 0x02, // SBC $02
+    0x99, 0x00, 0x04, // STA $0400,Y
+    0x08, // PHP
+    0x68, // PLA
+    0x99, 0x00, 0x05, // STA $0500,Y
+    0xA5, 0x00, // LDA $00
+    0x4A, // LSR A, taking the carry for the next operations from the lowest bit of $00
+    0xA5, 0x00, // LDA $00
+    0x71, 0x04, // ADC ($04),Y
+    0x99, 0x00, 0x06, // STA $0600,Y
+    0x08, // PHP
+    0x68, // PLA
+    0x99, 0x00, 0x07, // STA $0700,Y
+    0xA5, 0x00, // LDA $00
+    0x4A, // LSR A
+    0xA5, 0x00, // LDA $00
+    0xF9, 0xC0, 0x0F, // SBC $0FC0,Y
+    0x08, // PHP
+    0x68, // PLA
+    0x99, 0x00, 0x08, // STA $0800,Y
+    0xA5, 0x00, // LDA $00
+    0xC5, 0x02, // CMP $02
+    0x24, 0x02, // BIT $02
+    0x08, // PHP
+    0x68, // PLA
+    0x99, 0x00, 0x09, // STA $0900,Y
+    0xA5, 0x00, // LDA $00
+    0x4A, // LSR A
+    0x26, 0x02, // ROL $02
+    0x08, // PHP
+    0x68, // PLA
+    0x45, 0x02, // EOR $02
+    0x99, 0x00, 0x0A, // STA $0A00,Y
+    0xA5, 0x00, // LDA $00
+    0x4A, // LSR A
+    0x66, 0x02, // ROR $02
+    0x08, // PHP
+    0x68, // PLA
+    0x05, 0x02, // ORA $02
+    0x99, 0x00, 0x0B, // STA $0B00,Y
+    0xC8, // INY
+    0xD0, 0xA2, // BNE loop
+    0x02, // KIL
+};
+
+// Sums 1 to ($00) with a subroutine, then dispatches on the low bits of the sum through a jump table, so the lanes
+// split up along several paths.
+static const uint8_t g_flow_program[] = {
+    0xA9, 0x00, // LDA #$00
+    0x85, 0x01, // STA $01
+    0xA6, 0x00, // LDX $00
+    0xF0, 0x06, // BEQ done
+    0x20, 0x30, 0x80, // loop: JSR add
+    0xCA, // DEX
+    0xD0, 0xFA, // BNE loop
+    0xA5, 0x01, // done: LDA $01
+    0x29, 0x03, // AND #$03
+    0x0A, // ASL A
+    0xA8, // TAY
+    0xB9, 0x40, 0x80, // LDA table,Y
+    0x85, 0x06, // STA $06
+    0xB9, 0x41, 0x80, // LDA table+1,Y
+    0x85, 0x07, // STA $07
+    0x6C, 0x06, 0x00, // JMP ($0006)
+};
+
+static const uint8_t g_flow_add[] = {
+    0x8A, // add: TXA
+    0x18, // CLC
+    0x65, 0x01, // ADC $01
+    0x85, 0x01, // STA $01
+    0x48, // PHA
+    0xBD, 0xF0, 0x80, // LDA $80F0,X
+    0x68, // PLA
+    0x60, // RTS
+};
+
+static const uint8_t g_flow_tails[] = {
+    0xE6, 0x10, // $8050: INC $10
+    0x02, // KIL
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xC6, 0x10, // $8060: DEC $10
+    0x4C, 0x62, 0x80, // JMP *
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xA9, 0x55, // $8070: LDA #$55
+    0x00, // BRK
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x78, // $8080: SEI
+    0xF8, // SED
+    0xB8, // CLV
+    0x4C, 0x80, 0x80, // JMP $8080
+};
+
+static const uint8_t g_flow_table[] = {0x50, 0x80, 0x60, 0x80, 0x70, 0x80, 0x80, 0x80};
+
+static uint8_t *_alloc_memory(size_t lanes) {
+    return malloc(lanes * MEMORY_SIZE);
+}
+
+static void _init_alu(BatchInstance *instances, uint8_t *memory) {
+    for (size_t i = 0; i < ALU_LANES; i++) {
+        uint8_t *mem = &memory[i * MEMORY_SIZE];
+        memset(mem, 0, MEMORY_SIZE);
+        memcpy(&mem[0x8000], g_alu_program, sizeof(g_alu_program));
+        mem[0xFFFC] = 0x00;
+        mem[0xFFFD] = 0x80;
+        mem[0x00] = (uint8_t) i;
+
+        // an identity table for the indexed operands, read through a pointer which crosses a page for half the lanes
+        mem[0x04] = i & 1 ? 0xC0 : 0x00;
+        mem[0x05] = 0x0E;
+        for (size_t j = 0; j < 0x100; j++) {
+            mem[0x0E00 + (i & 1 ? 0xC0 : 0x00) + j] = (uint8_t) j;
+            mem[0x0FC0 + j] = (uint8_t) j;
+        }
+
+        instances[i] = (BatchInstance) {.memory = mem, .budget = 1000000, .stop_mask = CPU_STOP_KIL};
+    }
+}
+
+static void _init_flow(BatchInstance *instances, CpuRegisters *regs, uint8_t *memory) {
+    for (size_t i = 0; i < FLOW_LANES; i++) {
+        uint8_t *mem = &memory[i * MEMORY_SIZE];
+        memset(mem, 0, MEMORY_SIZE);
+        memcpy(&mem[0x8000], g_flow_program, sizeof(g_flow_program));
+        memcpy(&mem[0x8030], g_flow_add, sizeof(g_flow_add));
+        memcpy(&mem[0x8040], g_flow_table, sizeof(g_flow_table));
+        memcpy(&mem[0x8050], g_flow_tails, sizeof(g_flow_tails));
+        mem[0xFFFC] = 0x00;
+        mem[0xFFFD] = 0x80;
+        mem[0x00] = (uint8_t) (i * 5);
+
+        regs[i] = (CpuRegisters) {.status.serial = 0x24, .pc = 0x8000, .sp = (uint8_t) (0xFF - i), .acc = 0, .x = 0,
+                .y = 0};
+
+        instances[i] = (BatchInstance) {
+                .memory = mem,
+                .regs = i % 3 == 0 ? &regs[i] : NULL,
+                .budget = 500 + i * 61,
+                .stop_mask = (i % 4 == 0 ? CPU_STOP_PC : 0) | (i % 5 == 0 ? CPU_STOP_MNEMONIC : 0)
+                        | (i % 2 == 1 ? CPU_STOP_KIL : 0),
+                .stop_pc = 0x800E,
+                .stop_mnemonic = SED
+        };
+    }
+
+    // one instance modifies its own code, so it can no longer follow the others
+    memory[7 * MEMORY_SIZE + 0x800B] = 0x88; // DEY in place of DEX
+}
+
+static bool _check_results(const BatchResult *expected, const BatchResult *results, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_EQ((unsigned int) expected[i].cycles, (unsigned int) results[i].cycles);
+        ASSERT_EQ(expected[i].stop_reason, results[i].stop_reason);
+        ASSERT_EQ(expected[i].jammed, results[i].jammed);
+        ASSERT_EQ(expected[i].regs.pc, results[i].regs.pc);
+        ASSERT_EQ(expected[i].regs.sp, results[i].regs.sp);
+        ASSERT_EQ(expected[i].regs.acc, results[i].regs.acc);
+        ASSERT_EQ(expected[i].regs.x, results[i].regs.x);
+        ASSERT_EQ(expected[i].regs.y, results[i].regs.y);
+        ASSERT_EQ(expected[i].regs.status.serial, results[i].regs.status.serial);
+    }
+
+    return true;
+}
+
+static bool _test_alu(void) {
+    static BatchInstance instances[ALU_LANES];
+    static BatchResult expected[ALU_LANES];
+    static BatchResult results[ALU_LANES];
+
+    uint8_t *expected_memory = _alloc_memory(ALU_LANES);
+    uint8_t *memory = _alloc_memory(ALU_LANES);
+    ASSERT_EQ(true, (expected_memory != NULL && memory != NULL));
+
+    _init_alu(instances, expected_memory);
+    ASSERT_EQ(true, batch_run(instances, expected, ALU_LANES, 1, 0));
+
+    _init_alu(instances, memory);
+    WideStats stats;
+    ASSERT_EQ(true, wide_run(instances, results, ALU_LANES, &stats));
+
+    if (!_check_results(expected, results, ALU_LANES)) {
+        return false;
+    }
+    ASSERT_EQ(0, memcmp(expected_memory, memory, (size_t) ALU_LANES * MEMORY_SIZE));
+
+    // the lanes stay together until the end
+    ASSERT_EQ(CPU_STOP_KIL, results[0].stop_reason);
+    ASSERT_EQ(0, (unsigned int) stats.diverged);
+    ASSERT_EQ(true, (stats.lane_instrs > (uint64_t) ALU_LANES * 256 * 50));
+
+    free(memory);
+    free(expected_memory);
+
+    return true;
+}
+
+static bool _test_flow(void) {
+    static BatchInstance instances[FLOW_LANES];
+    static CpuRegisters regs[FLOW_LANES];
+    static BatchResult expected[FLOW_LANES];
+    static BatchResult results[FLOW_LANES];
+
+    uint8_t *expected_memory = _alloc_memory(FLOW_LANES);
+    uint8_t *memory = _alloc_memory(FLOW_LANES);
+    ASSERT_EQ(true, (expected_memory != NULL && memory != NULL));
+
+    _init_flow(instances, regs, expected_memory);
+    ASSERT_EQ(true, batch_run(instances, expected, FLOW_LANES, 1, 0));
+
+    _init_flow(instances, regs, memory);
+    WideStats stats;
+    ASSERT_EQ(true, wide_run(instances, results, FLOW_LANES, &stats));
+
+    if (!_check_results(expected, results, FLOW_LANES)) {
+        return false;
+    }
+    ASSERT_EQ(0, memcmp(expected_memory, memory, (size_t) FLOW_LANES * MEMORY_SIZE));
+
+    // every kind of ending is covered
+    unsigned int reasons = 0;
+    for (size_t i = 0; i < FLOW_LANES; i++) {
+        reasons |= results[i].stop_reason;
+    }
+    ASSERT_EQ((CPU_STOP_PC | CPU_STOP_MNEMONIC | CPU_STOP_KIL), reasons);
+    ASSERT_EQ(true, (stats.diverged > 0));
+
+    free(memory);
+    free(expected_memory);
+
+    return true;
+}
+
+bool test_wide(void) {
+    return _test_alu() && _test_flow();
+}
@@ -0,0 +1,669 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Translates a fixed program image into C source which can be installed with cpu_set_static_code(). Code is discovered
+// by following control flow from the reset, NMI and IRQ vectors, and every basic block found becomes a function. Jumps
+// whose targets are only known at run time (JMP indirect, RTS and RTI) simply end their block; if the target is not
+// the start of a known block, the interpreter takes over until execution reaches one again.
+
+#include "c6502/instrs.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_MAX_BLOCK_LEN 64
+#define STACK_BOTTOM_ADDR 0x100
+
+#define ADDR_VISITED 1
+#define ADDR_LEADER 2
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    uint32_t base; // the image is mapped here and repeated through the end of the address space
+} Image;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} StrBuf;
+
+static unsigned int g_max_block_len = DEFAULT_MAX_BLOCK_LEN;
+static uint8_t g_addr_flags[0x10000];
+static uint16_t g_worklist[0x10000];
+static size_t g_worklist_len;
+
+static void _usage(void) {
+    fprintf(stderr, "Usage: c6502_recomp [-b base] [-e addr]... [-m len] [-n name] [-o output.c] image.bin\n");
+    fprintf(stderr, "  -b base  address the image is mapped at, repeating up to $FFFF (default 0x8000)\n");
+    fprintf(stderr, "  -e addr  additional entry point, e.g. a target of an indirect jump\n");
+    fprintf(stderr, "  -m len   maximum number of instructions per block (default %d)\n", DEFAULT_MAX_BLOCK_LEN);
+    fprintf(stderr, "  -n name  prefix of the generated lookup function (default: derived from the file name)\n");
+    fprintf(stderr, "  -o file  output file (default: stdout)\n");
+}
+
+static void _buf_printf(StrBuf *buf, const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    if (buf->len + len + 1 > buf->cap) {
+        buf->cap = (buf->len + len + 1) * 2;
+        buf->data = realloc(buf->data, buf->cap);
+        if (!buf->data) {
+            fprintf(stderr, "Out of memory.\n");
+            exit(1);
+        }
+    }
+
+    va_start(args, fmt);
+    vsnprintf(buf->data + buf->len, len + 1, fmt, args);
+    va_end(args);
+
+    buf->len += len;
+}
+
+static bool _in_image(const Image *image, uint32_t addr) {
+    return addr >= image->base && addr <= 0xFFFF;
+}
+
+static uint8_t _image_byte(const Image *image, uint16_t addr) {
+    return image->data[(addr - image->base) % image->size];
+}
+
+// whether the instruction at addr lies entirely within the image
+static bool _has_instr(const Image *image, uint16_t addr) {
+    if (!_in_image(image, addr)) {
+        return false;
+    }
+
+    return _in_image(image, addr + get_opcode_info(_image_byte(image, addr))->len - 1u);
+}
+
+static uint16_t _read_operand(const Image *image, uint16_t addr) {
+    const OpcodeInfo *info = get_opcode_info(_image_byte(image, addr));
+
+    uint16_t operand = 0;
+    for (unsigned int i = 1; i < info->len; i++) {
+        operand |= _image_byte(image, addr + i) << ((i - 1) * 8);
+    }
+    return operand;
+}
+
+// Unofficial opcodes, BRK and KIL are left to the interpreter. Unofficial NOPs and the SBC alias behave exactly like
+// their official counterparts and are kept.
+static bool _is_supported(const OpcodeInfo *info) {
+    return info->mnemonic < KIL && info->handler != HND_BRK;
+}
+
+static void _add_leader(const Image *image, uint32_t addr) {
+    if (!_in_image(image, addr) || (g_addr_flags[addr] & ADDR_LEADER)) {
+        return;
+    }
+
+    g_addr_flags[addr] |= ADDR_LEADER;
+    g_worklist[g_worklist_len++] = addr;
+}
+
+// marks every instruction reachable from the known leaders, adding new leaders as control flow is discovered
+static void _discover(const Image *image) {
+    while (g_worklist_len > 0) {
+        uint16_t addr = g_worklist[--g_worklist_len];
+
+        while (_has_instr(image, addr) && !(g_addr_flags[addr] & ADDR_VISITED)) {
+            g_addr_flags[addr] |= ADDR_VISITED;
+
+            const OpcodeInfo *info = get_opcode_info(_image_byte(image, addr));
+            uint16_t operand = _read_operand(image, addr);
+            uint16_t next = addr + info->len;
+
+            if (info->mnemonic == KIL) {
+                break;
+            } else if (!_is_supported(info)) {
+                // the interpreter executes the instruction and continues after it (BRK returns past its padding byte)
+                _add_leader(image, next);
+                break;
+            }
+
+            if (info->type == INS_BRANCH) {
+                _add_leader(image, (uint16_t) (next + (int8_t) operand));
+                _add_leader(image, next);
+                break;
+            } else if (info->handler == HND_JSR) {
+                _add_leader(image, operand);
+                _add_leader(image, next);
+                break;
+            } else if (info->handler == HND_JMP) {
+                if (info->addr_mode == ABS) {
+                    _add_leader(image, operand);
+                }
+                break;
+            } else if (info->type == INS_RET) {
+                break;
+            }
+
+            addr = next;
+        }
+    }
+}
+
+static const char *_index_reg(const OpcodeInfo *info) {
+    return info->addr_mode == ABX || info->addr_mode == ZPX ? "x" : "y";
+}
+
+// Emits the effective address computation into ea, including the dummy reads the interpreter makes. For indexed
+// reads which may cross a page, the operand is also left in v.
+static void _emit_address(StrBuf *out, const OpcodeInfo *info, uint16_t operand) {
+    switch (info->addr_mode) {
+        case ZRP:
+        case ABS:
+            _buf_printf(out, "    ea = 0x%04X;\n", operand);
+            break;
+        case ZPX:
+        case ZPY:
+            _buf_printf(out, "    RD(0x%04X);\n", operand);
+            _buf_printf(out, "    ea = (0x%02X + %s) & 0xFF;\n", operand, _index_reg(info));
+            break;
+        case ABX:
+        case ABY:
+            _buf_printf(out, "    ea = 0x%04X | ((0x%02X + %s) & 0xFF);\n", operand & 0xFF00, operand & 0xFF,
+                    _index_reg(info));
+            _buf_printf(out, "    v = RD(ea);\n");
+            _buf_printf(out, "    if (0x%02X + %s >= 0x100) {\n", operand & 0xFF, _index_reg(info));
+            _buf_printf(out, "        ea += 0x100;\n");
+            if (info->type == INS_R) {
+                _buf_printf(out, "        v = RD(ea);\n");
+            }
+            if (info->page_penalty) {
+                _buf_printf(out, "        c++;\n");
+            }
+            _buf_printf(out, "    }\n");
+            break;
+        case IZX:
+            _buf_printf(out, "    RD(0x%04X);\n", operand);
+            _buf_printf(out, "    ea = RD((0x%02X + x) & 0xFF);\n", operand);
+            _buf_printf(out, "    ea |= RD((0x%02X + x + 1) & 0xFF) << 8;\n", operand);
+            break;
+        case IZY:
+            _buf_printf(out, "    ea = RD(0x%04X);\n", operand);
+            _buf_printf(out, "    ea |= RD(0x%04X) << 8;\n", (operand + 1) & 0xFF);
+            _buf_printf(out, "    t = ea & 0xFF;\n");
+            _buf_printf(out, "    ea = (ea & 0xFF00) | ((t + y) & 0xFF);\n");
+            _buf_printf(out, "    v = RD(ea);\n");
+            _buf_printf(out, "    if (t + y >= 0x100) {\n");
+            _buf_printf(out, "        ea += 0x100;\n");
+            if (info->type == INS_R) {
+                _buf_printf(out, "        v = RD(ea);\n");
+            }
+            if (info->page_penalty) {
+                _buf_printf(out, "        c++;\n");
+            }
+            _buf_printf(out, "    }\n");
+            break;
+        default:
+            break;
+    }
+}
+
+// emits the operation of a read instruction on the operand in v
+static void _emit_read_op(StrBuf *out, Mnemonic mnemonic) {
+    switch (mnemonic) {
+        case LDA: _buf_printf(out, "    a = v;\n    p = _nz(p, a);\n"); break;
+        case LDX: _buf_printf(out, "    x = v;\n    p = _nz(p, x);\n"); break;
+        case LDY: _buf_printf(out, "    y = v;\n    p = _nz(p, y);\n"); break;
+        case AND: _buf_printf(out, "    a &= v;\n    p = _nz(p, a);\n"); break;
+        case ORA: _buf_printf(out, "    a |= v;\n    p = _nz(p, a);\n"); break;
+        case EOR: _buf_printf(out, "    a ^= v;\n    p = _nz(p, a);\n"); break;
+        case ADC: _buf_printf(out, "    a = _adc(&p, a, v);\n"); break;
+        case SBC: _buf_printf(out, "    a = _adc(&p, a, ~v);\n"); break;
+        case CMP: _buf_printf(out, "    p = _cmp(p, a, v);\n"); break;
+        case CPX: _buf_printf(out, "    p = _cmp(p, x, v);\n"); break;
+        case CPY: _buf_printf(out, "    p = _cmp(p, y, v);\n"); break;
+        case BIT: _buf_printf(out, "    p = (p & 0x3D) | (v & 0xC0) | ((a & v) ? 0 : 0x02);\n"); break;
+        case NOP: break;
+        default: break;
+    }
+}
+
+// emits the operation of a read-modify-write instruction on the operand in v
+static void _emit_modify_op(StrBuf *out, Mnemonic mnemonic) {
+    switch (mnemonic) {
+        case INC: _buf_printf(out, "    v++;\n    p = _nz(p, v);\n"); break;
+        case DEC: _buf_printf(out, "    v--;\n    p = _nz(p, v);\n"); break;
+        case ASL: _buf_printf(out, "    v = _asl(&p, v);\n"); break;
+        case LSR: _buf_printf(out, "    v = _lsr(&p, v);\n"); break;
+        case ROL: _buf_printf(out, "    v = _rol(&p, v);\n"); break;
+        case ROR: _buf_printf(out, "    v = _ror(&p, v);\n"); break;
+        default: break;
+    }
+}
+
+static void _emit_implied(StrBuf *out, const OpcodeInfo *info) {
+    switch (info->mnemonic) {
+        case TAX: _buf_printf(out, "    x = a;\n    p = _nz(p, x);\n"); break;
+        case TAY: _buf_printf(out, "    y = a;\n    p = _nz(p, y);\n"); break;
+        case TXA: _buf_printf(out, "    a = x;\n    p = _nz(p, a);\n"); break;
+        case TYA: _buf_printf(out, "    a = y;\n    p = _nz(p, a);\n"); break;
+        case TSX: _buf_printf(out, "    x = s;\n    p = _nz(p, x);\n"); break;
+        case TXS: _buf_printf(out, "    s = x;\n"); break;
+        case INX: _buf_printf(out, "    x++;\n    p = _nz(p, x);\n"); break;
+        case INY: _buf_printf(out, "    y++;\n    p = _nz(p, y);\n"); break;
+        case DEX: _buf_printf(out, "    x--;\n    p = _nz(p, x);\n"); break;
+        case DEY: _buf_printf(out, "    y--;\n    p = _nz(p, y);\n"); break;
+        case CLC: _buf_printf(out, "    p &= ~0x01;\n"); break;
+        case SEC: _buf_printf(out, "    p |= 0x01;\n"); break;
+        case CLI: _buf_printf(out, "    p &= ~0x04;\n"); break;
+        case SEI: _buf_printf(out, "    p |= 0x04;\n"); break;
+        case CLD: _buf_printf(out, "    p &= ~0x08;\n"); break;
+        case SED: _buf_printf(out, "    p |= 0x08;\n"); break;
+        case CLV: _buf_printf(out, "    p &= ~0x40;\n"); break;
+        case ASL: _buf_printf(out, "    a = _asl(&p, a);\n"); break;
+        case LSR: _buf_printf(out, "    a = _lsr(&p, a);\n"); break;
+        case ROL: _buf_printf(out, "    a = _rol(&p, a);\n"); break;
+        case ROR: _buf_printf(out, "    a = _ror(&p, a);\n"); break;
+        case NOP: break;
+        default: break;
+    }
+}
+
+static const char *_branch_cond(Mnemonic mnemonic) {
+    switch (mnemonic) {
+        case BCC: return "!(p & 0x01)";
+        case BCS: return "p & 0x01";
+        case BNE: return "!(p & 0x02)";
+        case BEQ: return "p & 0x02";
+        case BVC: return "!(p & 0x40)";
+        case BVS: return "p & 0x40";
+        case BPL: return "!(p & 0x80)";
+        case BMI: return "p & 0x80";
+        default: return "0";
+    }
+}
+
+// Emits a single instruction. Returns false if it ends the block, in which case pc has been set.
+static bool _emit_instr(StrBuf *out, const Image *image, uint16_t addr) {
+    uint8_t opcode = _image_byte(image, addr);
+    const OpcodeInfo *info = get_opcode_info(opcode);
+    uint16_t operand = _read_operand(image, addr);
+    uint16_t next = addr + info->len;
+
+    _buf_printf(out, "    // $%04X: %s %s\n", addr, mnemonic_to_str(info->mnemonic), addr_mode_to_str(info->addr_mode));
+
+    switch (info->handler) {
+        case HND_IMP:
+            _emit_implied(out, info);
+            return true;
+        case HND_IMM:
+            _buf_printf(out, "    v = 0x%02X;\n", operand);
+            _emit_read_op(out, info->mnemonic);
+            return true;
+        case HND_JMP:
+            if (info->addr_mode == ABS) {
+                _buf_printf(out, "    pc = 0x%04X;\n", operand);
+            } else {
+                // the high byte is fetched without carrying into the page
+                _buf_printf(out, "    pc = RD(0x%04X);\n", operand);
+                _buf_printf(out, "    pc |= RD(0x%04X) << 8;\n", (operand & 0xFF00) | ((operand + 1) & 0xFF));
+            }
+            return false;
+        case HND_JSR:
+            _buf_printf(out, "    WR(STACK_BOTTOM_ADDR + s--, 0x%02X);\n", (uint16_t) (next - 1) >> 8);
+            _buf_printf(out, "    WR(STACK_BOTTOM_ADDR + s--, 0x%02X);\n", (uint16_t) (next - 1) & 0xFF);
+            _buf_printf(out, "    pc = 0x%04X;\n", operand);
+            return false;
+        case HND_RTI:
+        case HND_RTS:
+            if (info->handler == HND_RTI) {
+                _buf_printf(out, "    p = RD(STACK_BOTTOM_ADDR + ++s);\n");
+            }
+            _buf_printf(out, "    pc = RD(STACK_BOTTOM_ADDR + ++s);\n");
+            _buf_printf(out, "    pc |= RD(STACK_BOTTOM_ADDR + ++s) << 8;\n");
+            if (info->handler == HND_RTS) {
+                _buf_printf(out, "    pc++;\n");
+            }
+            return false;
+        case HND_PUSH:
+            _buf_printf(out, "    WR(STACK_BOTTOM_ADDR + s--, %s);\n", info->mnemonic == PHA ? "a" : "p | 0x30");
+            return true;
+        case HND_PULL:
+            if (info->mnemonic == PLA) {
+                _buf_printf(out, "    a = RD(STACK_BOTTOM_ADDR + ++s);\n    p = _nz(p, a);\n");
+            } else {
+                _buf_printf(out, "    p = RD(STACK_BOTTOM_ADDR + ++s);\n");
+            }
+            return true;
+        case HND_BRANCH: {
+            uint16_t target = next + (int8_t) operand;
+
+            _buf_printf(out, "    if (%s) {\n", _branch_cond(info->mnemonic));
+            _buf_printf(out, "        pc = 0x%04X;\n", target);
+            _buf_printf(out, "        c += %d;\n", (target >> 8) != (next >> 8) ? 2 : 1);
+            _buf_printf(out, "    } else {\n");
+            _buf_printf(out, "        pc = 0x%04X;\n", next);
+            _buf_printf(out, "    }\n");
+            return false;
+        }
+        default:
+            break;
+    }
+
+    _emit_address(out, info, operand);
+
+    bool indexed = info->addr_mode == ABX || info->addr_mode == ABY || info->addr_mode == IZY;
+
+    switch (info->type) {
+        case INS_R:
+            if (!indexed) {
+                _buf_printf(out, "    v = RD(ea);\n");
+            }
+            _emit_read_op(out, info->mnemonic);
+            break;
+        case INS_W: {
+            const char *reg = info->mnemonic == STX ? "x" : info->mnemonic == STY ? "y" : "a";
+            _buf_printf(out, "    WR(ea, %s);\n", reg);
+            break;
+        }
+        case INS_RW:
+            _buf_printf(out, "    v = RD(ea);\n");
+            _buf_printf(out, "    WR(ea, v);\n"); // dummy write
+            _emit_modify_op(out, info->mnemonic);
+            _buf_printf(out, "    WR(ea, v);\n");
+            break;
+        default:
+            break;
+    }
+
+    return true;
+}
+
+// Emits the block starting at addr. Returns the number of instructions in it, which is 0 if the first instruction
+// has to be left to the interpreter.
+static unsigned int _emit_block(FILE *out, const Image *image, uint16_t addr, uint8_t *last_opcode,
+        uint16_t *last_operand) {
+    StrBuf body = {0};
+    unsigned int count = 0;
+    unsigned int cycles = 0;
+    uint16_t pc = addr;
+    bool open = true;
+
+    while (open && count < g_max_block_len && _has_instr(image, pc)
+            && (count == 0 || !(g_addr_flags[pc] & ADDR_LEADER))) {
+        const OpcodeInfo *info = get_opcode_info(_image_byte(image, pc));
+        if (!_is_supported(info)) {
+            break;
+        }
+
+        *last_opcode = _image_byte(image, pc);
+        *last_operand = _read_operand(image, pc);
+
+        open = _emit_instr(&body, image, pc);
+        cycles += info->cycles;
+        count++;
+        pc += info->len;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    // a block cut short falls through into another one
+    if (open) {
+        _add_leader(image, pc);
+    }
+
+    fprintf(out, "static unsigned int _blk_%04X(Cpu6502 *cpu) {\n", addr);
+    fprintf(out, "    CpuRegisters *r = cpu_get_registers(cpu);\n");
+    fprintf(out, "    uint8_t a = r->acc, x = r->x, y = r->y, s = r->sp, p = r->status.serial;\n");
+    fprintf(out, "    unsigned int c = %u;\n", cycles);
+    fprintf(out, "    uint16_t pc = 0x%04X, ea = 0, t = 0;\n", pc);
+    fprintf(out, "    uint8_t v = 0;\n");
+    fprintf(out, "    (void) ea;\n    (void) t;\n    (void) v;\n\n");
+    fwrite(body.data, 1, body.len, out);
+    fprintf(out, "\n");
+    fprintf(out, "    r->acc = a;\n    r->x = x;\n    r->y = y;\n    r->sp = s;\n    r->status.serial = p;\n");
+    fprintf(out, "    r->pc = pc;\n");
+    fprintf(out, "    return c;\n");
+    fprintf(out, "}\n\n");
+
+    free(body.data);
+
+    return count;
+}
+
+static const char g_prelude[] =
+    "#include \"c6502/cpu.h\"\n"
+    "\n"
+    "#include <stdint.h>\n"
+    "\n"
+    "#define STACK_BOTTOM_ADDR 0x100\n"
+    "\n"
+    "// register values are kept in locals for the duration of a block, so memory callbacks must not inspect them\n"
+    "#define RD(addr) cpu_read_memory(cpu, (uint16_t) (addr))\n"
+    "#define WR(addr, val) cpu_write_memory(cpu, (uint16_t) (addr), (uint8_t) (val))\n"
+    "\n"
+    "static inline uint8_t _nz(uint8_t p, uint8_t v) {\n"
+    "    return (p & 0x7D) | (v & 0x80) | (v ? 0 : 0x02);\n"
+    "}\n"
+    "\n"
+    "static inline uint8_t _adc(uint8_t *p, uint8_t a, uint8_t v) {\n"
+    "    unsigned int sum = a + v + (*p & 0x01);\n"
+    "    uint8_t res = (uint8_t) sum;\n"
+    "    *p = (_nz(*p, res) & 0xBE) | (sum >> 8) | (((a ^ res) & (v ^ res) & 0x80) >> 1);\n"
+    "    return res;\n"
+    "}\n"
+    "\n"
+    "static inline uint8_t _cmp(uint8_t p, uint8_t reg, uint8_t v) {\n"
+    "    return (_nz(p, (uint8_t) (reg - v)) & 0xFE) | (reg >= v);\n"
+    "}\n"
+    "\n"
+    "static inline uint8_t _asl(uint8_t *p, uint8_t v) {\n"
+    "    uint8_t res = v << 1;\n"
+    "    *p = (_nz(*p, res) & 0xFE) | (v >> 7);\n"
+    "    return res;\n"
+    "}\n"
+    "\n"
+    "static inline uint8_t _lsr(uint8_t *p, uint8_t v) {\n"
+    "    uint8_t res = v >> 1;\n"
+    "    *p = (_nz(*p, res) & 0xFE) | (v & 0x01);\n"
+    "    return res;\n"
+    "}\n"
+    "\n"
+    "static inline uint8_t _rol(uint8_t *p, uint8_t v) {\n"
+    "    uint8_t res = (v << 1) | (*p & 0x01);\n"
+    "    *p = (_nz(*p, res) & 0xFE) | (v >> 7);\n"
+    "    return res;\n"
+    "}\n"
+    "\n"
+    "static inline uint8_t _ror(uint8_t *p, uint8_t v) {\n"
+    "    uint8_t res = (v >> 1) | ((*p & 0x01) << 7);\n"
+    "    *p = (_nz(*p, res) & 0xFE) | (v & 0x01);\n"
+    "    return res;\n"
+    "}\n"
+    "\n";
+
+static bool _load_image(const char *path, Image *image) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open image file %s.\n", path);
+        return false;
+    }
+
+    image->data = malloc(0x10000);
+    image->size = image->data ? fread(image->data, 1, 0x10000, file) : 0;
+    fclose(file);
+
+    if (image->size == 0) {
+        fprintf(stderr, "Failed to read image file %s.\n", path);
+        return false;
+    }
+
+    if (image->size > 0x10000 - image->base) {
+        fprintf(stderr, "Image does not fit above $%04X.\n", image->base);
+        return false;
+    }
+
+    return true;
+}
+
+// derives a C identifier from the file name of the image
+static void _default_name(const char *path, char *name, size_t max_len) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+
+    size_t len = 0;
+    if (!isalpha((unsigned char) *base) && *base != '_') {
+        name[len++] = '_';
+    }
+
+    for (; *base && *base != '.' && len < max_len - 1; base++) {
+        name[len++] = isalnum((unsigned char) *base) ? *base : '_';
+    }
+
+    name[len] = '\0';
+}
+
+int main(int argc, char **argv) {
+    Image image = {NULL, 0, 0x8000};
+    const char *out_path = NULL;
+    const char *in_path = NULL;
+    char name[64] = {0};
+    uint16_t entries[64];
+    size_t entry_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            image.base = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc && entry_count < sizeof(entries) / sizeof(entries[0])) {
+            entries[entry_count++] = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            g_max_block_len = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            snprintf(name, sizeof(name), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (argv[i][0] != '-' && in_path == NULL) {
+            in_path = argv[i];
+        } else {
+            _usage();
+            return 1;
+        }
+    }
+
+    if (in_path == NULL || image.base > 0xFFFF || g_max_block_len == 0 || g_max_block_len > 0xFFFF) {
+        _usage();
+        return 1;
+    }
+
+    if (!_load_image(in_path, &image)) {
+        return 1;
+    }
+
+    if (name[0] == '\0') {
+        _default_name(in_path, name, sizeof(name));
+    }
+
+    for (uint32_t vector = 0xFFFA; vector < 0x10000; vector += 2) {
+        if (_in_image(&image, vector)) {
+            _add_leader(&image, _image_byte(&image, vector) | (_image_byte(&image, vector + 1) << 8));
+        }
+    }
+
+    for (size_t i = 0; i < entry_count; i++) {
+        _add_leader(&image, entries[i]);
+    }
+
+    _discover(&image);
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Could not open output file %s.\n", out_path);
+        return 1;
+    }
+
+    fprintf(out, "// Generated by c6502_recomp from %s. Do not edit.\n\n", in_path);
+    fputs(g_prelude, out);
+
+    StrBuf table = {0};
+    StrBuf lookup = {0};
+    unsigned int block_count = 0;
+
+    for (uint32_t addr = 0; addr < 0x10000; addr++) {
+        if (!(g_addr_flags[addr] & ADDR_LEADER)) {
+            continue;
+        }
+
+        uint8_t last_opcode = 0;
+        uint16_t last_operand = 0;
+        unsigned int count = _emit_block(out, &image, addr, &last_opcode, &last_operand);
+        if (count == 0) {
+            continue;
+        }
+
+        _buf_printf(&table, "    {0x%04X, %u, 0x%02X, 0x%04X, _blk_%04X},\n", addr, count, last_opcode, last_operand,
+                addr);
+        _buf_printf(&lookup, "        case 0x%04X: return &g_blocks[%u];\n", addr, block_count);
+        block_count++;
+    }
+
+    if (block_count == 0) {
+        // keep the table non-empty so the output is still valid C
+        _buf_printf(&table, "    {0, 0, 0, 0, NULL},\n");
+    }
+
+    fprintf(out, "static const CpuStaticBlock g_blocks[] = {\n");
+    if (table.data) {
+        fwrite(table.data, 1, table.len, out);
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "const CpuStaticBlock *%s_lookup(uint16_t pc) {\n", name);
+    fprintf(out, "    switch (pc) {\n");
+    if (lookup.data) {
+        fwrite(lookup.data, 1, lookup.len, out);
+    }
+    fprintf(out, "        default: return NULL;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    fprintf(stderr, "Compiled %u blocks from %s.\n", block_count, in_path);
+
+    free(table.data);
+    free(lookup.data);
+    free(image.data);
+
+    return 0;
+}
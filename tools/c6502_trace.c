@@ -0,0 +1,235 @@
+/*
+ * This file is a part of c6502.
+ * Copyright (c) 2019, Max Roncace <mproncace@gmail.com>
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Records, prints and summarizes trace files written with the trace_writer_* functions. The record command runs a
+// program image in a flat 64K address space, which is mostly useful for trying out the format.
+
+#include "c6502/cpu.h"
+#include "c6502/trace_file.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RING_CAPACITY 4096
+#define DRAIN_INTERVAL 1024 // instructions run between drains of the ring, which must stay below its capacity
+
+static uint8_t g_memory[0x10000];
+static uint8_t g_bus;
+static CpuTraceRecord g_ring[RING_CAPACITY];
+
+static void _usage(void) {
+    fprintf(stderr, "Usage: c6502_trace record [-b base] [-i count] image.bin output.trace\n");
+    fprintf(stderr, "       c6502_trace print [-c cycle] [-n count] input.trace\n");
+    fprintf(stderr, "       c6502_trace stats input.trace\n");
+    fprintf(stderr, "  -b base   address the image is mapped at, repeating up to $FFFF (default 0x8000)\n");
+    fprintf(stderr, "  -i count  number of instructions to record (default 1000000)\n");
+    fprintf(stderr, "  -c cycle  start with the first instruction at or after this cycle\n");
+    fprintf(stderr, "  -n count  maximum number of lines to print\n");
+}
+
+static uint8_t _mem_read(void *userdata, uint16_t addr) {
+    (void) userdata;
+    return g_memory[addr];
+}
+
+static void _mem_write(void *userdata, uint16_t addr, uint8_t val) {
+    (void) userdata;
+    g_memory[addr] = val;
+}
+
+static uint8_t _bus_read(void *userdata) {
+    (void) userdata;
+    return g_bus;
+}
+
+static void _bus_write(void *userdata, uint8_t val) {
+    (void) userdata;
+    g_bus = val;
+}
+
+static unsigned int _poll_line(void *userdata) {
+    (void) userdata;
+    return 1;
+}
+
+static int _record(const char *image_path, uint32_t base, uint64_t instr_count, const char *out_path) {
+    FILE *image = fopen(image_path, "rb");
+    if (image == NULL) {
+        fprintf(stderr, "Could not open image %s.\n", image_path);
+        return 1;
+    }
+
+    size_t size = fread(g_memory + base, 1, 0x10000 - base, image);
+    fclose(image);
+    if (size == 0) {
+        fprintf(stderr, "Image %s is empty.\n", image_path);
+        return 1;
+    }
+
+    for (uint32_t addr = base + size; addr < 0x10000; addr++) {
+        g_memory[addr] = g_memory[base + (addr - base) % size];
+    }
+
+    TraceWriter *writer = trace_writer_open(out_path);
+    if (writer == NULL) {
+        fprintf(stderr, "Could not open output file %s.\n", out_path);
+        return 1;
+    }
+
+    CpuSystemInterface iface = {_mem_read, _mem_write, _bus_read, _bus_write, _poll_line, _poll_line, _poll_line,
+            NULL};
+    Cpu6502 *cpu = cpu_create(iface);
+    if (cpu == NULL) {
+        fprintf(stderr, "Failed to create CPU.\n");
+        return 1;
+    }
+
+    cpu_map_memory(cpu, 0, sizeof(g_memory), g_memory, CPU_PAGE_READ_WRITE);
+    cpu_set_trace_buffer(cpu, g_ring, RING_CAPACITY);
+
+    bool ok = true;
+    uint64_t position = 0;
+    for (uint64_t done = 0; done < instr_count && ok && !cpu_is_jammed(cpu); done += DRAIN_INTERVAL) {
+        uint64_t count = instr_count - done < DRAIN_INTERVAL ? instr_count - done : DRAIN_INTERVAL;
+        cpu_run_instructions(cpu, count);
+        ok = trace_writer_drain(writer, cpu, &position);
+    }
+
+    cpu_destroy(cpu);
+
+    if (!trace_writer_close(writer) || !ok) {
+        fprintf(stderr, "Failed to write %s.\n", out_path);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int _print(const char *path, uint64_t cycle, uint64_t max_lines) {
+    TraceReader *reader = trace_reader_open(path);
+    if (reader == NULL) {
+        fprintf(stderr, "Could not open trace file %s.\n", path);
+        return 1;
+    }
+
+    if (trace_reader_seek_cycle(reader, cycle)) {
+        CpuTraceRecord record;
+        char line[CPU_TRACE_LINE_MAX];
+        for (uint64_t i = 0; i < max_lines && trace_reader_next(reader, &record); i++) {
+            puts(cpu_format_trace_record(&record, line));
+        }
+    }
+
+    trace_reader_close(reader);
+
+    return 0;
+}
+
+static int _stats(const char *path) {
+    TraceReader *reader = trace_reader_open(path);
+    if (reader == NULL) {
+        fprintf(stderr, "Could not open trace file %s.\n", path);
+        return 1;
+    }
+
+    FILE *file = fopen(path, "rb");
+    fseek(file, 0, SEEK_END);
+    uint64_t file_size = ftell(file);
+    fclose(file);
+
+    // the size the trace would have taken up as text
+    uint64_t text_size = 0;
+    uint64_t read = 0;
+    CpuTraceRecord record;
+    char line[CPU_TRACE_LINE_MAX];
+    while (trace_reader_next(reader, &record)) {
+        text_size += strlen(cpu_format_trace_record(&record, line)) + 1;
+        read++;
+    }
+
+    uint64_t record_count = trace_reader_get_record_count(reader);
+    trace_reader_close(reader);
+
+    printf("records:          %" PRIu64 "\n", record_count);
+    printf("file size:        %" PRIu64 " bytes\n", file_size);
+    if (record_count != 0) {
+        printf("bytes per record: %.2f\n", (double) file_size / record_count);
+        printf("as text:          %" PRIu64 " bytes (%.1fx larger)\n", text_size, (double) text_size / file_size);
+    }
+
+    if (read != record_count) {
+        fprintf(stderr, "Only %" PRIu64 " records could be read.\n", read);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        _usage();
+        return 1;
+    }
+
+    const char *command = argv[1];
+    uint32_t base = 0x8000;
+    uint64_t instr_count = 1000000;
+    uint64_t cycle = 0;
+    uint64_t max_lines = UINT64_MAX;
+    const char *paths[2] = {NULL, NULL};
+    size_t path_count = 0;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            base = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            instr_count = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cycle = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            max_lines = strtoull(argv[++i], NULL, 0);
+        } else if (argv[i][0] != '-' && path_count < 2) {
+            paths[path_count++] = argv[i];
+        } else {
+            _usage();
+            return 1;
+        }
+    }
+
+    if (strcmp(command, "record") == 0 && path_count == 2 && base <= 0xFFFF) {
+        return _record(paths[0], base, instr_count, paths[1]);
+    } else if (strcmp(command, "print") == 0 && path_count == 1) {
+        return _print(paths[0], cycle, max_lines);
+    } else if (strcmp(command, "stats") == 0 && path_count == 1) {
+        return _stats(paths[0]);
+    }
+
+    _usage();
+    return 1;
+}